@@ -0,0 +1,35 @@
+#ifndef TLIB_CHANNEL_H
+#define TLIB_CHANNEL_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_CHANNEL_MAX_SLOTS          16
+#define TLIB_CHANNEL_MAX_EXPORT_NAME    64
+#define TLIB_CHANNEL_MAX_PAYLOAD_SIZE   1024
+
+/*
+ *
+ * Controller side of the command channel
+ *
+ */
+
+TracerHandle tracerCreateChannel(void* address, size_t spaceInBytes, int pid);
+
+void tracerDestroyChannel(TracerHandle channel);
+
+TracerBool tracerChannelIsAgentReady(TracerHandle channel);
+
+TracerBool tracerChannelCall(TracerHandle channel, const char* exportName,
+    const TracerStruct* parameter, TracerStruct* outParameter, int* result);
+
+/*
+ *
+ * Agent side of the command channel (runs inside the traced process)
+ *
+ */
+
+TracerHandle tracerCreateChannelAgent(void* address, size_t spaceInBytes);
+
+void tracerDestroyChannelAgent(TracerHandle agent);
+
+#endif
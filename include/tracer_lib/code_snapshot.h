@@ -0,0 +1,18 @@
+#ifndef TLIB_CODE_SNAPSHOT_H
+#define TLIB_CODE_SNAPSHOT_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_CODE_SNAPSHOT_PAGE_SIZE        0x1000
+#define TLIB_CODE_SNAPSHOT_NUM_PAGES        256
+#define TLIB_CODE_SNAPSHOT_CHECK_INTERVAL   500
+
+TracerHandle tracerCreateCodeSnapshot(TracerContext* memoryContext);
+
+void tracerDestroyCodeSnapshot(TracerHandle snapshot);
+
+void tracerCodeSnapshotInvalidate(TracerHandle snapshot);
+
+size_t tracerCodeSnapshotRead(TracerHandle snapshot, uintptr_t address, void* buffer, size_t size);
+
+#endif
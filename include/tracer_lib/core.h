@@ -36,9 +36,6 @@ typedef struct TracerBaseContext {
     int                              mSizeOfStruct;
     int                              mTypeFlags;
 
-    struct TracerBaseContext*        mNextLink;
-    struct TracerBaseContext*        mPrevLink;
-
     void(*mCleanup)(TracerContext* ctx);
 } TracerBaseContext;
 
@@ -67,8 +64,6 @@ int tracerCoreGetContextTypeFlags(TracerContext* ctx);
 
 typedef TracerBool(*TracerContextCallback)(TracerContext*, void*);
 
-TracerBool tracerCoreEnumContexts(const TracerContextCallback cb, void* parameter, int type, TracerBool returnAfterFail);
-
 /*
  *
  * Core utility functions (getter, setter...)
@@ -79,10 +74,6 @@ void tracerCoreSetLastError(TracerError error);
 
 TracerError tracerCoreGetLastError();
 
-void tracerCoreSetProcessContext(TracerContext* ctx);
-
-TracerContext* tracerCoreGetProcessContext();
-
 TracerHandle tracerCoreGetModuleHandle();
 
 int tracerCoreGetActiveHwBreakpointIndex();
@@ -95,15 +86,79 @@ void tracerCoreSetSuspendedHwBreakpointIndex(int index);
 
 int tracerCoreGetCurrentTraceId();
 
-void tracerCoreOnBeginNewTrace(int breakpointIndex);
+TracerBool tracerCoreOnBeginNewTrace(int breakpointIndex, uintptr_t stackPointer);
 
 void tracerCoreOnTraceEnded();
 
+/*
+ *
+ * Shadow call stack of the current thread
+ *
+ */
+
+#define TLIB_CORE_SHADOW_STACK_SIZE     512
+
+typedef struct TracerShadowFrame {
+    uintptr_t                        mReturnAddress;        // Address that the call will return to
+    uintptr_t                        mStackPointer;         // Location of the return address on the stack
+} TracerShadowFrame;
+
+typedef struct TracerShadowStack {
+    uintptr_t                        mEntryStackPointer;    // Stack pointer when the traced function was entered
+    int                              mNumFrames;
+    int                              mNumOverflowFrames;    // Calls that were nested too deep to be recorded
+    TracerShadowFrame                mFrames[TLIB_CORE_SHADOW_STACK_SIZE];
+} TracerShadowStack;
+
 int tracerCoreGetBranchCallDepth();
 
-int tracerCoreOnBranchEntered();
+uintptr_t tracerCoreGetTraceEntryStackPointer();
 
-int tracerCoreOnBranchReturned();
+void tracerCoreSyncShadowStack(uintptr_t stackPointer);
+
+int tracerCoreOnBranchEntered(uintptr_t returnAddress, uintptr_t stackPointer);
+
+int tracerCoreOnBranchReturned(uintptr_t returnAddress, uintptr_t stackPointer, TracerBool* matched);
+
+/*
+ *
+ * Per thread state
+ *
+ */
+
+#define TLIB_CORE_CACHE_LINE_SIZE       64
+
+// Threads beyond these limits fall back to the heap on API calls and are not traced
+#define TLIB_CORE_MAX_THREAD_STATES     1024
+#define TLIB_CORE_MAX_SHADOW_STACKS     256
+
+// Everything the exception handler needs about the current thread, in a single cache line
+typedef __declspec(align(64)) struct TracerThreadState {
+    TracerError                      mLastError;
+    int                              mProcessId;            // Picked with tracerSetProcessContext
+    uint32_t                         mProcessGeneration;    // Of the registration of mProcessId, 0 if none
+    int                              mActiveHwBreakpointIndex;
+    int                              mSuspendedHwBreakpointIndex;
+    int                              mCurrentTraceId;
+    TracerShadowStack*               mShadowStack;          // Allocated when the thread begins its first trace
+    int                              mHotPathDepth;         // Only maintained by debug builds
+} TracerThreadState;
+
+// Takes the state from the thread state pool on first use, never from the heap so the exception
+// handler may call it. Returns NULL if the pool is exhausted.
+TracerThreadState* tracerCoreGetThreadState();
+
+// Debug builds assert on any heap call between these two, they compile to nothing in release builds
+#ifdef _DEBUG
+void tracerCoreEnterHotPath();
+void tracerCoreLeaveHotPath();
+
+#define TLIB_CORE_ENTER_HOT_PATH()      tracerCoreEnterHotPath()
+#define TLIB_CORE_LEAVE_HOT_PATH()      tracerCoreLeaveHotPath()
+#else
+#define TLIB_CORE_ENTER_HOT_PATH()
+#define TLIB_CORE_LEAVE_HOT_PATH()
+#endif
 
 TracerHandle tracerCoreFindWindow(int processId);
 
@@ -117,13 +172,41 @@ TracerBool tracerCoreSetPrivilege(TracerHandle process, const tchar* privilege,
 
 TracerContext* tracerCoreGetContextForPID(int pid);
 
-void tracerCoreSetContextForPID(int pid, TracerContext* ctx);
+// Passing a NULL context removes the process from the table
+TracerBool tracerCoreSetContextForPID(int pid, TracerContext* ctx);
 
+// Only visits the attached processes, the callback may detach the process it is called for
 TracerBool tracerCoreEnumProcessContexts(const TracerContextCallback cb, void* parameter, TracerBool returnAfterFail);
 
+// Only compares pointers, ctx may already be freed. Visits every process, use it for handles
+// passed in by the caller only.
+TracerBool tracerCoreIsContextRegistered(TracerContext* ctx);
+
+// The generation of the registration of ctx for pid, 0 if ctx isn't registered for it
+uint32_t tracerCoreGetContextGeneration(int pid, TracerContext* ctx);
+
+// The calling thread keeps the process id and the generation of its registration, a context that
+// got detached or replaced in the meantime is never returned. Both need the lock of the table.
+void tracerCoreSetProcessContext(int pid, uint32_t generation);
+
+TracerContext* tracerCoreGetProcessContext();
+
+size_t tracerCoreGetNumProcessContexts();
+
+// Guards the table only, hold it just long enough to look up a context and take a reference
 void tracerCoreAcquireProcessContextLock();
 
 void tracerCoreReleaseProcessContextLock();
 
+// Serializes attaching and detaching, which may take a while for remote processes
+void tracerCoreAcquireProcessAttachLock();
+
+void tracerCoreReleaseProcessAttachLock();
+
+// DbgHelp is single threaded, every call into it has to hold this lock
+void tracerCoreAcquireDbgHelpLock();
+
+void tracerCoreReleaseDbgHelpLock();
+
 
 #endif
@@ -0,0 +1,25 @@
+#ifndef TLIB_FUNCTION_INDEX_H
+#define TLIB_FUNCTION_INDEX_H
+
+#include <tracer_lib/core.h>
+
+// Call targets that neither follow padding nor start with a prologue need this many callers
+#define TLIB_FUNCTION_INDEX_MIN_CALLERS     2
+
+// The index holds the sorted start addresses of all functions of a module that we could find in
+// its exports, its symbols (if a resolver is given), the targets of direct calls and well known
+// prologues behind padding. It is built once and only describes the module it was created for.
+
+TracerHandle tracerCreateFunctionIndex(HANDLE process, uintptr_t moduleBase, TracerHandle symbolResolver);
+
+void tracerDestroyFunctionIndex(TracerHandle index);
+
+uintptr_t tracerFunctionIndexGetModuleBase(TracerHandle index);
+
+// Compares the header of the loaded image with the one the index was built from
+TracerBool tracerFunctionIndexIsCurrent(TracerHandle index, HANDLE process);
+
+// Returns the start of the function that contains the address, 0 if the address isn't code of the module
+uintptr_t tracerFunctionIndexFind(TracerHandle index, uintptr_t address);
+
+#endif
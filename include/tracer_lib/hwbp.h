@@ -3,6 +3,9 @@
 
 #include <tracer_lib/core.h>
 
+// Enough for all four debug registers on 1024 threads
+#define TLIB_HWBP_MAX_BREAKPOINTS   4096
+
 typedef enum TracerHwBpCond {
     eTracerBpCondExecute        = 0,
     eTracerBpCondWrite          = 1,
@@ -10,6 +13,27 @@ typedef enum TracerHwBpCond {
     eTracerBpCondReadWrite      = 3,
 } TracerHwBpCond;
 
+typedef struct TracerHwBreakpointChange {
+    TracerBool                  mArm;               // Disarms mBreakpoint if not set
+    void*                       mAddress;
+    int                         mLength;
+    TracerHwBpCond              mCondition;
+    TracerHandle                mBreakpoint;        // Receives the new breakpoint when armed
+} TracerHwBreakpointChange;
+
+// Sets up the breakpoint pool, called once when the library is loaded
+TracerBool tracerHwBreakpointInit();
+
+void tracerHwBreakpointShutdown();
+
+// Called from DllMain, new threads get every global breakpoint that is armed at that time
+void tracerHwBreakpointOnThreadAttach();
+
+void tracerHwBreakpointOnThreadDetach();
+
+// The number of new threads that couldn't inherit every global breakpoint
+uint64_t tracerHwBreakpointGetNumUnarmedThreads();
+
 int tracerHwBreakpointGetBits(uintptr_t dw, int lowBit, int bits);
 
 void tracerHwBreakpointSetBits(uintptr_t* dw, int lowBit, int bits, int newValue);
@@ -20,6 +44,12 @@ TracerHandle tracerSetHwBreakpointOnThread(void* address, int length, int thread
 
 TracerHandle tracerSetHwBreakpointGlobal(void* address, int length, TracerHwBpCond cond);
 
+// Arms and disarms global breakpoints on all threads of the process at once. Every thread is
+// suspended and resumed a single time for the whole batch, no matter how many changes it has.
+// Nothing is applied if any of the changes is invalid, and nothing is armed if any thread is out
+// of registers or the pool is exhausted.
+TracerBool tracerApplyHwBreakpointsGlobal(TracerHwBreakpointChange* changes, size_t numChanges);
+
 TracerBool tracerRemoveHwBreakpoint(TracerHandle breakpoint);
 
 TracerBool tracerRemoveHwBreakpointOnContext(TracerHandle breakpoint, PCONTEXT ctx);
@@ -0,0 +1,42 @@
+#ifndef TLIB_LDE_H
+#define TLIB_LDE_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_LDE_MAX_INSTRUCTION_SIZE   15
+
+#ifdef _WIN64
+#define TLIB_LDE_MODE_NATIVE            eTracerLdeMode64
+#else
+#define TLIB_LDE_MODE_NATIVE            eTracerLdeMode32
+#endif
+
+typedef enum TracerLdeMode {
+    eTracerLdeMode32,
+    eTracerLdeMode64,
+} TracerLdeMode;
+
+typedef enum TracerLdeFlow {
+    eTracerLdeFlowNone,
+    eTracerLdeFlowCall,                                     // Near and far calls, direct or indirect
+    eTracerLdeFlowReturn,                                   // ret, retf and iret
+    eTracerLdeFlowBranch,                                   // Jumps, conditional jumps and loops
+} TracerLdeFlow;
+
+typedef struct TracerLdeInstruction {
+    uint8_t                         mLength;
+    uint8_t                         mMap;                   // 1 = one byte, 2 = 0F, 3 = 0F 38, 4 = 0F 3A, 8 to 10 = XOP
+    uint8_t                         mOpcode;
+    uint8_t                         mModRm;                 // Only valid if mHasModRm is set
+    TracerBool                      mHasModRm;
+    TracerLdeFlow                   mFlow;
+} TracerLdeInstruction;
+
+// Determines the length of the instruction with a handful of table lookups, without decoding any
+// operands. Returns 0 if the bytes don't form a valid instruction within size bytes.
+
+size_t tracerLdeDecode(const uint8_t* code, size_t size, TracerLdeMode mode, TracerLdeInstruction* instruction);
+
+size_t tracerLdeGetLength(const uint8_t* code, size_t size, TracerLdeMode mode);
+
+#endif
@@ -2,6 +2,9 @@
 #define TLIB_MEMORY_H
 
 #include <tracer_lib/core.h>
+#include <tracer_lib/scan.h>
+
+#define TLIB_MEMORY_MAX_FUNCTION_INDICES    16
 
 typedef struct TracerMemoryContext {
     TracerBaseContext           mBaseContext;
@@ -9,6 +12,10 @@ typedef struct TracerMemoryContext {
     TracerHandle                mProcessHandle;
     TracerHandle                mModuleHandle;
 
+    TracerHandle                mSymbolResolver;            // Optional, owned by the process context
+    TracerHandle                mFunctionIndices[TLIB_MEMORY_MAX_FUNCTION_INDICES];
+    size_t                      mNextFunctionIndex;         // Slot that is replaced next
+
     size_t(*mWriteMemory)(TracerContext* ctx, void* address, const void* buffer, size_t size);
 
     size_t(*mReadMemory)(TracerContext* ctx, const void* address, void* buffer, size_t size);
@@ -26,6 +33,8 @@ typedef struct TracerMemoryContext {
     const uint8_t*(*mSearchSequence)(TracerContext* ctx, const uint8_t* start, const uint8_t* end, const uint8_t* seq, const char* mask);
 
     const uint8_t*(*mFindFunctionStart)(TracerContext* ctx, const uint8_t* offset, size_t size);
+
+    size_t(*mSearchPatterns)(TracerContext* ctx, const uint8_t* start, size_t size, TracerHandle scanSet, TracerScanCallback callback, void* userData);
 } TracerMemoryContext;
 
 TracerContext* tracerCreateMemoryContext(int type, int size, int pid);
@@ -50,4 +59,11 @@ const uint8_t* tracerMemorySearchSequence(TracerContext* ctx, const uint8_t* sta
 
 const uint8_t* tracerMemoryFindFunctionStart(TracerContext* ctx, const uint8_t* offset, size_t size);
 
+size_t tracerMemorySearchPatterns(TracerContext* ctx, const uint8_t* start, size_t size, TracerHandle scanSet, TracerScanCallback callback, void* userData);
+
+void tracerMemorySetSymbolResolver(TracerContext* ctx, TracerHandle symbolResolver);
+
+// Looks the address up in the function index of its module, the index is built on first use
+uintptr_t tracerMemoryFindContainingFunction(TracerContext* ctx, uintptr_t address);
+
 #endif
@@ -11,4 +11,8 @@ TracerContext* tracerCreateLocalMemoryContext(int type, int size);
 
 void tracerCleanupLocalMemoryContext(TracerContext* ctx);
 
+// Runs the prologue search on a local copy of the code, offset points into that copy
+
+const uint8_t* tracerMemoryLocalFindFunctionStartInBuffer(const uint8_t* offset, size_t size);
+
 #endif
@@ -5,12 +5,15 @@
 
 typedef struct TracerRemoteMemoryContext {
     TracerMemoryContext             mBaseContext;
+    TracerHandle                    mChannel;
 } TracerRemoteMemoryContext;
 
 TracerContext* tracerCreateRemoteMemoryContext(int type, int size, int pid, TracerHandle sharedMemoryHandle);
 
 void tracerCleanupRemoteMemoryContext(TracerContext* ctx);
 
+void tracerMemoryRemoteSetChannel(TracerContext* ctx, TracerHandle channel);
+
 int tracerMemoryRemoteCallLocalExport(TracerContext* ctx, const char* exportName, const TracerStruct* parameter);
 
 int tracerMemoryRemoteCallLocalExportEx(TracerContext* ctx, const char* exportName, TracerStruct* parameter);
@@ -0,0 +1,22 @@
+#ifndef TLIB_MEMORY_SCAN_H
+#define TLIB_MEMORY_SCAN_H
+
+#include <tracer_lib/memory.h>
+
+#define TLIB_MEMORY_SCAN_CHUNK_SIZE     (1024 * 1024)
+#define TLIB_MEMORY_SCAN_MAX_WORKERS    64
+
+typedef struct TracerScanMatch {
+    uintptr_t                       mAddress;
+    size_t                          mPatternId;
+} TracerScanMatch;
+
+// Scans the readable memory of the process behind the memory context, or only the given module if it
+// isn't NULL. The matches are sorted by address and have to be released with tracerMemoryFreeScanMatches.
+
+TracerBool tracerMemoryScan(TracerContext* ctx, TracerHandle module, TracerHandle scanSet,
+    TracerScanMatch** outMatches, size_t* outNumMatches);
+
+void tracerMemoryFreeScanMatches(TracerScanMatch* matches);
+
+#endif
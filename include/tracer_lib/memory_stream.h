@@ -0,0 +1,18 @@
+#ifndef TLIB_MEMORY_STREAM_H
+#define TLIB_MEMORY_STREAM_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_MEMORY_STREAM_WINDOW_SIZE  (1024 * 1024)
+
+// The window holds numPositions + overlap bytes, returning eTracerFalse stops the stream
+typedef TracerBool(*TracerMemoryStreamCallback)(const uint8_t* window, uintptr_t windowAddress, size_t numPositions, void* userData);
+
+// Streams the positions [address, address + numPositions) of another process through two windows,
+// the next window is read while the callback looks at the current one. Backward streams hand out
+// the windows from the highest address to the lowest.
+
+TracerBool tracerMemoryStream(HANDLE process, uintptr_t address, size_t numPositions, size_t overlap,
+    TracerBool backward, TracerMemoryStreamCallback callback, void* userData);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef TLIB_PE_IMAGE_H
+#define TLIB_PE_IMAGE_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_PE_IMAGE_MAX_PDB_PATH      260
+#define TLIB_PE_IMAGE_MAX_EXPORT_DATA   (16 * 1024 * 1024)
+#define TLIB_PE_IMAGE_MAX_SECTIONS      96
+
+typedef struct TracerPeSection {
+    uint32_t                        mRva;
+    uint32_t                        mSize;
+    TracerBool                      mIsExecutable;
+} TracerPeSection;
+
+typedef struct TracerPeImageInfo {
+    uintptr_t                       mBaseAddress;
+    size_t                          mSizeOfImage;
+    uint32_t                        mTimeDateStamp;
+    uint32_t                        mEntryPointRva;
+
+    TracerPeSection                 mSections[TLIB_PE_IMAGE_MAX_SECTIONS];
+    size_t                          mNumSections;
+
+    uint32_t                        mExportDirectoryRva;
+    uint32_t                        mExportDirectorySize;
+
+    TracerBool                      mHasDebugInfo;          // The image has a CodeView (RSDS) record
+    uint8_t                         mPdbSignature[16];
+    uint32_t                        mPdbAge;
+    char                            mPdbPath[TLIB_PE_IMAGE_MAX_PDB_PATH];
+} TracerPeImageInfo;
+
+typedef void(*TracerPeExportCallback)(uintptr_t address, const char* name, void* userData);
+
+// The image is read from the memory of the given process, the module has to be loaded there
+
+TracerBool tracerPeReadImageInfo(HANDLE process, uintptr_t baseAddress, TracerPeImageInfo* info);
+
+// Only reads the headers, enough to tell whether another image was loaded at the same base
+TracerBool tracerPeReadImageStamp(HANDLE process, uintptr_t baseAddress, uint32_t* outTimeDateStamp, uint32_t* outCheckSum);
+
+TracerBool tracerPeEnumExports(HANDLE process, const TracerPeImageInfo* info, TracerPeExportCallback callback, void* userData);
+
+#endif
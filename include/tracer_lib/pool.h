@@ -0,0 +1,20 @@
+#ifndef TLIB_POOL_H
+#define TLIB_POOL_H
+
+#include <tracer_lib/core.h>
+
+// A fixed number of equally sized objects, allocated up front. Allocating and freeing only
+// push or pop an interlocked singly linked list, so both are safe inside the exception handler.
+
+TracerHandle tracerCreatePool(size_t elemSize, size_t alignment, size_t capacity);
+
+void tracerDestroyPool(TracerHandle pool);
+
+// Returns NULL once all objects are in use, the memory is not initialized
+void* tracerPoolAlloc(TracerHandle pool);
+
+void tracerPoolFree(TracerHandle pool, void* object);
+
+TracerBool tracerPoolOwns(TracerHandle pool, const void* object);
+
+#endif
@@ -6,6 +6,13 @@
 #define TLIB_IN_MEGABYTES       1024*1024
 #define TLIB_SHARED_MEMORY_SIZE 16*TLIB_IN_MEGABYTES
 
+// The command channel lives at the start of the shared memory, the trace queue right after it
+#define TLIB_SHARED_CHANNEL_SIZE    64*1024
+#define TLIB_SHARED_QUEUE_SIZE      (TLIB_SHARED_MEMORY_SIZE - TLIB_SHARED_CHANNEL_SIZE)
+
+// Readers that wait for several processes poll the ones without a data event this often (ms)
+#define TLIB_PROCESS_POLL_INTERVAL  10
+
 typedef struct TracerProcessContext {
     TracerBaseContext           mBaseContext;
     int                         mProcessId;
@@ -13,6 +20,10 @@ typedef struct TracerProcessContext {
     TracerHandle                mSharedMemoryHandle;
     TracerHandle                mSharedRWQueue;
     void*                       mMappedView;
+    TracerHandle                mDataEvent;             // Signaled by the traced process when a waiting reader has to wake up
+    TracerHandle                mRemoteDataEvent;       // The handle of mDataEvent in a remote traced process, closed on cleanup
+    volatile LONG               mRefCount;              // The registry owns one reference while attached
+    CRITICAL_SECTION            mLock;                  // Serializes the API calls made on this process
 
     TracerBool(*mStartTrace)(TracerContext* ctx, const TracerStartTrace* startTrace);
 
@@ -21,12 +32,29 @@ typedef struct TracerProcessContext {
     const char*(*mDecodeAndFormat)(TracerContext* ctx, TracerDecodeAndFormat* decodeAndFmt);
 
     TracerBool(*mGetSymbolAddressFromSymbolName)(TracerContext* ctx, TracerGetSymbolAddrFromName* addrFromName);
+
+    TracerBool(*mGetStatistics)(TracerContext* ctx, TracerStatistics* statistics);
+
+    TracerBool(*mSymbolizeAddresses)(TracerContext* ctx, TracerSymbolizeAddresses* symbolize);
+
+    TracerBool(*mStartWatch)(TracerContext* ctx, const TracerStartWatch* startWatch);
+
+    TracerBool(*mStopWatch)(TracerContext* ctx, const TracerStopWatch* stopWatch);
 } TracerProcessContext;
 
 TracerContext* tracerCreateProcessContext(int type, int size, int pid);
 
 void tracerCleanupProcessContext(TracerContext* ctx);
 
+// A detached process is destroyed once its last reference is released
+void tracerProcessAddRef(TracerContext* ctx);
+
+void tracerProcessRelease(TracerContext* ctx);
+
+void tracerProcessLock(TracerContext* ctx);
+
+void tracerProcessUnlock(TracerContext* ctx);
+
 int tracerProcessGetPid(TracerContext* ctx);
 
 TracerContext* tracerProcessGetMemoryContext(TracerContext* ctx);
@@ -35,10 +63,31 @@ TracerBool tracerProcessStartTrace(TracerContext* ctx, const TracerStartTrace* s
 
 TracerBool tracerProcessStopTrace(TracerContext* ctx, const TracerStopTrace* stopTrace);
 
+TracerBool tracerProcessStartWatch(TracerContext* ctx, const TracerStartWatch* startWatch);
+
+TracerBool tracerProcessStopWatch(TracerContext* ctx, const TracerStopWatch* stopWatch);
+
 size_t tracerProcessFetchTraces(TracerContext* ctx, TracerTracedInstruction* outTraces, size_t maxElements);
 
+size_t tracerProcessFetchTracesTagged(TracerContext* ctx, TracerProcessTracedInstruction* outTraces, size_t maxElements);
+
+// Creates the event that the traced process signals when new traces arrive while somebody waits for them
+TracerBool tracerProcessCreateDataEvent(TracerContext* ctx);
+
+// NULL if the process has no data event, the reader has to poll in that case
+TracerHandle tracerProcessGetDataEvent(TracerContext* ctx);
+
+// Returns eTracerFalse if traces are pending, there is no need to wait then
+TracerBool tracerProcessPrepareWaitForTraces(TracerContext* ctx);
+
+void tracerProcessCancelWaitForTraces(TracerContext* ctx);
+
 const char* tracerProcessDecodeAndFormatInstruction(TracerContext* ctx, TracerDecodeAndFormat* decodeAndFmt);
 
 TracerBool tracerProcessGetSymbolAddressFromSymbolName(TracerContext* ctx, TracerGetSymbolAddrFromName* addrFromName);
 
+TracerBool tracerProcessGetStatistics(TracerContext* ctx, TracerStatistics* statistics);
+
+TracerBool tracerProcessSymbolizeAddresses(TracerContext* ctx, TracerSymbolizeAddresses* symbolize);
+
 #endif
@@ -10,9 +10,11 @@
 typedef struct TracerLocalProcessContext {
     TracerProcessContext            mBaseContext;
     TracerContext*                  mTraceContext;
+    TracerHandle                    mChannelAgent;
 
     ZydisDecoder                    mDecoder;
     ZydisFormatter                  mFormatter;
+    TracerHandle                    mSymbolResolver;
 } TracerLocalProcessContext;
 
 TracerContext* tracerCreateLocalProcessContext(int type, int size, TracerHandle sharedMemoryHandle);
@@ -3,8 +3,18 @@
 
 #include <tracer_lib/process.h>
 
+#define ZYDIS_STATIC_DEFINE
+
+#include <Zydis/Zydis.h>
+
 typedef struct TracerRemoteProcessContext {
     TracerProcessContext            mBaseContext;
+    TracerHandle                    mChannel;
+    TracerHandle                    mCodeSnapshot;
+
+    ZydisDecoder                    mDecoder;
+    ZydisFormatter                  mFormatter;
+    TracerHandle                    mSymbolResolver;
 } TracerRemoteProcessContext;
 
 TracerContext* tracerCreateRemoteProcessContext(int type, int size, int pid);
@@ -13,4 +13,14 @@ TracerBool tracerRWQueuePopItem(TracerHandle queue, void* outItem);
 
 size_t tracerRWQueuePopAll(TracerHandle queue, void* outItems, size_t maxElements);
 
+TracerBool tracerRWQueueIsEmpty(TracerHandle queue);
+
+// The writer signals the event (a handle of its own process) when a sleeping reader has to wake up
+void tracerRWQueueSetDataEvent(TracerHandle queue, TracerHandle event);
+
+// Returns eTracerFalse if the queue isn't empty anymore, the reader must not wait in that case
+TracerBool tracerRWQueuePrepareWait(TracerHandle queue);
+
+void tracerRWQueueCancelWait(TracerHandle queue);
+
 #endif
@@ -0,0 +1,48 @@
+#ifndef TLIB_SCAN_H
+#define TLIB_SCAN_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_SCAN_MAX_PATTERN_SIZE      256
+
+typedef struct TracerScanPattern {
+    uint8_t                         mBytes[TLIB_SCAN_MAX_PATTERN_SIZE];     // Wildcard bytes are zeroed
+    uint8_t                         mMask[TLIB_SCAN_MAX_PATTERN_SIZE];      // 0xFF if the byte has to match, 0 otherwise
+    size_t                          mSize;
+    size_t                          mAnchors[2];            // Offsets of the two rarest bytes that have to match
+    size_t                          mNumAnchors;            // 0 if the pattern only consists of wildcards
+} TracerScanPattern;
+
+// Returning eTracerFalse from the callback stops the search
+typedef TracerBool(*TracerScanCallback)(const uint8_t* address, size_t patternId, void* userData);
+
+// Patterns longer than TLIB_SCAN_MAX_PATTERN_SIZE can't be compiled, callers fall back to a plain search then
+
+TracerBool tracerScanCompile(TracerScanPattern* pattern, const uint8_t* bytes, const uint8_t* mask, size_t size);
+
+TracerBool tracerScanCompileWildcard(TracerScanPattern* pattern, const uint8_t* bytes, size_t size, uint8_t wildcard);
+
+TracerBool tracerScanCompileMask(TracerScanPattern* pattern, const uint8_t* bytes, const char* mask);
+
+// Both searches test the positions [data, data + numPositions) and may read up to
+// data + numPositions + pattern->mSize - 1. The first one returns the lowest match, the last one the highest.
+
+const uint8_t* tracerScanFirst(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions);
+
+const uint8_t* tracerScanLast(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions);
+
+// A scan set finds any number of patterns in a single pass, the id of a pattern is its index in the
+// array. Every pattern needs at least two bytes and one byte that has to match.
+
+TracerHandle tracerCreateScanSet(const TracerScanPattern* patterns, size_t numPatterns);
+
+void tracerDestroyScanSet(TracerHandle scanSet);
+
+size_t tracerScanSetGetMaxPatternSize(TracerHandle scanSet);
+
+// Reports every match that lies entirely within [data, data + size). Matches are reported in the
+// order of their anchors, which isn't necessarily the order of their addresses.
+
+size_t tracerScanSetSearch(TracerHandle scanSet, const uint8_t* data, size_t size, TracerScanCallback callback, void* userData);
+
+#endif
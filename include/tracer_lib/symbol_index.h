@@ -0,0 +1,80 @@
+#ifndef TLIB_SYMBOL_INDEX_H
+#define TLIB_SYMBOL_INDEX_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_SYMBOL_INDEX_MAX_MODULE_NAME   64
+
+typedef struct TracerSymbolEntry {
+    uintptr_t                       mAddress;
+    uint32_t                        mSize;
+    uint32_t                        mNameOffset;            // Offset of the name within the string pool
+} TracerSymbolEntry;
+
+typedef struct TracerSymbolModule {
+    uintptr_t                       mBaseAddress;
+    size_t                          mSize;
+    uint32_t                        mTimeDateStamp;         // Together with the base and the size they tell
+    uint32_t                        mCheckSum;              // apart images that were loaded at the same base
+    char                            mName[TLIB_SYMBOL_INDEX_MAX_MODULE_NAME];
+    TracerBool                      mIsIndexed;             // Symbols are sorted and hashed
+    uint32_t                        mGeneration;            // Free for the owner, e.g. to mark modules still loaded
+
+    TracerSymbolEntry*              mSymbols;
+    size_t                          mNumSymbols;
+    size_t                          mMaxSymbols;
+
+    char*                           mStringPool;
+    size_t                          mStringPoolSize;
+    size_t                          mMaxStringPoolSize;
+} TracerSymbolModule;
+
+typedef struct TracerSymbolNameSlot {
+    uint32_t                        mHash;
+    uint32_t                        mSymbolIndex;
+    TracerSymbolModule*             mModule;                // NULL if the slot is free
+} TracerSymbolNameSlot;
+
+typedef struct TracerSymbolIndex {
+    TracerSymbolModule**            mModules;               // Sorted by base address
+    size_t                          mNumModules;
+    size_t                          mMaxModules;
+
+    TracerSymbolNameSlot*           mNameTable;             // Open addressing, power of two size
+    size_t                          mNameTableSize;
+    size_t                          mNumNames;
+} TracerSymbolIndex;
+
+typedef struct TracerSymbolLookup {
+    const TracerSymbolModule*       mModule;
+    const char*                     mSymbolName;
+    uintptr_t                       mSymbolAddress;
+    uintptr_t                       mDisplacement;
+} TracerSymbolLookup;
+
+void tracerSymbolIndexInit(TracerSymbolIndex* index);
+
+void tracerSymbolIndexClear(TracerSymbolIndex* index);
+
+// Returns the known module if base, size, time stamp and checksum match. A different module at the
+// same base is replaced.
+TracerSymbolModule* tracerSymbolIndexAddModule(TracerSymbolIndex* index, uintptr_t baseAddress, size_t size,
+    uint32_t timeDateStamp, uint32_t checkSum, const char* name);
+
+// Frees the module, pointers into it are invalid afterwards
+void tracerSymbolIndexRemoveModule(TracerSymbolIndex* index, TracerSymbolModule* module);
+
+TracerSymbolModule* tracerSymbolIndexFindModule(const TracerSymbolIndex* index, uintptr_t address);
+
+TracerBool tracerSymbolIndexAddSymbol(TracerSymbolModule* module, uintptr_t address, size_t size, const char* name);
+
+TracerBool tracerSymbolIndexFinalizeModule(TracerSymbolIndex* index, TracerSymbolModule* module);
+
+TracerBool tracerSymbolIndexLookupAddress(const TracerSymbolModule* module, uintptr_t address, TracerSymbolLookup* lookup);
+
+TracerBool tracerSymbolIndexLookupAddressSorted(const TracerSymbolModule* module,
+    uintptr_t address, size_t* cursor, TracerSymbolLookup* lookup);
+
+TracerBool tracerSymbolIndexLookupName(const TracerSymbolIndex* index, const char* name, TracerSymbolLookup* lookup);
+
+#endif
@@ -3,11 +3,26 @@
 #define SYMBOL_RESOLVER_H
 
 #include <tracer_lib/core.h>
+#include <tracer_lib/symbol_index.h>
+
+#define TLIB_SYMBOL_RESOLVER_REFRESH_INTERVAL   1000
+
+TracerHandle tracerCreateSymbolResolver(TracerHandle process);
+
+void tracerDestroySymbolResolver(TracerHandle resolver);
+
+// The formatter expects the symbol resolver as user data (see ZydisFormatterFormatInstructionEx)
 
 TracerBool tracerRegisterCustomSymbolResolver(void* instructionFormatter);
 
-TracerBool tracerUnregisterCustomSymbolResolver();
+TracerBool tracerResolveAddress(TracerHandle resolver, uintptr_t address, TracerSymbolLookup* lookup);
+
+uintptr_t tracerResolveSymbol(TracerHandle resolver, const char* symbolName);
+
+// Returns the indexed module that contains the address, NULL if no loaded module does. Modules are
+// dropped once a refresh finds them unloaded, so don't keep the pointer across calls.
+const TracerSymbolModule* tracerResolveModule(TracerHandle resolver, uintptr_t address);
 
-uintptr_t tracerResolveSymbol(const char* symbolName);
+size_t tracerResolveAddresses(TracerHandle resolver, const uintptr_t* addresses, size_t numAddresses, TracerSymbolInfo* outSymbols);
 
 #endif
@@ -9,6 +9,12 @@ typedef struct TracerTraceContext {
     TracerBool(*mStartTrace)(TracerContext* ctx, void* address, int threadId, int maxTraceDepth, int lifetime);
 
     TracerBool(*mStopTrace)(TracerContext* ctx, void* address, int threadId);
+
+    TracerBool(*mGetStatistics)(TracerContext* ctx, TracerStatistics* statistics);
+
+    TracerBool(*mStartWatch)(TracerContext* ctx, void* address, int size, TracerWatchCondition condition, int threadId);
+
+    TracerBool(*mStopWatch)(TracerContext* ctx, void* address, int threadId);
 } TracerTraceContext;
 
 TracerContext* tracerCreateTraceContext(int type, int size);
@@ -19,4 +25,10 @@ TracerBool tracerTraceStart(TracerContext* ctx, void* address, int threadId, int
 
 TracerBool tracerTraceStop(TracerContext* ctx, void* address, int threadId);
 
+TracerBool tracerTraceGetStatistics(TracerContext* ctx, TracerStatistics* statistics);
+
+TracerBool tracerTraceStartWatch(TracerContext* ctx, void* address, int size, TracerWatchCondition condition, int threadId);
+
+TracerBool tracerTraceStopWatch(TracerContext* ctx, void* address, int threadId);
+
 #endif
@@ -0,0 +1,118 @@
+#ifndef TLIB_TRACE_CHUNK_H
+#define TLIB_TRACE_CHUNK_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_TRACE_REF_TYPE             0x46455254  // 'TREF'
+#define TLIB_TRACE_CHUNK_TYPE_REF       0xFF        // The type column value of a reference
+#define TLIB_TRACE_CHUNK_MAX_DICTIONARY 256
+
+// A call subtree that repeats one that was stored before is replaced by a single record of this
+// layout, back to back repeats share the same record.
+typedef struct TracerTraceRef {
+    uint32_t                    mType;              // TLIB_TRACE_REF_TYPE
+    int                         mTraceId;
+    int                         mThreadId;
+    int                         mCallDepth;
+    uint64_t                    mFirstRecord;       // The stored copy of the subtree, starts with its call
+    uint64_t                    mNumRecords;        // The number of stored records of the copy
+    uint64_t                    mTimestamp;         // Of the call that started the first repeat
+    uint32_t                    mCount;             // The number of repeats
+} TracerTraceRef;
+
+typedef enum TracerTraceColumn {
+    eTracerTraceColumnType,                         // uint8_t
+    eTracerTraceColumnTraceId,                      // int
+    eTracerTraceColumnThreadId,                     // int
+    eTracerTraceColumnCallDepth,                    // int
+    eTracerTraceColumnSource,                       // uintptr_t
+    eTracerTraceColumnTarget,                       // uintptr_t, the index into mRefs for references
+    eTracerTraceColumnTimestamp,                    // uint64_t
+    eTracerTraceColumnOldValue,                     // uint32_t
+    eTracerTraceColumnNewValue,                     // uint32_t
+    eTracerTraceColumnEAX,                          // uint32_t, the registers in the order of TracerRegisterSetX86
+    eTracerTraceColumnEBX,
+    eTracerTraceColumnECX,
+    eTracerTraceColumnEDX,
+    eTracerTraceColumnESI,
+    eTracerTraceColumnEDI,
+    eTracerTraceColumnEBP,
+    eTracerTraceColumnESP,
+    eTracerTraceColumnSegGS,
+    eTracerTraceColumnSegFS,
+    eTracerTraceColumnSegES,
+    eTracerTraceColumnSegDS,
+    eTracerTraceColumnSegCS,
+    eTracerTraceColumnSegSS,
+    eTracerTraceColumnCount,
+} TracerTraceColumn;
+
+#define TLIB_TRACE_COLUMN_BIT(column)   (1u << (column))
+#define TLIB_TRACE_COLUMN_ALL           ((1u << eTracerTraceColumnCount) - 1)
+
+typedef enum TracerTraceEncoding {
+    eTracerTraceEncodingRaw,                        // Values of the column width
+    eTracerTraceEncodingConstant,                   // A single value for all records
+    eTracerTraceEncodingDictionary,                 // Up to 256 distinct values followed by an 8 bit index per record
+    eTracerTraceEncodingDelta,                      // Zigzag LEB128 differences to the previous value
+} TracerTraceEncoding;
+
+typedef struct TracerTraceColumnHeader {
+    uint8_t                     mEncoding;
+    uint8_t                     mWidth;             // Bytes per value of the column
+    uint16_t                    mNumEntries;        // Dictionary entries minus one
+    uint32_t                    mOffset;            // From the start of the chunk
+    uint32_t                    mSize;
+} TracerTraceColumnHeader;
+
+// An encoded chunk is this header, the columns and the references of the chunk
+typedef struct TracerTraceChunkHeader {
+    uint32_t                    mNumRecords;
+    uint32_t                    mNumRefs;
+    uint32_t                    mRefsOffset;
+    uint32_t                    mSize;
+    TracerTraceColumnHeader     mColumns[eTracerTraceColumnCount];
+} TracerTraceChunkHeader;
+
+// A decoded chunk, every column is a plain array of mNumRecords values of its type. Columns that
+// were not requested while decoding keep their previous content.
+typedef struct TracerTraceChunk {
+    size_t                      mNumRecords;
+    size_t                      mMaxRecords;
+    void*                       mColumns[eTracerTraceColumnCount];
+    TracerTraceRef*             mRefs;
+    size_t                      mNumRefs;
+} TracerTraceChunk;
+
+#define TLIB_TRACE_CHUNK_COLUMN(chunk, column, type) ((type*)(chunk)->mColumns[column])
+
+size_t tracerTraceColumnWidth(TracerTraceColumn column);
+
+// The largest size that encoding numRecords records can take
+size_t tracerTraceChunkMaxEncodedSize(size_t numRecords);
+
+// Encodes the records into outBuffer and returns the size, references are stored as records of
+// the layout TracerTraceRef. scratch must hold numRecords 64 bit values.
+size_t tracerTraceChunkEncode(const TracerTracedInstruction* records, size_t numRecords,
+    uint64_t* scratch, uint8_t* outBuffer, size_t bufferSize);
+
+TracerTraceChunk* tracerCreateTraceChunk(size_t maxRecords);
+
+void tracerDestroyTraceChunk(TracerTraceChunk* chunk);
+
+// Decodes the columns in columnMask, the references are always decoded. Doesn't touch any other
+// state, so different chunks of the same mapping can be decoded on different threads.
+TracerBool tracerTraceChunkDecode(const uint8_t* data, size_t size, uint32_t columnMask, TracerTraceChunk* chunk);
+
+// Needs all columns, a reference is returned in the layout TracerTraceRef
+void tracerTraceChunkGetRecord(const TracerTraceChunk* chunk, size_t index, TracerTracedInstruction* outTrace);
+
+// The value a record has in the column, zero extended
+uint64_t tracerTraceColumnGetValue(const TracerTracedInstruction* record, TracerTraceColumn column);
+
+// Determines the range of the values of a column from the encoded chunk without decoding it. Only
+// possible for constant and dictionary encoded columns.
+TracerBool tracerTraceChunkGetColumnRange(const uint8_t* data, size_t size, TracerTraceColumn column,
+    uint64_t* outMin, uint64_t* outMax);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef TLIB_TRACE_DIFF_H
+#define TLIB_TRACE_DIFF_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_TRACE_DIFF_READ_BATCH      4096        // Records copied out of a mapped file at once
+
+// Both files are summarized into per record subtree hashes first, which is linear in the number
+// of records. The comparison itself then skips every subtree whose hash matches in O(1).
+TracerBool tracerTraceDiff(TracerDiffTraces* diff);
+
+#endif
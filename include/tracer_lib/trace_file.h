@@ -0,0 +1,117 @@
+#ifndef TLIB_TRACE_FILE_H
+#define TLIB_TRACE_FILE_H
+
+#include <tracer_lib/core.h>
+#include <tracer_lib/trace_chunk.h>
+
+#define TLIB_TRACE_FILE_MAGIC           0x46544C54  // 'TLTF'
+#define TLIB_TRACE_FILE_VERSION         5
+#define TLIB_TRACE_FILE_CHUNK_RECORDS   16384       // Stored records per chunk, also what the writer buffers
+#define TLIB_TRACE_FILE_DEDUP_ENTRIES   65536       // Subtrees the writer remembers, must be a power of 2
+#define TLIB_TRACE_FILE_CHUNK_CACHE     4           // Decoded chunks a reader keeps for record access
+#define TLIB_TRACE_FILE_COMPARE_DEPTH   32          // Nested references the writer follows to compare a repeat
+#define TLIB_TRACE_FILE_ZONE_COLUMNS    (eTracerTraceColumnTimestamp + 1)  // The columns with a value range per chunk
+
+// The counters of TracerStatistics, totals of all threads
+typedef struct TracerTraceFileStatistics {
+    uint64_t                    mSingleStepExceptions;
+    uint64_t                    mIgnoredTraceEntries;
+    uint64_t                    mQueueFullStalls;
+    uint64_t                    mQueueStallCycles;
+    uint64_t                    mDecodeFailures;
+    uint64_t                    mBreakpointSuspensions;
+    uint64_t                    mHandlerCycles;
+    uint64_t                    mReturnMismatches;
+    uint64_t                    mUnarmedThreads;
+} TracerTraceFileStatistics;
+
+typedef struct TracerTraceFileHeader {
+    uint32_t                    mMagic;
+    uint32_t                    mVersion;
+    uint32_t                    mChunkRecords;      // Every chunk but the last holds exactly this many records
+    uint32_t                    mNumChunks;
+    uint64_t                    mNumRecords;        // Stored records, references count as one
+    uint64_t                    mDirectoryOffset;   // Only written when the writer is closed
+    uint64_t                    mIndexOffset;       // 0 if the file has no target index
+    uint64_t                    mNumIndexEntries;
+    TracerTraceFileStatistics   mStatistics;        // Zero unless the writer was given them
+} TracerTraceFileHeader;
+
+// The range of the values of a column in a chunk, references are left out. mMin > mMax if the
+// chunk only holds references.
+typedef struct TracerTraceFileZone {
+    uint64_t                    mMin;
+    uint64_t                    mMax;
+} TracerTraceFileZone;
+
+// The chunks follow the header, see TracerTraceChunkHeader. The directory after them has an entry
+// per chunk.
+typedef struct TracerTraceFileChunkEntry {
+    uint64_t                    mOffset;
+    uint32_t                    mSize;
+    uint32_t                    mNumRefs;
+    TracerTraceFileZone         mZones[TLIB_TRACE_FILE_ZONE_COLUMNS];
+} TracerTraceFileChunkEntry;
+
+// The optional target index follows the directory, an entry per branch target sorted by target and
+// then the postings. The postings of a target are the indices of the chunks that store a record
+// with it, as LEB128 differences to the previous index.
+typedef struct TracerTraceFileIndexEntry {
+    uint64_t                    mTarget;
+    uint64_t                    mOffset;            // From the start of the postings
+    uint32_t                    mNumChunks;
+    uint32_t                    mSize;
+} TracerTraceFileIndexEntry;
+
+// Subtrees are compared by their control flow and watched values only, and only against copies
+// that are still buffered. A repeat is expanded with the register values of the stored copy, and
+// its time stamps are shifted to the first repeat.
+// The target index is kept in memory until the writer is closed.
+TracerHandle tracerCreateTraceWriter(const char* path, TracerBool deduplicate, TracerBool indexTargets);
+
+TracerBool tracerTraceWriterAppend(TracerHandle writer, const TracerTracedInstruction* traces, size_t numTraces);
+
+// The statistics go into the header when the writer is closed
+TracerBool tracerTraceWriterSetStatistics(TracerHandle writer, const TracerStatistics* statistics);
+
+// Flushes the outstanding records and completes the header, the handle is invalid afterwards
+TracerBool tracerDestroyTraceWriter(TracerHandle writer);
+
+// The whole file is mapped read only, chunks are only decoded on access. References are expanded
+// transparently, record indices always count the expanded records. Not thread safe.
+TracerHandle tracerCreateTraceReader(const char* path);
+
+void tracerDestroyTraceReader(TracerHandle reader);
+
+uint64_t tracerTraceReaderGetNumRecords(TracerHandle reader);
+
+// Only the counters are filled in, mSizeOfStruct and mThreadId are left as they are
+TracerBool tracerTraceReaderGetStatistics(TracerHandle reader, TracerStatistics* outStatistics);
+
+size_t tracerTraceReaderRead(TracerHandle reader, uint64_t firstRecord, TracerTracedInstruction* outTraces, size_t maxElements);
+
+// Raw access to the stored chunks, references are not expanded. Decoding only reads the mapping,
+// different threads may decode chunks of the same reader into their own chunk objects.
+size_t tracerTraceReaderGetNumChunks(TracerHandle reader);
+
+TracerTraceChunk* tracerTraceReaderCreateChunk(TracerHandle reader);
+
+TracerBool tracerTraceReaderDecodeChunk(TracerHandle reader, size_t index, uint32_t columnMask, TracerTraceChunk* chunk);
+
+// Whether any chunk stores a reference, stored and expanded record indices only match without them
+TracerBool tracerTraceReaderHasReferences(TracerHandle reader);
+
+// The expanded index of the first record that a stored record expands to, storedRecord may be the
+// number of stored records to get the end of the last expansion
+uint64_t tracerTraceReaderGetExpandedIndex(TracerHandle reader, uint64_t storedRecord);
+
+// The range of the values of a column in a chunk, if it is known without decoding the chunk
+TracerBool tracerTraceReaderGetColumnRange(TracerHandle reader, size_t index, TracerTraceColumn column,
+    uint64_t* outMin, uint64_t* outMax);
+
+// Returns the number of chunks that may store a record branching to target and copies up to
+// maxChunks of their indices in ascending order. Uses the target index if the file has one and
+// the value ranges of the chunks otherwise.
+size_t tracerTraceReaderFindTarget(TracerHandle reader, uint64_t target, uint32_t* outChunks, size_t maxChunks);
+
+#endif
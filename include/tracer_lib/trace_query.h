@@ -0,0 +1,13 @@
+#ifndef TLIB_TRACE_QUERY_H
+#define TLIB_TRACE_QUERY_H
+
+#include <tracer_lib/core.h>
+
+#define TLIB_TRACE_QUERY_MAX_WORKERS    64
+#define TLIB_TRACE_QUERY_READ_BATCH     4096        // Records per read when references have to be expanded
+
+// Chunks are handed out to the workers one at a time. A first pass counts and groups the matches,
+// a second one decodes only the chunks whose matches end up in mOutRecords again.
+TracerBool tracerTraceQuery(TracerQueryTraceFile* query);
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #define TLIB_VERSION                    100
+#define TLIB_DIFF_MAX_CONTEXT           16
 
 #if defined(_MSC_VER)
     #define TLIB_DECL(...)              __declspec(__VA_ARGS__)
@@ -144,6 +145,41 @@ typedef struct TracerStopTrace {
     int                                 mThreadId;                  ///< The thread id that should be traced (-1 for all threads).
 } TracerStopTrace;
 
+/**
+ * @brief   Values that represent the accesses that trigger a watchpoint.
+ * @see     tracerStartWatch
+ */
+typedef enum TracerWatchCondition {
+    eTracerWatchWrite                   = 1,                        ///< Record every write to the watched data.
+    eTracerWatchReadWrite               = 3,                        ///< Record every read or write of the watched data.
+} TracerWatchCondition;
+
+/**
+ * @brief   The structure that should be passed to \ref tracerStartWatchEx.
+ * @remarks Don't forget to set \ref mSizeOfStruct.
+ * @see     tracerStartWatch
+ * @see     tracerStartWatchEx
+ */
+typedef struct TracerStartWatch {
+    int                                 mSizeOfStruct;              ///< The size of the structure (in bytes).
+    void*                               mAddress;                   ///< The address of the data to watch. Has to be aligned to mSize.
+    int                                 mSize;                      ///< The number of bytes to watch (1, 2 or 4).
+    TracerWatchCondition                mCondition;                 ///< The accesses that should be recorded.
+    int                                 mThreadId;                  ///< The thread id that should be watched (-1 for all threads).
+} TracerStartWatch;
+
+/**
+ * @brief   The structure that should be passed to \ref tracerStopWatchEx.
+ * @remarks Don't forget to set \ref mSizeOfStruct.
+ * @see     tracerStopWatch
+ * @see     tracerStopWatchEx
+ */
+typedef struct TracerStopWatch {
+    int                                 mSizeOfStruct;              ///< The size of the structure (in bytes).
+    void*                               mAddress;                   ///< The address of the watched data.
+    int                                 mThreadId;                  ///< The thread id that was passed to \ref tracerStartWatch.
+} TracerStopWatch;
+
 /**
  * @brief   The structure that should be passed to \ref tracerDecodeAndFormatInstructionEx.
  * @remarks Don't forget to set \ref mSizeOfStruct.
@@ -170,6 +206,59 @@ typedef struct TracerGetSymbolAddrFromName {
     uintptr_t                           mSymbolAddress;             ///< The address of the symbol.
 } TracerGetSymbolAddrFromName;
 
+/**
+ * @brief   A structure that receives the symbol information for a single address.
+ * @see     tracerSymbolizeAddresses
+ */
+typedef struct TracerSymbolInfo {
+    uintptr_t                           mAddress;                   ///< The address that was symbolized.
+    uintptr_t                           mModuleBase;                ///< The base address of the module that contains the address, or 0.
+    uintptr_t                           mSymbolAddress;             ///< The address of the symbol, or 0 if no symbol was found.
+    uintptr_t                           mDisplacement;              ///< The offset of the address from the start of the symbol.
+    char                                mModuleName[64];            ///< The name of the module that contains the address.
+    char                                mSymbolName[256];           ///< The name of the symbol.
+} TracerSymbolInfo;
+
+/**
+ * @brief   The structure that should be passed to \ref tracerSymbolizeAddressesEx.
+ * @remarks Don't forget to set \ref mSizeOfStruct.
+ * @see     tracerSymbolizeAddresses
+ * @see     tracerSymbolizeAddressesEx
+ */
+typedef struct TracerSymbolizeAddresses {
+    int                                 mSizeOfStruct;              ///< The size of the structure (in bytes).
+    const uintptr_t*                    mAddresses;                 ///< An array of addresses that should be symbolized.
+    size_t                              mNumAddresses;              ///< The number of elements in the mAddresses array.
+    TracerSymbolInfo*                   mOutSymbols;                ///< An array of at least mNumAddresses elements that receives the results.
+    size_t                              mNumResolved;               ///< Receives the number of addresses that could be resolved to a symbol.
+} TracerSymbolizeAddresses;
+
+/**
+ * @brief   The structure that should be passed to \ref tracerGetStatistics.
+ *
+ * All counters are maintained by the tracer itself and describe the overhead that it adds
+ * to the traced process.
+ *
+ * @remarks Don't forget to set \ref mSizeOfStruct and \ref mThreadId.
+ * @see     tracerGetStatistics
+ */
+typedef struct TracerStatistics {
+    int                                 mSizeOfStruct;              ///< The size of the structure (in bytes).
+    int                                 mThreadId;                  ///< The thread id for which the statistics should be retrieved.
+                                                                    ///< Set this to \c -1 to retrieve the totals of all threads.
+                                                                    ///< Threads that exited only count towards the totals.
+    uint64_t                            mSingleStepExceptions;      ///< The number of single step exceptions handled by the tracer.
+    uint64_t                            mIgnoredTraceEntries;       ///< The number of trace entries that were ignored because another trace was active.
+    uint64_t                            mQueueFullStalls;           ///< The number of records that had to wait for free space in the trace queue.
+    uint64_t                            mQueueStallCycles;          ///< The number of cycles spent waiting for free space in the trace queue.
+    uint64_t                            mDecodeFailures;            ///< The number of branch instructions that could not be decoded.
+    uint64_t                            mBreakpointSuspensions;     ///< The number of times a trace was suspended and resumed by a breakpoint.
+    uint64_t                            mHandlerCycles;             ///< The cumulative number of cycles spent inside the exception handler.
+    uint64_t                            mReturnMismatches;          ///< The number of returns whose target did not match the shadow call stack.
+    uint64_t                            mUnarmedThreads;            ///< The number of new threads that could not inherit every global hardware
+                                                                    ///< breakpoint. Only counted in the totals of all threads.
+} TracerStatistics;
+
 /**
  * @brief   Values that represent the type of a traced instruction.
  * @see     tracerFetchTraces
@@ -178,6 +267,7 @@ typedef enum TracerTracedInstructionType {
     eTracerInstructionTypeBranch        = 0,                        ///< The instruction is a conditional or unconditional branch.
     eTracerInstructionTypeCall          = 1,                        ///< The instruction is a function call.
     eTracerInstructionTypeReturn        = 2,                        ///< The instruction is a return from a function
+    eTracerInstructionTypeWatch         = 3,                        ///< The instruction accessed watched data, see \ref tracerStartWatch.
 } TracerTracedInstructionType;
 
 /**
@@ -213,11 +303,163 @@ typedef struct TracerTracedInstruction {
     int                                 mTraceId;
     int                                 mThreadId;
     int                                 mCallDepth;
-    uintptr_t                           mBranchSource;
-    uintptr_t                           mBranchTarget;
+    uintptr_t                           mBranchSource;              ///< For watch hits, the watched data address.
+    uintptr_t                           mBranchTarget;              ///< For watch hits, the instruction after the one that accessed the data.
+    uint64_t                            mTimestamp;                 ///< The time stamp counter when the branch was recorded.
+    uint32_t                            mOldValue;                  ///< For watch hits, the value this watch read at its previous hit or when it
+                                                                    ///< was started. Changes that the watch doesn't trap, e.g. by other threads
+                                                                    ///< for a watch on a single thread, only show up here at the next hit.
+    uint32_t                            mNewValue;                  ///< For watch hits, the value after the access.
     TracerRegisterSet                   mRegisterSet;
 } TracerTracedInstruction;
 
+/**
+ * @brief   A trace result together with the process that recorded it.
+ * @see     tracerFetchTracesAll
+ */
+typedef struct TracerProcessTracedInstruction {
+    int                                 mProcessId;                 ///< The process id of the attached process that recorded the trace.
+    TracerTracedInstruction             mTrace;                     ///< The trace result itself.
+} TracerProcessTracedInstruction;
+
+/**
+ * @brief   The structure that should be passed to \ref tracerFetchTracesAllEx.
+ * @remarks Don't forget to set \ref mSizeOfStruct.
+ * @see     tracerFetchTracesAll
+ * @see     tracerFetchTracesAllEx
+ */
+typedef struct TracerFetchTracesAll {
+    int                                 mSizeOfStruct;              ///< The size of the structure (in bytes).
+    TracerProcessTracedInstruction*     mOutTraces;                 ///< An array of at least mMaxElements elements that receives the results.
+    size_t                              mMaxElements;               ///< The maximum number of elements to copy to the mOutTraces array.
+    int                                 mTimeout;                   ///< Milliseconds to wait while all processes are idle (0 returns at once, -1 waits forever).
+    TracerBool                          mMergeByTimestamp;          ///< Whether the results of all processes are merged by \ref TracerTracedInstruction::mTimestamp.
+    size_t                              mNumTraces;                 ///< Receives the number of elements that were copied to mOutTraces.
+} TracerFetchTracesAll;
+
+/**
+ * @brief   The structure that should be passed to \ref tracerOpenTraceWriterEx.
+ * @remarks Don't forget to set \ref mSizeOfStruct.
+ * @see     tracerOpenTraceWriter
+ * @see     tracerOpenTraceWriterEx
+ */
+typedef struct TracerOpenTraceWriter {
+    int                                 mSizeOfStruct;              ///< The size of the structure (in bytes).
+    const char*                         mPath;                      ///< The path of the file.
+    TracerBool                          mDeduplicate;               ///< Whether repeated call subtrees are stored only once.
+    TracerBool                          mIndexTargets;              ///< Whether the chunks are indexed by branch target.
+} TracerOpenTraceWriter;
+
+/**
+ * @brief   The structure that should be passed to \ref tracerDiffTraceFiles.
+ *
+ * All addresses of a file are made relative to its base address before they are compared,
+ * so captures of a module that was loaded at different addresses can be compared as well.
+ *
+ * @remarks Don't forget to set \ref mSizeOfStruct, \ref mLeftFile and \ref mRightFile.
+ * @see     tracerDiffTraceFiles
+ */
+typedef struct TracerDiffTraces {
+    int                                 mSizeOfStruct;              ///< The size of the structure (in bytes).
+    TracerHandle                        mLeftFile;                  ///< A trace file opened with \ref tracerOpenTraceFile.
+    TracerHandle                        mRightFile;                 ///< The trace file that is compared against mLeftFile.
+    uintptr_t                           mLeftBaseAddress;           ///< Subtracted from all addresses of mLeftFile, e.g. the module base of the capture.
+    uintptr_t                           mRightBaseAddress;          ///< Subtracted from all addresses of mRightFile.
+    TracerBool                          mDiverged;                  ///< Receives whether the traces differ at all.
+    size_t                              mInvocation;                ///< Receives the index of the first invocation that differs.
+    uint64_t                            mLeftRecord;                ///< Receives the index of the first differing record of mLeftFile,
+                                                                    ///< or of the record after the invocation if it ended first.
+    uint64_t                            mRightRecord;               ///< Receives the index of the first differing record of mRightFile.
+    TracerTracedInstruction             mLeftTrace;                 ///< Receives the record at mLeftRecord, zeroed if there is none.
+    TracerTracedInstruction             mRightTrace;                ///< Receives the record at mRightRecord, zeroed if there is none.
+    int                                 mContextDepth;              ///< Receives the number of calls that enclose the divergence in mLeftFile.
+    TracerTracedInstruction             mContext[TLIB_DIFF_MAX_CONTEXT];
+                                                                    ///< Receives up to \ref TLIB_DIFF_MAX_CONTEXT of these calls, the innermost
+                                                                    ///< last.
+} TracerDiffTraces;
+
+/**
+ * @brief   Values that represent the fields of a \ref TracerTracedInstruction that queries can test.
+ * @see     tracerQueryTraceFile
+ */
+typedef enum TracerTraceField {
+    eTracerTraceFieldNone               = -1,                       ///< No field, e.g. to not group the results.
+    eTracerTraceFieldType               = 0,                        ///< \ref TracerTracedInstruction::mType.
+    eTracerTraceFieldTraceId            = 1,                        ///< \ref TracerTracedInstruction::mTraceId.
+    eTracerTraceFieldThreadId           = 2,                        ///< \ref TracerTracedInstruction::mThreadId.
+    eTracerTraceFieldCallDepth          = 3,                        ///< \ref TracerTracedInstruction::mCallDepth.
+    eTracerTraceFieldBranchSource       = 4,                        ///< \ref TracerTracedInstruction::mBranchSource.
+    eTracerTraceFieldBranchTarget       = 5,                        ///< \ref TracerTracedInstruction::mBranchTarget.
+    eTracerTraceFieldTimestamp          = 6,                        ///< \ref TracerTracedInstruction::mTimestamp.
+    eTracerTraceFieldOldValue           = 7,                        ///< \ref TracerTracedInstruction::mOldValue.
+    eTracerTraceFieldNewValue           = 8,                        ///< \ref TracerTracedInstruction::mNewValue.
+    eTracerTraceFieldEAX                = 9,                        ///< The registers in the order of \ref TracerRegisterSetX86.
+    eTracerTraceFieldEBX                = 10,
+    eTracerTraceFieldECX                = 11,
+    eTracerTraceFieldEDX                = 12,
+    eTracerTraceFieldESI                = 13,
+    eTracerTraceFieldEDI                = 14,
+    eTracerTraceFieldEBP                = 15,
+    eTracerTraceFieldESP                = 16,
+    eTracerTraceFieldSegGS              = 17,
+    eTracerTraceFieldSegFS              = 18,
+    eTracerTraceFieldSegES              = 19,
+    eTracerTraceFieldSegDS              = 20,
+    eTracerTraceFieldSegCS              = 21,
+    eTracerTraceFieldSegSS              = 22,
+} TracerTraceField;
+
+/**
+ * @brief   A condition that a record has to meet to match a query.
+ *
+ * Values are compared as unsigned integers of the width of the field, an equality test uses the
+ * same value for \ref mMin and \ref mMax.
+ *
+ * @see     tracerQueryTraceFile
+ */
+typedef struct TracerQueryPredicate {
+    TracerTraceField                    mField;                     ///< The field that is tested.
+    uint64_t                            mMin;                       ///< The smallest value that matches.
+    uint64_t                            mMax;                       ///< The largest value that matches.
+} TracerQueryPredicate;
+
+/**
+ * @brief   The number of matching records that share a value of the grouped field.
+ * @see     tracerQueryTraceFileEx
+ */
+typedef struct TracerQueryGroup {
+    uint64_t                            mValue;                     ///< The value of the grouped field.
+    uint64_t                            mCount;                     ///< The number of matching records with that value.
+} TracerQueryGroup;
+
+/**
+ * @brief   The structure that should be passed to \ref tracerQueryTraceFileEx.
+ * @remarks Don't forget to set \ref mSizeOfStruct and \ref mGroupByField.
+ * @remarks Files with deduplicated subtrees are queried on the calling thread only, mNumThreads
+ *          is ignored for them. Chunks are still skipped by the value ranges of their records and
+ *          of the subtrees they repeat, but the repeats that can match are expanded and tested
+ *          record by record.
+ * @see     tracerQueryTraceFile
+ * @see     tracerQueryTraceFileEx
+ */
+typedef struct TracerQueryTraceFile {
+    int                                 mSizeOfStruct;              ///< The size of the structure (in bytes).
+    TracerHandle                        mFile;                      ///< A trace file opened with \ref tracerOpenTraceFile.
+    const TracerQueryPredicate*         mPredicates;                ///< An array of mNumPredicates conditions that all have to be met.
+    size_t                              mNumPredicates;             ///< The number of elements in the mPredicates array, 0 matches all records.
+    TracerTraceField                    mGroupByField;              ///< The field to count the matches by, or \ref eTracerTraceFieldNone.
+    TracerQueryGroup*                   mOutGroups;                 ///< An array of at least mMaxGroups elements that receives the largest groups.
+    size_t                              mMaxGroups;                 ///< The maximum number of elements to copy to the mOutGroups array.
+    uint64_t*                           mOutRecords;                ///< An array of at least mMaxRecords elements that receives the
+                                                                    ///< indices of the first matches, or \c NULL.
+    size_t                              mMaxRecords;                ///< The maximum number of elements to copy to the mOutRecords array.
+    int                                 mNumThreads;                ///< The number of threads to use, 0 for one per processor.
+                                                                    ///< Ignored for files with deduplicated subtrees.
+    uint64_t                            mNumMatches;                ///< Receives the number of matching records.
+    size_t                              mNumGroups;                 ///< Receives the number of groups, which can exceed mMaxGroups.
+    size_t                              mNumSkippedChunks;          ///< Receives the number of chunks that were skipped without decoding.
+} TracerQueryTraceFile;
+
 /**
  * @brief   A context is the equivalent to a class in this lib.
  */
@@ -363,6 +605,8 @@ TLIB_API TracerBool TLIB_CALL tracerDetachProcess(TracerContext* ctx);
  * @param   ctx             The process context.
  * @remarks You can set the context to \c NULL to distribute calls among all attached
  *          processes.
+ * @remarks The thread loses the context when its process is detached, even if the process is
+ *          attached again afterwards.
  * @see     tracerGetProcessContext
  */
 TLIB_API void TLIB_CALL tracerSetProcessContext(TracerContext* ctx);
@@ -427,6 +671,48 @@ TLIB_API TracerBool TLIB_CALL tracerStopTrace(void* functionAddress, int threadI
  */
 TLIB_API TracerBool TLIB_CALL tracerStopTraceEx(TracerStopTrace* stopTrace);
 
+/**
+ * @brief   Records every access to the specified data into the trace results.
+ *
+ * Each hit is reported as a \ref eTracerInstructionTypeWatch trace with the accessing thread, its call
+ * depth, the value after the access and the value the watch read last, see
+ * \ref TracerTracedInstruction::mOldValue. Watchpoints use the same debug registers as traces.
+ *
+ * @param   address         The address of the data to watch. Has to be aligned to size.
+ * @param   size            The number of bytes to watch (1, 2 or 4).
+ * @param   condition       The accesses that should be recorded.
+ * @param   threadId        The thread id of the thread that should be watched.
+ *                          When set to -1, the accesses of all threads will be recorded.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ */
+TLIB_API TracerBool TLIB_CALL tracerStartWatch(void* address, int size, TracerWatchCondition condition TLIB_ARG(eTracerWatchWrite), int threadId TLIB_ARG(-1));
+
+/**
+ * @brief   Records every access to the specified data into the trace results.
+ * @param   startWatch      See \ref tracerStartWatch.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ */
+TLIB_API TracerBool TLIB_CALL tracerStartWatchEx(TracerStartWatch* startWatch);
+
+/**
+ * @brief   Removes the watchpoint on the specified data.
+ * @param   address         The address that was passed to \ref tracerStartWatch.
+ * @param   threadId        The thread id that was passed to \ref tracerStartWatch.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ */
+TLIB_API TracerBool TLIB_CALL tracerStopWatch(void* address, int threadId TLIB_ARG(-1));
+
+/**
+ * @brief   Removes the watchpoint on the specified data.
+ * @param   stopWatch       See \ref tracerStopWatch.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ */
+TLIB_API TracerBool TLIB_CALL tracerStopWatchEx(TracerStopWatch* stopWatch);
+
 /**
  * @brief   Fetch the current trace results from the active process context.
  * @param   outTraces       An array of at least maxElements length, which will receive all
@@ -436,6 +722,33 @@ TLIB_API TracerBool TLIB_CALL tracerStopTraceEx(TracerStopTrace* stopTrace);
  */
 TLIB_API size_t TLIB_CALL tracerFetchTraces(TracerTracedInstruction* outTraces, size_t maxElements);
 
+/**
+ * @brief   Fetch the current trace results from all attached processes at once.
+ *
+ * If none of the processes has outstanding traces, the calling thread sleeps until one of them
+ * records a trace or the timeout elapses. The space in outTraces is shared fairly between the
+ * processes, so a busy process can't starve the others.
+ *
+ * @param   outTraces       An array of at least maxElements length, which will receive the outstanding
+ *                          recorded traces of all attached processes, tagged with their process id.
+ * @param   maxElements     The maximum number of elements to copy to the outTraces array.
+ * @param   timeout         The number of milliseconds to wait while all processes are idle, or -1 to wait forever.
+ *                          With 0 the function returns at once, even if nothing was fetched.
+ * @return  The number of trace results that were returned in outTraces.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ *          If the timeout elapses, the function returns 0 and sets \ref eTracerErrorWaitTimeout.
+ */
+TLIB_API size_t TLIB_CALL tracerFetchTracesAll(TracerProcessTracedInstruction* outTraces, size_t maxElements, int timeout TLIB_ARG(-1));
+
+/**
+ * @brief   Fetch the current trace results from all attached processes at once.
+ * @param   fetchAll        See \ref tracerFetchTracesAll.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerFetchTracesAllEx(TracerFetchTracesAll* fetchAll);
+
 /**
  * @brief   Decodes and formats the instruction at the specified address within the memory space
  *          of the active process context.
@@ -455,10 +768,212 @@ TLIB_API const char* TLIB_CALL tracerDecodeAndFormatInstruction(uintptr_t addres
  */
 TLIB_API const char* TLIB_CALL tracerDecodeAndFormatInstructionEx(TracerDecodeAndFormat* decodeAndFmt);
 
+/**
+ * @brief   Retrieves the self-instrumentation counters of the tracer in the active process context.
+ *
+ * The counters are always maintained and can be used to tune parameters like the maximum trace depth.
+ *
+ * @param   statistics      See \ref TracerStatistics. Set \ref TracerStatistics::mThreadId to \c -1
+ *                          to retrieve the totals of all threads.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerGetStatistics(TracerStatistics* statistics);
+
 TLIB_API uintptr_t TLIB_CALL tracerGetSymbolAddressFromSymbolName(const char* symbolName);
 
 TLIB_API TracerBool TLIB_CALL tracerGetSymbolAddressFromSymbolNameEx(TracerGetSymbolAddrFromName* addrFromName);
 
+/**
+ * @brief   Resolves an array of addresses within the memory space of the active process context
+ *          to module and symbol names.
+ *
+ * The addresses don't need to be sorted or unique. This is much faster than resolving the addresses
+ * one by one, and doesn't require any round trips to a remote process.
+ *
+ * @param   addresses       An array of numAddresses addresses that should be symbolized.
+ * @param   numAddresses    The number of elements in the addresses array.
+ * @param   outSymbols      An array of at least numAddresses elements. The element at index i receives
+ *                          the symbol information for addresses[i].
+ * @return  The number of addresses that could be resolved to a symbol.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API size_t TLIB_CALL tracerSymbolizeAddresses(const uintptr_t* addresses, size_t numAddresses, TracerSymbolInfo* outSymbols);
+
+/**
+ * @brief   Resolves an array of addresses within the memory space of the active process context
+ *          to module and symbol names.
+ *
+ * @param   symbolize       See \ref tracerSymbolizeAddresses.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerSymbolizeAddressesEx(TracerSymbolizeAddresses* symbolize);
+
+/**
+ * @brief   Creates a trace file that records can be written to.
+ *
+ * Any existing file at path is overwritten. The file can be read once it was closed with
+ * \ref tracerCloseTraceWriter.
+ *
+ * With deduplication, every call subtree is hashed as soon as its return is written. A subtree
+ * whose control flow repeats a recent one in the same chunk is stored as a reference to it, and
+ * back to back repeats share a single reference with a count. Readers expand the references
+ * transparently, but the repeats carry the register values of the stored copy and time stamps
+ * relative to their first call. The writer only remembers a bounded number of subtrees.
+ *
+ * Every chunk of the file stores the value ranges of the control flow fields of its records. The
+ * target index additionally lists the chunks that hold each branch target, which lets
+ * \ref tracerQueryTraceFile find e.g. the calls of a function without touching any other chunk.
+ *
+ * @param   path            The path of the file.
+ * @param   deduplicate     Whether repeated call subtrees are stored only once.
+ * @param   indexTargets    Whether the chunks are indexed by branch target.
+ * @return  If the function succeeds, a handle to the writer. Otherwise \c NULL.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerHandle TLIB_CALL tracerOpenTraceWriter(const char* path, TracerBool deduplicate TLIB_ARG(eTracerFalse), TracerBool indexTargets TLIB_ARG(eTracerFalse));
+
+/**
+ * @brief   Creates a trace file that records can be written to.
+ * @param   open            See \ref tracerOpenTraceWriter.
+ * @return  If the function succeeds, a handle to the writer. Otherwise \c NULL.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerHandle TLIB_CALL tracerOpenTraceWriterEx(TracerOpenTraceWriter* open);
+
+/**
+ * @brief   Appends trace results, e.g. the ones returned by \ref tracerFetchTraces, to a trace file.
+ * @param   writer          A handle returned by \ref tracerOpenTraceWriter.
+ * @param   traces          An array of numTraces records.
+ * @param   numTraces       The number of elements in the traces array.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerWriteTraces(TracerHandle writer, const TracerTracedInstruction* traces, size_t numTraces);
+
+/**
+ * @brief   Sets the tracer statistics that are stored with the records of a trace file.
+ *
+ * Pass the totals of \ref tracerGetStatistics for the process the records were fetched from, e.g.
+ * to tell later whether trace entries were ignored. They are written when the file is closed and
+ * can be read with \ref tracerGetTraceFileStatistics. Files are written without statistics unless
+ * this function is called.
+ *
+ * @param   writer          A handle returned by \ref tracerOpenTraceWriter.
+ * @param   statistics      The statistics to store, \ref TracerStatistics::mThreadId is ignored.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerSetTraceWriterStatistics(TracerHandle writer, const TracerStatistics* statistics);
+
+/**
+ * @brief   Writes the outstanding records and closes the trace file. The handle is invalid afterwards.
+ * @param   writer          A handle returned by \ref tracerOpenTraceWriter.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed, the file is incomplete.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerCloseTraceWriter(TracerHandle writer);
+
+/**
+ * @brief   Opens a trace file for reading.
+ *
+ * The file is mapped into memory, so reading records doesn't require any system calls.
+ *
+ * @param   path            The path of a file created with \ref tracerOpenTraceWriter.
+ * @return  If the function succeeds, a handle to the file. Otherwise \c NULL.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerHandle TLIB_CALL tracerOpenTraceFile(const char* path);
+
+/**
+ * @brief   Closes a trace file. The handle is invalid afterwards.
+ * @param   file            A handle returned by \ref tracerOpenTraceFile.
+ */
+TLIB_API void TLIB_CALL tracerCloseTraceFile(TracerHandle file);
+
+/**
+ * @brief   Retrieves the number of records in a trace file.
+ * @param   file            A handle returned by \ref tracerOpenTraceFile.
+ * @return  The number of records.
+ */
+TLIB_API uint64_t TLIB_CALL tracerGetTraceFileRecordCount(TracerHandle file);
+
+/**
+ * @brief   Retrieves the tracer statistics that were stored with a trace file.
+ * @param   file            A handle returned by \ref tracerOpenTraceFile.
+ * @param   statistics      Receives the totals of all threads, \ref TracerStatistics::mThreadId is set to \c -1.
+ *                          The counters are zero unless \ref tracerSetTraceWriterStatistics was called.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerGetTraceFileStatistics(TracerHandle file, TracerStatistics* statistics);
+
+/**
+ * @brief   Reads records from a trace file.
+ * @param   file            A handle returned by \ref tracerOpenTraceFile.
+ * @param   firstRecord     The index of the first record to read.
+ * @param   outTraces       An array of at least maxElements length, which will receive the records.
+ * @param   maxElements     The maximum number of elements to copy to the outTraces array.
+ * @return  The number of records that were returned in outTraces.
+ */
+TLIB_API size_t TLIB_CALL tracerReadTraceFile(TracerHandle file, uint64_t firstRecord, TracerTracedInstruction* outTraces, size_t maxElements);
+
+/**
+ * @brief   Locates the first divergence between two captures of the same function.
+ *
+ * The invocations of both files, runs of records with the same thread and trace id, are paired
+ * in order. Within a pair, call subtrees with the same content are skipped as a whole, so the
+ * time spent is dominated by reading the files rather than by the size of the common part.
+ * The first record that differs is reported together with the calls that enclose it.
+ *
+ * Watch hits are not compared.
+ *
+ * @param   diff            See \ref TracerDiffTraces.
+ * @retval  eTracerTrue     The function succeeded, check \ref TracerDiffTraces::mDiverged for the result.
+ * @retval  eTracerFalse    The function failed.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerDiffTraceFiles(TracerDiffTraces* diff);
+
+/**
+ * @brief   Counts the records of a trace file that meet all predicates.
+ *
+ * The file is stored in chunks of columns. Only the columns that the predicates test are decoded,
+ * chunks whose value ranges can't match are skipped, and the chunks are spread over all processors.
+ * A predicate on a single branch target only visits the chunks the target index lists for it.
+ * Files with deduplicated subtrees are evaluated on the calling thread, and the repeats that can
+ * match are expanded record by record. Their repeats carry the register values of the stored copy,
+ * so predicates on registers and grouping by a register fail with \ref eTracerErrorInvalidArgument
+ * for them.
+ *
+ * @param   file            A handle returned by \ref tracerOpenTraceFile.
+ * @param   predicates      An array of numPredicates conditions.
+ * @param   numPredicates   The number of elements in the predicates array.
+ * @return  The number of matching records.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API uint64_t TLIB_CALL tracerQueryTraceFile(TracerHandle file, const TracerQueryPredicate* predicates, size_t numPredicates);
+
+/**
+ * @brief   Queries the records of a trace file, optionally grouping the matches by a field.
+ *
+ * The groups are returned with the largest first, the record indices in ascending order. They can
+ * be passed to \ref tracerReadTraceFile.
+ *
+ * @param   query           See \ref TracerQueryTraceFile.
+ * @retval  eTracerTrue     The function succeeded.
+ * @retval  eTracerFalse    The function failed.
+ * @remarks To get extended error information, call \ref tracerGetLastError.
+ */
+TLIB_API TracerBool TLIB_CALL tracerQueryTraceFileEx(TracerQueryTraceFile* query);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,6 +3,10 @@
 
 #include <tracer_lib/trace.h>
 
+#define TLIB_VETRACE_MAX_THREAD_STATISTICS  1024
+#define TLIB_VETRACE_MAX_ACTIVE_TRACES      256
+#define TLIB_VETRACE_MAX_ACTIVE_WATCHES     64
+
 typedef struct TracerActiveTrace {
     void*                       mStartAddress;
     uintptr_t                   mBaseOfCode;
@@ -14,17 +18,39 @@ typedef struct TracerActiveTrace {
     struct TracerActiveTrace*   mNextLink;
 } TracerActiveTrace;
 
+typedef struct TracerActiveWatch {
+    void*                       mAddress;
+    int                         mSize;
+    int                         mThreadId;
+    uint32_t                    mLastValue;         // Read at the last hit of any matching thread, or at the start
+    TracerHandle                mBreakpoint;
+    struct TracerActiveWatch*   mNextLink;
+} TracerActiveWatch;
+
 typedef struct TracerVeTraceContext {
     TracerTraceContext          mBaseContext;
     TracerHandle                mAddVehHandle;
     TracerHandle                mSharedRWQueue;
     TracerActiveTrace*          mActiveTraces;
+    TracerHandle                mActiveTracePool;   // The handler releases traces whose lifetime ran out
+    TracerActiveWatch*          mActiveWatches;
+    TracerHandle                mActiveWatchPool;
     TracerActiveTrace* volatile mCurrentTrace;
     CRITICAL_SECTION            mTraceCritSect;
+    CRITICAL_SECTION            mPushCritSect;      // Serializes the writers of mSharedRWQueue
+
+    // Each thread owns one slot, so the handler can update its counters without locking.
+    // Threads that don't find a free slot share the overflow slot, which also keeps the counts of
+    // the threads that exited.
+    TracerStatistics            mThreadStatistics[TLIB_VETRACE_MAX_THREAD_STATISTICS];
+    TracerStatistics            mOverflowStatistics;
 } TracerVeTraceContext;
 
 TracerContext* tracerCreateVeTraceContext(int type, int size, TracerHandle traceQueue);
 
 void tracerCleanupVeTraceContext(TracerContext* ctx);
 
+// Releases the statistics slot of the calling thread
+void tracerVeTraceOnThreadDetach();
+
 #endif
@@ -0,0 +1,360 @@
+
+#include <tracer_lib/channel.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define TLIB_CHANNEL_MAGIC              0x4C4E4843
+
+typedef enum TracerChannelSlotState {
+    eTracerChannelSlotFree          = 0,
+    eTracerChannelSlotClaimed       = 1,
+    eTracerChannelSlotPending       = 2,
+    eTracerChannelSlotRunning       = 3,
+    eTracerChannelSlotCompleted     = 4,
+} TracerChannelSlotState;
+
+typedef int(TLIB_CALL* TracerChannelExport)(TracerStruct* parameter);
+
+// The handles stored inside of the shared memory are only valid within the traced process
+
+typedef struct TracerChannelSlot {
+    volatile LONG           mState;
+    int                     mResult;
+    TracerHandle            mCompletionEvent;
+    char                    mExportName[TLIB_CHANNEL_MAX_EXPORT_NAME];
+    uint8_t                 mPayload[TLIB_CHANNEL_MAX_PAYLOAD_SIZE];
+} TracerChannelSlot;
+
+typedef struct TracerChannelHeader {
+    int                     mMagic;
+    int                     mNumSlots;
+    volatile LONG           mAgentReady;
+    volatile LONG           mShutdown;
+    TracerHandle            mRequestEvent;
+    TracerChannelSlot       mSlots[TLIB_CHANNEL_MAX_SLOTS];
+} TracerChannelHeader;
+
+typedef struct TracerChannel {
+    TracerChannelHeader*    mHeader;
+    HANDLE                  mProcess;
+    HANDLE                  mRequestEvent;
+    HANDLE                  mCompletionEvents[TLIB_CHANNEL_MAX_SLOTS];
+    volatile LONG           mProcessDied;       // The agent never answers again, mAgentReady stays set
+} TracerChannel;
+
+typedef struct TracerChannelAgent {
+    TracerChannelHeader*    mHeader;
+    HANDLE                  mThread;
+    DWORD                   mThreadId;
+} TracerChannelAgent;
+
+static HANDLE tracerChannelCreateEvent(TracerChannel* channel, TracerHandle* remoteEvent) {
+    HANDLE event = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    if (!event) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return NULL;
+    }
+
+    HANDLE duplicatedEvent = NULL;
+
+    // The agent inside of the remote process needs its own handle to the event
+    if (!DuplicateHandle(GetCurrentProcess(), event, channel->mProcess,
+            &duplicatedEvent, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        CloseHandle(event);
+        return NULL;
+    }
+
+    *remoteEvent = (TracerHandle)duplicatedEvent;
+    return event;
+}
+
+TracerHandle tracerCreateChannel(void* address, size_t spaceInBytes, int pid) {
+    if (!address) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    if (spaceInBytes < sizeof(TracerChannelHeader)) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    TracerChannel* channel = (TracerChannel*)calloc(1, sizeof(TracerChannel));
+
+    if (!channel) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    // We need the process handle to duplicate our events and to notice when the process dies
+    channel->mProcess = OpenProcess(PROCESS_DUP_HANDLE | SYNCHRONIZE, FALSE, (DWORD)pid);
+
+    if (!channel->mProcess) {
+        tracerCoreSetLastError(eTracerErrorInsufficientPermission);
+        tracerDestroyChannel((TracerHandle)channel);
+        return NULL;
+    }
+
+    TracerChannelHeader* header = (TracerChannelHeader*)address;
+    memset(header, 0, sizeof(TracerChannelHeader));
+
+    channel->mHeader = header;
+    channel->mRequestEvent = tracerChannelCreateEvent(channel, &header->mRequestEvent);
+
+    if (!channel->mRequestEvent) {
+        tracerDestroyChannel((TracerHandle)channel);
+        return NULL;
+    }
+
+    for (int i = 0; i < TLIB_CHANNEL_MAX_SLOTS; ++i) {
+        channel->mCompletionEvents[i] = tracerChannelCreateEvent(
+            channel, &header->mSlots[i].mCompletionEvent);
+
+        if (!channel->mCompletionEvents[i]) {
+            tracerDestroyChannel((TracerHandle)channel);
+            return NULL;
+        }
+    }
+
+    header->mNumSlots = TLIB_CHANNEL_MAX_SLOTS;
+    header->mMagic = TLIB_CHANNEL_MAGIC;
+
+    return (TracerHandle)channel;
+}
+
+void tracerDestroyChannel(TracerHandle handle) {
+    TracerChannel* channel = (TracerChannel*)handle;
+
+    if (!channel) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    // The duplicated handles are owned by the agent, we only close our own ones here.
+    // The shared memory may already be unmapped at this point, so don't touch the header.
+
+    for (int i = 0; i < TLIB_CHANNEL_MAX_SLOTS; ++i) {
+        if (channel->mCompletionEvents[i]) {
+            CloseHandle(channel->mCompletionEvents[i]);
+        }
+    }
+
+    if (channel->mRequestEvent) {
+        CloseHandle(channel->mRequestEvent);
+    }
+
+    if (channel->mProcess) {
+        CloseHandle(channel->mProcess);
+    }
+
+    free(channel);
+}
+
+TracerBool tracerChannelIsAgentReady(TracerHandle handle) {
+    TracerChannel* channel = (TracerChannel*)handle;
+    return (channel && !channel->mProcessDied && channel->mHeader->mAgentReady) ? eTracerTrue : eTracerFalse;
+}
+
+TracerBool tracerChannelCall(TracerHandle handle, const char* exportName,
+    const TracerStruct* parameter, TracerStruct* outParameter, int* result) {
+
+    TracerChannel* channel = (TracerChannel*)handle;
+
+    // Returning false means that the call could not be made through the channel and that the
+    // caller has to fall back to the remote thread
+
+    if (!tracerChannelIsAgentReady(handle)) {
+        return eTracerFalse;
+    }
+
+    size_t exportNameLength = strlen(exportName);
+
+    if (exportNameLength >= TLIB_CHANNEL_MAX_EXPORT_NAME ||
+        parameter->mSizeOfStruct > TLIB_CHANNEL_MAX_PAYLOAD_SIZE) {
+
+        return eTracerFalse;
+    }
+
+    TracerChannelHeader* header = channel->mHeader;
+
+    int index = -1;
+
+    while (index == -1) {
+        for (int i = 0; i < TLIB_CHANNEL_MAX_SLOTS; ++i) {
+            if (InterlockedCompareExchange(&header->mSlots[i].mState,
+                    eTracerChannelSlotClaimed, eTracerChannelSlotFree) == eTracerChannelSlotFree) {
+
+                index = i;
+                break;
+            }
+        }
+
+        // Every slot is in use by other threads, give them a chance to finish unless the process is gone
+        if (index == -1 && (channel->mProcessDied || WaitForSingleObject(channel->mProcess, 1) != WAIT_TIMEOUT)) {
+            InterlockedExchange(&channel->mProcessDied, 1);
+            tracerCoreSetLastError(eTracerErrorRemoteInterop);
+
+            *result = 0;
+            return eTracerTrue;
+        }
+    }
+
+    TracerChannelSlot* slot = &header->mSlots[index];
+
+    memcpy(slot->mExportName, exportName, exportNameLength + 1);
+    memcpy(slot->mPayload, parameter, parameter->mSizeOfStruct);
+    slot->mResult = 0;
+
+    // Publish the request and wake up the agent
+    InterlockedExchange(&slot->mState, eTracerChannelSlotPending);
+    SetEvent(channel->mRequestEvent);
+
+    HANDLE waitHandles[2] = { channel->mCompletionEvents[index], channel->mProcess };
+
+    if (WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+        // The remote process terminated before the call was completed. Nobody answers the
+        // request anymore, so the slot can be handed back and later calls fail right away.
+        InterlockedExchange(&channel->mProcessDied, 1);
+        InterlockedExchange(&slot->mState, eTracerChannelSlotFree);
+        tracerCoreSetLastError(eTracerErrorRemoteInterop);
+
+        *result = 0;
+        return eTracerTrue;
+    }
+
+    *result = slot->mResult;
+
+    if (outParameter) {
+        memcpy(outParameter, slot->mPayload, parameter->mSizeOfStruct);
+    }
+
+    InterlockedExchange(&slot->mState, eTracerChannelSlotFree);
+    return eTracerTrue;
+}
+
+static void tracerChannelAgentExecute(TracerChannelSlot* slot) {
+    char decoratedExportName[TLIB_CHANNEL_MAX_EXPORT_NAME + 8];
+
+    // Never trust the contents of the shared memory
+    slot->mExportName[TLIB_CHANNEL_MAX_EXPORT_NAME - 1] = 0;
+    snprintf(decoratedExportName, sizeof(decoratedExportName), "_%s@4", slot->mExportName);
+
+    TracerChannelExport function = (TracerChannelExport)GetProcAddress(
+        (HMODULE)tracerCoreGetModuleHandle(), decoratedExportName);
+
+    TracerStruct* parameter = (TracerStruct*)slot->mPayload;
+
+    if (function && parameter->mSizeOfStruct > 0 &&
+        parameter->mSizeOfStruct <= TLIB_CHANNEL_MAX_PAYLOAD_SIZE) {
+
+        slot->mResult = function(parameter);
+    } else {
+        slot->mResult = 0;
+    }
+
+    InterlockedExchange(&slot->mState, eTracerChannelSlotCompleted);
+    SetEvent((HANDLE)slot->mCompletionEvent);
+}
+
+static DWORD WINAPI tracerChannelAgentThread(LPVOID parameter) {
+    TracerChannelAgent* agent = (TracerChannelAgent*)parameter;
+    TracerChannelHeader* header = agent->mHeader;
+
+    // The request event is auto reset. A request that is published while we are scanning
+    // the slots will signal the event again, so no request can get lost.
+
+    while (WaitForSingleObject((HANDLE)header->mRequestEvent, INFINITE) == WAIT_OBJECT_0) {
+        if (header->mShutdown) {
+            break;
+        }
+
+        for (int i = 0; i < TLIB_CHANNEL_MAX_SLOTS; ++i) {
+            TracerChannelSlot* slot = &header->mSlots[i];
+
+            if (InterlockedCompareExchange(&slot->mState,
+                    eTracerChannelSlotRunning, eTracerChannelSlotPending) == eTracerChannelSlotPending) {
+
+                tracerChannelAgentExecute(slot);
+            }
+        }
+    }
+
+    return 0;
+}
+
+TracerHandle tracerCreateChannelAgent(void* address, size_t spaceInBytes) {
+    TracerChannelHeader* header = (TracerChannelHeader*)address;
+
+    if (!header || spaceInBytes < sizeof(TracerChannelHeader) ||
+        header->mMagic != TLIB_CHANNEL_MAGIC || header->mNumSlots != TLIB_CHANNEL_MAX_SLOTS) {
+
+        // The controlling process didn't set up a channel for us
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    TracerChannelAgent* agent = (TracerChannelAgent*)malloc(sizeof(TracerChannelAgent));
+
+    if (!agent) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    agent->mHeader = header;
+    agent->mThread = CreateThread(NULL, 0, tracerChannelAgentThread, agent, 0, &agent->mThreadId);
+
+    if (!agent->mThread) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        free(agent);
+        return NULL;
+    }
+
+    InterlockedExchange(&header->mAgentReady, 1);
+    return (TracerHandle)agent;
+}
+
+void tracerDestroyChannelAgent(TracerHandle handle) {
+    TracerChannelAgent* agent = (TracerChannelAgent*)handle;
+
+    if (!agent) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    // The agent can't join itself, the controller makes sure to never route shutdown calls through it
+    assert(GetCurrentThreadId() != agent->mThreadId);
+
+    TracerChannelHeader* header = agent->mHeader;
+
+    // Stop accepting new requests and wake up the agent thread
+    InterlockedExchange(&header->mAgentReady, 0);
+    InterlockedExchange(&header->mShutdown, 1);
+
+    SetEvent((HANDLE)header->mRequestEvent);
+    WaitForSingleObject(agent->mThread, INFINITE);
+    CloseHandle(agent->mThread);
+
+    for (int i = 0; i < TLIB_CHANNEL_MAX_SLOTS; ++i) {
+        TracerChannelSlot* slot = &header->mSlots[i];
+
+        // Fail the requests that were published after the agent thread stopped
+        if (InterlockedCompareExchange(&slot->mState,
+                eTracerChannelSlotCompleted, eTracerChannelSlotPending) == eTracerChannelSlotPending) {
+
+            slot->mResult = 0;
+            SetEvent((HANDLE)slot->mCompletionEvent);
+        }
+
+        CloseHandle((HANDLE)slot->mCompletionEvent);
+        slot->mCompletionEvent = NULL;
+    }
+
+    CloseHandle((HANDLE)header->mRequestEvent);
+    header->mRequestEvent = NULL;
+
+    free(agent);
+}
@@ -0,0 +1,166 @@
+
+#include <tracer_lib/code_snapshot.h>
+#include <tracer_lib/memory.h>
+
+#include <Psapi.h>
+
+#pragma comment(lib, "psapi")
+
+#define TLIB_CODE_SNAPSHOT_MAX_MODULES      1024
+
+typedef struct TracerCodePage {
+    uintptr_t               mBaseAddress;
+    TracerBool              mIsValid;
+    TracerBool              mIsReadable;
+    uint8_t                 mData[TLIB_CODE_SNAPSHOT_PAGE_SIZE];
+} TracerCodePage;
+
+typedef struct TracerCodeSnapshot {
+    TracerContext*          mMemoryContext;
+    uint32_t                mModuleFingerprint;
+    DWORD                   mLastCheckTime;
+    TracerCodePage          mPages[TLIB_CODE_SNAPSHOT_NUM_PAGES];
+} TracerCodeSnapshot;
+
+static uint32_t tracerCodeSnapshotGetModuleFingerprint(TracerCodeSnapshot* snapshot) {
+    TracerMemoryContext* memory = (TracerMemoryContext*)snapshot->mMemoryContext;
+
+    HMODULE modules[TLIB_CODE_SNAPSHOT_MAX_MODULES];
+    DWORD bytesNeeded = 0;
+
+    if (!EnumProcessModules((HANDLE)memory->mProcessHandle, modules, sizeof(modules), &bytesNeeded)) {
+        return 0;
+    }
+
+    DWORD numModules = min(bytesNeeded, sizeof(modules)) / sizeof(HMODULE);
+
+    // FNV-1a over the number of modules and their base addresses
+    uint32_t fingerprint = 2166136261u ^ (uint32_t)numModules;
+
+    for (DWORD i = 0; i < numModules; ++i) {
+        fingerprint = (fingerprint ^ (uint32_t)(uintptr_t)modules[i]) * 16777619u;
+    }
+
+    return fingerprint;
+}
+
+static void tracerCodeSnapshotCheckModules(TracerCodeSnapshot* snapshot) {
+    DWORD currentTime = GetTickCount();
+
+    // Enumerating the modules of the remote process is expensive, so only do it every now and then
+    if (currentTime - snapshot->mLastCheckTime < TLIB_CODE_SNAPSHOT_CHECK_INTERVAL) {
+        return;
+    }
+
+    snapshot->mLastCheckTime = currentTime;
+
+    uint32_t fingerprint = tracerCodeSnapshotGetModuleFingerprint(snapshot);
+
+    if (fingerprint != snapshot->mModuleFingerprint) {
+        // A module was loaded or unloaded, the cached code might be stale
+        tracerCodeSnapshotInvalidate((TracerHandle)snapshot);
+        snapshot->mModuleFingerprint = fingerprint;
+    }
+}
+
+TracerHandle tracerCreateCodeSnapshot(TracerContext* memoryContext) {
+    if (!tracerCoreValidateContext(memoryContext, eTracerMemoryContext)) {
+        return NULL;
+    }
+
+    TracerCodeSnapshot* snapshot = (TracerCodeSnapshot*)malloc(sizeof(TracerCodeSnapshot));
+
+    if (!snapshot) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    snapshot->mMemoryContext = memoryContext;
+    snapshot->mLastCheckTime = GetTickCount();
+
+    tracerCodeSnapshotInvalidate((TracerHandle)snapshot);
+
+    snapshot->mModuleFingerprint = tracerCodeSnapshotGetModuleFingerprint(snapshot);
+    return (TracerHandle)snapshot;
+}
+
+void tracerDestroyCodeSnapshot(TracerHandle handle) {
+    TracerCodeSnapshot* snapshot = (TracerCodeSnapshot*)handle;
+
+    if (!snapshot) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    free(snapshot);
+}
+
+void tracerCodeSnapshotInvalidate(TracerHandle handle) {
+    TracerCodeSnapshot* snapshot = (TracerCodeSnapshot*)handle;
+
+    if (!snapshot) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    for (int i = 0; i < TLIB_CODE_SNAPSHOT_NUM_PAGES; ++i) {
+        snapshot->mPages[i].mIsValid = eTracerFalse;
+    }
+}
+
+static const TracerCodePage* tracerCodeSnapshotGetPage(TracerCodeSnapshot* snapshot, uintptr_t pageAddress) {
+    // The cache is direct mapped, every page can only live in a single slot
+    size_t slot = (pageAddress / TLIB_CODE_SNAPSHOT_PAGE_SIZE) % TLIB_CODE_SNAPSHOT_NUM_PAGES;
+
+    TracerCodePage* page = &snapshot->mPages[slot];
+
+    if (page->mIsValid && page->mBaseAddress == pageAddress) {
+        return page;
+    }
+
+    page->mBaseAddress = pageAddress;
+    page->mIsValid = eTracerTrue;
+
+    // Unreadable pages are cached as well, so we don't ask for them over and over again
+    page->mIsReadable = (tracerMemoryRead(snapshot->mMemoryContext, (const void*)pageAddress,
+        page->mData, TLIB_CODE_SNAPSHOT_PAGE_SIZE) == TLIB_CODE_SNAPSHOT_PAGE_SIZE);
+
+    return page;
+}
+
+size_t tracerCodeSnapshotRead(TracerHandle handle, uintptr_t address, void* buffer, size_t size) {
+    TracerCodeSnapshot* snapshot = (TracerCodeSnapshot*)handle;
+
+    if (!snapshot || !buffer) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    tracerCodeSnapshotCheckModules(snapshot);
+
+    size_t bytesRead = 0;
+
+    while (bytesRead < size) {
+        uintptr_t currentAddress = address + bytesRead;
+        uintptr_t pageAddress = currentAddress & ~(uintptr_t)(TLIB_CODE_SNAPSHOT_PAGE_SIZE - 1);
+
+        const TracerCodePage* page = tracerCodeSnapshotGetPage(snapshot, pageAddress);
+
+        if (!page->mIsReadable) {
+            // Return what we got so far, instructions at the end of a region are still decodable
+            break;
+        }
+
+        size_t pageOffset = currentAddress - pageAddress;
+        size_t length = min(size - bytesRead, TLIB_CODE_SNAPSHOT_PAGE_SIZE - pageOffset);
+
+        memcpy((uint8_t*)buffer + bytesRead, page->mData + pageOffset, length);
+        bytesRead += length;
+    }
+
+    if (!bytesRead) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+    }
+
+    return bytesRead;
+}
@@ -1,9 +1,17 @@
 #include <tracer_lib/core.h>
+#include <tracer_lib/pool.h>
+#include <tracer_lib/hwbp.h>
+#include <tracer_lib/vetrace.h>
 
 #include <assert.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <stdio.h>
 
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
 #include <Zydis/Zydis.h>
 
 /*
@@ -12,9 +20,6 @@
  *
  */
 
-static CRITICAL_SECTION gLinkedListCritSect;
-static TracerBaseContext* gLinkedListHead = NULL;
-
 TracerContext* tracerCoreCreateContext(int type, int size) {
     assert(size >= sizeof(TracerBaseContext));
 
@@ -28,16 +33,6 @@ TracerContext* tracerCoreCreateContext(int type, int size) {
     ctx->mTypeFlags = type;
     ctx->mCleanup = tracerCoreCleanupContext;
 
-    EnterCriticalSection(&gLinkedListCritSect);
-
-    if (gLinkedListHead) {
-        ctx->mNextLink = gLinkedListHead;
-        gLinkedListHead->mPrevLink = ctx;
-    }
-    gLinkedListHead = ctx;
-
-    LeaveCriticalSection(&gLinkedListCritSect);
-
     return (TracerContext*)ctx;
 }
 
@@ -46,22 +41,6 @@ void tracerCoreCleanupContext(TracerContext* ctx) {
         tracerCoreSetLastError(eTracerErrorInvalidArgument);
         return;
     }
-
-    EnterCriticalSection(&gLinkedListCritSect);
-
-    TracerBaseContext* base = (TracerBaseContext*)ctx;
-    if (base->mPrevLink) {
-        base->mPrevLink->mNextLink = base->mNextLink;
-    }
-    if (base->mNextLink) {
-        base->mNextLink->mPrevLink = base->mPrevLink;
-    }
-
-    if (base == gLinkedListHead) {
-        gLinkedListHead = base->mNextLink;
-    }
-
-    LeaveCriticalSection(&gLinkedListCritSect);
 }
 
 void tracerCoreDestroyContext(TracerContext* ctx) {
@@ -93,63 +72,122 @@ int tracerCoreGetContextTypeFlags(TracerContext* ctx) {
     return 0;
 }
 
-TracerBool tracerCoreEnumContexts(const TracerContextCallback cb,
-    void* parameter, int type, TracerBool returnAfterFail) {
+/*
+ *
+ * Core utility functions (getter, setter...)
+ *
+ */
 
-    EnterCriticalSection(&gLinkedListCritSect);
+// Allocated on first use and released when the thread detaches. A single TlsGetValue replaces the
+// six of the handler. Implicit __declspec(thread) data isn't set up for a DLL that is loaded with
+// LoadLibrary before Vista, and that is how we get into the target.
+static DWORD gTracerThreadStateTlsIndex = TLS_OUT_OF_INDEXES;
 
-    TracerBool result = eTracerTrue;
-    TracerBaseContext* current = gLinkedListHead;
+static TracerHandle gTracerModuleHandle;
 
-    while (current) {
-        if ((current->mTypeFlags & type) == type &&
-            !cb((TracerContext*)current, parameter)) {
+// The exception handler may not touch the heap, its per-thread memory comes from these pools
+static TracerHandle gTracerThreadStatePool;
+static TracerHandle gTracerShadowStackPool;
 
-            result = eTracerFalse;
+static TracerThreadState* tracerCoreLoadThreadState() {
+    return (TracerThreadState*)TlsGetValue(gTracerThreadStateTlsIndex);
+}
 
-            if (returnAfterFail) {
-                goto cleanup;
-            }
-        }
-        current = current->mNextLink;
+static TracerThreadState* tracerCoreAllocThreadState(TracerBool allowHeap) {
+    TracerThreadState* state = NULL;
+
+    if (gTracerThreadStatePool) {
+        state = (TracerThreadState*)tracerPoolAlloc(gTracerThreadStatePool);
     }
 
-cleanup:
-    LeaveCriticalSection(&gLinkedListCritSect);
-    return result;
+    if (!state && allowHeap) {
+        state = (TracerThreadState*)_aligned_malloc(sizeof(TracerThreadState), TLIB_CORE_CACHE_LINE_SIZE);
+    }
+
+    if (!state) {
+        return NULL;
+    }
+
+    memset(state, 0, sizeof(TracerThreadState));
+    state->mActiveHwBreakpointIndex = -1;
+    state->mSuspendedHwBreakpointIndex = -1;
+
+    TlsSetValue(gTracerThreadStateTlsIndex, state);
+    return state;
 }
 
-/*
- *
- * Core utility functions (getter, setter...)
- *
- */
+static void tracerCoreFreeThreadState() {
+    TracerThreadState* state = tracerCoreLoadThreadState();
 
-static DWORD gTracerLastErrorTlsIndex;
-static DWORD gTracerProcessContextTlsIndex;
-static DWORD gTracerActiveHwBreakpointTlsIndex;
-static DWORD gTracerSuspendedHwBreakpointTlsIndex;
-static DWORD gTracerBranchCallDepthTlsIndex;
-static DWORD gTracerCurrentTraceIdTlsIndex;
+    if (state) {
+        TlsSetValue(gTracerThreadStateTlsIndex, NULL);
 
-static TracerHandle gTracerModuleHandle;
+        tracerPoolFree(gTracerShadowStackPool, state->mShadowStack);
 
-void tracerCoreSetLastError(TracerError error) {
-    TlsSetValue(gTracerLastErrorTlsIndex, (LPVOID)(int)error);
+        if (tracerPoolOwns(gTracerThreadStatePool, state)) {
+            tracerPoolFree(gTracerThreadStatePool, state);
+        } else {
+            _aligned_free(state);
+        }
+    }
 }
 
-TracerError tracerCoreGetLastError() {
-    return (TracerError)(int)TlsGetValue(gTracerLastErrorTlsIndex);
+#ifdef _DEBUG
+static _CRT_ALLOC_HOOK gTracerPrevAllocHook;
+
+static int __cdecl tracerCoreAllocHook(int allocType, void* userData, size_t size, int blockType,
+    long requestNumber, const unsigned char* fileName, int lineNumber) {
+
+    // Anything that reaches the heap from inside the exception handler can deadlock the traced thread.
+    // The depth is cleared first, the assertion itself may allocate.
+    TracerThreadState* state = tracerCoreLoadThreadState();
+
+    if (state && state->mHotPathDepth) {
+        state->mHotPathDepth = 0;
+        assert(!"Heap call on the hot path");
+    }
+
+    return gTracerPrevAllocHook ? gTracerPrevAllocHook(allocType, userData, size,
+        blockType, requestNumber, fileName, lineNumber) : TRUE;
 }
 
-void tracerCoreSetProcessContext(TracerContext* ctx) {
-    if (!ctx || tracerCoreValidateContext(ctx, eTracerProcessContext)) {
-        TlsSetValue(gTracerProcessContextTlsIndex, ctx);
+void tracerCoreEnterHotPath() {
+    TracerThreadState* state = tracerCoreGetThreadState();
+    if (state) {
+        ++state->mHotPathDepth;
     }
 }
 
-TracerContext* tracerCoreGetProcessContext() {
-    return (TracerContext*)TlsGetValue(gTracerProcessContextTlsIndex);
+void tracerCoreLeaveHotPath() {
+    TracerThreadState* state = tracerCoreLoadThreadState();
+    if (state && state->mHotPathDepth) {
+        --state->mHotPathDepth;
+    }
+}
+#endif
+
+TracerThreadState* tracerCoreGetThreadState() {
+    TracerThreadState* state = tracerCoreLoadThreadState();
+    return state ? state : tracerCoreAllocThreadState(eTracerFalse);
+}
+
+void tracerCoreSetLastError(TracerError error) {
+    TracerThreadState* state = tracerCoreLoadThreadState();
+
+    // Don't allocate the state just to report that everything went fine
+    if (!state && error == eTracerErrorSuccess) {
+        return;
+    }
+
+    state = state ? state : tracerCoreAllocThreadState(eTracerTrue);
+    if (state) {
+        state->mLastError = error;
+    }
+}
+
+TracerError tracerCoreGetLastError() {
+    TracerThreadState* state = tracerCoreLoadThreadState();
+    return state ? state->mLastError : eTracerErrorSuccess;
 }
 
 TracerHandle tracerCoreGetModuleHandle() {
@@ -157,53 +195,168 @@ TracerHandle tracerCoreGetModuleHandle() {
 }
 
 int tracerCoreGetActiveHwBreakpointIndex() {
-    return ((int)TlsGetValue(gTracerActiveHwBreakpointTlsIndex)) - 1;
+    TracerThreadState* state = tracerCoreLoadThreadState();
+    return state ? state->mActiveHwBreakpointIndex : -1;
 }
 
 void tracerCoreSetActiveHwBreakpointIndex(int index) {
-    TlsSetValue(gTracerActiveHwBreakpointTlsIndex, (LPVOID)(index + 1));
+    TracerThreadState* state = tracerCoreGetThreadState();
+    if (state) {
+        state->mActiveHwBreakpointIndex = index;
+    }
 }
 
 int tracerCoreGetSuspendedHwBreakpointIndex() {
-    return ((int)TlsGetValue(gTracerSuspendedHwBreakpointTlsIndex)) - 1;
+    TracerThreadState* state = tracerCoreLoadThreadState();
+    return state ? state->mSuspendedHwBreakpointIndex : -1;
 }
 
 void tracerCoreSetSuspendedHwBreakpointIndex(int index) {
-    TlsSetValue(gTracerSuspendedHwBreakpointTlsIndex, (LPVOID)(index + 1));
+    TracerThreadState* state = tracerCoreGetThreadState();
+    if (state) {
+        state->mSuspendedHwBreakpointIndex = index;
+    }
 }
 
 int tracerCoreGetCurrentTraceId() {
-    return (int)TlsGetValue(gTracerCurrentTraceIdTlsIndex);
+    TracerThreadState* state = tracerCoreLoadThreadState();
+    return state ? state->mCurrentTraceId : 0;
 }
 
-void tracerCoreOnBeginNewTrace(int breakpointIndex) {
-    tracerCoreSetActiveHwBreakpointIndex(breakpointIndex);
-    TlsSetValue(gTracerBranchCallDepthTlsIndex, (LPVOID)0);
+TracerBool tracerCoreOnBeginNewTrace(int breakpointIndex, uintptr_t stackPointer) {
+    TracerThreadState* state = tracerCoreGetThreadState();
+    if (!state) {
+        return eTracerFalse;
+    }
+
+    TracerShadowStack* shadowStack = state->mShadowStack;
+
+    if (!shadowStack) {
+        // First trace on this thread, the stack is released when the thread detaches
+        shadowStack = (TracerShadowStack*)tracerPoolAlloc(gTracerShadowStackPool);
+        if (!shadowStack) {
+            return eTracerFalse;
+        }
 
-    int traceId = tracerCoreGetCurrentTraceId() + 1;
-    TlsSetValue(gTracerCurrentTraceIdTlsIndex, (LPVOID)traceId);
+        state->mShadowStack = shadowStack;
+    }
+
+    shadowStack->mEntryStackPointer = stackPointer;
+    shadowStack->mNumFrames = 0;
+    shadowStack->mNumOverflowFrames = 0;
+
+    state->mActiveHwBreakpointIndex = breakpointIndex;
+    state->mCurrentTraceId++;
+    return eTracerTrue;
 }
 
 void tracerCoreOnTraceEnded() {
     tracerCoreSetActiveHwBreakpointIndex(-1);
 }
 
+static TracerShadowStack* tracerCoreGetShadowStack() {
+    TracerThreadState* state = tracerCoreLoadThreadState();
+    return state ? state->mShadowStack : NULL;
+}
+
+static int tracerCoreUnwindShadowStack(TracerShadowStack* shadowStack, uintptr_t stackPointer) {
+    int numPopped = 0;
+
+    // Every frame whose return address lies below the current stack pointer has been left already.
+    // This is how we resynchronize after tail calls, longjmp or exception unwinding.
+    while (shadowStack->mNumFrames > 0 &&
+           shadowStack->mFrames[shadowStack->mNumFrames - 1].mStackPointer < stackPointer) {
+
+        --shadowStack->mNumFrames;
+        ++numPopped;
+    }
+
+    if (numPopped) {
+        // Overflowed frames are nested deeper than any recorded frame, so they are gone as well
+        shadowStack->mNumOverflowFrames = 0;
+    }
+
+    return numPopped;
+}
+
 int tracerCoreGetBranchCallDepth() {
-    return (int)TlsGetValue(gTracerBranchCallDepthTlsIndex);
+    TracerShadowStack* shadowStack = tracerCoreGetShadowStack();
+    return shadowStack ? shadowStack->mNumFrames + shadowStack->mNumOverflowFrames : 0;
 }
 
-int tracerCoreOnBranchEntered() {
-    int callDepth = tracerCoreGetBranchCallDepth();
-    TlsSetValue(gTracerBranchCallDepthTlsIndex, (LPVOID)(callDepth + 1));
-    return callDepth;
+uintptr_t tracerCoreGetTraceEntryStackPointer() {
+    TracerShadowStack* shadowStack = tracerCoreGetShadowStack();
+    return shadowStack ? shadowStack->mEntryStackPointer : 0;
 }
 
-int tracerCoreOnBranchReturned() {
-    int callDepth = tracerCoreGetBranchCallDepth();
-    TlsSetValue(gTracerBranchCallDepthTlsIndex, (LPVOID)(callDepth - 1));
+void tracerCoreSyncShadowStack(uintptr_t stackPointer) {
+    TracerShadowStack* shadowStack = tracerCoreGetShadowStack();
+
+    if (shadowStack) {
+        tracerCoreUnwindShadowStack(shadowStack, stackPointer);
+    }
+}
+
+int tracerCoreOnBranchEntered(uintptr_t returnAddress, uintptr_t stackPointer) {
+    TracerShadowStack* shadowStack = tracerCoreGetShadowStack();
+
+    if (!shadowStack) {
+        return 0;
+    }
+
+    tracerCoreUnwindShadowStack(shadowStack, stackPointer);
+
+    int callDepth = shadowStack->mNumFrames + shadowStack->mNumOverflowFrames;
+
+    if (shadowStack->mNumFrames < TLIB_CORE_SHADOW_STACK_SIZE && !shadowStack->mNumOverflowFrames) {
+        TracerShadowFrame* frame = &shadowStack->mFrames[shadowStack->mNumFrames++];
+        frame->mReturnAddress = returnAddress;
+        frame->mStackPointer = stackPointer;
+    } else {
+        ++shadowStack->mNumOverflowFrames;
+    }
+
     return callDepth;
 }
 
+int tracerCoreOnBranchReturned(uintptr_t returnAddress, uintptr_t stackPointer, TracerBool* matched) {
+    TracerShadowStack* shadowStack = tracerCoreGetShadowStack();
+
+    if (matched) {
+        *matched = eTracerFalse;
+    }
+
+    if (!shadowStack) {
+        return 0;
+    }
+
+    int overflowDepth = shadowStack->mNumOverflowFrames;
+
+    if (tracerCoreUnwindShadowStack(shadowStack, stackPointer)) {
+        // The frame that we returned from is the last one popped by the unwind
+        if (matched) {
+            *matched = (shadowStack->mFrames[shadowStack->mNumFrames].mReturnAddress == returnAddress);
+        }
+
+        // Report the depth of the frame that we returned from
+        return shadowStack->mNumFrames + 1;
+    }
+
+    if (overflowDepth > 0) {
+        // Returned from a call that was nested too deep to be recorded
+        --shadowStack->mNumOverflowFrames;
+
+        if (matched) {
+            *matched = eTracerTrue;
+        }
+
+        return shadowStack->mNumFrames + overflowDepth;
+    }
+
+    // Returned from a frame that we never saw being entered (e.g. the traced function itself)
+    return shadowStack->mNumFrames;
+}
+
 typedef struct TracerEnumWindowsParams {
     int             mProcessId;
     TracerHandle    mWindowHandle;
@@ -274,65 +427,211 @@ TracerBool tracerCoreSetPrivilege(TracerHandle process, const tchar* privilege,
  *
  */
 
-#define CONTEXT_TABLE_SIZE 4091
+#define TLIB_CORE_CONTEXT_TABLE_MIN_SIZE    64
+
+typedef struct TracerContextEntry {
+    int                     mProcessId;
+    uint32_t                mGeneration;    // Unique per registration, never 0
+    TracerContext*          mContext;
+} TracerContextEntry;
 
-typedef struct TracerContextBlock {
-    int                     mProcessId;  //< Key
-    TracerContext*          mContext;    //< Value
-} TracerContextBlock;
+typedef struct TracerContextRegistry {
+    uint32_t*               mSlots;         // Open addressing, power of two size. Index into mEntries + 1, 0 if free
+    size_t                  mNumSlots;
+
+    TracerContextEntry*     mEntries;       // Dense array of the attached processes
+    size_t                  mNumEntries;
+    size_t                  mMaxEntries;
+    uint32_t                mLastGeneration;
+} TracerContextRegistry;
 
 static CRITICAL_SECTION gProcessContextCritSect;
-static TracerContextBlock gProcessContexts[CONTEXT_TABLE_SIZE];
+static CRITICAL_SECTION gProcessAttachCritSect;
+static CRITICAL_SECTION gDbgHelpCritSect;
+static TracerContextRegistry gProcessContexts;
+
+static size_t tracerCoreHashProcessId(int pid, size_t numSlots) {
+    // Process ids are multiples of four, spread them over the whole table
+    uint32_t hash = (uint32_t)pid * 0x9E3779B1u;
+    return (size_t)(hash ^ (hash >> 16)) & (numSlots - 1);
+}
+
+static size_t tracerCoreFindContextSlot(const TracerContextRegistry* registry, int pid) {
+    size_t slot = tracerCoreHashProcessId(pid, registry->mNumSlots);
+
+    // The table never runs full, so there always is a free slot to stop at
+    while (registry->mSlots[slot] && registry->mEntries[registry->mSlots[slot] - 1].mProcessId != pid) {
+        slot = (slot + 1) & (registry->mNumSlots - 1);
+    }
+    return slot;
+}
+
+static TracerContextEntry* tracerCoreFindContextEntry(const TracerContextRegistry* registry, int pid) {
+    if (!registry->mNumEntries) {
+        return NULL;
+    }
+
+    size_t slot = tracerCoreFindContextSlot(registry, pid);
+    return registry->mSlots[slot] ? &registry->mEntries[registry->mSlots[slot] - 1] : NULL;
+}
+
+static uint32_t tracerCoreNextContextGeneration(TracerContextRegistry* registry) {
+    if (!++registry->mLastGeneration) {
+        ++registry->mLastGeneration;
+    }
+    return registry->mLastGeneration;
+}
+
+static TracerBool tracerCoreResizeContextSlots(TracerContextRegistry* registry, size_t numSlots) {
+    uint32_t* slots = (uint32_t*)calloc(numSlots, sizeof(uint32_t));
+
+    if (!slots) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    free(registry->mSlots);
+    registry->mSlots = slots;
+    registry->mNumSlots = numSlots;
+
+    for (size_t i = 0; i < registry->mNumEntries; ++i) {
+        registry->mSlots[tracerCoreFindContextSlot(registry, registry->mEntries[i].mProcessId)] = (uint32_t)(i + 1);
+    }
+    return eTracerTrue;
+}
 
-static TracerContextBlock* tracerCoreGetContextBlock(int pid, TracerBool firstFree) {
-    TracerContextBlock* current;
-    int startBlock = pid % CONTEXT_TABLE_SIZE;
-    int currentBlock = startBlock;
+static TracerBool tracerCoreInsertContext(TracerContextRegistry* registry, int pid, TracerContext* ctx) {
+    // Keep the load factor at or below one half, the probe sequences stay short
+    if ((registry->mNumEntries + 1) * 2 > registry->mNumSlots) {
+        size_t numSlots = registry->mNumSlots ? registry->mNumSlots * 2 : TLIB_CORE_CONTEXT_TABLE_MIN_SIZE;
 
-    do {
-        current = &gProcessContexts[currentBlock];
-        if (current->mProcessId == pid) {
-            return current;
+        if (!tracerCoreResizeContextSlots(registry, numSlots)) {
+            return eTracerFalse;
         }
+    }
+
+    if (registry->mNumEntries == registry->mMaxEntries) {
+        size_t maxEntries = registry->mMaxEntries ? registry->mMaxEntries * 2 : TLIB_CORE_CONTEXT_TABLE_MIN_SIZE / 2;
+
+        TracerContextEntry* entries = (TracerContextEntry*)realloc(registry->mEntries, maxEntries * sizeof(TracerContextEntry));
 
-        if (firstFree && !current->mContext) {
-            return current;
+        if (!entries) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            return eTracerFalse;
         }
 
-        currentBlock = (currentBlock + 1) % CONTEXT_TABLE_SIZE;
-    } while (current->mProcessId && currentBlock != startBlock);
+        registry->mEntries = entries;
+        registry->mMaxEntries = maxEntries;
+    }
+
+    TracerContextEntry* entry = &registry->mEntries[registry->mNumEntries++];
+    entry->mProcessId = pid;
+    entry->mGeneration = tracerCoreNextContextGeneration(registry);
+    entry->mContext = ctx;
 
-    return NULL;
+    registry->mSlots[tracerCoreFindContextSlot(registry, pid)] = (uint32_t)registry->mNumEntries;
+    return eTracerTrue;
+}
+
+static void tracerCoreRemoveContext(TracerContextRegistry* registry, size_t slot) {
+    size_t mask = registry->mNumSlots - 1;
+    size_t index = registry->mSlots[slot] - 1;
+
+    // Shift the following entries of the probe sequence back instead of leaving a tombstone behind
+    size_t hole = slot;
+    size_t next = (slot + 1) & mask;
+
+    while (registry->mSlots[next]) {
+        int pid = registry->mEntries[registry->mSlots[next] - 1].mProcessId;
+        size_t home = tracerCoreHashProcessId(pid, registry->mNumSlots);
+
+        // The entry may only move if its home slot isn't within (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            registry->mSlots[hole] = registry->mSlots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    registry->mSlots[hole] = 0;
+
+    // Fill the hole in the dense array with its last entry
+    size_t lastIndex = --registry->mNumEntries;
+
+    if (index != lastIndex) {
+        registry->mEntries[index] = registry->mEntries[lastIndex];
+        registry->mSlots[tracerCoreFindContextSlot(registry, registry->mEntries[index].mProcessId)] = (uint32_t)(index + 1);
+    }
 }
 
 TracerContext* tracerCoreGetContextForPID(int pid) {
-    TracerContextBlock* block = tracerCoreGetContextBlock(pid, eTracerFalse);
-    return block ? block->mContext : NULL;
+    const TracerContextEntry* entry = tracerCoreFindContextEntry(&gProcessContexts, pid);
+    return entry ? entry->mContext : NULL;
+}
+
+uint32_t tracerCoreGetContextGeneration(int pid, TracerContext* ctx) {
+    const TracerContextEntry* entry = tracerCoreFindContextEntry(&gProcessContexts, pid);
+    return (entry && entry->mContext == ctx) ? entry->mGeneration : 0;
 }
 
-void tracerCoreSetContextForPID(int pid, TracerContext* ctx) {
-    // Try to find a matching block
-    TracerContextBlock* block = tracerCoreGetContextBlock(pid, eTracerFalse);
+TracerBool tracerCoreSetContextForPID(int pid, TracerContext* ctx) {
+    TracerContextRegistry* registry = &gProcessContexts;
+    size_t slot = registry->mNumSlots ? tracerCoreFindContextSlot(registry, pid) : 0;
 
-    // No match, try to find an unused block
-    if (!block) {
-        block = tracerCoreGetContextBlock(pid, eTracerTrue);
+    if (registry->mNumSlots && registry->mSlots[slot]) {
+        if (ctx) {
+            TracerContextEntry* entry = &registry->mEntries[registry->mSlots[slot] - 1];
+
+            if (entry->mContext != ctx) {
+                entry->mGeneration = tracerCoreNextContextGeneration(registry);
+                entry->mContext = ctx;
+            }
+        } else {
+            tracerCoreRemoveContext(registry, slot);
+        }
+        return eTracerTrue;
+    }
+
+    return ctx ? tracerCoreInsertContext(registry, pid, ctx) : eTracerTrue;
+}
+
+void tracerCoreSetProcessContext(int pid, uint32_t generation) {
+    TracerThreadState* state = tracerCoreLoadThreadState();
+
+    if (!state && generation) {
+        state = tracerCoreAllocThreadState(eTracerTrue);
     }
 
-    if (block) {
-        block->mProcessId = pid;
-        block->mContext = ctx;
+    if (state) {
+        state->mProcessId = pid;
+        state->mProcessGeneration = generation;
     }
 }
 
+TracerContext* tracerCoreGetProcessContext() {
+    TracerThreadState* state = tracerCoreLoadThreadState();
+
+    if (!state || !state->mProcessGeneration) {
+        return NULL;
+    }
+
+    // A process that was detached and attached again is registered with a new generation
+    const TracerContextEntry* entry = tracerCoreFindContextEntry(&gProcessContexts, state->mProcessId);
+    return (entry && entry->mGeneration == state->mProcessGeneration) ? entry->mContext : NULL;
+}
+
 TracerBool tracerCoreEnumProcessContexts(const TracerContextCallback cb,
     void* parameter, TracerBool returnAfterFail) {
 
     TracerBool result = eTracerTrue;
 
-    for (int i = 0; i < CONTEXT_TABLE_SIZE; ++i) {
-        TracerContextBlock* block = &gProcessContexts[i];
-        if (block->mContext && !cb(block->mContext, parameter)) {
+    // Walk backwards, the callback may remove its own context (the last entry takes its place)
+    for (size_t i = gProcessContexts.mNumEntries; i > 0; --i) {
+        if (i > gProcessContexts.mNumEntries) {
+            continue;
+        }
+
+        if (!cb(gProcessContexts.mEntries[i - 1].mContext, parameter)) {
             result = eTracerFalse;
 
             if (returnAfterFail) {
@@ -345,6 +644,19 @@ cleanup:
     return result;
 }
 
+TracerBool tracerCoreIsContextRegistered(TracerContext* ctx) {
+    for (size_t i = 0; i < gProcessContexts.mNumEntries; ++i) {
+        if (gProcessContexts.mEntries[i].mContext == ctx) {
+            return eTracerTrue;
+        }
+    }
+    return eTracerFalse;
+}
+
+size_t tracerCoreGetNumProcessContexts() {
+    return gProcessContexts.mNumEntries;
+}
+
 void tracerCoreAcquireProcessContextLock() {
     EnterCriticalSection(&gProcessContextCritSect);
 }
@@ -353,6 +665,22 @@ void tracerCoreReleaseProcessContextLock() {
     LeaveCriticalSection(&gProcessContextCritSect);
 }
 
+void tracerCoreAcquireProcessAttachLock() {
+    EnterCriticalSection(&gProcessAttachCritSect);
+}
+
+void tracerCoreReleaseProcessAttachLock() {
+    LeaveCriticalSection(&gProcessAttachCritSect);
+}
+
+void tracerCoreAcquireDbgHelpLock() {
+    EnterCriticalSection(&gDbgHelpCritSect);
+}
+
+void tracerCoreReleaseDbgHelpLock() {
+    LeaveCriticalSection(&gDbgHelpCritSect);
+}
+
 /*
  *
  * DllMain entry point
@@ -362,37 +690,73 @@ void tracerCoreReleaseProcessContextLock() {
 BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved) {
     switch (reason) {
     case DLL_PROCESS_ATTACH:
-        InitializeCriticalSection(&gLinkedListCritSect);
         InitializeCriticalSection(&gProcessContextCritSect);
+        InitializeCriticalSection(&gProcessAttachCritSect);
+        InitializeCriticalSection(&gDbgHelpCritSect);
 
-        gTracerModuleHandle = instance;
-        gTracerLastErrorTlsIndex = TlsAlloc();
-        gTracerProcessContextTlsIndex = TlsAlloc();
-        gTracerActiveHwBreakpointTlsIndex = TlsAlloc();
-        gTracerSuspendedHwBreakpointTlsIndex = TlsAlloc();
-        gTracerBranchCallDepthTlsIndex = TlsAlloc();
-        gTracerCurrentTraceIdTlsIndex = TlsAlloc();
-
-        if (gTracerLastErrorTlsIndex == TLS_OUT_OF_INDEXES ||
-            gTracerProcessContextTlsIndex == TLS_OUT_OF_INDEXES ||
-            gTracerActiveHwBreakpointTlsIndex == TLS_OUT_OF_INDEXES ||
-            gTracerSuspendedHwBreakpointTlsIndex == TLS_OUT_OF_INDEXES ||
-            gTracerBranchCallDepthTlsIndex == TLS_OUT_OF_INDEXES ||
-            gTracerCurrentTraceIdTlsIndex == TLS_OUT_OF_INDEXES) {
+        gTracerThreadStateTlsIndex = TlsAlloc();
+
+        if (gTracerThreadStateTlsIndex == TLS_OUT_OF_INDEXES) {
+            return FALSE;
+        }
+
+        gTracerThreadStatePool = tracerCreatePool(sizeof(TracerThreadState),
+            TLIB_CORE_CACHE_LINE_SIZE, TLIB_CORE_MAX_THREAD_STATES);
+        gTracerShadowStackPool = tracerCreatePool(sizeof(TracerShadowStack), 0, TLIB_CORE_MAX_SHADOW_STACKS);
 
+        if (!gTracerThreadStatePool || !gTracerShadowStackPool || !tracerHwBreakpointInit()) {
             return FALSE;
         }
+
+#ifdef _DEBUG
+        gTracerPrevAllocHook = _CrtSetAllocHook(tracerCoreAllocHook);
+#endif
+
+        gTracerModuleHandle = instance;
         break;
     case DLL_PROCESS_DETACH:
-        TlsFree(gTracerLastErrorTlsIndex);
-        TlsFree(gTracerProcessContextTlsIndex);
-        TlsFree(gTracerActiveHwBreakpointTlsIndex);
-        TlsFree(gTracerSuspendedHwBreakpointTlsIndex);
-        TlsFree(gTracerBranchCallDepthTlsIndex);
-        TlsFree(gTracerCurrentTraceIdTlsIndex);
+        if (gTracerThreadStateTlsIndex == TLS_OUT_OF_INDEXES) {
+            break;
+        }
 
+        tracerCoreFreeThreadState();
+
+#ifdef _DEBUG
+        _CrtSetAllocHook(gTracerPrevAllocHook);
+#endif
+
+        tracerHwBreakpointShutdown();
+
+        // Also called if the attach failed, the pools may not exist
+        if (gTracerShadowStackPool) {
+            tracerDestroyPool(gTracerShadowStackPool);
+        }
+
+        if (gTracerThreadStatePool) {
+            tracerDestroyPool(gTracerThreadStatePool);
+        }
+
+        gTracerShadowStackPool = NULL;
+        gTracerThreadStatePool = NULL;
+
+        TlsFree(gTracerThreadStateTlsIndex);
+        gTracerThreadStateTlsIndex = TLS_OUT_OF_INDEXES;
+
+        free(gProcessContexts.mSlots);
+        free(gProcessContexts.mEntries);
+        memset(&gProcessContexts, 0, sizeof(gProcessContexts));
+
+        DeleteCriticalSection(&gDbgHelpCritSect);
+        DeleteCriticalSection(&gProcessAttachCritSect);
         DeleteCriticalSection(&gProcessContextCritSect);
-        DeleteCriticalSection(&gLinkedListCritSect);
+        break;
+    case DLL_THREAD_ATTACH:
+        tracerHwBreakpointOnThreadAttach();
+        break;
+    case DLL_THREAD_DETACH:
+        tracerHwBreakpointOnThreadDetach();
+        tracerVeTraceOnThreadDetach();
+        tracerCoreFreeThreadState();
         break;
     default:
         break;
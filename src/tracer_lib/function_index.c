@@ -0,0 +1,397 @@
+
+#include <tracer_lib/function_index.h>
+#include <tracer_lib/pe_image.h>
+#include <tracer_lib/symbol_resolver.h>
+#include <tracer_lib/lde.h>
+
+#define TLIB_FUNCTION_INDEX_ALIGNMENT       16
+
+typedef struct TracerFunctionIndex {
+    uintptr_t                       mModuleBase;
+    size_t                          mSizeOfImage;
+    uint32_t                        mTimeDateStamp;
+
+    TracerPeSection                 mCode[TLIB_PE_IMAGE_MAX_SECTIONS];      // Executable sections only
+    size_t                          mNumCode;
+
+    uintptr_t*                      mStarts;                // Sorted, without duplicates
+    size_t                          mNumStarts;
+    size_t                          mMaxStarts;
+} TracerFunctionIndex;
+
+typedef struct TracerFunctionIndexBuild {
+    TracerFunctionIndex*            mIndex;
+    uint8_t*                        mCode[TLIB_PE_IMAGE_MAX_SECTIONS];      // Copies of the executable sections
+
+    uintptr_t*                      mCallTargets;
+    size_t                          mNumCallTargets;
+    size_t                          mMaxCallTargets;
+
+    TracerBool                      mOutOfMemory;
+} TracerFunctionIndexBuild;
+
+typedef struct TracerFunctionPrologue {
+    const uint8_t*                  mBytes;
+    size_t                          mSize;
+} TracerFunctionPrologue;
+
+static const TracerFunctionPrologue gTracerFunctionPrologues[] = {
+    { (const uint8_t*)"\x8B\xFF\x55\x8B\xEC", 5 },    // mov edi, edi; push ebp; mov ebp, esp
+    { (const uint8_t*)"\x55\x8B\xEC", 3 },            // push ebp; mov ebp, esp
+    { (const uint8_t*)"\x55\x89\xE5", 3 },            // push ebp; mov ebp, esp (other encoding)
+    { (const uint8_t*)"\x56\x8B\xF1", 3 },            // push esi; mov esi, ecx
+    { (const uint8_t*)"\x53\x8B\xDC", 3 },            // push ebx; mov ebx, esp
+};
+
+static TracerBool tracerFunctionIndexAppend(uintptr_t** addresses, size_t* numAddresses, size_t* maxAddresses, uintptr_t address) {
+    if (*numAddresses == *maxAddresses) {
+        size_t maxElements = *maxAddresses ? *maxAddresses * 2 : 1024;
+
+        uintptr_t* elements = (uintptr_t*)realloc(*addresses, maxElements * sizeof(uintptr_t));
+
+        if (!elements) {
+            return eTracerFalse;
+        }
+
+        *addresses = elements;
+        *maxAddresses = maxElements;
+    }
+
+    (*addresses)[(*numAddresses)++] = address;
+    return eTracerTrue;
+}
+
+static int tracerFunctionIndexCompareAddresses(const void* lhs, const void* rhs) {
+    uintptr_t a = *(const uintptr_t*)lhs;
+    uintptr_t b = *(const uintptr_t*)rhs;
+
+    return (a > b) - (a < b);
+}
+
+static const TracerPeSection* tracerFunctionIndexFindSection(const TracerFunctionIndex* index, uintptr_t address, size_t* sectionIndex) {
+    if (address < index->mModuleBase) {
+        return NULL;
+    }
+
+    uintptr_t rva = address - index->mModuleBase;
+
+    for (size_t i = 0; i < index->mNumCode; ++i) {
+        const TracerPeSection* section = &index->mCode[i];
+
+        if (rva >= section->mRva && rva - section->mRva < section->mSize) {
+            if (sectionIndex) {
+                *sectionIndex = i;
+            }
+            return section;
+        }
+    }
+    return NULL;
+}
+
+static void tracerFunctionIndexAddStart(TracerFunctionIndexBuild* build, uintptr_t address) {
+    TracerFunctionIndex* index = build->mIndex;
+
+    // Data exports and symbols of other sections don't start any code
+    if (!tracerFunctionIndexFindSection(index, address, NULL)) {
+        return;
+    }
+
+    if (!tracerFunctionIndexAppend(&index->mStarts, &index->mNumStarts, &index->mMaxStarts, address)) {
+        build->mOutOfMemory = eTracerTrue;
+    }
+}
+
+static void tracerFunctionIndexOnExport(uintptr_t address, const char* name, void* userData) {
+    tracerFunctionIndexAddStart((TracerFunctionIndexBuild*)userData, address);
+}
+
+static TracerBool tracerFunctionIndexIsPadding(uint8_t value) {
+    // int3, nop and ret are what the linker leaves in front of a function
+    return value == 0xCC || value == 0x90 || value == 0xC3;
+}
+
+static TracerBool tracerFunctionIndexHasPrologue(const uint8_t* code, size_t remaining) {
+    for (size_t i = 0; i < _countof(gTracerFunctionPrologues); ++i) {
+        const TracerFunctionPrologue* prologue = &gTracerFunctionPrologues[i];
+
+        if (remaining >= prologue->mSize && !memcmp(code, prologue->mBytes, prologue->mSize)) {
+            return eTracerTrue;
+        }
+    }
+    return eTracerFalse;
+}
+
+static TracerBool tracerFunctionIndexLooksLikeStart(const TracerFunctionIndexBuild* build, uintptr_t address) {
+    size_t sectionIndex = 0;
+    const TracerPeSection* section = tracerFunctionIndexFindSection(build->mIndex, address, &sectionIndex);
+
+    if (!section) {
+        return eTracerFalse;
+    }
+
+    size_t offset = (size_t)(address - build->mIndex->mModuleBase - section->mRva);
+    const uint8_t* code = build->mCode[sectionIndex];
+
+    if (offset == 0 || tracerFunctionIndexIsPadding(code[offset - 1])) {
+        return eTracerTrue;
+    }
+    return tracerFunctionIndexHasPrologue(code + offset, section->mSize - offset);
+}
+
+static void tracerFunctionIndexSweep(TracerFunctionIndexBuild* build, size_t sectionIndex) {
+    TracerFunctionIndex* index = build->mIndex;
+
+    const TracerPeSection* section = &index->mCode[sectionIndex];
+    const uint8_t* code = build->mCode[sectionIndex];
+
+    uintptr_t address = index->mModuleBase + section->mRva;
+    size_t offset = 0;
+
+    while (offset < section->mSize && !build->mOutOfMemory) {
+        // A prologue right behind padding at an aligned address is most likely a function nobody calls directly
+        if (offset && !((address + offset) % TLIB_FUNCTION_INDEX_ALIGNMENT) &&
+            tracerFunctionIndexIsPadding(code[offset - 1]) &&
+            tracerFunctionIndexHasPrologue(code + offset, section->mSize - offset)) {
+
+            tracerFunctionIndexAddStart(build, address + offset);
+        }
+
+        TracerLdeInstruction instruction;
+
+        if (!tracerLdeDecode(code + offset, section->mSize - offset, TLIB_LDE_MODE_NATIVE, &instruction)) {
+            // Data within the code section, resynchronize on the next byte
+            ++offset;
+            continue;
+        }
+
+        // Operands aren't decoded, take the target of call rel32 from the bytes
+        if (instruction.mFlow == eTracerLdeFlowCall && instruction.mLength == 5 && code[offset] == 0xE8) {
+            int32_t displacement;
+            memcpy(&displacement, code + offset + 1, sizeof(displacement));
+
+            uintptr_t target = address + offset + 5 + (uintptr_t)(intptr_t)displacement;
+
+            if (tracerFunctionIndexFindSection(index, target, NULL) &&
+                !tracerFunctionIndexAppend(&build->mCallTargets, &build->mNumCallTargets, &build->mMaxCallTargets, target)) {
+
+                build->mOutOfMemory = eTracerTrue;
+            }
+        }
+
+        offset += instruction.mLength;
+    }
+}
+
+static void tracerFunctionIndexAddCallTargets(TracerFunctionIndexBuild* build) {
+    qsort(build->mCallTargets, build->mNumCallTargets, sizeof(uintptr_t), tracerFunctionIndexCompareAddresses);
+
+    for (size_t i = 0; i < build->mNumCallTargets && !build->mOutOfMemory;) {
+        uintptr_t target = build->mCallTargets[i];
+        size_t numCallers = 0;
+
+        for (; i < build->mNumCallTargets && build->mCallTargets[i] == target; ++i) {
+            ++numCallers;
+        }
+
+        // A single call into the middle of nowhere is more likely a misaligned sweep than a function
+        if (numCallers >= TLIB_FUNCTION_INDEX_MIN_CALLERS || tracerFunctionIndexLooksLikeStart(build, target)) {
+            tracerFunctionIndexAddStart(build, target);
+        }
+    }
+}
+
+static void tracerFunctionIndexAddSymbols(TracerFunctionIndexBuild* build, TracerHandle symbolResolver) {
+    const TracerSymbolModule* module = tracerResolveModule(symbolResolver, build->mIndex->mModuleBase);
+
+    if (!module) {
+        return;
+    }
+
+    for (size_t i = 0; i < module->mNumSymbols; ++i) {
+        tracerFunctionIndexAddStart(build, module->mSymbols[i].mAddress);
+    }
+}
+
+static void tracerFunctionIndexSortStarts(TracerFunctionIndex* index) {
+    qsort(index->mStarts, index->mNumStarts, sizeof(uintptr_t), tracerFunctionIndexCompareAddresses);
+
+    size_t numUnique = 0;
+
+    for (size_t i = 0; i < index->mNumStarts; ++i) {
+        if (!numUnique || index->mStarts[numUnique - 1] != index->mStarts[i]) {
+            index->mStarts[numUnique++] = index->mStarts[i];
+        }
+    }
+
+    index->mNumStarts = numUnique;
+}
+
+TracerHandle tracerCreateFunctionIndex(HANDLE process, uintptr_t moduleBase, TracerHandle symbolResolver) {
+    TracerPeImageInfo imageInfo;
+
+    if (!tracerPeReadImageInfo(process, moduleBase, &imageInfo)) {
+        return NULL;
+    }
+
+    TracerFunctionIndex* index = (TracerFunctionIndex*)calloc(1, sizeof(TracerFunctionIndex));
+
+    if (!index) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    index->mModuleBase = moduleBase;
+    index->mSizeOfImage = imageInfo.mSizeOfImage;
+    index->mTimeDateStamp = imageInfo.mTimeDateStamp;
+
+    TracerFunctionIndexBuild build;
+    memset(&build, 0, sizeof(build));
+
+    build.mIndex = index;
+
+    for (size_t i = 0; i < imageInfo.mNumSections; ++i) {
+        const TracerPeSection* section = &imageInfo.mSections[i];
+
+        if (!section->mIsExecutable || !section->mSize || section->mRva + section->mSize > imageInfo.mSizeOfImage) {
+            continue;
+        }
+
+        uint8_t* code = (uint8_t*)malloc(section->mSize);
+        SIZE_T bytesRead = 0;
+
+        if (!code || !ReadProcessMemory(process, (LPCVOID)(moduleBase + section->mRva),
+                code, section->mSize, &bytesRead) || bytesRead != section->mSize) {
+
+            free(code);
+            continue;
+        }
+
+        build.mCode[index->mNumCode] = code;
+        index->mCode[index->mNumCode++] = *section;
+    }
+
+    if (imageInfo.mEntryPointRva) {
+        tracerFunctionIndexAddStart(&build, moduleBase + imageInfo.mEntryPointRva);
+    }
+
+    tracerPeEnumExports(process, &imageInfo, tracerFunctionIndexOnExport, &build);
+
+    if (symbolResolver) {
+        tracerFunctionIndexAddSymbols(&build, symbolResolver);
+    }
+
+    for (size_t i = 0; i < index->mNumCode; ++i) {
+        tracerFunctionIndexSweep(&build, i);
+    }
+
+    tracerFunctionIndexAddCallTargets(&build);
+
+    for (size_t i = 0; i < index->mNumCode; ++i) {
+        free(build.mCode[i]);
+    }
+
+    free(build.mCallTargets);
+
+    if (build.mOutOfMemory) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        tracerDestroyFunctionIndex((TracerHandle)index);
+        return NULL;
+    }
+
+    tracerFunctionIndexSortStarts(index);
+    return (TracerHandle)index;
+}
+
+void tracerDestroyFunctionIndex(TracerHandle handle) {
+    TracerFunctionIndex* index = (TracerFunctionIndex*)handle;
+
+    if (!index) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    free(index->mStarts);
+    free(index);
+}
+
+uintptr_t tracerFunctionIndexGetModuleBase(TracerHandle handle) {
+    TracerFunctionIndex* index = (TracerFunctionIndex*)handle;
+
+    if (!index) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    return index->mModuleBase;
+}
+
+TracerBool tracerFunctionIndexIsCurrent(TracerHandle handle, HANDLE process) {
+    TracerFunctionIndex* index = (TracerFunctionIndex*)handle;
+
+    if (!index) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    IMAGE_DOS_HEADER dosHeader;
+    IMAGE_FILE_HEADER fileHeader;
+    DWORD sizeOfImage = 0;
+
+    // The module might have been unloaded and something else mapped at its address
+    if (!ReadProcessMemory(process, (LPCVOID)index->mModuleBase, &dosHeader, sizeof(dosHeader), NULL) ||
+        dosHeader.e_magic != IMAGE_DOS_SIGNATURE) {
+        return eTracerFalse;
+    }
+
+    uintptr_t ntHeaders = index->mModuleBase + dosHeader.e_lfanew;
+
+    if (!ReadProcessMemory(process, (LPCVOID)(ntHeaders + FIELD_OFFSET(IMAGE_NT_HEADERS, FileHeader)),
+            &fileHeader, sizeof(fileHeader), NULL) ||
+        !ReadProcessMemory(process, (LPCVOID)(ntHeaders + FIELD_OFFSET(IMAGE_NT_HEADERS, OptionalHeader.SizeOfImage)),
+            &sizeOfImage, sizeof(sizeOfImage), NULL)) {
+        return eTracerFalse;
+    }
+
+    return fileHeader.TimeDateStamp == index->mTimeDateStamp && sizeOfImage == index->mSizeOfImage;
+}
+
+uintptr_t tracerFunctionIndexFind(TracerHandle handle, uintptr_t address) {
+    TracerFunctionIndex* index = (TracerFunctionIndex*)handle;
+
+    if (!index) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    const TracerPeSection* section = tracerFunctionIndexFindSection(index, address, NULL);
+
+    if (!section) {
+        return 0;
+    }
+
+    // Find the last start at or below the address
+    size_t low = 0;
+    size_t high = index->mNumStarts;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (index->mStarts[middle] <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (!low) {
+        return 0;
+    }
+
+    uintptr_t start = index->mStarts[low - 1];
+
+    // Functions don't span sections, a start in front of the section belongs to some other code
+    if (start < index->mModuleBase + section->mRva) {
+        return 0;
+    }
+    return start;
+}
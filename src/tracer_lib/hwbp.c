@@ -1,14 +1,82 @@
 
 #include <tracer_lib/hwbp.h>
+#include <tracer_lib/pool.h>
 
 #include <TlHelp32.h>
 
+#define TLIB_HWBP_THREAD_GLOBAL         -2          // Thread id of the first node of a global breakpoint
+
+#define TLIB_HWBP_EXCEPTION_INHERIT     0xE0484250  // Raised by new threads to pick up the global breakpoints
+
 typedef struct TracerHwBreakpoint {
     int                         mIndex;
     int                         mThreadId;
     struct TracerHwBreakpoint*  mNextLink;
+
+    // Only used by the first node of a global breakpoint, new threads are armed from these
+    void*                       mAddress;
+    int                         mLengthBits;
+    TracerHwBpCond              mCondition;
+    struct TracerHwBreakpoint*  mNextGlobal;
 } TracerHwBreakpoint;
 
+typedef struct TracerHwThread {
+    int                         mThreadId;
+    HANDLE                      mThread;
+    TracerBool                  mSuspended;
+} TracerHwThread;
+
+typedef struct TracerHwBatch {
+    TracerHwBreakpointChange*   mChanges;
+    size_t                      mNumChanges;
+    TracerBool                  mResult;
+    TracerError                 mError;
+} TracerHwBatch;
+
+// Breakpoints are released from inside the exception handler, so they never come from the heap
+static TracerHandle gTracerHwBreakpointPool;
+
+// Protects the list of global breakpoints and the thread nodes of each of them
+static CRITICAL_SECTION gTracerHwBreakpointCritSect;
+static TracerHwBreakpoint* gTracerHwGlobalBreakpoints;
+static volatile LONG gTracerHwNumGlobalBreakpoints;
+
+static TracerHandle gTracerHwInheritVehHandle;
+
+// New threads that couldn't get every global breakpoint, the handler has nobody to report it to
+static volatile LONG gTracerHwNumUnarmedThreads;
+
+static LONG CALLBACK tracerHwBreakpointInheritHandler(PEXCEPTION_POINTERS ex);
+
+TracerBool tracerHwBreakpointInit() {
+    InitializeCriticalSection(&gTracerHwBreakpointCritSect);
+
+    gTracerHwBreakpointPool = tracerCreatePool(sizeof(TracerHwBreakpoint), 0, TLIB_HWBP_MAX_BREAKPOINTS);
+    if (!gTracerHwBreakpointPool) {
+        return eTracerFalse;
+    }
+
+    gTracerHwInheritVehHandle = AddVectoredExceptionHandler(TRUE, tracerHwBreakpointInheritHandler);
+    return gTracerHwInheritVehHandle ? eTracerTrue : eTracerFalse;
+}
+
+void tracerHwBreakpointShutdown() {
+    if (gTracerHwInheritVehHandle) {
+        RemoveVectoredExceptionHandler(gTracerHwInheritVehHandle);
+        gTracerHwInheritVehHandle = NULL;
+    }
+
+    if (gTracerHwBreakpointPool) {
+        tracerDestroyPool(gTracerHwBreakpointPool);
+        gTracerHwBreakpointPool = NULL;
+    }
+
+    gTracerHwGlobalBreakpoints = NULL;
+    gTracerHwNumGlobalBreakpoints = 0;
+
+    DeleteCriticalSection(&gTracerHwBreakpointCritSect);
+}
+
 int tracerHwBreakpointGetBits(uintptr_t dw, int lowBit, int bits) {
     uintptr_t mask = (1 << bits) - 1;
     return (dw >> lowBit) & mask;
@@ -19,48 +87,73 @@ void tracerHwBreakpointSetBits(uintptr_t* dw, int lowBit, int bits, int newValue
     *dw = (*dw & ~(mask << lowBit)) | (newValue << lowBit);
 }
 
+static int tracerHwBreakpointEncodeLength(int length) {
+    switch (length) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 3;
+    default: return -1;
+    }
+}
+
+static int tracerHwBreakpointFindFreeIndex(const CONTEXT* ctx) {
+    if (!ctx->Dr0 && !tracerHwBreakpointGetBits(ctx->Dr7, 0 << 1, 1)) {
+        return 0;
+    } else if (!ctx->Dr1 && !tracerHwBreakpointGetBits(ctx->Dr7, 1 << 1, 1)) {
+        return 1;
+    } else if (!ctx->Dr2 && !tracerHwBreakpointGetBits(ctx->Dr7, 2 << 1, 1)) {
+        return 2;
+    } else if (!ctx->Dr3 && !tracerHwBreakpointGetBits(ctx->Dr7, 3 << 1, 1)) {
+        return 3;
+    }
+    return -1;
+}
+
+static void tracerHwBreakpointWrite(PCONTEXT ctx, int index, void* address, int lengthBits, TracerHwBpCond cond) {
+    switch (index) {
+    case 0: ctx->Dr0 = (uintptr_t)address; break;
+    case 1: ctx->Dr1 = (uintptr_t)address; break;
+    case 2: ctx->Dr2 = (uintptr_t)address; break;
+    case 3: ctx->Dr3 = (uintptr_t)address; break;
+    default: assert(FALSE);
+    }
+
+    tracerHwBreakpointSetBits(&ctx->Dr7, 16 | (index << 2), 2, (int)cond);
+    tracerHwBreakpointSetBits(&ctx->Dr7, 18 | (index << 2), 2, lengthBits);
+    tracerHwBreakpointSetBits(&ctx->Dr7, index << 1, 1, 1);
+}
+
+static void tracerHwBreakpointClear(PCONTEXT ctx, int index) {
+    switch (index) {
+    case 0: ctx->Dr0 = 0; break;
+    case 1: ctx->Dr1 = 0; break;
+    case 2: ctx->Dr2 = 0; break;
+    case 3: ctx->Dr3 = 0; break;
+    default: assert(FALSE);
+    }
+
+    // Clear enabled bit for this breakpoint
+    tracerHwBreakpointSetBits(&ctx->Dr7, index << 1, 1, 0);
+}
+
 int tracerSetHwBreakpointOnContext(void* address, int length, PCONTEXT ctx, TracerHwBpCond cond) {
     if (!address) {
         tracerCoreSetLastError(eTracerErrorInvalidArgument);
         return -1;
     }
 
-    switch (length) {
-    case 1: length = 0; break;
-    case 2: length = 1; break;
-    case 4: length = 3; break;
-    default:
+    int lengthBits = tracerHwBreakpointEncodeLength(length);
+
+    if (lengthBits < 0) {
         tracerCoreSetLastError(eTracerErrorInvalidArgument);
         return -1;
     }
 
     // Find first available hardware register index
-    int index = -1;
-
-    if (!ctx->Dr0 && !tracerHwBreakpointGetBits(ctx->Dr7, 0 << 1, 1)) {
-        index = 0;
-    } else if (!ctx->Dr1 && !tracerHwBreakpointGetBits(ctx->Dr7, 1 << 1, 1)) {
-        index = 1;
-    } else if (!ctx->Dr2 && !tracerHwBreakpointGetBits(ctx->Dr7, 2 << 1, 1)) {
-        index = 2;
-    } else if (!ctx->Dr3 && !tracerHwBreakpointGetBits(ctx->Dr7, 3 << 1, 1)) {
-        index = 3;
-    }
+    int index = tracerHwBreakpointFindFreeIndex(ctx);
 
     if (index >= 0) {
-
-        switch (index) {
-        case 0: ctx->Dr0 = (uintptr_t)address; break;
-        case 1: ctx->Dr1 = (uintptr_t)address; break;
-        case 2: ctx->Dr2 = (uintptr_t)address; break;
-        case 3: ctx->Dr3 = (uintptr_t)address; break;
-        default: assert(FALSE);
-        }
-
-        tracerHwBreakpointSetBits(&ctx->Dr7, 16 | (index << 2), 2, (int)cond);
-        tracerHwBreakpointSetBits(&ctx->Dr7, 18 | (index << 2), 2, length);
-        tracerHwBreakpointSetBits(&ctx->Dr7, index << 1, 1, 1);
-
+        tracerHwBreakpointWrite(ctx, index, address, lengthBits, cond);
         return index;
 
     } else {
@@ -76,11 +169,9 @@ static TracerHandle tracerSetHwBreakpointOnForeignThread(void* address, int leng
         return NULL;
     }
 
-    switch (length) {
-    case 1: length = 0; break;
-    case 2: length = 1; break;
-    case 4: length = 3; break;
-    default:
+    int lengthBits = tracerHwBreakpointEncodeLength(length);
+
+    if (lengthBits < 0) {
         tracerCoreSetLastError(eTracerErrorInvalidArgument);
         return NULL;
     }
@@ -107,49 +198,28 @@ static TracerHandle tracerSetHwBreakpointOnForeignThread(void* address, int leng
     if (GetThreadContext(thread, &ctx)) {
 
         // Find first available hardware register index
-        int index = -1;
-
-        if (!ctx.Dr0 && !tracerHwBreakpointGetBits(ctx.Dr7, 0 << 1, 1)) {
-            index = 0;
-        } else if (!ctx.Dr1 && !tracerHwBreakpointGetBits(ctx.Dr7, 1 << 1, 1)) {
-            index = 1;
-        } else if (!ctx.Dr2 && !tracerHwBreakpointGetBits(ctx.Dr7, 2 << 1, 1)) {
-            index = 2;
-        } else if (!ctx.Dr3 && !tracerHwBreakpointGetBits(ctx.Dr7, 3 << 1, 1)) {
-            index = 3;
-        }
+        int index = tracerHwBreakpointFindFreeIndex(&ctx);
 
         if (index >= 0) {
 
-            TracerHwBreakpoint* breakpoint = (TracerHwBreakpoint*)
-                malloc(sizeof(TracerHwBreakpoint));
+            TracerHwBreakpoint* breakpoint = (TracerHwBreakpoint*)tracerPoolAlloc(gTracerHwBreakpointPool);
 
             if (breakpoint) {
+                memset(breakpoint, 0, sizeof(TracerHwBreakpoint));
                 breakpoint->mIndex = index;
                 breakpoint->mThreadId = threadId;
-                breakpoint->mNextLink = NULL;
-
-                switch (index) {
-                case 0: ctx.Dr0 = (uintptr_t)address; break;
-                case 1: ctx.Dr1 = (uintptr_t)address; break;
-                case 2: ctx.Dr2 = (uintptr_t)address; break;
-                case 3: ctx.Dr3 = (uintptr_t)address; break;
-                default: assert(FALSE);
-                }
 
-                tracerHwBreakpointSetBits(&ctx.Dr7, 16 | (index << 2), 2, (int)cond);
-                tracerHwBreakpointSetBits(&ctx.Dr7, 18 | (index << 2), 2, length);
-                tracerHwBreakpointSetBits(&ctx.Dr7, index << 1, 1, 1);
+                tracerHwBreakpointWrite(&ctx, index, address, lengthBits, cond);
 
                 if (SetThreadContext(thread, &ctx)) {
                     result = (TracerHandle)breakpoint;
                 } else {
-                    free(breakpoint);
+                    tracerPoolFree(gTracerHwBreakpointPool, breakpoint);
                     tracerCoreSetLastError(eTracerErrorSystemCall);
                 }
 
             } else {
-                tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+                tracerCoreSetLastError(eTracerErrorOutOfResources);
             }
 
         } else {
@@ -192,17 +262,7 @@ static TracerBool tracerRemoveHwBreakpointOnForeignThread(TracerHandle handle) {
         ctx.ContextFlags = CONTEXT_DEBUG_REGISTERS;
 
         if (GetThreadContext(thread, &ctx)) {
-
-            switch (breakpoint->mIndex) {
-            case 0: ctx.Dr0 = 0; break;
-            case 1: ctx.Dr1 = 0; break;
-            case 2: ctx.Dr2 = 0; break;
-            case 3: ctx.Dr3 = 0; break;
-            default: assert(FALSE);
-            }
-
-            // Clear enabled bit for this breakpoint
-            tracerHwBreakpointSetBits(&ctx.Dr7, breakpoint->mIndex << 1, 1, 0);
+            tracerHwBreakpointClear(&ctx, breakpoint->mIndex);
 
             if (SetThreadContext(thread, &ctx)) {
                 result = eTracerTrue;
@@ -224,7 +284,7 @@ static TracerBool tracerRemoveHwBreakpointOnForeignThread(TracerHandle handle) {
         result = eTracerTrue;
     }
 
-    free(breakpoint);
+    tracerPoolFree(gTracerHwBreakpointPool, breakpoint);
     return result;
 }
 
@@ -300,49 +360,497 @@ TracerHandle tracerSetHwBreakpointOnThread(void* address, int length, int thread
     return result;
 }
 
-TracerHandle tracerSetHwBreakpointGlobal(void* address, int length, TracerHwBpCond cond) {
-    if (!address) {
-        tracerCoreSetLastError(eTracerErrorInvalidArgument);
-        return NULL;
+/*
+ *
+ * Global breakpoints
+ *
+ */
+
+static TracerHwBreakpoint* tracerHwBreakpointFindThreadNode(TracerHwBreakpoint* global, int threadId) {
+    for (TracerHwBreakpoint* node = global->mNextLink; node; node = node->mNextLink) {
+        if (node->mThreadId == threadId) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static void tracerHwBreakpointUnlinkGlobal(TracerHwBreakpoint* global) {
+    TracerHwBreakpoint** link = &gTracerHwGlobalBreakpoints;
+
+    while (*link) {
+        if (*link == global) {
+            *link = global->mNextGlobal;
+            global->mNextGlobal = NULL;
+
+            InterlockedDecrement(&gTracerHwNumGlobalBreakpoints);
+            return;
+        }
+        link = &(*link)->mNextGlobal;
+    }
+}
+
+static void tracerHwBreakpointFreeGlobal(TracerHwBreakpoint* global) {
+    TracerHwBreakpoint* node = global->mNextLink;
+
+    while (node) {
+        TracerHwBreakpoint* next = node->mNextLink;
+        tracerPoolFree(gTracerHwBreakpointPool, node);
+        node = next;
     }
 
-    TracerHwBreakpoint* breakpoint = NULL;
+    tracerPoolFree(gTracerHwBreakpointPool, global);
+}
 
+static TracerHwThread* tracerHwBreakpointOpenThreads(size_t* outNumThreads) {
     DWORD processId = GetCurrentProcessId();
+    DWORD currentTid = GetCurrentThreadId();
+
     HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, processId);
 
-    if (snapshot != INVALID_HANDLE_VALUE) {
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return NULL;
+    }
 
-        THREADENTRY32 entry;
-        entry.dwSize = sizeof(entry);
+    DWORD accessFlags = THREAD_GET_CONTEXT
+        | THREAD_SET_CONTEXT
+        | THREAD_QUERY_INFORMATION
+        | THREAD_SUSPEND_RESUME;
+
+    size_t numThreads = 0;
+    size_t capacity = 64;
+
+    TracerHwThread* threads = (TracerHwThread*)malloc(capacity * sizeof(TracerHwThread));
+
+    if (!threads) {
+        CloseHandle(snapshot);
+
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    THREADENTRY32 entry;
+    entry.dwSize = sizeof(entry);
 
-        if (Thread32First(snapshot, &entry)) {
-            do {
-                if (entry.th32OwnerProcessID != processId) {
-                    // The snapshot contained a process ID that we aren't even looking for
-                    continue;
+    if (Thread32First(snapshot, &entry)) {
+        do {
+            // The calling thread can't modify its own registers, it is never part of the batch
+            if (entry.th32OwnerProcessID != processId || entry.th32ThreadID == currentTid) {
+                continue;
+            }
+
+            if (numThreads == capacity) {
+                TracerHwThread* newThreads = (TracerHwThread*)realloc(threads, 2 * capacity * sizeof(TracerHwThread));
+
+                if (!newThreads) {
+                    // The threads that didn't fit are left unchanged
+                    break;
                 }
 
-                TracerHandle handle = tracerSetHwBreakpointOnThread(
-                    address, length, (int)entry.th32ThreadID, cond);
+                threads = newThreads;
+                capacity *= 2;
+            }
+
+            HANDLE thread = OpenThread(accessFlags, FALSE, entry.th32ThreadID);
+
+            if (thread) {
+                threads[numThreads].mThreadId = (int)entry.th32ThreadID;
+                threads[numThreads].mThread = thread;
+                threads[numThreads].mSuspended = eTracerFalse;
+                numThreads++;
+            }
+
+        } while (Thread32Next(snapshot, &entry));
+    }
+
+    CloseHandle(snapshot);
+
+    *outNumThreads = numThreads;
+    return threads;
+}
+
+// Applies the batch to a stopped thread. If any breakpoint can't be armed, the thread gets none of
+// the armed ones but still loses the disarmed ones. A rollback disarms the breakpoints that the
+// batch armed and leaves everything else alone.
+static TracerError tracerHwBreakpointApplyToThread(TracerHwThread* thread,
+    TracerHwBreakpointChange* changes, size_t numChanges, TracerBool rollback) {
+
+    CONTEXT ctx;
+    ctx.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+
+    if (!GetThreadContext(thread->mThread, &ctx)) {
+        return eTracerErrorSystemCall;
+    }
+
+    // A thread has no more than four registers, so no more than four nodes can be armed
+    TracerHwBreakpoint* armed[4];
+    TracerHwBreakpoint* armedGlobals[4];
+    int numArmed = 0;
 
-                if (handle) {
-                    TracerHwBreakpoint* current = (TracerHwBreakpoint*)handle;
-                    current->mNextLink = breakpoint;
+    TracerError error = eTracerErrorSuccess;
 
-                    breakpoint = current;
+    for (size_t i = 0; i < numChanges; ++i) {
+        TracerHwBreakpoint* global = (TracerHwBreakpoint*)changes[i].mBreakpoint;
+
+        if (!global || (rollback && !changes[i].mArm)) {
+            continue;
+        }
+
+        if (!changes[i].mArm || rollback) {
+            for (TracerHwBreakpoint* node = global->mNextLink; node; node = node->mNextLink) {
+                if (node->mThreadId == thread->mThreadId) {
+                    tracerHwBreakpointClear(&ctx, node->mIndex);
                 }
+            }
+            continue;
+        }
 
-            } while (Thread32Next(snapshot, &entry));
+        if (error != eTracerErrorSuccess) {
+            continue;
         }
 
-        CloseHandle(snapshot);
+        int index = tracerHwBreakpointFindFreeIndex(&ctx);
+        if (index < 0) {
+            error = eTracerErrorOutOfResources;
+            continue;
+        }
 
-    } else {
+        TracerHwBreakpoint* node = (TracerHwBreakpoint*)tracerPoolAlloc(gTracerHwBreakpointPool);
+        if (!node) {
+            error = eTracerErrorNotEnoughMemory;
+            continue;
+        }
+
+        memset(node, 0, sizeof(TracerHwBreakpoint));
+        node->mIndex = index;
+        node->mThreadId = thread->mThreadId;
+
+        tracerHwBreakpointWrite(&ctx, index, global->mAddress, global->mLengthBits, global->mCondition);
+
+        armed[numArmed] = node;
+        armedGlobals[numArmed] = global;
+        numArmed++;
+    }
+
+    if (error != eTracerErrorSuccess) {
+        for (int i = 0; i < numArmed; ++i) {
+            tracerHwBreakpointClear(&ctx, armed[i]->mIndex);
+            tracerPoolFree(gTracerHwBreakpointPool, armed[i]);
+        }
+        numArmed = 0;
+    }
+
+    if (!SetThreadContext(thread->mThread, &ctx)) {
+        for (int i = 0; i < numArmed; ++i) {
+            tracerPoolFree(gTracerHwBreakpointPool, armed[i]);
+        }
+        return eTracerErrorSystemCall;
+    }
+
+    for (int i = 0; i < numArmed; ++i) {
+        armed[i]->mNextLink = armedGlobals[i]->mNextLink;
+        armedGlobals[i]->mNextLink = armed[i];
+    }
+
+    return error;
+}
+
+static TracerError tracerHwBreakpointApplyStopped(TracerHwBreakpointChange* changes, size_t numChanges) {
+    // Everything that may touch the heap happens before the threads are suspended, any of them
+    // might hold the heap lock. The breakpoint nodes come from the pool, which is lock free.
+    size_t numThreads = 0;
+    TracerHwThread* threads = tracerHwBreakpointOpenThreads(&numThreads);
+
+    if (!threads) {
+        return tracerCoreGetLastError();
+    }
+
+    TracerError error = eTracerErrorSuccess;
+
+    EnterCriticalSection(&gTracerHwBreakpointCritSect);
+
+    // New breakpoints are published before the threads are stopped. A thread that is created from
+    // now on either is in our snapshot or inherits them once it gets the lock, never neither.
+    for (size_t i = 0; i < numChanges; ++i) {
+        TracerHwBreakpointChange* change = &changes[i];
+
+        if (change->mArm) {
+            TracerHwBreakpoint* global = (TracerHwBreakpoint*)tracerPoolAlloc(gTracerHwBreakpointPool);
+
+            if (!global) {
+                change->mBreakpoint = NULL;
+                error = eTracerErrorOutOfResources;
+                continue;
+            }
+
+            memset(global, 0, sizeof(TracerHwBreakpoint));
+            global->mIndex = -1;
+            global->mThreadId = TLIB_HWBP_THREAD_GLOBAL;
+            global->mAddress = change->mAddress;
+            global->mLengthBits = tracerHwBreakpointEncodeLength(change->mLength);
+            global->mCondition = change->mCondition;
+            global->mNextGlobal = gTracerHwGlobalBreakpoints;
+
+            gTracerHwGlobalBreakpoints = global;
+            InterlockedIncrement(&gTracerHwNumGlobalBreakpoints);
+
+            change->mBreakpoint = (TracerHandle)global;
+
+        } else {
+            tracerHwBreakpointUnlinkGlobal((TracerHwBreakpoint*)change->mBreakpoint);
+        }
+    }
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads[i].mSuspended = (SuspendThread(threads[i].mThread) != (DWORD)-1);
+    }
+
+    TracerError armError = eTracerErrorSuccess;
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        // Threads that we couldn't stop are most likely about to exit
+        if (!threads[i].mSuspended) {
+            continue;
+        }
+
+        TracerError threadError = tracerHwBreakpointApplyToThread(&threads[i], changes, numChanges, eTracerFalse);
+
+        if (threadError == eTracerErrorSystemCall) {
+            error = threadError;
+        } else if (threadError != eTracerErrorSuccess) {
+            armError = threadError;
+        }
+    }
+
+    // A thread that is left without a breakpoint would silently miss it, so a breakpoint is only
+    // armed if every thread got it. The threads are still stopped while the batch is undone.
+    if (armError != eTracerErrorSuccess) {
+        for (size_t i = 0; i < numThreads; ++i) {
+            if (threads[i].mSuspended) {
+                tracerHwBreakpointApplyToThread(&threads[i], changes, numChanges, eTracerTrue);
+            }
+        }
+
+        for (size_t i = 0; i < numChanges; ++i) {
+            TracerHwBreakpoint* global = (TracerHwBreakpoint*)changes[i].mBreakpoint;
+
+            if (changes[i].mArm && global) {
+                tracerHwBreakpointUnlinkGlobal(global);
+                tracerHwBreakpointFreeGlobal(global);
+
+                changes[i].mBreakpoint = NULL;
+            }
+        }
+
+        error = armError;
+    }
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        if (threads[i].mSuspended) {
+            ResumeThread(threads[i].mThread);
+        }
+    }
+
+    for (size_t i = 0; i < numChanges; ++i) {
+        TracerHwBreakpoint* global = (TracerHwBreakpoint*)changes[i].mBreakpoint;
+
+        if (!global) {
+            continue;
+        }
+
+        if (!changes[i].mArm) {
+            tracerHwBreakpointFreeGlobal(global);
+            changes[i].mBreakpoint = NULL;
+
+        } else if (!global->mNextLink && numThreads > 0) {
+            // Not a single thread had a free register left
+            tracerHwBreakpointUnlinkGlobal(global);
+            tracerHwBreakpointFreeGlobal(global);
+
+            changes[i].mBreakpoint = NULL;
+            error = eTracerErrorOutOfResources;
+        }
+    }
+
+    LeaveCriticalSection(&gTracerHwBreakpointCritSect);
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        CloseHandle(threads[i].mThread);
+    }
+
+    free(threads);
+    return error;
+}
+
+static DWORD WINAPI tracerHwBreakpointApplyOnHelperThread(LPVOID parameter) {
+    TracerHwBatch* batch = (TracerHwBatch*)parameter;
+
+    batch->mError = tracerHwBreakpointApplyStopped(batch->mChanges, batch->mNumChanges);
+
+    return TRUE;
+}
+
+TracerBool tracerApplyHwBreakpointsGlobal(TracerHwBreakpointChange* changes, size_t numChanges) {
+    if (!changes || !numChanges) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    // Reject the whole batch before anything is applied
+    for (size_t i = 0; i < numChanges; ++i) {
+        TracerHwBreakpoint* global = (TracerHwBreakpoint*)changes[i].mBreakpoint;
+
+        TracerBool valid = changes[i].mArm ?
+            (changes[i].mAddress && tracerHwBreakpointEncodeLength(changes[i].mLength) >= 0) :
+            (global && global->mThreadId == TLIB_HWBP_THREAD_GLOBAL);
+
+        if (!valid) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return eTracerFalse;
+        }
+    }
+
+    // The calling thread is one of the threads to modify, so the batch runs on a helper thread.
+    // It is spawned once per batch instead of once per breakpoint.
+    TracerHwBatch batch = {
+        /* mChanges               = */ changes,
+        /* mNumChanges            = */ numChanges,
+        /* mResult                = */ eTracerFalse,
+        /* mError                 = */ eTracerErrorSuccess,
+    };
+
+    HANDLE thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)
+        tracerHwBreakpointApplyOnHelperThread, (LPVOID)&batch, 0, NULL);
+
+    if (!thread) {
         tracerCoreSetLastError(eTracerErrorSystemCall);
+        return eTracerFalse;
+    }
+
+    if (WaitForSingleObject(thread, INFINITE) == WAIT_OBJECT_0) {
+        batch.mResult = (batch.mError == eTracerErrorSuccess) ? eTracerTrue : eTracerFalse;
+
+        if (!batch.mResult) {
+            tracerCoreSetLastError(batch.mError);
+        }
+
+    } else {
+        tracerCoreSetLastError(eTracerErrorWaitIncomplete);
+    }
+
+    CloseHandle(thread);
+    return batch.mResult;
+}
+
+TracerHandle tracerSetHwBreakpointGlobal(void* address, int length, TracerHwBpCond cond) {
+    TracerHwBreakpointChange change = {
+        /* mArm                   = */ eTracerTrue,
+        /* mAddress               = */ address,
+        /* mLength                = */ length,
+        /* mCondition             = */ cond,
+        /* mBreakpoint            = */ NULL,
+    };
+
+    if (!tracerApplyHwBreakpointsGlobal(&change, 1)) {
+        return NULL;
+    }
+
+    return change.mBreakpoint;
+}
+
+static LONG CALLBACK tracerHwBreakpointInheritHandler(PEXCEPTION_POINTERS ex) {
+    if (ex->ExceptionRecord->ExceptionCode != TLIB_HWBP_EXCEPTION_INHERIT) {
+        return EXCEPTION_CONTINUE_SEARCH;
+    }
+
+    PCONTEXT ctx = ex->ContextRecord;
+    int threadId = (int)GetCurrentThreadId();
+
+    // A raised exception only carries the debug registers if we ask for them. The thread was just
+    // created, so it doesn't have any breakpoints that we could overwrite.
+    if (!(ctx->ContextFlags & CONTEXT_DEBUG_REGISTERS)) {
+        ctx->Dr0 = ctx->Dr1 = ctx->Dr2 = ctx->Dr3 = 0;
+        ctx->Dr6 = ctx->Dr7 = 0;
+        ctx->ContextFlags |= CONTEXT_DEBUG_REGISTERS;
+    }
+
+    EnterCriticalSection(&gTracerHwBreakpointCritSect);
+
+    // A batch that ran after the exception was raised may already have armed this thread. Those
+    // registers were wiped above and are written again first, so their slots aren't handed out.
+    for (TracerHwBreakpoint* global = gTracerHwGlobalBreakpoints; global; global = global->mNextGlobal) {
+        TracerHwBreakpoint* node = tracerHwBreakpointFindThreadNode(global, threadId);
+
+        if (node) {
+            tracerHwBreakpointWrite(ctx, node->mIndex, global->mAddress, global->mLengthBits, global->mCondition);
+        }
+    }
+
+    for (TracerHwBreakpoint* global = gTracerHwGlobalBreakpoints; global; global = global->mNextGlobal) {
+        if (tracerHwBreakpointFindThreadNode(global, threadId)) {
+            continue;
+        }
+
+        int index = tracerHwBreakpointFindFreeIndex(ctx);
+        TracerHwBreakpoint* node = index < 0 ? NULL : (TracerHwBreakpoint*)tracerPoolAlloc(gTracerHwBreakpointPool);
+
+        if (!node) {
+            InterlockedIncrement(&gTracerHwNumUnarmedThreads);
+            break;
+        }
+
+        memset(node, 0, sizeof(TracerHwBreakpoint));
+        node->mIndex = index;
+        node->mThreadId = threadId;
+        node->mNextLink = global->mNextLink;
+        global->mNextLink = node;
+
+        tracerHwBreakpointWrite(ctx, index, global->mAddress, global->mLengthBits, global->mCondition);
     }
 
-    return (TracerHandle)breakpoint;
+    LeaveCriticalSection(&gTracerHwBreakpointCritSect);
+
+    return EXCEPTION_CONTINUE_EXECUTION;
+}
+
+void tracerHwBreakpointOnThreadAttach() {
+    // We run under the loader lock and can't spawn a helper thread, but the registers of the
+    // current thread can be changed through the context record of an exception.
+    if (gTracerHwNumGlobalBreakpoints > 0) {
+        RaiseException(TLIB_HWBP_EXCEPTION_INHERIT, 0, 0, NULL);
+    }
+}
+
+uint64_t tracerHwBreakpointGetNumUnarmedThreads() {
+    return (uint64_t)gTracerHwNumUnarmedThreads;
+}
+
+void tracerHwBreakpointOnThreadDetach() {
+    if (gTracerHwNumGlobalBreakpoints <= 0) {
+        return;
+    }
+
+    int threadId = (int)GetCurrentThreadId();
+
+    EnterCriticalSection(&gTracerHwBreakpointCritSect);
+
+    for (TracerHwBreakpoint* global = gTracerHwGlobalBreakpoints; global; global = global->mNextGlobal) {
+        TracerHwBreakpoint** link = &global->mNextLink;
+
+        while (*link) {
+            TracerHwBreakpoint* node = *link;
+
+            if (node->mThreadId == threadId) {
+                *link = node->mNextLink;
+                tracerPoolFree(gTracerHwBreakpointPool, node);
+            } else {
+                link = &node->mNextLink;
+            }
+        }
+    }
+
+    LeaveCriticalSection(&gTracerHwBreakpointCritSect);
 }
 
 static DWORD WINAPI tracerRemoveHwBreakpointOnCurrentThread(LPVOID parameter) {
@@ -357,6 +865,18 @@ TracerBool tracerRemoveHwBreakpoint(TracerHandle handle) {
         return eTracerFalse;
     }
 
+    if (breakpoint->mThreadId == TLIB_HWBP_THREAD_GLOBAL) {
+        TracerHwBreakpointChange change = {
+            /* mArm                   = */ eTracerFalse,
+            /* mAddress               = */ NULL,
+            /* mLength                = */ 0,
+            /* mCondition             = */ eTracerBpCondExecute,
+            /* mBreakpoint            = */ handle,
+        };
+
+        return tracerApplyHwBreakpointsGlobal(&change, 1);
+    }
+
     TracerBool result = eTracerTrue;
 
     do {
@@ -425,6 +945,27 @@ TracerBool tracerRemoveHwBreakpointOnContext(TracerHandle handle, PCONTEXT ctx)
         return eTracerFalse;
     }
 
+    TracerHwBreakpoint* global = NULL;
+
+    if (breakpoint->mThreadId == TLIB_HWBP_THREAD_GLOBAL) {
+        // Detach the thread nodes under the lock, new threads must not pick the breakpoint up anymore
+        EnterCriticalSection(&gTracerHwBreakpointCritSect);
+
+        tracerHwBreakpointUnlinkGlobal(breakpoint);
+
+        global = breakpoint;
+        breakpoint = global->mNextLink;
+        global->mNextLink = NULL;
+
+        LeaveCriticalSection(&gTracerHwBreakpointCritSect);
+
+        tracerPoolFree(gTracerHwBreakpointPool, global);
+
+        if (!breakpoint) {
+            return eTracerTrue;
+        }
+    }
+
     TracerBool result = eTracerTrue;
 
     do {
@@ -436,18 +977,9 @@ TracerBool tracerRemoveHwBreakpointOnContext(TracerHandle handle, PCONTEXT ctx)
         if (breakpoint->mThreadId == -1 ||
             breakpoint->mThreadId == (int)GetCurrentThreadId()) {
 
-            switch (breakpoint->mIndex) {
-            case 0: ctx->Dr0 = 0; break;
-            case 1: ctx->Dr1 = 0; break;
-            case 2: ctx->Dr2 = 0; break;
-            case 3: ctx->Dr3 = 0; break;
-            default: assert(FALSE);
-            }
-
-            // Clear enabled bit for this breakpoint
-            tracerHwBreakpointSetBits(&ctx->Dr7, breakpoint->mIndex << 1, 1, 0);
+            tracerHwBreakpointClear(ctx, breakpoint->mIndex);
 
-            free(breakpoint);
+            tracerPoolFree(gTracerHwBreakpointPool, breakpoint);
 
         } else {
             if (!tracerRemoveHwBreakpointOnForeignThread((TracerHandle)breakpoint)) {
@@ -460,4 +992,4 @@ TracerBool tracerRemoveHwBreakpointOnContext(TracerHandle handle, PCONTEXT ctx)
     } while (breakpoint);
 
     return result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,392 @@
+
+#include <tracer_lib/lde.h>
+
+#ifndef NDEBUG
+
+#define ZYDIS_STATIC_DEFINE
+
+#include <Zydis/Zydis.h>
+
+#endif
+
+#define TLIB_LDE_MODRM          0x0001
+#define TLIB_LDE_IMM8           0x0002
+#define TLIB_LDE_IMM16          0x0004
+#define TLIB_LDE_IMM32          0x0008
+#define TLIB_LDE_IMMZ           0x0010      // 16 or 32 bits, depending on the operand size
+#define TLIB_LDE_IMMV           0x0020      // 16, 32 or 64 bits, depending on the operand size
+#define TLIB_LDE_MOFFS          0x0040      // Depends on the address size
+#define TLIB_LDE_REL32          0x0080      // Near branches ignore the operand size in 64 bit mode
+#define TLIB_LDE_GROUP3         0x0100      // Only /0 and /1 (test) have an immediate
+#define TLIB_LDE_NODISP         0x0200      // mov cr/dr always use the register form
+#define TLIB_LDE_NO64           0x0400
+#define TLIB_LDE_INVALID        0x0800
+
+#define TLIB_LDE_PREFIX_NONE    0
+#define TLIB_LDE_PREFIX_LEGACY  1
+#define TLIB_LDE_PREFIX_OPSIZE  2
+#define TLIB_LDE_PREFIX_ADSIZE  3
+#define TLIB_LDE_PREFIX_REX     4
+
+#define TLIB_LDE_MODRM_SIB      0x10
+#define TLIB_LDE_MODRM_DISP     0x0F
+
+// Short names to keep the opcode tables readable
+#define __  0
+#define XX  TLIB_LDE_INVALID
+#define MR  TLIB_LDE_MODRM
+#define I8  TLIB_LDE_IMM8
+#define IW  TLIB_LDE_IMM16
+#define IZ  TLIB_LDE_IMMZ
+#define IV  TLIB_LDE_IMMV
+#define MO  TLIB_LDE_MOFFS
+#define RZ  (TLIB_LDE_IMMZ | TLIB_LDE_REL32)
+#define N6  TLIB_LDE_NO64
+#define MB  (TLIB_LDE_MODRM | TLIB_LDE_IMM8)
+#define MZ  (TLIB_LDE_MODRM | TLIB_LDE_IMMZ)
+#define MN  (TLIB_LDE_MODRM | TLIB_LDE_NODISP)
+#define PL  TLIB_LDE_PREFIX_LEGACY
+#define PO  TLIB_LDE_PREFIX_OPSIZE
+#define PA  TLIB_LDE_PREFIX_ADSIZE
+#define PR  TLIB_LDE_PREFIX_REX
+
+static const uint8_t gTracerLdePrefixes[256] = {
+    /*          0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F */
+    /* 0x00 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0x10 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0x20 */ __, __, __, __, __, __, PL, __, __, __, __, __, __, __, PL, __,
+    /* 0x30 */ __, __, __, __, __, __, PL, __, __, __, __, __, __, __, PL, __,
+    /* 0x40 */ PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR, PR,
+    /* 0x50 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0x60 */ __, __, __, __, PL, PL, PO, PA, __, __, __, __, __, __, __, __,
+    /* 0x70 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0x80 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0x90 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0xA0 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0xB0 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0xC0 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0xD0 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0xE0 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0xF0 */ PL, __, PL, PL, __, __, __, __, __, __, __, __, __, __, __, __,
+};
+
+static const uint16_t gTracerLdeOneByte[256] = {
+    /*          0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F */
+    /* 0x00 */ MR, MR, MR, MR, I8, IZ, N6, N6, MR, MR, MR, MR, I8, IZ, N6, __,
+    /* 0x10 */ MR, MR, MR, MR, I8, IZ, N6, N6, MR, MR, MR, MR, I8, IZ, N6, N6,
+    /* 0x20 */ MR, MR, MR, MR, I8, IZ, __, N6, MR, MR, MR, MR, I8, IZ, __, N6,
+    /* 0x30 */ MR, MR, MR, MR, I8, IZ, __, N6, MR, MR, MR, MR, I8, IZ, __, N6,
+    /* 0x40 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0x50 */ __, __, __, __, __, __, __, __, __, __, __, __, __, __, __, __,
+    /* 0x60 */ N6, N6, MR | N6, MR, __, __, __, __, IZ, MZ, I8, MB, __, __, __, __,
+    /* 0x70 */ I8, I8, I8, I8, I8, I8, I8, I8, I8, I8, I8, I8, I8, I8, I8, I8,
+    /* 0x80 */ MB, MZ, MB | N6, MB, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0x90 */ __, __, __, __, __, __, __, __, __, __, IZ | IW | N6, __, __, __, __, __,
+    /* 0xA0 */ MO, MO, MO, MO, __, __, __, __, I8, IZ, __, __, __, __, __, __,
+    /* 0xB0 */ I8, I8, I8, I8, I8, I8, I8, I8, IV, IV, IV, IV, IV, IV, IV, IV,
+    /* 0xC0 */ MB, MB, IW, __, MR | N6, MR | N6, MB, MZ, IW | I8, __, IW, __, __, I8, N6, __,
+    /* 0xD0 */ MR, MR, MR, MR, I8 | N6, I8 | N6, N6, __, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0xE0 */ I8, I8, I8, I8, I8, I8, I8, I8, RZ, RZ, IZ | IW | N6, I8, __, __, __, __,
+    /* 0xF0 */ __, __, __, __, __, __, MB | TLIB_LDE_GROUP3, MZ | TLIB_LDE_GROUP3, __, __, __, __, __, __, MR, MR,
+};
+
+static const uint16_t gTracerLdeTwoByte[256] = {
+    /*          0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F */
+    /* 0x00 */ MR, MR, MR, MR, XX, __, __, __, __, __, XX, __, XX, MR, __, MB,
+    /* 0x10 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0x20 */ MN, MN, MN, MN, XX, XX, XX, XX, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0x30 */ __, __, __, __, __, __, XX, __, __, XX, __, XX, XX, XX, XX, XX,
+    /* 0x40 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0x50 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0x60 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0x70 */ MB, MB, MB, MB, MR, MR, MR, __, MR, MR, XX, XX, MR, MR, MR, MR,
+    /* 0x80 */ RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ,
+    /* 0x90 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0xA0 */ __, __, __, MR, MB, MR, XX, XX, __, __, __, MR, MB, MR, MR, MR,
+    /* 0xB0 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MB, MR, MR, MR, MR, MR,
+    /* 0xC0 */ MR, MR, MB, MR, MB, MB, MB, MR, __, __, __, __, __, __, __, __,
+    /* 0xD0 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0xE0 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+    /* 0xF0 */ MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR, MR,
+};
+
+// Displacement size and SIB presence for 32 and 64 bit addressing, indexed by mod << 3 | rm
+static const uint8_t gTracerLdeModRm32[32] = {
+    0, 0, 0, 0, TLIB_LDE_MODRM_SIB,     4, 0, 0,
+    1, 1, 1, 1, TLIB_LDE_MODRM_SIB | 1, 1, 1, 1,
+    4, 4, 4, 4, TLIB_LDE_MODRM_SIB | 4, 4, 4, 4,
+    0, 0, 0, 0, 0,                      0, 0, 0,
+};
+
+// 16 bit addressing doesn't know SIB bytes
+static const uint8_t gTracerLdeModRm16[32] = {
+    0, 0, 0, 0, 0, 0, 2, 0,
+    1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2,
+    0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+#undef __
+#undef XX
+#undef MR
+#undef I8
+#undef IW
+#undef IZ
+#undef IV
+#undef MO
+#undef RZ
+#undef N6
+#undef MB
+#undef MZ
+#undef MN
+#undef PL
+#undef PO
+#undef PA
+#undef PR
+
+static TracerBool tracerLdeIsExtendedEncoding(uint8_t opcode, uint8_t next, TracerLdeMode mode) {
+    if (opcode == 0x8F) {
+        // XOP uses map selects 8 and above, pop r/m always has a reg field of 0
+        return (next & 0x1F) >= 8;
+    }
+
+    // In 32 bit mode les, lds and bound can't have a register operand, that's what VEX/EVEX use instead
+    return (opcode == 0xC4 || opcode == 0xC5 || opcode == 0x62) &&
+        (mode == eTracerLdeMode64 || (next & 0xC0) == 0xC0);
+}
+
+static TracerLdeFlow tracerLdeGetFlow(uint8_t map, uint8_t opcode, uint8_t modRm) {
+    if (map == 2) {
+        return (opcode & 0xF0) == 0x80 ? eTracerLdeFlowBranch : eTracerLdeFlowNone;
+    }
+
+    if (map != 1) {
+        return eTracerLdeFlowNone;
+    }
+
+    switch (opcode) {
+    case 0xE8: case 0x9A:
+        return eTracerLdeFlowCall;
+    case 0xC2: case 0xC3: case 0xCA: case 0xCB: case 0xCF:
+        return eTracerLdeFlowReturn;
+    case 0xE0: case 0xE1: case 0xE2: case 0xE3: case 0xE9: case 0xEA: case 0xEB:
+        return eTracerLdeFlowBranch;
+    case 0xFF:
+        switch ((modRm >> 3) & 7) {
+        case 2: case 3: return eTracerLdeFlowCall;
+        case 4: case 5: return eTracerLdeFlowBranch;
+        }
+        return eTracerLdeFlowNone;
+    }
+
+    return (opcode & 0xF0) == 0x70 ? eTracerLdeFlowBranch : eTracerLdeFlowNone;
+}
+
+static size_t tracerLdeDecodeInternal(const uint8_t* code, size_t size, TracerLdeMode mode, TracerLdeInstruction* instruction) {
+    TracerBool is64Bit = (mode == eTracerLdeMode64);
+    TracerBool operandSizeOverride = eTracerFalse;
+    TracerBool addressSizeOverride = eTracerFalse;
+    TracerBool rexW = eTracerFalse;
+    TracerBool isExtended = eTracerFalse;
+
+    size_t offset = 0;
+
+    for (;; ++offset) {
+        if (offset >= size) {
+            return 0;
+        }
+
+        uint8_t prefix = gTracerLdePrefixes[code[offset]];
+
+        if (prefix == TLIB_LDE_PREFIX_NONE || (prefix == TLIB_LDE_PREFIX_REX && !is64Bit)) {
+            break;
+        }
+
+        // A REX prefix only counts if nothing follows it
+        rexW = (prefix == TLIB_LDE_PREFIX_REX) && (code[offset] & 0x08);
+
+        if (prefix == TLIB_LDE_PREFIX_OPSIZE) {
+            operandSizeOverride = eTracerTrue;
+        } else if (prefix == TLIB_LDE_PREFIX_ADSIZE) {
+            addressSizeOverride = eTracerTrue;
+        }
+    }
+
+    uint8_t opcode = code[offset++];
+    uint8_t map = 1;
+    uint16_t flags = 0;
+
+    if (opcode == 0x0F) {
+        if (offset >= size) {
+            return 0;
+        }
+
+        opcode = code[offset++];
+
+        if (opcode == 0x38 || opcode == 0x3A) {
+            if (offset >= size) {
+                return 0;
+            }
+
+            // None of the three byte opcodes has an immediate, except for the ones in 0F 3A with exactly one byte
+            map = (opcode == 0x38) ? 3 : 4;
+            flags = (map == 3) ? TLIB_LDE_MODRM : (TLIB_LDE_MODRM | TLIB_LDE_IMM8);
+            opcode = code[offset++];
+        } else {
+            map = 2;
+            flags = gTracerLdeTwoByte[opcode];
+        }
+    } else if (offset < size && tracerLdeIsExtendedEncoding(opcode, code[offset], mode)) {
+        size_t payload = (opcode == 0xC5) ? 1 : (opcode == 0x62) ? 3 : 2;
+
+        if (offset + payload >= size) {
+            return 0;
+        }
+
+        uint8_t select = (opcode == 0xC5) ? 1 : (opcode == 0x62) ? (code[offset] & 0x03) : (code[offset] & 0x1F);
+        uint8_t escape = opcode;
+
+        offset += payload;
+        opcode = code[offset++];
+        isExtended = eTracerTrue;
+
+        if (escape == 0x8F) {
+            // XOP map 8 has an imm8, map 9 none and map A an imm32
+            switch (select) {
+            case 0x08: flags = TLIB_LDE_MODRM | TLIB_LDE_IMM8; break;
+            case 0x09: flags = TLIB_LDE_MODRM; break;
+            case 0x0A: flags = TLIB_LDE_MODRM | TLIB_LDE_IMM32; break;
+            default: return 0;
+            }
+            map = select;
+        } else {
+            // VEX and EVEX share the opcode maps with the legacy encoding
+            switch (select) {
+            case 1: flags = gTracerLdeTwoByte[opcode]; break;
+            case 2: flags = TLIB_LDE_MODRM; break;
+            case 3: flags = TLIB_LDE_MODRM | TLIB_LDE_IMM8; break;
+            default: return 0;
+            }
+            map = select + 1;
+        }
+    } else {
+        flags = gTracerLdeOneByte[opcode];
+    }
+
+    if ((flags & TLIB_LDE_INVALID) || (is64Bit && (flags & TLIB_LDE_NO64))) {
+        return 0;
+    }
+
+    instruction->mMap = map;
+    instruction->mOpcode = opcode;
+
+    if (flags & TLIB_LDE_MODRM) {
+        if (offset >= size) {
+            return 0;
+        }
+
+        uint8_t modRm = code[offset++];
+        uint8_t index = ((modRm >> 3) & 0x18) | (modRm & 0x07);
+
+        instruction->mModRm = modRm;
+        instruction->mHasModRm = eTracerTrue;
+
+        if (!(flags & TLIB_LDE_NODISP)) {
+            if (!is64Bit && addressSizeOverride) {
+                offset += gTracerLdeModRm16[index];
+            } else {
+                uint8_t info = gTracerLdeModRm32[index];
+
+                if (info & TLIB_LDE_MODRM_SIB) {
+                    if (offset >= size) {
+                        return 0;
+                    }
+
+                    // A SIB base of ebp without displacement from the ModRM byte means disp32 without base
+                    if ((modRm >> 6) == 0 && (code[offset] & 0x07) == 5) {
+                        offset += 4;
+                    }
+                    ++offset;
+                }
+                offset += info & TLIB_LDE_MODRM_DISP;
+            }
+        }
+
+        if ((flags & TLIB_LDE_GROUP3) && ((modRm >> 3) & 7) > 1) {
+            flags &= ~(TLIB_LDE_IMM8 | TLIB_LDE_IMMZ);
+        }
+    }
+
+    size_t operandSize = (is64Bit && rexW) ? 8 : operandSizeOverride ? 2 : 4;
+
+    if (flags & TLIB_LDE_IMM8) {
+        offset += 1;
+    }
+    if (flags & TLIB_LDE_IMM16) {
+        offset += 2;
+    }
+    if (flags & TLIB_LDE_IMM32) {
+        offset += 4;
+    }
+    if (flags & TLIB_LDE_IMMZ) {
+        offset += (operandSize == 2 && !(is64Bit && (flags & TLIB_LDE_REL32))) ? 2 : 4;
+    }
+    if (flags & TLIB_LDE_IMMV) {
+        offset += operandSize;
+    }
+    if (flags & TLIB_LDE_MOFFS) {
+        offset += is64Bit ? (addressSizeOverride ? 4 : 8) : (addressSizeOverride ? 2 : 4);
+    }
+
+    if (offset > size) {
+        return 0;
+    }
+
+    if (!isExtended) {
+        instruction->mFlow = tracerLdeGetFlow(map, opcode, instruction->mModRm);
+    }
+
+    instruction->mLength = (uint8_t)offset;
+    return offset;
+}
+
+#ifndef NDEBUG
+static void tracerLdeVerify(const uint8_t* code, size_t size, TracerLdeMode mode, size_t length) {
+    ZydisDecoder decoder;
+    ZydisDecodedInstruction instruction;
+
+    if (mode == eTracerLdeMode64) {
+        ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64);
+    } else {
+        ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_COMPAT_32, ZYDIS_ADDRESS_WIDTH_32);
+    }
+
+    // Zydis rejects a few encodings we still walk over, only compare what it accepts
+    if (ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(&decoder, code, size, 0, &instruction))) {
+        assert(instruction.length == length);
+    }
+}
+#endif
+
+size_t tracerLdeDecode(const uint8_t* code, size_t size, TracerLdeMode mode, TracerLdeInstruction* instruction) {
+    if (!code || !instruction) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    memset(instruction, 0, sizeof(TracerLdeInstruction));
+    size = min(size, TLIB_LDE_MAX_INSTRUCTION_SIZE);
+
+    size_t length = tracerLdeDecodeInternal(code, size, mode, instruction);
+
+#ifndef NDEBUG
+    tracerLdeVerify(code, size, mode, length);
+#endif
+
+    return length;
+}
+
+size_t tracerLdeGetLength(const uint8_t* code, size_t size, TracerLdeMode mode) {
+    TracerLdeInstruction instruction;
+    return tracerLdeDecode(code, size, mode, &instruction);
+}
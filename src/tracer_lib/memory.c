@@ -1,5 +1,6 @@
 
 #include <tracer_lib/memory.h>
+#include <tracer_lib/function_index.h>
 
 #include <Psapi.h>
 
@@ -28,6 +29,14 @@ void tracerCleanupMemoryContext(TracerContext* ctx) {
     }
 
     TracerMemoryContext* memory = (TracerMemoryContext*)ctx;
+
+    for (size_t i = 0; i < TLIB_MEMORY_MAX_FUNCTION_INDICES; ++i) {
+        if (memory->mFunctionIndices[i]) {
+            tracerDestroyFunctionIndex(memory->mFunctionIndices[i]);
+            memory->mFunctionIndices[i] = NULL;
+        }
+    }
+
     CloseHandle((HANDLE)memory->mProcessHandle);
     memory->mProcessHandle = NULL;
 
@@ -129,3 +138,83 @@ const uint8_t* tracerMemoryFindFunctionStart(TracerContext* ctx, const uint8_t*
     TLIB_METHOD_CHECK_SUPPORT(memory->mFindFunctionStart, NULL);
     return memory->mFindFunctionStart(ctx, offset, size);
 }
+
+size_t tracerMemorySearchPatterns(TracerContext* ctx, const uint8_t* start, size_t size,
+    TracerHandle scanSet, TracerScanCallback callback, void* userData) {
+
+    if (!tracerCoreValidateContext(ctx, eTracerMemoryContext)) {
+        return 0;
+    }
+
+    TracerMemoryContext* memory = (TracerMemoryContext*)ctx;
+    TLIB_METHOD_CHECK_SUPPORT(memory->mSearchPatterns, 0);
+    return memory->mSearchPatterns(ctx, start, size, scanSet, callback, userData);
+}
+
+void tracerMemorySetSymbolResolver(TracerContext* ctx, TracerHandle symbolResolver) {
+    if (!tracerCoreValidateContext(ctx, eTracerMemoryContext)) {
+        return;
+    }
+
+    TracerMemoryContext* memory = (TracerMemoryContext*)ctx;
+    memory->mSymbolResolver = symbolResolver;
+}
+
+static TracerHandle tracerMemoryGetFunctionIndex(TracerMemoryContext* memory, uintptr_t moduleBase) {
+    HANDLE process = (HANDLE)memory->mProcessHandle;
+
+    for (size_t i = 0; i < TLIB_MEMORY_MAX_FUNCTION_INDICES; ++i) {
+        TracerHandle index = memory->mFunctionIndices[i];
+
+        if (!index || tracerFunctionIndexGetModuleBase(index) != moduleBase) {
+            continue;
+        }
+
+        if (tracerFunctionIndexIsCurrent(index, process)) {
+            return index;
+        }
+
+        // Another module has been loaded at the same address
+        tracerDestroyFunctionIndex(index);
+        memory->mFunctionIndices[i] = NULL;
+    }
+
+    TracerHandle index = tracerCreateFunctionIndex(process, moduleBase, memory->mSymbolResolver);
+
+    if (!index) {
+        return NULL;
+    }
+
+    size_t slot = memory->mNextFunctionIndex;
+    memory->mNextFunctionIndex = (slot + 1) % TLIB_MEMORY_MAX_FUNCTION_INDICES;
+
+    if (memory->mFunctionIndices[slot]) {
+        tracerDestroyFunctionIndex(memory->mFunctionIndices[slot]);
+    }
+
+    memory->mFunctionIndices[slot] = index;
+    return index;
+}
+
+uintptr_t tracerMemoryFindContainingFunction(TracerContext* ctx, uintptr_t address) {
+    if (!tracerCoreValidateContext(ctx, eTracerMemoryContext)) {
+        return 0;
+    }
+
+    TracerMemoryContext* memory = (TracerMemoryContext*)ctx;
+    MEMORY_BASIC_INFORMATION region;
+
+    // Only code that belongs to a mapped image has an index
+    if (!VirtualQueryEx((HANDLE)memory->mProcessHandle, (LPCVOID)address, &region, sizeof(region)) ||
+        region.State != MEM_COMMIT || region.Type != MEM_IMAGE) {
+        return 0;
+    }
+
+    TracerHandle index = tracerMemoryGetFunctionIndex(memory, (uintptr_t)region.AllocationBase);
+
+    if (!index) {
+        return 0;
+    }
+
+    return tracerFunctionIndexFind(index, address);
+}
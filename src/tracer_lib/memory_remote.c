@@ -1,5 +1,9 @@
 
 #include <tracer_lib/memory_remote.h>
+#include <tracer_lib/memory_local.h>
+#include <tracer_lib/memory_stream.h>
+#include <tracer_lib/lde.h>
+#include <tracer_lib/channel.h>
 
 #include <assert.h>
 #include <stdio.h>
@@ -27,6 +31,36 @@ static TracerHandle tracerMemoryRemoteCallNamedExport(TracerContext* ctx, const
 
 static TracerHandle tracerMemoryRemoteCallNamedExportEx(TracerContext* ctx, const tchar* module, const char* exportName, void* parameter, int timeout);
 
+static const uint8_t* tracerMemoryRemoteSearchPattern(TracerContext* ctx, const uint8_t* haystack, size_t haystackSize, const uint8_t* needle, size_t needleSize, uint8_t wildcard);
+
+static size_t tracerMemoryRemoteGetInstructionSize(TracerContext* ctx, const uint8_t* instruction);
+
+static const uint8_t* tracerMemoryRemoteSearchSequence(TracerContext* ctx, const uint8_t* start, const uint8_t* end, const uint8_t* seq, const char* mask);
+
+static const uint8_t* tracerMemoryRemoteFindFunctionStart(TracerContext* ctx, const uint8_t* offset, size_t size);
+
+static size_t tracerMemoryRemoteSearchPatterns(TracerContext* ctx, const uint8_t* start, size_t size, TracerHandle scanSet, TracerScanCallback callback, void* userData);
+
+typedef struct TracerRemoteSearch {
+    const TracerScanPattern*        mPattern;
+    TracerBool                      mBackward;
+    uintptr_t                       mResult;
+} TracerRemoteSearch;
+
+typedef struct TracerRemoteMultiSearch {
+    TracerHandle                    mScanSet;
+    TracerScanCallback              mCallback;
+    void*                           mUserData;
+
+    const uint8_t*                  mWindow;
+    uintptr_t                       mWindowAddress;
+    size_t                          mNumPositions;
+    uintptr_t                       mEndAddress;            // End of the positions of the whole search
+
+    size_t                          mNumMatches;
+    TracerBool                      mStopped;
+} TracerRemoteMultiSearch;
+
 
 TracerContext* tracerCreateRemoteMemoryContext(int type, int size, int pid, TracerHandle sharedMemoryHandle) {
     assert(size >= sizeof(TracerRemoteMemoryContext));
@@ -46,8 +80,14 @@ TracerContext* tracerCreateRemoteMemoryContext(int type, int size, int pid, Trac
     memory->mAllocMemory = tracerMemoryRemoteAlloc;
     memory->mFreeMemory = tracerMemoryRemoteFree;
     memory->mFindModule = tracerMemoryRemoteFindModule;
-
-    DWORD accessFlags = PROCESS_VM_OPERATION
+    memory->mSearchPattern = tracerMemoryRemoteSearchPattern;
+    memory->mGetInstructionSize = tracerMemoryRemoteGetInstructionSize;
+    memory->mSearchSequence = tracerMemoryRemoteSearchSequence;
+    memory->mFindFunctionStart = tracerMemoryRemoteFindFunctionStart;
+    memory->mSearchPatterns = tracerMemoryRemoteSearchPatterns;
+
+    DWORD accessFlags = SYNCHRONIZE
+        | PROCESS_VM_OPERATION
         | PROCESS_VM_READ
         | PROCESS_VM_WRITE
         | PROCESS_QUERY_INFORMATION
@@ -77,6 +117,15 @@ void tracerCleanupRemoteMemoryContext(TracerContext* ctx) {
     tracerCleanupMemoryContext(ctx);
 }
 
+void tracerMemoryRemoteSetChannel(TracerContext* ctx, TracerHandle channel) {
+    if (!tracerCoreValidateContext(ctx, eTracerMemoryContextRemote)) {
+        return;
+    }
+
+    TracerRemoteMemoryContext* remote = (TracerRemoteMemoryContext*)ctx;
+    remote->mChannel = channel;
+}
+
 static TracerBool tracerMemoryRemoteInit(TracerContext* ctx, TracerHandle sharedMemoryHandle) {
     wchar_t fileName[MAX_PATH];
     wchar_t filePath[MAX_PATH];
@@ -177,6 +226,9 @@ static TracerBool tracerMemoryRemoteShutdown(TracerContext* ctx) {
         return eTracerTrue;
     }
 
+    // The agent thread of the channel is stopped by tracerShutdownEx, it can't serve this call itself
+    tracerMemoryRemoteSetChannel(ctx, NULL);
+
     TracerShutdown shutdown = {
         /* mSizeOfStruct     = */ sizeof(TracerShutdown),
     };
@@ -373,6 +425,15 @@ TracerHandle tracerMemoryRemoteCallNamedExportEx(TracerContext* ctx,
 #define MAX_EXPORT_NAME_LENGTH 256
 
 int tracerMemoryRemoteCallLocalExport(TracerContext* ctx, const char* exportName, const TracerStruct* parameter) {
+    TracerRemoteMemoryContext* remote = (TracerRemoteMemoryContext*)ctx;
+
+    int result = 0;
+
+    // Prefer the command channel, it saves us from spawning a new thread inside the remote process
+    if (remote->mChannel && tracerChannelCall(remote->mChannel, exportName, parameter, NULL, &result)) {
+        return result;
+    }
+
     char decoratedExportName[MAX_EXPORT_NAME_LENGTH];
     snprintf(decoratedExportName, MAX_EXPORT_NAME_LENGTH, "_%s@4", exportName);
 
@@ -382,8 +443,6 @@ int tracerMemoryRemoteCallLocalExport(TracerContext* ctx, const char* exportName
         return 0;
     }
 
-    int result = 0;
-
     if (tracerMemoryRemoteWrite(ctx, buffer, parameter, parameter->mSizeOfStruct)) {
         result = (int)tracerMemoryRemoteCallNamedExportEx(ctx, NULL, decoratedExportName, buffer, -1);
     }
@@ -393,6 +452,15 @@ int tracerMemoryRemoteCallLocalExport(TracerContext* ctx, const char* exportName
 }
 
 int tracerMemoryRemoteCallLocalExportEx(TracerContext* ctx, const char* exportName, TracerStruct* parameter) {
+    TracerRemoteMemoryContext* remote = (TracerRemoteMemoryContext*)ctx;
+
+    int result = 0;
+
+    // Prefer the command channel, it saves us from spawning a new thread inside the remote process
+    if (remote->mChannel && tracerChannelCall(remote->mChannel, exportName, parameter, parameter, &result)) {
+        return result;
+    }
+
     char decoratedExportName[MAX_EXPORT_NAME_LENGTH];
     snprintf(decoratedExportName, MAX_EXPORT_NAME_LENGTH, "_%s@4", exportName);
 
@@ -402,8 +470,6 @@ int tracerMemoryRemoteCallLocalExportEx(TracerContext* ctx, const char* exportNa
         return 0;
     }
 
-    int result = 0;
-
     if (tracerMemoryRemoteWrite(ctx, buffer, parameter, parameter->mSizeOfStruct)) {
         result = (int)tracerMemoryRemoteCallNamedExportEx(ctx, NULL, decoratedExportName, buffer, -1);
 
@@ -413,3 +479,200 @@ int tracerMemoryRemoteCallLocalExportEx(TracerContext* ctx, const char* exportNa
     tracerMemoryRemoteFree(ctx, buffer);
     return result;
 }
+
+static TracerBool tracerMemoryRemoteSearchWindow(const uint8_t* window, uintptr_t windowAddress, size_t numPositions, void* userData) {
+    TracerRemoteSearch* search = (TracerRemoteSearch*)userData;
+
+    const uint8_t* match = search->mBackward ?
+        tracerScanLast(search->mPattern, window, numPositions) :
+        tracerScanFirst(search->mPattern, window, numPositions);
+
+    if (match) {
+        search->mResult = windowAddress + (uintptr_t)(match - window);
+        return eTracerFalse;
+    }
+    return eTracerTrue;
+}
+
+static const uint8_t* tracerMemoryRemoteSearch(TracerContext* ctx, const TracerScanPattern* pattern,
+    uintptr_t address, size_t numPositions, TracerBool backward) {
+
+    TracerMemoryContext* memory = (TracerMemoryContext*)ctx;
+
+    TracerRemoteSearch search;
+    search.mPattern = pattern;
+    search.mBackward = backward;
+    search.mResult = 0;
+
+    // The windows overlap by the pattern size, so a match can't fall between two of them
+    tracerMemoryStream((HANDLE)memory->mProcessHandle, address, numPositions, pattern->mSize ? pattern->mSize - 1 : 0,
+        backward, tracerMemoryRemoteSearchWindow, &search);
+
+    return (const uint8_t*)search.mResult;
+}
+
+static const uint8_t* tracerMemoryRemoteSearchPattern(TracerContext* ctx, const uint8_t* haystack,
+    size_t haystackSize, const uint8_t* needle, size_t needleSize, uint8_t wildcard) {
+
+    if (!needleSize || haystackSize < needleSize) {
+        return NULL;
+    }
+
+    TracerScanPattern pattern;
+
+    if (!tracerScanCompileWildcard(&pattern, needle, needleSize, wildcard)) {
+        tracerCoreSetLastError(eTracerErrorNotImplemented);
+        return NULL;
+    }
+
+    return tracerMemoryRemoteSearch(ctx, &pattern, (uintptr_t)haystack, haystackSize - needleSize + 1, eTracerFalse);
+}
+
+static const uint8_t* tracerMemoryRemoteSearchSequence(TracerContext* ctx, const uint8_t* start,
+    const uint8_t* end, const uint8_t* seq, const char* mask) {
+
+    TracerScanPattern pattern;
+
+    if (!tracerScanCompileMask(&pattern, seq, mask)) {
+        tracerCoreSetLastError(eTracerErrorNotImplemented);
+        return NULL;
+    }
+
+    // Same positions as the local search, [start, end) upwards and (end, start] downwards
+    if (start < end) {
+        return tracerMemoryRemoteSearch(ctx, &pattern, (uintptr_t)start, (size_t)(end - start), eTracerFalse);
+    } else if (start > end) {
+        return tracerMemoryRemoteSearch(ctx, &pattern, (uintptr_t)end + 1, (size_t)(start - end), eTracerTrue);
+    }
+    return NULL;
+}
+
+static size_t tracerMemoryRemoteGetInstructionSize(TracerContext* ctx, const uint8_t* instruction) {
+    uint8_t buffer[TLIB_LDE_MAX_INSTRUCTION_SIZE];
+    size_t size = tracerMemoryRemoteRead(ctx, instruction, buffer, sizeof(buffer));
+
+    if (!size) {
+        // The instruction might end right in front of an inaccessible page, try again with what's left of this one
+        size_t pageRemaining = 0x1000 - ((uintptr_t)instruction & 0xFFF);
+        size = tracerMemoryRemoteRead(ctx, instruction, buffer, min(pageRemaining, sizeof(buffer)));
+    }
+
+    return tracerLdeGetLength(buffer, size, TLIB_LDE_MODE_NATIVE);
+}
+
+static const uint8_t* tracerMemoryRemoteFindFunctionStart(TracerContext* ctx, const uint8_t* offset, size_t size) {
+    // The disassembly pass might run up to one instruction past the offset
+    static const size_t maxInstructionSize = 16;
+
+    const uint8_t* indexed = (const uint8_t*)tracerMemoryFindContainingFunction(ctx, (uintptr_t)offset);
+
+    if (indexed && (size_t)(offset - indexed) <= size) {
+        return indexed;
+    }
+
+    uint8_t* buffer = (uint8_t*)calloc(1, size + maxInstructionSize);
+
+    if (!buffer) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    const uint8_t* result = NULL;
+    const uint8_t* start = offset - size;
+
+    // Only the code in front of the offset has to be readable, the tail is best effort
+    if (tracerMemoryRemoteRead(ctx, start, buffer, size) == size) {
+        tracerMemoryRemoteRead(ctx, offset, buffer + size, maxInstructionSize);
+
+        const uint8_t* match = tracerMemoryLocalFindFunctionStartInBuffer(buffer + size, size);
+
+        if (match) {
+            result = start + (match - buffer);
+        }
+    }
+
+    free(buffer);
+    return result;
+}
+
+static TracerBool tracerMemoryRemoteOnPatternMatch(const uint8_t* address, size_t patternId, void* userData) {
+    TracerRemoteMultiSearch* search = (TracerRemoteMultiSearch*)userData;
+
+    size_t offset = (size_t)(address - search->mWindow);
+
+    // Matches that start within the overlap are reported by the next window, if there is one
+    if (offset >= search->mNumPositions && search->mWindowAddress + search->mNumPositions != search->mEndAddress) {
+        return eTracerTrue;
+    }
+
+    ++search->mNumMatches;
+
+    if (!search->mCallback((const uint8_t*)(search->mWindowAddress + offset), patternId, search->mUserData)) {
+        search->mStopped = eTracerTrue;
+        return eTracerFalse;
+    }
+    return eTracerTrue;
+}
+
+static TracerBool tracerMemoryRemoteSearchPatternsWindow(const uint8_t* window, uintptr_t windowAddress, size_t numPositions, void* userData) {
+    TracerRemoteMultiSearch* search = (TracerRemoteMultiSearch*)userData;
+
+    search->mWindow = window;
+    search->mWindowAddress = windowAddress;
+    search->mNumPositions = numPositions;
+
+    size_t overlap = tracerScanSetGetMaxPatternSize(search->mScanSet) - 1;
+
+    tracerScanSetSearch(search->mScanSet, window, numPositions + overlap, tracerMemoryRemoteOnPatternMatch, search);
+    return !search->mStopped;
+}
+
+static size_t tracerMemoryRemoteSearchPatterns(TracerContext* ctx, const uint8_t* start, size_t size,
+    TracerHandle scanSet, TracerScanCallback callback, void* userData) {
+
+    TracerMemoryContext* memory = (TracerMemoryContext*)ctx;
+
+    size_t maxPatternSize = tracerScanSetGetMaxPatternSize(scanSet);
+
+    if (!maxPatternSize || !callback) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    if (size < maxPatternSize) {
+        // Too small for a window, fetch it in one piece
+        uint8_t buffer[TLIB_SCAN_MAX_PATTERN_SIZE];
+
+        TracerRemoteMultiSearch search;
+        memset(&search, 0, sizeof(search));
+
+        search.mScanSet = scanSet;
+        search.mCallback = callback;
+        search.mUserData = userData;
+        search.mWindow = buffer;
+        search.mWindowAddress = (uintptr_t)start;
+        search.mNumPositions = size;
+        search.mEndAddress = (uintptr_t)start + size;
+
+        if (tracerMemoryRemoteRead(ctx, start, buffer, size) != size) {
+            return 0;
+        }
+
+        tracerScanSetSearch(scanSet, buffer, size, tracerMemoryRemoteOnPatternMatch, &search);
+        return search.mNumMatches;
+    }
+
+    TracerRemoteMultiSearch search;
+    memset(&search, 0, sizeof(search));
+
+    search.mScanSet = scanSet;
+    search.mCallback = callback;
+    search.mUserData = userData;
+    search.mEndAddress = (uintptr_t)start + size - maxPatternSize + 1;
+
+    // The last maxPatternSize - 1 bytes are only read as the overlap of the last window
+    tracerMemoryStream((HANDLE)memory->mProcessHandle, (uintptr_t)start, size - maxPatternSize + 1,
+        maxPatternSize - 1, eTracerFalse, tracerMemoryRemoteSearchPatternsWindow, &search);
+
+    return search.mNumMatches;
+}
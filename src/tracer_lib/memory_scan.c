@@ -0,0 +1,335 @@
+
+#include <tracer_lib/memory_scan.h>
+
+#include <Psapi.h>
+
+#pragma comment(lib, "psapi")
+
+typedef struct TracerScanChunk {
+    uintptr_t                       mAddress;
+    size_t                          mSize;                  // Matches have to start within this part
+    size_t                          mReadSize;              // Includes the overlap with the next chunk
+} TracerScanChunk;
+
+typedef struct TracerMemoryScanJob {
+    HANDLE                          mProcess;
+    TracerHandle                    mScanSet;
+
+    TracerScanChunk*                mChunks;
+    size_t                          mNumChunks;
+    size_t                          mMaxChunks;
+    volatile LONG                   mNextChunk;
+} TracerMemoryScanJob;
+
+typedef struct TracerMemoryScanWorker {
+    TracerMemoryScanJob*            mJob;
+    HANDLE                          mThread;
+    uint8_t*                        mBuffer;
+    const TracerScanChunk*          mCurrentChunk;
+
+    TracerScanMatch*                mMatches;
+    size_t                          mNumMatches;
+    size_t                          mMaxMatches;
+    TracerBool                      mOutOfMemory;
+} TracerMemoryScanWorker;
+
+static TracerBool tracerMemoryScanIsReadable(const MEMORY_BASIC_INFORMATION* region) {
+    if (region->State != MEM_COMMIT || !region->Protect) {
+        return eTracerFalse;
+    }
+    return !(region->Protect & (PAGE_NOACCESS | PAGE_GUARD));
+}
+
+static TracerBool tracerMemoryScanAddRun(TracerMemoryScanJob* job, uintptr_t address, size_t size, size_t overlap) {
+    // Split the run into chunks that overlap by the longest pattern, so no match gets lost at their borders
+    for (size_t offset = 0; offset < size; offset += TLIB_MEMORY_SCAN_CHUNK_SIZE) {
+        if (job->mNumChunks == job->mMaxChunks) {
+            size_t maxChunks = job->mMaxChunks ? job->mMaxChunks * 2 : 64;
+
+            TracerScanChunk* chunks = (TracerScanChunk*)realloc(job->mChunks, maxChunks * sizeof(TracerScanChunk));
+
+            if (!chunks) {
+                tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+                return eTracerFalse;
+            }
+
+            job->mChunks = chunks;
+            job->mMaxChunks = maxChunks;
+        }
+
+        TracerScanChunk* chunk = &job->mChunks[job->mNumChunks++];
+        chunk->mAddress = address + offset;
+        chunk->mSize = min(TLIB_MEMORY_SCAN_CHUNK_SIZE, size - offset);
+        chunk->mReadSize = min(chunk->mSize + overlap, size - offset);
+    }
+    return eTracerTrue;
+}
+
+static TracerBool tracerMemoryScanCollectChunks(TracerMemoryScanJob* job, uintptr_t start, uintptr_t end,
+    size_t overlap, TracerMemoryScanWorker* workers, size_t numWorkers) {
+
+    uintptr_t runStart = 0;
+    uintptr_t runEnd = 0;
+    uintptr_t address = start;
+
+    while (address < end) {
+        MEMORY_BASIC_INFORMATION region;
+
+        if (!VirtualQueryEx(job->mProcess, (LPCVOID)address, &region, sizeof(region))) {
+            break;
+        }
+
+        uintptr_t regionEnd = min((uintptr_t)region.BaseAddress + region.RegionSize, end);
+        TracerBool isReadable = tracerMemoryScanIsReadable(&region);
+
+        // Our own buffers hold copies of the scanned memory, they would only produce duplicates
+        for (size_t i = 0; i < numWorkers && isReadable; ++i) {
+            if (region.AllocationBase == workers[i].mBuffer) {
+                isReadable = eTracerFalse;
+            }
+        }
+
+        if (isReadable) {
+            // Adjacent readable regions (e.g. the sections of a module) are scanned as one run,
+            // patterns can cross the border between them
+            if (address != runEnd) {
+                if (runEnd > runStart && !tracerMemoryScanAddRun(job, runStart, runEnd - runStart, overlap)) {
+                    return eTracerFalse;
+                }
+                runStart = address;
+            }
+            runEnd = regionEnd;
+        }
+
+        if (regionEnd <= address) {
+            break;
+        }
+        address = regionEnd;
+    }
+
+    if (runEnd > runStart) {
+        return tracerMemoryScanAddRun(job, runStart, runEnd - runStart, overlap);
+    }
+    return eTracerTrue;
+}
+
+static TracerBool tracerMemoryScanOnMatch(const uint8_t* address, size_t patternId, void* userData) {
+    TracerMemoryScanWorker* worker = (TracerMemoryScanWorker*)userData;
+    const TracerScanChunk* chunk = worker->mCurrentChunk;
+
+    size_t offset = (size_t)(address - worker->mBuffer);
+
+    // Matches within the overlap belong to the next chunk, it reports them
+    if (offset >= chunk->mSize) {
+        return eTracerTrue;
+    }
+
+    if (worker->mNumMatches == worker->mMaxMatches) {
+        size_t maxMatches = worker->mMaxMatches ? worker->mMaxMatches * 2 : 256;
+
+        TracerScanMatch* matches = (TracerScanMatch*)realloc(worker->mMatches, maxMatches * sizeof(TracerScanMatch));
+
+        if (!matches) {
+            worker->mOutOfMemory = eTracerTrue;
+            return eTracerFalse;
+        }
+
+        worker->mMatches = matches;
+        worker->mMaxMatches = maxMatches;
+    }
+
+    TracerScanMatch* match = &worker->mMatches[worker->mNumMatches++];
+    match->mAddress = chunk->mAddress + offset;
+    match->mPatternId = patternId;
+
+    return eTracerTrue;
+}
+
+static DWORD WINAPI tracerMemoryScanWorkerThread(LPVOID parameter) {
+    TracerMemoryScanWorker* worker = (TracerMemoryScanWorker*)parameter;
+    TracerMemoryScanJob* job = worker->mJob;
+
+    while (!worker->mOutOfMemory) {
+        LONG chunkIndex = InterlockedIncrement(&job->mNextChunk) - 1;
+
+        if ((size_t)chunkIndex >= job->mNumChunks) {
+            break;
+        }
+
+        const TracerScanChunk* chunk = &job->mChunks[chunkIndex];
+        SIZE_T bytesRead = 0;
+
+        // A region might have been released since we looked at it, scan whatever we still got
+        if (!ReadProcessMemory(job->mProcess, (LPCVOID)chunk->mAddress, worker->mBuffer, chunk->mReadSize, &bytesRead) &&
+            !bytesRead) {
+            continue;
+        }
+
+        worker->mCurrentChunk = chunk;
+        tracerScanSetSearch(job->mScanSet, worker->mBuffer, (size_t)bytesRead, tracerMemoryScanOnMatch, worker);
+    }
+    return 0;
+}
+
+static int tracerMemoryScanCompareMatches(const void* lhs, const void* rhs) {
+    const TracerScanMatch* a = (const TracerScanMatch*)lhs;
+    const TracerScanMatch* b = (const TracerScanMatch*)rhs;
+
+    if (a->mAddress != b->mAddress) {
+        return (a->mAddress < b->mAddress) ? -1 : 1;
+    }
+    return (a->mPatternId > b->mPatternId) - (a->mPatternId < b->mPatternId);
+}
+
+static TracerBool tracerMemoryScanGetRange(TracerMemoryContext* memory, TracerHandle module, uintptr_t* start, uintptr_t* end) {
+    if (!module) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+
+        *start = (uintptr_t)systemInfo.lpMinimumApplicationAddress;
+        *end = (uintptr_t)systemInfo.lpMaximumApplicationAddress;
+        return eTracerTrue;
+    }
+
+    MODULEINFO moduleInfo;
+
+    if (!GetModuleInformation((HANDLE)memory->mProcessHandle, (HMODULE)module, &moduleInfo, sizeof(moduleInfo))) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return eTracerFalse;
+    }
+
+    *start = (uintptr_t)moduleInfo.lpBaseOfDll;
+    *end = *start + moduleInfo.SizeOfImage;
+    return eTracerTrue;
+}
+
+TracerBool tracerMemoryScan(TracerContext* ctx, TracerHandle module, TracerHandle scanSet,
+    TracerScanMatch** outMatches, size_t* outNumMatches) {
+
+    if (!tracerCoreValidateContext(ctx, eTracerMemoryContext)) {
+        return eTracerFalse;
+    }
+
+    if (!scanSet || !outMatches || !outNumMatches) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    *outMatches = NULL;
+    *outNumMatches = 0;
+
+    TracerMemoryContext* memory = (TracerMemoryContext*)ctx;
+
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+
+    if (!tracerMemoryScanGetRange(memory, module, &start, &end)) {
+        return eTracerFalse;
+    }
+
+    size_t overlap = tracerScanSetGetMaxPatternSize(scanSet) - 1;
+
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+
+    size_t numWorkers = min(max(systemInfo.dwNumberOfProcessors, 1), TLIB_MEMORY_SCAN_MAX_WORKERS);
+
+    TracerMemoryScanJob job;
+    memset(&job, 0, sizeof(job));
+
+    job.mProcess = (HANDLE)memory->mProcessHandle;
+    job.mScanSet = scanSet;
+
+    TracerMemoryScanWorker* workers = (TracerMemoryScanWorker*)calloc(numWorkers, sizeof(TracerMemoryScanWorker));
+
+    if (!workers) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    TracerBool result = eTracerFalse;
+
+    // The buffers are allocated before the regions are collected, so they can be left out of local scans
+    for (size_t i = 0; i < numWorkers; ++i) {
+        workers[i].mJob = &job;
+        workers[i].mBuffer = (uint8_t*)VirtualAlloc(NULL, TLIB_MEMORY_SCAN_CHUNK_SIZE + overlap,
+            MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+        if (!workers[i].mBuffer) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            goto cleanup;
+        }
+    }
+
+    if (!tracerMemoryScanCollectChunks(&job, start, end, overlap, workers, numWorkers)) {
+        goto cleanup;
+    }
+
+    size_t numThreads = min(numWorkers, max(job.mNumChunks, 1));
+
+    // The calling thread is the first worker, the others get a thread of their own
+    for (size_t i = 1; i < numThreads; ++i) {
+        workers[i].mThread = CreateThread(NULL, 0, tracerMemoryScanWorkerThread, &workers[i], 0, NULL);
+    }
+
+    tracerMemoryScanWorkerThread(&workers[0]);
+
+    size_t numMatches = workers[0].mNumMatches;
+    TracerBool outOfMemory = workers[0].mOutOfMemory;
+
+    for (size_t i = 1; i < numThreads; ++i) {
+        if (workers[i].mThread) {
+            WaitForSingleObject(workers[i].mThread, INFINITE);
+            CloseHandle(workers[i].mThread);
+        }
+
+        numMatches += workers[i].mNumMatches;
+        outOfMemory |= workers[i].mOutOfMemory;
+    }
+
+    if (outOfMemory) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        goto cleanup;
+    }
+
+    if (numMatches) {
+        TracerScanMatch* matches = (TracerScanMatch*)malloc(numMatches * sizeof(TracerScanMatch));
+
+        if (!matches) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            goto cleanup;
+        }
+
+        size_t position = 0;
+
+        for (size_t i = 0; i < numThreads; ++i) {
+            memcpy(&matches[position], workers[i].mMatches, workers[i].mNumMatches * sizeof(TracerScanMatch));
+            position += workers[i].mNumMatches;
+        }
+
+        // The workers picked up the chunks in whatever order they got to them
+        qsort(matches, numMatches, sizeof(TracerScanMatch), tracerMemoryScanCompareMatches);
+
+        *outMatches = matches;
+        *outNumMatches = numMatches;
+    }
+
+    result = eTracerTrue;
+
+cleanup:
+    for (size_t i = 0; i < numWorkers; ++i) {
+        if (workers[i].mBuffer) {
+            VirtualFree(workers[i].mBuffer, 0, MEM_RELEASE);
+        }
+        free(workers[i].mMatches);
+    }
+
+    free(workers);
+    free(job.mChunks);
+
+    return result;
+}
+
+void tracerMemoryFreeScanMatches(TracerScanMatch* matches) {
+    free(matches);
+}
@@ -0,0 +1,176 @@
+
+#include <tracer_lib/memory_stream.h>
+
+typedef struct TracerMemoryWindow {
+    uint8_t*                        mData;
+    uintptr_t                       mAddress;
+    size_t                          mNumPositions;
+    TracerBool                      mIsValid;               // The whole window could be read
+} TracerMemoryWindow;
+
+typedef struct TracerMemoryStreamState {
+    HANDLE                          mProcess;
+    uintptr_t                       mAddress;
+    size_t                          mNumPositions;
+    size_t                          mOverlap;
+    TracerBool                      mBackward;
+
+    TracerMemoryWindow              mWindows[2];
+
+    HANDLE                          mReader;
+    HANDLE                          mReadRequest;
+    HANDLE                          mReadDone;
+    size_t                          mPendingWindow;
+    volatile LONG                   mStop;
+} TracerMemoryStreamState;
+
+static void tracerMemoryStreamRead(TracerMemoryStreamState* state, size_t index) {
+    TracerMemoryWindow* window = &state->mWindows[index & 1];
+
+    size_t first = index * TLIB_MEMORY_STREAM_WINDOW_SIZE;
+    size_t count = min(TLIB_MEMORY_STREAM_WINDOW_SIZE, state->mNumPositions - first);
+
+    if (state->mBackward) {
+        first = state->mNumPositions - first - count;
+    }
+
+    window->mAddress = state->mAddress + first;
+    window->mNumPositions = count;
+
+    SIZE_T bytesRead = 0;
+    size_t size = count + state->mOverlap;
+
+    window->mIsValid = ReadProcessMemory(state->mProcess, (LPCVOID)window->mAddress,
+        window->mData, size, &bytesRead) && bytesRead == size;
+}
+
+static DWORD WINAPI tracerMemoryStreamReaderThread(LPVOID parameter) {
+    TracerMemoryStreamState* state = (TracerMemoryStreamState*)parameter;
+
+    for (;;) {
+        WaitForSingleObject(state->mReadRequest, INFINITE);
+
+        if (state->mStop) {
+            break;
+        }
+
+        tracerMemoryStreamRead(state, state->mPendingWindow);
+        SetEvent(state->mReadDone);
+    }
+    return 0;
+}
+
+static void tracerMemoryStreamStartReader(TracerMemoryStreamState* state) {
+    state->mReadRequest = CreateEvent(NULL, FALSE, FALSE, NULL);
+    state->mReadDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    if (state->mReadRequest && state->mReadDone) {
+        state->mReader = CreateThread(NULL, 0, tracerMemoryStreamReaderThread, state, 0, NULL);
+    }
+
+    // Without a reader thread the windows are simply read one after another
+}
+
+static void tracerMemoryStreamStopReader(TracerMemoryStreamState* state) {
+    if (state->mReader) {
+        InterlockedExchange(&state->mStop, 1);
+        SetEvent(state->mReadRequest);
+
+        WaitForSingleObject(state->mReader, INFINITE);
+        CloseHandle(state->mReader);
+    }
+
+    if (state->mReadRequest) {
+        CloseHandle(state->mReadRequest);
+    }
+
+    if (state->mReadDone) {
+        CloseHandle(state->mReadDone);
+    }
+}
+
+TracerBool tracerMemoryStream(HANDLE process, uintptr_t address, size_t numPositions, size_t overlap,
+    TracerBool backward, TracerMemoryStreamCallback callback, void* userData) {
+
+    if (!callback) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    if (!numPositions) {
+        return eTracerTrue;
+    }
+
+    TracerMemoryStreamState state;
+    memset(&state, 0, sizeof(state));
+
+    state.mProcess = process;
+    state.mAddress = address;
+    state.mNumPositions = numPositions;
+    state.mOverlap = overlap;
+    state.mBackward = backward;
+
+    size_t numWindows = (numPositions + TLIB_MEMORY_STREAM_WINDOW_SIZE - 1) / TLIB_MEMORY_STREAM_WINDOW_SIZE;
+    size_t bufferSize = min(numPositions, TLIB_MEMORY_STREAM_WINDOW_SIZE) + overlap;
+
+    state.mWindows[0].mData = (uint8_t*)malloc(bufferSize);
+    state.mWindows[1].mData = (numWindows > 1) ? (uint8_t*)malloc(bufferSize) : NULL;
+
+    if (!state.mWindows[0].mData || (numWindows > 1 && !state.mWindows[1].mData)) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        free(state.mWindows[0].mData);
+        free(state.mWindows[1].mData);
+        return eTracerFalse;
+    }
+
+    if (numWindows > 1) {
+        tracerMemoryStreamStartReader(&state);
+    }
+
+    TracerBool result = eTracerTrue;
+    TracerBool readPending = eTracerFalse;
+
+    tracerMemoryStreamRead(&state, 0);
+
+    for (size_t i = 0; i < numWindows; ++i) {
+        const TracerMemoryWindow* window = &state.mWindows[i & 1];
+
+        // Fetch the next window while the callback looks at this one
+        if (i + 1 < numWindows && state.mReader) {
+            state.mPendingWindow = i + 1;
+            readPending = eTracerTrue;
+            SetEvent(state.mReadRequest);
+        }
+
+        if (!window->mIsValid) {
+            tracerCoreSetLastError(eTracerErrorSystemCall);
+            result = eTracerFalse;
+            break;
+        }
+
+        if (!callback(window->mData, window->mAddress, window->mNumPositions, userData)) {
+            break;
+        }
+
+        if (i + 1 < numWindows) {
+            if (readPending) {
+                WaitForSingleObject(state.mReadDone, INFINITE);
+                readPending = eTracerFalse;
+            } else {
+                tracerMemoryStreamRead(&state, i + 1);
+            }
+        }
+    }
+
+    // Don't pull the buffers out from under the reader
+    if (readPending) {
+        WaitForSingleObject(state.mReadDone, INFINITE);
+    }
+
+    tracerMemoryStreamStopReader(&state);
+
+    free(state.mWindows[0].mData);
+    free(state.mWindows[1].mData);
+
+    return result;
+}
@@ -0,0 +1,272 @@
+
+#include <tracer_lib/pe_image.h>
+
+#define TLIB_PE_IMAGE_RSDS_SIGNATURE        0x53445352  // 'RSDS'
+#define TLIB_PE_IMAGE_MAX_DEBUG_ENTRIES     16
+#define TLIB_PE_IMAGE_MAX_EXPORT_NAME       256
+
+#pragma pack(push, 1)
+typedef struct TracerCodeViewRsds {
+    uint32_t                        mSignature;
+    uint8_t                         mGuid[16];
+    uint32_t                        mAge;
+} TracerCodeViewRsds;
+#pragma pack(pop)
+
+static TracerBool tracerPeRead(HANDLE process, uintptr_t address, void* buffer, size_t size) {
+    SIZE_T bytesRead = 0;
+
+    if (!ReadProcessMemory(process, (LPCVOID)address, buffer, size, &bytesRead) || bytesRead != size) {
+        return eTracerFalse;
+    }
+
+    return eTracerTrue;
+}
+
+static void tracerPeReadDebugInfo(HANDLE process, const IMAGE_DATA_DIRECTORY* directory, TracerPeImageInfo* info) {
+    IMAGE_DEBUG_DIRECTORY entries[TLIB_PE_IMAGE_MAX_DEBUG_ENTRIES];
+
+    size_t numEntries = min(directory->Size / sizeof(IMAGE_DEBUG_DIRECTORY), TLIB_PE_IMAGE_MAX_DEBUG_ENTRIES);
+
+    if (!numEntries || !tracerPeRead(process, info->mBaseAddress + directory->VirtualAddress,
+            entries, numEntries * sizeof(IMAGE_DEBUG_DIRECTORY))) {
+        return;
+    }
+
+    for (size_t i = 0; i < numEntries; ++i) {
+        const IMAGE_DEBUG_DIRECTORY* entry = &entries[i];
+
+        // The raw data of the record is only mapped if it has a virtual address
+        if (entry->Type != IMAGE_DEBUG_TYPE_CODEVIEW || !entry->AddressOfRawData ||
+            entry->SizeOfData <= sizeof(TracerCodeViewRsds)) {
+            continue;
+        }
+
+        uintptr_t recordAddress = info->mBaseAddress + entry->AddressOfRawData;
+        TracerCodeViewRsds rsds;
+
+        if (!tracerPeRead(process, recordAddress, &rsds, sizeof(rsds)) ||
+            rsds.mSignature != TLIB_PE_IMAGE_RSDS_SIGNATURE) {
+            continue;
+        }
+
+        size_t pathLength = min(entry->SizeOfData - sizeof(TracerCodeViewRsds), sizeof(info->mPdbPath) - 1);
+
+        if (!tracerPeRead(process, recordAddress + sizeof(TracerCodeViewRsds), info->mPdbPath, pathLength)) {
+            continue;
+        }
+
+        info->mPdbPath[pathLength] = 0;
+
+        memcpy(info->mPdbSignature, rsds.mGuid, sizeof(info->mPdbSignature));
+        info->mPdbAge = rsds.mAge;
+        info->mHasDebugInfo = eTracerTrue;
+        return;
+    }
+}
+
+static void tracerPeReadSections(HANDLE process, uintptr_t ntHeadersAddress,
+    const IMAGE_NT_HEADERS* ntHeaders, TracerPeImageInfo* info) {
+
+    IMAGE_SECTION_HEADER sections[TLIB_PE_IMAGE_MAX_SECTIONS];
+
+    size_t numSections = min(ntHeaders->FileHeader.NumberOfSections, TLIB_PE_IMAGE_MAX_SECTIONS);
+
+    // The section table follows the optional header, whatever size the header claims to have
+    uintptr_t sectionsAddress = ntHeadersAddress + FIELD_OFFSET(IMAGE_NT_HEADERS, OptionalHeader) +
+        ntHeaders->FileHeader.SizeOfOptionalHeader;
+
+    if (!numSections || !tracerPeRead(process, sectionsAddress, sections, numSections * sizeof(IMAGE_SECTION_HEADER))) {
+        return;
+    }
+
+    for (size_t i = 0; i < numSections; ++i) {
+        TracerPeSection* section = &info->mSections[i];
+
+        section->mRva = sections[i].VirtualAddress;
+        section->mSize = sections[i].Misc.VirtualSize ? sections[i].Misc.VirtualSize : sections[i].SizeOfRawData;
+        section->mIsExecutable = (sections[i].Characteristics & (IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_CNT_CODE)) != 0;
+    }
+
+    info->mNumSections = numSections;
+}
+
+static TracerBool tracerPeReadHeaders(HANDLE process, uintptr_t baseAddress, IMAGE_DOS_HEADER* dosHeader, IMAGE_NT_HEADERS* ntHeaders) {
+    if (!tracerPeRead(process, baseAddress, dosHeader, sizeof(IMAGE_DOS_HEADER)) ||
+        !tracerPeRead(process, baseAddress + dosHeader->e_lfanew, ntHeaders, sizeof(IMAGE_NT_HEADERS))) {
+
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return eTracerFalse;
+    }
+
+    // We only handle images that match our own bitness
+    if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE || ntHeaders->Signature != IMAGE_NT_SIGNATURE ||
+        ntHeaders->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR_MAGIC) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    return eTracerTrue;
+}
+
+TracerBool tracerPeReadImageStamp(HANDLE process, uintptr_t baseAddress, uint32_t* outTimeDateStamp, uint32_t* outCheckSum) {
+    if (!outTimeDateStamp || !outCheckSum) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    IMAGE_DOS_HEADER dosHeader;
+    IMAGE_NT_HEADERS ntHeaders;
+
+    if (!tracerPeReadHeaders(process, baseAddress, &dosHeader, &ntHeaders)) {
+        return eTracerFalse;
+    }
+
+    *outTimeDateStamp = ntHeaders.FileHeader.TimeDateStamp;
+    *outCheckSum = ntHeaders.OptionalHeader.CheckSum;
+    return eTracerTrue;
+}
+
+TracerBool tracerPeReadImageInfo(HANDLE process, uintptr_t baseAddress, TracerPeImageInfo* info) {
+    if (!info) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    memset(info, 0, sizeof(TracerPeImageInfo));
+    info->mBaseAddress = baseAddress;
+
+    IMAGE_DOS_HEADER dosHeader;
+    IMAGE_NT_HEADERS ntHeaders;
+
+    if (!tracerPeReadHeaders(process, baseAddress, &dosHeader, &ntHeaders)) {
+        return eTracerFalse;
+    }
+
+    const IMAGE_OPTIONAL_HEADER* optionalHeader = &ntHeaders.OptionalHeader;
+
+    info->mSizeOfImage = optionalHeader->SizeOfImage;
+    info->mTimeDateStamp = ntHeaders.FileHeader.TimeDateStamp;
+    info->mEntryPointRva = optionalHeader->AddressOfEntryPoint;
+
+    tracerPeReadSections(process, baseAddress + dosHeader.e_lfanew, &ntHeaders, info);
+
+    if (optionalHeader->NumberOfRvaAndSizes > IMAGE_DIRECTORY_ENTRY_EXPORT) {
+        info->mExportDirectoryRva = optionalHeader->DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress;
+        info->mExportDirectorySize = optionalHeader->DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].Size;
+    }
+
+    if (optionalHeader->NumberOfRvaAndSizes > IMAGE_DIRECTORY_ENTRY_DEBUG) {
+        tracerPeReadDebugInfo(process, &optionalHeader->DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG], info);
+    }
+
+    return eTracerTrue;
+}
+
+TracerBool tracerPeEnumExports(HANDLE process, const TracerPeImageInfo* info, TracerPeExportCallback callback, void* userData) {
+    if (!info || !callback) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    if (!info->mExportDirectoryRva || info->mExportDirectorySize < sizeof(IMAGE_EXPORT_DIRECTORY)) {
+        // Nothing to do, the image doesn't export anything
+        return eTracerTrue;
+    }
+
+    IMAGE_EXPORT_DIRECTORY directory;
+
+    if (!tracerPeRead(process, info->mBaseAddress + info->mExportDirectoryRva, &directory, sizeof(directory))) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return eTracerFalse;
+    }
+
+    // The linker places the directory, its tables and the names next to each other. Read the
+    // whole range with a single call instead of going back to the (remote) process for every name.
+    // The sizes come from the target, so they are computed in 64 bits to not wrap around
+    uint64_t firstRva = info->mExportDirectoryRva;
+    uint64_t lastRva = (uint64_t)info->mExportDirectoryRva + info->mExportDirectorySize;
+
+    uint64_t tableRvas[3] = { directory.AddressOfFunctions, directory.AddressOfNames, directory.AddressOfNameOrdinals };
+    uint64_t tableSizes[3] = { (uint64_t)directory.NumberOfFunctions * 4, (uint64_t)directory.NumberOfNames * 4, (uint64_t)directory.NumberOfNames * 2 };
+
+    for (int i = 0; i < 3; ++i) {
+        firstRva = min(firstRva, tableRvas[i]);
+        lastRva = max(lastRva, tableRvas[i] + tableSizes[i]);
+    }
+
+    if (lastRva <= firstRva || lastRva - firstRva > TLIB_PE_IMAGE_MAX_EXPORT_DATA ||
+        lastRva > info->mSizeOfImage) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    // Every table has to lie completely within the range that is read below
+    for (int i = 0; i < 3; ++i) {
+        if (tableRvas[i] < firstRva || tableRvas[i] + tableSizes[i] > lastRva) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return eTracerFalse;
+        }
+    }
+
+    uint8_t* data = (uint8_t*)malloc((size_t)(lastRva - firstRva));
+
+    if (!data) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    if (!tracerPeRead(process, info->mBaseAddress + (size_t)firstRva, data, (size_t)(lastRva - firstRva))) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        free(data);
+        return eTracerFalse;
+    }
+
+    const uint32_t* functions = (const uint32_t*)(data + (size_t)(directory.AddressOfFunctions - firstRva));
+    const uint32_t* names = (const uint32_t*)(data + (size_t)(directory.AddressOfNames - firstRva));
+    const uint16_t* ordinals = (const uint16_t*)(data + (size_t)(directory.AddressOfNameOrdinals - firstRva));
+
+    char nameBuffer[TLIB_PE_IMAGE_MAX_EXPORT_NAME];
+
+    for (uint32_t i = 0; i < directory.NumberOfNames; ++i) {
+        if (ordinals[i] >= directory.NumberOfFunctions) {
+            continue;
+        }
+
+        uint32_t functionRva = functions[ordinals[i]];
+
+        // Forwarded exports point into the export directory, they don't have any code in this image
+        if (!functionRva || (functionRva >= info->mExportDirectoryRva &&
+            functionRva < info->mExportDirectoryRva + info->mExportDirectorySize)) {
+            continue;
+        }
+
+        const char* name = NULL;
+        uint32_t nameRva = names[i];
+
+        if (nameRva >= firstRva && nameRva < lastRva) {
+            name = (const char*)(data + (size_t)(nameRva - firstRva));
+
+            if (!memchr(name, 0, (size_t)(lastRva - nameRva))) {
+                continue;
+            }
+        } else {
+            // Unusual layout, the name lives somewhere else
+            size_t length = min(sizeof(nameBuffer) - 1, (size_t)(info->mSizeOfImage - min(nameRva, info->mSizeOfImage)));
+
+            if (!length || !tracerPeRead(process, info->mBaseAddress + nameRva, nameBuffer, length)) {
+                continue;
+            }
+
+            nameBuffer[length] = 0;
+            name = nameBuffer;
+        }
+
+        callback(info->mBaseAddress + functionRva, name, userData);
+    }
+
+    free(data);
+    return eTracerTrue;
+}
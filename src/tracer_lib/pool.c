@@ -0,0 +1,96 @@
+
+#include <tracer_lib/pool.h>
+
+#include <malloc.h>
+
+typedef struct TracerPool {
+    SLIST_HEADER            mFreeList;      // Has to be the first member, it needs MEMORY_ALLOCATION_ALIGNMENT
+    uint8_t*                mStorage;
+    size_t                  mStride;
+    size_t                  mCapacity;
+} TracerPool;
+
+TracerHandle tracerCreatePool(size_t elemSize, size_t alignment, size_t capacity) {
+    if (!elemSize || !capacity || (alignment & (alignment - 1))) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    // Free objects hold the list entry, so they need at least its size and alignment
+    alignment = max(alignment, MEMORY_ALLOCATION_ALIGNMENT);
+    elemSize = max(elemSize, sizeof(SLIST_ENTRY));
+
+    TracerPool* pool = (TracerPool*)_aligned_malloc(sizeof(TracerPool), MEMORY_ALLOCATION_ALIGNMENT);
+
+    if (!pool) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    pool->mStride = (elemSize + alignment - 1) & ~(alignment - 1);
+    pool->mCapacity = capacity;
+    pool->mStorage = (uint8_t*)_aligned_malloc(pool->mStride * capacity, alignment);
+
+    if (!pool->mStorage) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        _aligned_free(pool);
+        return NULL;
+    }
+
+    InitializeSListHead(&pool->mFreeList);
+
+    // Push in reverse, the first allocations are handed out in address order
+    for (size_t i = capacity; i > 0; --i) {
+        InterlockedPushEntrySList(&pool->mFreeList, (PSLIST_ENTRY)(pool->mStorage + (i - 1) * pool->mStride));
+    }
+
+    return (TracerHandle)pool;
+}
+
+void tracerDestroyPool(TracerHandle handle) {
+    TracerPool* pool = (TracerPool*)handle;
+
+    if (!pool) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    _aligned_free(pool->mStorage);
+    _aligned_free(pool);
+}
+
+void* tracerPoolAlloc(TracerHandle handle) {
+    TracerPool* pool = (TracerPool*)handle;
+
+    if (!pool) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    // No error is set when the pool is exhausted, the caller might be the exception handler
+    return InterlockedPopEntrySList(&pool->mFreeList);
+}
+
+void tracerPoolFree(TracerHandle handle, void* object) {
+    TracerPool* pool = (TracerPool*)handle;
+
+    if (!pool || !object) {
+        return;
+    }
+
+    assert(tracerPoolOwns(handle, object));
+
+    InterlockedPushEntrySList(&pool->mFreeList, (PSLIST_ENTRY)object);
+}
+
+TracerBool tracerPoolOwns(TracerHandle handle, const void* object) {
+    TracerPool* pool = (TracerPool*)handle;
+
+    if (!pool || (const uint8_t*)object < pool->mStorage) {
+        return eTracerFalse;
+    }
+
+    size_t offset = (size_t)((const uint8_t*)object - pool->mStorage);
+
+    return (offset < pool->mStride * pool->mCapacity && offset % pool->mStride == 0) ? eTracerTrue : eTracerFalse;
+}
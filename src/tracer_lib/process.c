@@ -17,7 +17,9 @@ TracerContext* tracerCreateProcessContext(int type, int size, int pid) {
 
     TracerProcessContext* process = (TracerProcessContext*)ctx;
     process->mProcessId = pid;
+    process->mRefCount = 1;
 
+    InitializeCriticalSection(&process->mLock);
     return ctx;
 }
 
@@ -48,9 +50,61 @@ void tracerCleanupProcessContext(TracerContext* ctx) {
         process->mMemoryContext = NULL;
     }
 
+    // Destroying the queue above cleared the handle the traced process signals, so its copy of the
+    // event can go. Nothing to do if the process is gone, its handles went with it.
+    if (process->mRemoteDataEvent) {
+        HANDLE remoteProcess = OpenProcess(PROCESS_DUP_HANDLE, FALSE, (DWORD)process->mProcessId);
+
+        if (remoteProcess) {
+            DuplicateHandle(remoteProcess, (HANDLE)process->mRemoteDataEvent, NULL, NULL, 0, FALSE, DUPLICATE_CLOSE_SOURCE);
+            CloseHandle(remoteProcess);
+        }
+        process->mRemoteDataEvent = NULL;
+    }
+
+    if (process->mDataEvent) {
+        CloseHandle(process->mDataEvent);
+        process->mDataEvent = NULL;
+    }
+
+    DeleteCriticalSection(&process->mLock);
     tracerCoreCleanupContext(ctx);
 }
 
+void tracerProcessAddRef(TracerContext* ctx) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    InterlockedIncrement(&process->mRefCount);
+}
+
+void tracerProcessRelease(TracerContext* ctx) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    if (!InterlockedDecrement(&process->mRefCount)) {
+        tracerCoreDestroyContext(ctx);
+    }
+}
+
+void tracerProcessLock(TracerContext* ctx) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    EnterCriticalSection(&process->mLock);
+}
+
+void tracerProcessUnlock(TracerContext* ctx) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    LeaveCriticalSection(&process->mLock);
+}
+
 int tracerProcessGetPid(TracerContext* ctx) {
     if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
         return 0;
@@ -85,6 +139,24 @@ TracerBool tracerProcessStopTrace(TracerContext* ctx, const TracerStopTrace* sto
     return process->mStopTrace(ctx, stopTrace);
 }
 
+TracerBool tracerProcessStartWatch(TracerContext* ctx, const TracerStartWatch* startWatch) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return eTracerFalse;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    TLIB_METHOD_CHECK_SUPPORT(process->mStartWatch, eTracerFalse);
+    return process->mStartWatch(ctx, startWatch);
+}
+
+TracerBool tracerProcessStopWatch(TracerContext* ctx, const TracerStopWatch* stopWatch) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return eTracerFalse;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    TLIB_METHOD_CHECK_SUPPORT(process->mStopWatch, eTracerFalse);
+    return process->mStopWatch(ctx, stopWatch);
+}
+
 size_t tracerProcessFetchTraces(TracerContext* ctx, TracerTracedInstruction* outTraces, size_t maxElements) {
     if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
         return 0;
@@ -93,6 +165,89 @@ size_t tracerProcessFetchTraces(TracerContext* ctx, TracerTracedInstruction* out
     return tracerRWQueuePopAll(process->mSharedRWQueue, outTraces, maxElements);
 }
 
+size_t tracerProcessFetchTracesTagged(TracerContext* ctx, TracerProcessTracedInstruction* outTraces, size_t maxElements) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return 0;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+
+    size_t numTraces = 0;
+
+    while (numTraces < maxElements && tracerRWQueuePopItem(process->mSharedRWQueue, &outTraces[numTraces].mTrace)) {
+        outTraces[numTraces++].mProcessId = process->mProcessId;
+    }
+
+    return numTraces;
+}
+
+TracerBool tracerProcessCreateDataEvent(TracerContext* ctx) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return eTracerFalse;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+
+    HANDLE event = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    if (!event) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return eTracerFalse;
+    }
+
+    HANDLE writerEvent = event;
+
+    if (process->mProcessId != (int)GetCurrentProcessId()) {
+        // The traced process signals the event, it needs its own handle to it
+        HANDLE remoteProcess = OpenProcess(PROCESS_DUP_HANDLE, FALSE, (DWORD)process->mProcessId);
+
+        if (!remoteProcess) {
+            tracerCoreSetLastError(eTracerErrorInsufficientPermission);
+            CloseHandle(event);
+            return eTracerFalse;
+        }
+
+        BOOL duplicated = DuplicateHandle(GetCurrentProcess(), event, remoteProcess,
+            &writerEvent, 0, FALSE, DUPLICATE_SAME_ACCESS);
+
+        CloseHandle(remoteProcess);
+
+        if (!duplicated) {
+            tracerCoreSetLastError(eTracerErrorSystemCall);
+            CloseHandle(event);
+            return eTracerFalse;
+        }
+    }
+
+    process->mDataEvent = (TracerHandle)event;
+    process->mRemoteDataEvent = (writerEvent != event) ? (TracerHandle)writerEvent : NULL;
+
+    tracerRWQueueSetDataEvent(process->mSharedRWQueue, (TracerHandle)writerEvent);
+    return eTracerTrue;
+}
+
+TracerHandle tracerProcessGetDataEvent(TracerContext* ctx) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return NULL;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    return process->mDataEvent;
+}
+
+TracerBool tracerProcessPrepareWaitForTraces(TracerContext* ctx) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return eTracerFalse;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    return tracerRWQueuePrepareWait(process->mSharedRWQueue);
+}
+
+void tracerProcessCancelWaitForTraces(TracerContext* ctx) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    tracerRWQueueCancelWait(process->mSharedRWQueue);
+}
+
 const char* tracerProcessDecodeAndFormatInstruction(TracerContext* ctx, TracerDecodeAndFormat* decodeAndFmt) {
     if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
         return NULL;
@@ -110,3 +265,21 @@ TracerBool tracerProcessGetSymbolAddressFromSymbolName(TracerContext* ctx, Trace
     TLIB_METHOD_CHECK_SUPPORT(process->mGetSymbolAddressFromSymbolName, eTracerFalse);
     return process->mGetSymbolAddressFromSymbolName(ctx, addrFromName);
 }
+
+TracerBool tracerProcessGetStatistics(TracerContext* ctx, TracerStatistics* statistics) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return eTracerFalse;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    TLIB_METHOD_CHECK_SUPPORT(process->mGetStatistics, eTracerFalse);
+    return process->mGetStatistics(ctx, statistics);
+}
+
+TracerBool tracerProcessSymbolizeAddresses(TracerContext* ctx, TracerSymbolizeAddresses* symbolize) {
+    if (!tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return eTracerFalse;
+    }
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    TLIB_METHOD_CHECK_SUPPORT(process->mSymbolizeAddresses, eTracerFalse);
+    return process->mSymbolizeAddresses(ctx, symbolize);
+}
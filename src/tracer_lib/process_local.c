@@ -4,6 +4,7 @@
 #include <tracer_lib/symbol_resolver.h>
 #include <tracer_lib/vetrace.h>
 #include <tracer_lib/rwqueue.h>
+#include <tracer_lib/channel.h>
 
 #include <assert.h>
 
@@ -17,10 +18,18 @@ static TracerBool tracerProcessLocalStartTrace(TracerContext* ctx, const TracerS
 
 static TracerBool tracerProcessLocalStopTrace(TracerContext* ctx, const TracerStopTrace* stopTrace);
 
+static TracerBool tracerProcessLocalStartWatch(TracerContext* ctx, const TracerStartWatch* startWatch);
+
+static TracerBool tracerProcessLocalStopWatch(TracerContext* ctx, const TracerStopWatch* stopWatch);
+
 static const char* tracerProcessLocalDecodeAndFormatInstruction(TracerContext* ctx, TracerDecodeAndFormat* decodeAndFmt);
 
 static TracerBool tracerProcessLocalGetSymbolAddressFromSymbolName(TracerContext* ctx, TracerGetSymbolAddrFromName* addrFromName);
 
+static TracerBool tracerProcessLocalGetStatistics(TracerContext* ctx, TracerStatistics* statistics);
+
+static TracerBool tracerProcessLocalSymbolizeAddresses(TracerContext* ctx, TracerSymbolizeAddresses* symbolize);
+
 static TracerContext* gTracerLocalProcessContext = NULL;
 
 TracerContext* tracerCreateLocalProcessContext(int type, int size, TracerHandle sharedMemoryHandle) {
@@ -46,8 +55,12 @@ TracerContext* tracerCreateLocalProcessContext(int type, int size, TracerHandle
     process->mSharedMemoryHandle = sharedMemoryHandle;
     process->mStartTrace = tracerProcessLocalStartTrace;
     process->mStopTrace = tracerProcessLocalStopTrace;
+    process->mStartWatch = tracerProcessLocalStartWatch;
+    process->mStopWatch = tracerProcessLocalStopWatch;
     process->mDecodeAndFormat = tracerProcessLocalDecodeAndFormatInstruction;
     process->mGetSymbolAddressFromSymbolName = tracerProcessLocalGetSymbolAddressFromSymbolName;
+    process->mGetStatistics = tracerProcessLocalGetStatistics;
+    process->mSymbolizeAddresses = tracerProcessLocalSymbolizeAddresses;
 
     process->mMemoryContext = tracerCreateLocalMemoryContext(
         eTracerMemoryContextLocal, sizeof(TracerLocalMemoryContext));
@@ -57,6 +70,8 @@ TracerContext* tracerCreateLocalProcessContext(int type, int size, TracerHandle
         return NULL;
     }
 
+    void* queueAddress = NULL;
+
     if (process->mSharedMemoryHandle) {
         process->mMappedView = MapViewOfFile(process->mSharedMemoryHandle,
             FILE_MAP_ALL_ACCESS, 0, 0, TLIB_SHARED_MEMORY_SIZE);
@@ -65,10 +80,13 @@ TracerContext* tracerCreateLocalProcessContext(int type, int size, TracerHandle
             tracerCoreDestroyContext(ctx);
             return NULL;
         }
+
+        // Skip the command channel at the start of the shared memory
+        queueAddress = (uint8_t*)process->mMappedView + TLIB_SHARED_CHANNEL_SIZE;
     }
 
-    process->mSharedRWQueue = tracerCreateRWQueue(process->mMappedView,
-        TLIB_SHARED_MEMORY_SIZE, sizeof(TracerTracedInstruction));
+    process->mSharedRWQueue = tracerCreateRWQueue(queueAddress,
+        TLIB_SHARED_QUEUE_SIZE, sizeof(TracerTracedInstruction));
 
     if (!process->mSharedRWQueue) {
         tracerCoreDestroyContext(ctx);
@@ -115,19 +133,49 @@ static TracerBool tracerProcessLocalInit(TracerContext* ctx) {
         return eTracerFalse;
     }
 
+    // Symbols are optional, instructions are formatted without them if this fails
+    local->mSymbolResolver = tracerCreateSymbolResolver(NULL);
+
+    tracerMemorySetSymbolResolver(process->mMemoryContext, local->mSymbolResolver);
+
     tracerRegisterCustomSymbolResolver(&local->mFormatter);
+
+    if (!process->mMappedView) {
+        // Nobody else reads our traces, the controller of a traced process sets up its own event
+        tracerProcessCreateDataEvent(ctx);
+    }
+
+    if (process->mMappedView) {
+        // Serve the requests of the controlling process. This is optional, the controller
+        // falls back to remote threads if the agent isn't running.
+        local->mChannelAgent = tracerCreateChannelAgent(process->mMappedView, TLIB_SHARED_CHANNEL_SIZE);
+    }
+
     return eTracerTrue;
 }
 
 static TracerBool tracerProcessLocalShutdown(TracerContext* ctx) {
     TracerLocalProcessContext* process = (TracerLocalProcessContext*)ctx;
 
+    if (process->mChannelAgent) {
+        tracerDestroyChannelAgent(process->mChannelAgent);
+        process->mChannelAgent = NULL;
+    }
+
     if (process->mTraceContext) {
         tracerCoreDestroyContext(process->mTraceContext);
         process->mTraceContext = NULL;
     }
 
-    tracerUnregisterCustomSymbolResolver();
+    if (process->mSymbolResolver) {
+        if (process->mBaseContext.mMemoryContext) {
+            tracerMemorySetSymbolResolver(process->mBaseContext.mMemoryContext, NULL);
+        }
+
+        tracerDestroySymbolResolver(process->mSymbolResolver);
+        process->mSymbolResolver = NULL;
+    }
+
     return eTracerTrue;
 }
 
@@ -146,6 +194,21 @@ static TracerBool tracerProcessLocalStopTrace(TracerContext* ctx, const TracerSt
     return tracerTraceStop(process->mTraceContext, stopTrace->mAddress, stopTrace->mThreadId);
 }
 
+static TracerBool tracerProcessLocalStartWatch(TracerContext* ctx, const TracerStartWatch* startWatch) {
+    TracerLocalProcessContext* process = (TracerLocalProcessContext*)ctx;
+
+    return tracerTraceStartWatch(process->mTraceContext,
+        startWatch->mAddress,
+        startWatch->mSize,
+        startWatch->mCondition,
+        startWatch->mThreadId);
+}
+
+static TracerBool tracerProcessLocalStopWatch(TracerContext* ctx, const TracerStopWatch* stopWatch) {
+    TracerLocalProcessContext* process = (TracerLocalProcessContext*)ctx;
+    return tracerTraceStopWatch(process->mTraceContext, stopWatch->mAddress, stopWatch->mThreadId);
+}
+
 static const char* tracerProcessLocalDecodeAndFormatInstruction(TracerContext* ctx, TracerDecodeAndFormat* decodeAndFmt) {
     TracerLocalProcessContext* process = (TracerLocalProcessContext*)ctx;
 
@@ -161,10 +224,11 @@ static const char* tracerProcessLocalDecodeAndFormatInstruction(TracerContext* c
         return NULL;
     }
 
-    if (ZydisFormatterFormatInstruction(&process->mFormatter,
+    if (ZydisFormatterFormatInstructionEx(&process->mFormatter,
             &decodedInst,
             decodeAndFmt->mOutBuffer,
-            decodeAndFmt->mBufferLength) != ZYDIS_STATUS_SUCCESS) {
+            decodeAndFmt->mBufferLength,
+            process->mSymbolResolver) != ZYDIS_STATUS_SUCCESS) {
 
         tracerCoreSetLastError(eTracerErrorSystemCall);
         return NULL;
@@ -174,6 +238,32 @@ static const char* tracerProcessLocalDecodeAndFormatInstruction(TracerContext* c
 }
 
 static TracerBool tracerProcessLocalGetSymbolAddressFromSymbolName(TracerContext* ctx, TracerGetSymbolAddrFromName* addrFromName) {
-    addrFromName->mSymbolAddress = tracerResolveSymbol(addrFromName->mSymbolName);
+    TracerLocalProcessContext* process = (TracerLocalProcessContext*)ctx;
+
+    if (!process->mSymbolResolver) {
+        tracerCoreSetLastError(eTracerErrorNotImplemented);
+        return eTracerFalse;
+    }
+
+    addrFromName->mSymbolAddress = tracerResolveSymbol(process->mSymbolResolver, addrFromName->mSymbolName);
     return addrFromName->mSymbolAddress != 0;
 }
+
+static TracerBool tracerProcessLocalGetStatistics(TracerContext* ctx, TracerStatistics* statistics) {
+    TracerLocalProcessContext* process = (TracerLocalProcessContext*)ctx;
+    return tracerTraceGetStatistics(process->mTraceContext, statistics);
+}
+
+static TracerBool tracerProcessLocalSymbolizeAddresses(TracerContext* ctx, TracerSymbolizeAddresses* symbolize) {
+    TracerLocalProcessContext* process = (TracerLocalProcessContext*)ctx;
+
+    if (!process->mSymbolResolver) {
+        tracerCoreSetLastError(eTracerErrorNotImplemented);
+        return eTracerFalse;
+    }
+
+    symbolize->mNumResolved = tracerResolveAddresses(process->mSymbolResolver,
+        symbolize->mAddresses, symbolize->mNumAddresses, symbolize->mOutSymbols);
+
+    return eTracerTrue;
+}
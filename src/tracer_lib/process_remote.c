@@ -2,6 +2,9 @@
 #include <tracer_lib/process_remote.h>
 #include <tracer_lib/memory_remote.h>
 #include <tracer_lib/rwqueue.h>
+#include <tracer_lib/channel.h>
+#include <tracer_lib/code_snapshot.h>
+#include <tracer_lib/symbol_resolver.h>
 
 #include <stdio.h>
 #include <assert.h>
@@ -17,10 +20,18 @@ static TracerBool tracerProcessRemoteStartTrace(TracerContext* ctx, const Tracer
 
 static TracerBool tracerProcessRemoteStopTrace(TracerContext* ctx, const TracerStopTrace* stopTrace);
 
+static TracerBool tracerProcessRemoteStartWatch(TracerContext* ctx, const TracerStartWatch* startWatch);
+
+static TracerBool tracerProcessRemoteStopWatch(TracerContext* ctx, const TracerStopWatch* stopWatch);
+
 static const char* tracerProcessRemoteDecodeAndFormatInstruction(TracerContext* ctx, TracerDecodeAndFormat* decodeAndFmt);
 
 static TracerBool tracerProcessRemoteGetSymbolAddressFromSymbolName(TracerContext* ctx, TracerGetSymbolAddrFromName* addrFromName);
 
+static TracerBool tracerProcessRemoteGetStatistics(TracerContext* ctx, TracerStatistics* statistics);
+
+static TracerBool tracerProcessRemoteSymbolizeAddresses(TracerContext* ctx, TracerSymbolizeAddresses* symbolize);
+
 TracerContext* tracerCreateRemoteProcessContext(int type, int size, int pid) {
     assert(size >= sizeof(TracerRemoteProcessContext));
     assert(pid >= 0);
@@ -46,36 +57,50 @@ TracerContext* tracerCreateRemoteProcessContext(int type, int size, int pid) {
     process->mSharedMemoryHandle = localMapping;
     process->mStartTrace = tracerProcessRemoteStartTrace;
     process->mStopTrace = tracerProcessRemoteStopTrace;
+    process->mStartWatch = tracerProcessRemoteStartWatch;
+    process->mStopWatch = tracerProcessRemoteStopWatch;
     process->mDecodeAndFormat = tracerProcessRemoteDecodeAndFormatInstruction;
     process->mGetSymbolAddressFromSymbolName = tracerProcessRemoteGetSymbolAddressFromSymbolName;
+    process->mGetStatistics = tracerProcessRemoteGetStatistics;
+    process->mSymbolizeAddresses = tracerProcessRemoteSymbolizeAddresses;
 
-    process->mMemoryContext = tracerCreateRemoteMemoryContext(
-        eTracerMemoryContextRemote,
-        sizeof(TracerRemoteMemoryContext),
-        pid,
-        remoteMapping);
+    process->mMappedView = MapViewOfFile(process->mSharedMemoryHandle,
+        FILE_MAP_ALL_ACCESS, 0, 0, TLIB_SHARED_MEMORY_SIZE);
 
-    if (!process->mMemoryContext) {
+    if (!process->mMappedView) {
         tracerCoreDestroyContext(ctx);
         return NULL;
     }
 
-    process->mMappedView = MapViewOfFile(process->mSharedMemoryHandle,
-        FILE_MAP_ALL_ACCESS, 0, 0, TLIB_SHARED_MEMORY_SIZE);
+    // The channel has to be set up before we inject, the agent inside the remote process
+    // picks it up when our DLL attaches to the shared memory
+    TracerRemoteProcessContext* remote = (TracerRemoteProcessContext*)ctx;
+    remote->mChannel = tracerCreateChannel(process->mMappedView, TLIB_SHARED_CHANNEL_SIZE, pid);
 
-    if (!process->mMappedView) {
+    if (!remote->mChannel) {
         tracerCoreDestroyContext(ctx);
         return NULL;
     }
 
-    process->mSharedRWQueue = tracerCreateRWQueue(process->mMappedView,
-        TLIB_SHARED_MEMORY_SIZE, sizeof(TracerTracedInstruction));
+    process->mSharedRWQueue = tracerCreateRWQueue((uint8_t*)process->mMappedView + TLIB_SHARED_CHANNEL_SIZE,
+        TLIB_SHARED_QUEUE_SIZE, sizeof(TracerTracedInstruction));
 
     if (!process->mSharedRWQueue) {
         tracerCoreDestroyContext(ctx);
         return NULL;
     }
 
+    process->mMemoryContext = tracerCreateRemoteMemoryContext(
+        eTracerMemoryContextRemote,
+        sizeof(TracerRemoteMemoryContext),
+        pid,
+        remoteMapping);
+
+    if (!process->mMemoryContext) {
+        tracerCoreDestroyContext(ctx);
+        return NULL;
+    }
+
     if (!tracerProcessRemoteInit(ctx)) {
         tracerCoreDestroyContext(ctx);
         return NULL;
@@ -93,10 +118,69 @@ void tracerCleanupRemoteProcessContext(TracerContext* ctx) {
 }
 
 static TracerBool tracerProcessRemoteInit(TracerContext* ctx) {
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    TracerRemoteProcessContext* remote = (TracerRemoteProcessContext*)ctx;
+
+    // Our DLL is attached now, route further calls through the channel. If the agent failed
+    // to start, the calls will keep using remote threads.
+    tracerMemoryRemoteSetChannel(process->mMemoryContext, remote->mChannel);
+
+    // Instructions of the remote process are decoded on our side, from a cached copy of its code
+    remote->mCodeSnapshot = tracerCreateCodeSnapshot(process->mMemoryContext);
+
+    if (!remote->mCodeSnapshot) {
+        return eTracerFalse;
+    }
+
+    if (ZydisDecoderInit(&remote->mDecoder, ZYDIS_MACHINE_MODE_LONG_COMPAT_32, ZYDIS_ADDRESS_WIDTH_32) != ZYDIS_STATUS_SUCCESS) {
+        return eTracerFalse;
+    }
+    if (ZydisFormatterInit(&remote->mFormatter, ZYDIS_FORMATTER_STYLE_INTEL) != ZYDIS_STATUS_SUCCESS) {
+        return eTracerFalse;
+    }
+
+    TracerMemoryContext* memory = (TracerMemoryContext*)process->mMemoryContext;
+
+    // Symbols are optional, instructions are formatted without them if this fails
+    remote->mSymbolResolver = tracerCreateSymbolResolver(memory->mProcessHandle);
+
+    tracerMemorySetSymbolResolver(process->mMemoryContext, remote->mSymbolResolver);
+
+    tracerRegisterCustomSymbolResolver(&remote->mFormatter);
+
+    // Our DLL has set up its end of the queue by now. Without the event, tracerFetchTracesAll
+    // polls this process instead of waiting for it.
+    tracerProcessCreateDataEvent(ctx);
     return eTracerTrue;
 }
 
 static TracerBool tracerProcessRemoteShutdown(TracerContext* ctx) {
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+    TracerRemoteProcessContext* remote = (TracerRemoteProcessContext*)ctx;
+
+    if (remote->mChannel) {
+        if (process->mMemoryContext) {
+            tracerMemoryRemoteSetChannel(process->mMemoryContext, NULL);
+        }
+
+        tracerDestroyChannel(remote->mChannel);
+        remote->mChannel = NULL;
+    }
+
+    if (remote->mSymbolResolver) {
+        if (process->mMemoryContext) {
+            tracerMemorySetSymbolResolver(process->mMemoryContext, NULL);
+        }
+
+        tracerDestroySymbolResolver(remote->mSymbolResolver);
+        remote->mSymbolResolver = NULL;
+    }
+
+    if (remote->mCodeSnapshot) {
+        tracerDestroyCodeSnapshot(remote->mCodeSnapshot);
+        remote->mCodeSnapshot = NULL;
+    }
+
     return eTracerTrue;
 }
 
@@ -164,30 +248,55 @@ static TracerBool tracerProcessRemoteStopTrace(TracerContext* ctx, const TracerS
         process->mMemoryContext, "tracerStopTraceEx", (const TracerStruct*)stopTrace);
 }
 
+static TracerBool tracerProcessRemoteStartWatch(TracerContext* ctx, const TracerStartWatch* startWatch) {
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+
+    return (TracerBool)tracerMemoryRemoteCallLocalExport(
+        process->mMemoryContext, "tracerStartWatchEx", (const TracerStruct*)startWatch);
+}
+
+static TracerBool tracerProcessRemoteStopWatch(TracerContext* ctx, const TracerStopWatch* stopWatch) {
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+
+    return (TracerBool)tracerMemoryRemoteCallLocalExport(
+        process->mMemoryContext, "tracerStopWatchEx", (const TracerStruct*)stopWatch);
+}
+
 static const char* tracerProcessRemoteDecodeAndFormatInstruction(TracerContext* ctx, TracerDecodeAndFormat* decodeAndFmt) {
     TracerProcessContext* process = (TracerProcessContext*)ctx;
+    TracerRemoteProcessContext* remote = (TracerRemoteProcessContext*)ctx;
 
-    TracerDecodeAndFormat remoteArgs = {
-        /* mSizeOfStruct        = */ sizeof(TracerDecodeAndFormat),
-        /* mAddress             = */ decodeAndFmt->mAddress,
-        /* mOutBuffer           = */ NULL,
-        /* mBufferLength        = */ 0,
-        /* mDummy               = */ { 0 },
-    };
+    uint8_t instruction[ZYDIS_MAX_INSTRUCTION_LENGTH];
 
-    if (!tracerMemoryRemoteCallLocalExportEx(process->mMemoryContext,
-            "tracerDecodeAndFormatInstructionEx", (TracerStruct*)&remoteArgs)) {
+    // The snapshot might return less bytes if the instruction is located at the end of a readable region
+    size_t length = tracerCodeSnapshotRead(remote->mCodeSnapshot,
+        decodeAndFmt->mAddress, instruction, sizeof(instruction));
 
+    if (!length) {
         return NULL;
     }
 
-    size_t length = min(decodeAndFmt->mBufferLength, sizeof(remoteArgs.mDummy));
-    if (length == 0) {
+    ZydisDecodedInstruction decodedInst;
+
+    if (ZydisDecoderDecodeBuffer(&remote->mDecoder,
+            instruction,
+            length,
+            decodeAndFmt->mAddress,
+            &decodedInst) != ZYDIS_STATUS_SUCCESS) {
+
+        tracerCoreSetLastError(eTracerErrorSystemCall);
         return NULL;
     }
 
-    memcpy(decodeAndFmt->mOutBuffer, remoteArgs.mDummy, length);
-    decodeAndFmt->mOutBuffer[length - 1] = 0;
+    if (ZydisFormatterFormatInstructionEx(&remote->mFormatter,
+            &decodedInst,
+            decodeAndFmt->mOutBuffer,
+            decodeAndFmt->mBufferLength,
+            remote->mSymbolResolver) != ZYDIS_STATUS_SUCCESS) {
+
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return NULL;
+    }
 
     return decodeAndFmt->mOutBuffer;
 }
@@ -198,3 +307,25 @@ static TracerBool tracerProcessRemoteGetSymbolAddressFromSymbolName(TracerContex
     return (TracerBool)tracerMemoryRemoteCallLocalExportEx(process->mMemoryContext,
         "tracerGetSymbolAddressFromSymbolNameEx", (TracerStruct*)addrFromName);
 }
+
+static TracerBool tracerProcessRemoteGetStatistics(TracerContext* ctx, TracerStatistics* statistics) {
+    TracerProcessContext* process = (TracerProcessContext*)ctx;
+
+    return (TracerBool)tracerMemoryRemoteCallLocalExportEx(process->mMemoryContext,
+        "tracerGetStatistics", (TracerStruct*)statistics);
+}
+
+static TracerBool tracerProcessRemoteSymbolizeAddresses(TracerContext* ctx, TracerSymbolizeAddresses* symbolize) {
+    TracerRemoteProcessContext* remote = (TracerRemoteProcessContext*)ctx;
+
+    if (!remote->mSymbolResolver) {
+        tracerCoreSetLastError(eTracerErrorNotImplemented);
+        return eTracerFalse;
+    }
+
+    // The symbols are loaded on our side, so the whole batch is resolved without a single remote call
+    symbolize->mNumResolved = tracerResolveAddresses(remote->mSymbolResolver,
+        symbolize->mAddresses, symbolize->mNumAddresses, symbolize->mOutSymbols);
+
+    return eTracerTrue;
+}
@@ -7,6 +7,8 @@ typedef struct TracerRWQueue {
     volatile int        mReadOffset;
     volatile int        mWriteOffset;
     TracerBool          mIsOwnedByOther;
+    volatile LONG       mReaderWaiting;     // Set while the reader sleeps on mDataEvent
+    TracerHandle        mDataEvent;         // Only valid within the process of the writer
 } TracerRWQueue;
 
 TracerHandle tracerCreateRWQueue(void* address, size_t spaceInBytes, size_t elemSize) {
@@ -44,6 +46,8 @@ TracerHandle tracerCreateRWQueue(void* address, size_t spaceInBytes, size_t elem
     queue->mReadOffset = 0;
     queue->mWriteOffset = 0;
     queue->mIsOwnedByOther = ownedByOther;
+    queue->mReaderWaiting = 0;
+    queue->mDataEvent = NULL;
 
     return (TracerHandle)queue;
 }
@@ -60,6 +64,7 @@ void tracerDestroyRWQueue(TracerHandle handle) {
     queue->mElementSize = 0;
     queue->mReadOffset = 0;
     queue->mWriteOffset = 0;
+    queue->mDataEvent = NULL;
 
     if (!queue->mIsOwnedByOther) {
         free(queue);
@@ -107,6 +112,14 @@ TracerBool tracerRWQueuePushItem(TracerHandle handle, const void* item) {
         // And increment the write pointer
         queue->mWriteOffset++;
 
+        // The store above must be visible before we look at the flag of the reader, otherwise
+        // both sides could miss each other. Only wake the reader if it actually went to sleep.
+        MemoryBarrier();
+
+        if (queue->mReaderWaiting && InterlockedExchange(&queue->mReaderWaiting, 0) && queue->mDataEvent) {
+            SetEvent((HANDLE)queue->mDataEvent);
+        }
+
         // We are done here
         return eTracerTrue;
     } else {
@@ -178,3 +191,65 @@ size_t tracerRWQueuePopAll(TracerHandle handle, void* outItems, size_t maxElemen
 
     return numElements;
 }
+
+TracerBool tracerRWQueueIsEmpty(TracerHandle handle) {
+    TracerRWQueue* queue = (TracerRWQueue*)handle;
+
+    if (!queue) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerTrue;
+    }
+
+    int writeOffset = queue->mWriteOffset;
+    int readOffset = queue->mReadOffset;
+
+    // Same conditions as in tracerRWQueuePopItem, a reader at the end wraps around on its next pop
+    if (readOffset == queue->mMaxElements) {
+        readOffset = 0;
+    }
+
+    if ((readOffset < queue->mMaxElements && writeOffset < readOffset) || readOffset < writeOffset) {
+        return eTracerFalse;
+    }
+
+    return eTracerTrue;
+}
+
+void tracerRWQueueSetDataEvent(TracerHandle handle, TracerHandle event) {
+    TracerRWQueue* queue = (TracerRWQueue*)handle;
+
+    if (!queue) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    queue->mDataEvent = event;
+}
+
+TracerBool tracerRWQueuePrepareWait(TracerHandle handle) {
+    TracerRWQueue* queue = (TracerRWQueue*)handle;
+
+    if (!queue) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    // Raise the flag first and check for data afterwards, a writer that pushed in between
+    // either sees the flag or its item is seen here
+    InterlockedExchange(&queue->mReaderWaiting, 1);
+
+    if (!tracerRWQueueIsEmpty(handle)) {
+        queue->mReaderWaiting = 0;
+        return eTracerFalse;
+    }
+
+    return eTracerTrue;
+}
+
+void tracerRWQueueCancelWait(TracerHandle handle) {
+    TracerRWQueue* queue = (TracerRWQueue*)handle;
+
+    if (queue) {
+        queue->mReaderWaiting = 0;
+    }
+}
@@ -0,0 +1,616 @@
+
+#include <tracer_lib/scan.h>
+
+#include <intrin.h>
+#include <limits.h>
+
+typedef enum TracerScanLevel {
+    eTracerScanLevelUnknown         = 0,
+    eTracerScanLevelScalar          = 1,
+    eTracerScanLevelSse2            = 2,
+    eTracerScanLevelAvx2            = 3,
+} TracerScanLevel;
+
+typedef struct TracerScanSetEntry {
+    uint32_t                        mPatternId;
+    uint32_t                        mAnchorOffset;          // Offset of the anchor pair within the pattern
+} TracerScanSetEntry;
+
+typedef struct TracerScanSet {
+    TracerScanPattern*              mPatterns;
+    size_t                          mNumPatterns;
+    size_t                          mMaxPatternSize;
+
+    // Every pattern is filed under the two adjacent bytes of its anchor pair. A wildcard within the
+    // pair files the pattern under all 256 values of that byte.
+    uint32_t                        mFilter[65536 / 32];    // One bit per pair that has any entries
+    uint32_t*                       mBucketStarts;          // 65537 offsets into mEntries
+    TracerScanSetEntry*             mEntries;
+} TracerScanSet;
+
+static volatile LONG gTracerScanLevel = eTracerScanLevelUnknown;
+
+// Rough frequency of every byte value in x86 code, higher is more common. The anchors of a pattern
+// are its least common bytes, so that as few positions as possible survive the vector compare.
+static const uint8_t gTracerScanByteFrequency[256] = {
+    0xFF, 0x64, 0x50, 0x50, 0x64, 0x23, 0x37, 0x1E, 0x5A, 0x1E, 0x08, 0x2D, 0x4B, 0x1E, 0x08, 0x73,
+    0x55, 0x08, 0x1E, 0x08, 0x3C, 0x1E, 0x1E, 0x08, 0x3C, 0x08, 0x08, 0x08, 0x23, 0x08, 0x08, 0x08,
+    0x3C, 0x08, 0x08, 0x2D, 0x82, 0x1E, 0x08, 0x08, 0x23, 0x08, 0x08, 0x2D, 0x1E, 0x08, 0x08, 0x08,
+    0x37, 0x08, 0x08, 0x50, 0x1E, 0x08, 0x08, 0x08, 0x23, 0x32, 0x08, 0x32, 0x1E, 0x08, 0x08, 0x08,
+    0x46, 0x2D, 0x2D, 0x2D, 0x46, 0x78, 0x37, 0x2D, 0x46, 0x28, 0x08, 0x08, 0x37, 0x64, 0x28, 0x28,
+    0x55, 0x41, 0x3C, 0x3C, 0x08, 0x5A, 0x55, 0x55, 0x1E, 0x1E, 0x1E, 0x3C, 0x08, 0x5A, 0x55, 0x55,
+    0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x1E, 0x08, 0x50, 0x08, 0x55, 0x08, 0x08, 0x08, 0x08, 0x08,
+    0x08, 0x08, 0x28, 0x28, 0x6E, 0x6E, 0x32, 0x28, 0x08, 0x08, 0x08, 0x08, 0x28, 0x37, 0x28, 0x28,
+    0x46, 0x08, 0x08, 0x8C, 0x46, 0x6E, 0x08, 0x08, 0x32, 0x96, 0x32, 0xB9, 0x08, 0x64, 0x19, 0x08,
+    0x5F, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,
+    0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,
+    0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x32, 0x19, 0x19, 0x08, 0x08, 0x08, 0x19, 0x19,
+    0x5F, 0x23, 0x32, 0x5A, 0x46, 0x08, 0x08, 0x50, 0x08, 0x08, 0x08, 0x08, 0xBE, 0x08, 0x08, 0x08,
+    0x19, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x23, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,
+    0x23, 0x19, 0x19, 0x19, 0x23, 0x08, 0x08, 0x08, 0x78, 0x46, 0x08, 0x4B, 0x5A, 0x08, 0x08, 0x08,
+    0x41, 0x08, 0x08, 0x19, 0x23, 0x08, 0x28, 0x28, 0x41, 0x14, 0x14, 0x14, 0x41, 0x14, 0x19, 0xC8,
+};
+
+TracerBool tracerScanCompile(TracerScanPattern* pattern, const uint8_t* bytes, const uint8_t* mask, size_t size) {
+    if (!pattern || !bytes || !mask) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    if (size > TLIB_SCAN_MAX_PATTERN_SIZE) {
+        return eTracerFalse;
+    }
+
+    pattern->mSize = size;
+    pattern->mAnchors[0] = 0;
+    pattern->mAnchors[1] = 0;
+    pattern->mNumAnchors = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        pattern->mMask[i] = mask[i] ? 0xFF : 0x00;
+        pattern->mBytes[i] = bytes[i] & pattern->mMask[i];
+
+        if (!mask[i]) {
+            continue;
+        }
+
+        int frequency = gTracerScanByteFrequency[bytes[i]];
+
+        if (!pattern->mNumAnchors ||
+            frequency < gTracerScanByteFrequency[pattern->mBytes[pattern->mAnchors[0]]]) {
+
+            pattern->mAnchors[1] = pattern->mAnchors[0];
+            pattern->mAnchors[0] = i;
+        } else if (pattern->mNumAnchors == 1 ||
+            frequency < gTracerScanByteFrequency[pattern->mBytes[pattern->mAnchors[1]]]) {
+
+            pattern->mAnchors[1] = i;
+        }
+
+        pattern->mNumAnchors = min(pattern->mNumAnchors + 1, 2);
+    }
+
+    if (pattern->mNumAnchors == 1) {
+        // Comparing the same byte twice is cheaper than another code path
+        pattern->mAnchors[1] = pattern->mAnchors[0];
+    }
+
+    return eTracerTrue;
+}
+
+TracerBool tracerScanCompileWildcard(TracerScanPattern* pattern, const uint8_t* bytes, size_t size, uint8_t wildcard) {
+    if (!bytes || size > TLIB_SCAN_MAX_PATTERN_SIZE) {
+        return eTracerFalse;
+    }
+
+    uint8_t mask[TLIB_SCAN_MAX_PATTERN_SIZE];
+
+    for (size_t i = 0; i < size; ++i) {
+        mask[i] = (bytes[i] != wildcard);
+    }
+
+    return tracerScanCompile(pattern, bytes, mask, size);
+}
+
+TracerBool tracerScanCompileMask(TracerScanPattern* pattern, const uint8_t* bytes, const char* mask) {
+    if (!mask) {
+        return eTracerFalse;
+    }
+
+    size_t size = strlen(mask);
+
+    if (size > TLIB_SCAN_MAX_PATTERN_SIZE) {
+        return eTracerFalse;
+    }
+
+    uint8_t byteMask[TLIB_SCAN_MAX_PATTERN_SIZE];
+
+    for (size_t i = 0; i < size; ++i) {
+        byteMask[i] = (mask[i] == 'x');
+    }
+
+    return tracerScanCompile(pattern, bytes, byteMask, size);
+}
+
+static TracerScanLevel tracerScanDetectLevel() {
+    int info[4];
+    __cpuid(info, 0);
+
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+
+    if (!(info[3] & (1 << 26))) {
+        return eTracerScanLevelScalar;
+    }
+
+    // AVX2 needs support by the CPU as well as the OS saving the upper halves of the registers
+    TracerBool hasOsAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+
+    if (hasOsAvx && maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+
+        if (info[1] & (1 << 5)) {
+            return eTracerScanLevelAvx2;
+        }
+    }
+
+    return eTracerScanLevelSse2;
+}
+
+static TracerScanLevel tracerScanGetLevel() {
+    TracerScanLevel level = (TracerScanLevel)gTracerScanLevel;
+
+    if (level == eTracerScanLevelUnknown) {
+        level = tracerScanDetectLevel();
+        InterlockedExchange(&gTracerScanLevel, (LONG)level);
+    }
+
+    return level;
+}
+
+static TracerBool tracerScanVerifyScalar(const TracerScanPattern* pattern, const uint8_t* data) {
+    for (size_t i = 0; i < pattern->mSize; ++i) {
+        if ((data[i] & pattern->mMask[i]) != pattern->mBytes[i]) {
+            return eTracerFalse;
+        }
+    }
+    return eTracerTrue;
+}
+
+static TracerBool tracerScanVerifySse2(const TracerScanPattern* pattern, const uint8_t* data) {
+    size_t i = 0;
+
+    for (; i + 16 <= pattern->mSize; i += 16) {
+        __m128i bytes = _mm_and_si128(_mm_loadu_si128((const __m128i*)(data + i)),
+            _mm_loadu_si128((const __m128i*)(pattern->mMask + i)));
+
+        __m128i equal = _mm_cmpeq_epi8(bytes, _mm_loadu_si128((const __m128i*)(pattern->mBytes + i)));
+
+        if (_mm_movemask_epi8(equal) != 0xFFFF) {
+            return eTracerFalse;
+        }
+    }
+
+    for (; i < pattern->mSize; ++i) {
+        if ((data[i] & pattern->mMask[i]) != pattern->mBytes[i]) {
+            return eTracerFalse;
+        }
+    }
+    return eTracerTrue;
+}
+
+static const uint8_t* tracerScanFirstScalar(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions) {
+    size_t anchor = pattern->mAnchors[0];
+    uint8_t anchorByte = pattern->mBytes[anchor];
+
+    const uint8_t* end = data + numPositions;
+
+    // memchr is vectorized by the CRT, so even this path doesn't look at every byte on its own
+    while (data < end) {
+        const uint8_t* hit = (const uint8_t*)memchr(data + anchor, anchorByte, (size_t)(end - data));
+
+        if (!hit) {
+            break;
+        }
+
+        data = hit - anchor;
+
+        if (tracerScanVerifyScalar(pattern, data)) {
+            return data;
+        }
+
+        ++data;
+    }
+    return NULL;
+}
+
+static const uint8_t* tracerScanLastScalar(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions) {
+    size_t anchor = pattern->mAnchors[0];
+    uint8_t anchorByte = pattern->mBytes[anchor];
+
+    for (size_t i = numPositions; i > 0; --i) {
+        const uint8_t* current = data + i - 1;
+
+        if (current[anchor] == anchorByte && tracerScanVerifyScalar(pattern, current)) {
+            return current;
+        }
+    }
+    return NULL;
+}
+
+static const uint8_t* tracerScanFirstSse2(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions) {
+    const uint8_t* firstAnchor = data + pattern->mAnchors[0];
+    const uint8_t* secondAnchor = data + pattern->mAnchors[1];
+
+    __m128i firstByte = _mm_set1_epi8((char)pattern->mBytes[pattern->mAnchors[0]]);
+    __m128i secondByte = _mm_set1_epi8((char)pattern->mBytes[pattern->mAnchors[1]]);
+
+    size_t i = 0;
+
+    // Test 16 positions at once, only those where both anchors match are verified
+    for (; i + 16 <= numPositions; i += 16) {
+        __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(firstAnchor + i)), firstByte);
+        __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(secondAnchor + i)), secondByte);
+
+        unsigned long candidates = (uint32_t)_mm_movemask_epi8(_mm_and_si128(first, second));
+
+        while (candidates) {
+            unsigned long bit;
+            _BitScanForward(&bit, candidates);
+
+            if (tracerScanVerifySse2(pattern, data + i + bit)) {
+                return data + i + bit;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    return tracerScanFirstScalar(pattern, data + i, numPositions - i);
+}
+
+static const uint8_t* tracerScanLastSse2(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions) {
+    const uint8_t* firstAnchor = data + pattern->mAnchors[0];
+    const uint8_t* secondAnchor = data + pattern->mAnchors[1];
+
+    __m128i firstByte = _mm_set1_epi8((char)pattern->mBytes[pattern->mAnchors[0]]);
+    __m128i secondByte = _mm_set1_epi8((char)pattern->mBytes[pattern->mAnchors[1]]);
+
+    size_t i = numPositions;
+
+    for (; i >= 16; i -= 16) {
+        __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(firstAnchor + i - 16)), firstByte);
+        __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(secondAnchor + i - 16)), secondByte);
+
+        unsigned long candidates = (uint32_t)_mm_movemask_epi8(_mm_and_si128(first, second));
+
+        while (candidates) {
+            unsigned long bit;
+            _BitScanReverse(&bit, candidates);
+
+            if (tracerScanVerifySse2(pattern, data + i - 16 + bit)) {
+                return data + i - 16 + bit;
+            }
+            candidates &= ~(1ul << bit);
+        }
+    }
+
+    return tracerScanLastScalar(pattern, data, i);
+}
+
+static const uint8_t* tracerScanFirstAvx2(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions) {
+    const uint8_t* firstAnchor = data + pattern->mAnchors[0];
+    const uint8_t* secondAnchor = data + pattern->mAnchors[1];
+
+    __m256i firstByte = _mm256_set1_epi8((char)pattern->mBytes[pattern->mAnchors[0]]);
+    __m256i secondByte = _mm256_set1_epi8((char)pattern->mBytes[pattern->mAnchors[1]]);
+
+    size_t i = 0;
+
+    // Two vectors per iteration, 64 positions per step keep the loads ahead of the compares
+    for (; i + 64 <= numPositions; i += 64) {
+        __m256i firstLow = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(firstAnchor + i)), firstByte);
+        __m256i secondLow = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(secondAnchor + i)), secondByte);
+        __m256i firstHigh = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(firstAnchor + i + 32)), firstByte);
+        __m256i secondHigh = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(secondAnchor + i + 32)), secondByte);
+
+        unsigned long candidatesLow = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(firstLow, secondLow));
+        unsigned long candidatesHigh = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(firstHigh, secondHigh));
+
+        while (candidatesLow) {
+            unsigned long bit;
+            _BitScanForward(&bit, candidatesLow);
+
+            if (tracerScanVerifySse2(pattern, data + i + bit)) {
+                return data + i + bit;
+            }
+            candidatesLow &= candidatesLow - 1;
+        }
+
+        while (candidatesHigh) {
+            unsigned long bit;
+            _BitScanForward(&bit, candidatesHigh);
+
+            if (tracerScanVerifySse2(pattern, data + i + 32 + bit)) {
+                return data + i + 32 + bit;
+            }
+            candidatesHigh &= candidatesHigh - 1;
+        }
+    }
+
+    return tracerScanFirstSse2(pattern, data + i, numPositions - i);
+}
+
+static const uint8_t* tracerScanLastAvx2(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions) {
+    const uint8_t* firstAnchor = data + pattern->mAnchors[0];
+    const uint8_t* secondAnchor = data + pattern->mAnchors[1];
+
+    __m256i firstByte = _mm256_set1_epi8((char)pattern->mBytes[pattern->mAnchors[0]]);
+    __m256i secondByte = _mm256_set1_epi8((char)pattern->mBytes[pattern->mAnchors[1]]);
+
+    size_t i = numPositions;
+
+    for (; i >= 32; i -= 32) {
+        __m256i first = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(firstAnchor + i - 32)), firstByte);
+        __m256i second = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(secondAnchor + i - 32)), secondByte);
+
+        unsigned long candidates = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(first, second));
+
+        while (candidates) {
+            unsigned long bit;
+            _BitScanReverse(&bit, candidates);
+
+            if (tracerScanVerifySse2(pattern, data + i - 32 + bit)) {
+                return data + i - 32 + bit;
+            }
+            candidates &= ~(1ul << bit);
+        }
+    }
+
+    return tracerScanLastSse2(pattern, data, i);
+}
+
+const uint8_t* tracerScanFirst(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions) {
+    if (!pattern || !data) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    if (!numPositions) {
+        return NULL;
+    }
+
+    if (!pattern->mNumAnchors) {
+        // Wildcards only, everything matches
+        return data;
+    }
+
+    switch (tracerScanGetLevel()) {
+    case eTracerScanLevelAvx2:
+        return tracerScanFirstAvx2(pattern, data, numPositions);
+    case eTracerScanLevelSse2:
+        return tracerScanFirstSse2(pattern, data, numPositions);
+    default:
+        return tracerScanFirstScalar(pattern, data, numPositions);
+    }
+}
+
+const uint8_t* tracerScanLast(const TracerScanPattern* pattern, const uint8_t* data, size_t numPositions) {
+    if (!pattern || !data) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    if (!numPositions) {
+        return NULL;
+    }
+
+    if (!pattern->mNumAnchors) {
+        return data + numPositions - 1;
+    }
+
+    switch (tracerScanGetLevel()) {
+    case eTracerScanLevelAvx2:
+        return tracerScanLastAvx2(pattern, data, numPositions);
+    case eTracerScanLevelSse2:
+        return tracerScanLastSse2(pattern, data, numPositions);
+    default:
+        return tracerScanLastScalar(pattern, data, numPositions);
+    }
+}
+
+static size_t tracerScanSetFindAnchorPair(const TracerScanPattern* pattern) {
+    size_t bestOffset = 0;
+    int bestCost = INT_MAX;
+
+    for (size_t i = 0; i + 1 < pattern->mSize; ++i) {
+        // A wildcard is as bad as the most common byte
+        int cost = (pattern->mMask[i] ? gTracerScanByteFrequency[pattern->mBytes[i]] : 0x100) +
+            (pattern->mMask[i + 1] ? gTracerScanByteFrequency[pattern->mBytes[i + 1]] : 0x100);
+
+        if (cost < bestCost) {
+            bestCost = cost;
+            bestOffset = i;
+        }
+    }
+    return bestOffset;
+}
+
+static void tracerScanSetForEachKey(const TracerScanPattern* pattern, size_t offset,
+    void(*callback)(TracerScanSet*, uint16_t, uint32_t, uint32_t), TracerScanSet* scanSet, uint32_t patternId) {
+
+    int firstCount = pattern->mMask[offset] ? 1 : 256;
+    int secondCount = pattern->mMask[offset + 1] ? 1 : 256;
+
+    for (int first = 0; first < firstCount; ++first) {
+        for (int second = 0; second < secondCount; ++second) {
+            uint8_t low = pattern->mMask[offset] ? pattern->mBytes[offset] : (uint8_t)first;
+            uint8_t high = pattern->mMask[offset + 1] ? pattern->mBytes[offset + 1] : (uint8_t)second;
+
+            callback(scanSet, (uint16_t)(low | (high << 8)), patternId, (uint32_t)offset);
+        }
+    }
+}
+
+static void tracerScanSetCountKey(TracerScanSet* scanSet, uint16_t key, uint32_t patternId, uint32_t offset) {
+    scanSet->mBucketStarts[key + 1]++;
+}
+
+static void tracerScanSetInsertKey(TracerScanSet* scanSet, uint16_t key, uint32_t patternId, uint32_t offset) {
+    // mBucketStarts[key] is used as the insertion cursor while filling and restored afterwards
+    TracerScanSetEntry* entry = &scanSet->mEntries[scanSet->mBucketStarts[key]++];
+    entry->mPatternId = patternId;
+    entry->mAnchorOffset = offset;
+
+    scanSet->mFilter[key >> 5] |= (1u << (key & 31));
+}
+
+TracerHandle tracerCreateScanSet(const TracerScanPattern* patterns, size_t numPatterns) {
+    if (!patterns || !numPatterns) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < numPatterns; ++i) {
+        if (patterns[i].mSize < 2 || !patterns[i].mNumAnchors) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return NULL;
+        }
+    }
+
+    TracerScanSet* scanSet = (TracerScanSet*)calloc(1, sizeof(TracerScanSet));
+
+    if (!scanSet) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    scanSet->mPatterns = (TracerScanPattern*)malloc(numPatterns * sizeof(TracerScanPattern));
+    scanSet->mBucketStarts = (uint32_t*)calloc(65537, sizeof(uint32_t));
+
+    if (!scanSet->mPatterns || !scanSet->mBucketStarts) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        tracerDestroyScanSet((TracerHandle)scanSet);
+        return NULL;
+    }
+
+    memcpy(scanSet->mPatterns, patterns, numPatterns * sizeof(TracerScanPattern));
+    scanSet->mNumPatterns = numPatterns;
+
+    for (size_t i = 0; i < numPatterns; ++i) {
+        scanSet->mMaxPatternSize = max(scanSet->mMaxPatternSize, patterns[i].mSize);
+    }
+
+    size_t* anchorOffsets = (size_t*)malloc(numPatterns * sizeof(size_t));
+
+    if (!anchorOffsets) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        tracerDestroyScanSet((TracerHandle)scanSet);
+        return NULL;
+    }
+
+    // Count the entries per bucket first, so they can be stored contiguously
+    for (size_t i = 0; i < numPatterns; ++i) {
+        anchorOffsets[i] = tracerScanSetFindAnchorPair(&patterns[i]);
+        tracerScanSetForEachKey(&patterns[i], anchorOffsets[i], tracerScanSetCountKey, scanSet, (uint32_t)i);
+    }
+
+    for (size_t key = 0; key < 65536; ++key) {
+        scanSet->mBucketStarts[key + 1] += scanSet->mBucketStarts[key];
+    }
+
+    scanSet->mEntries = (TracerScanSetEntry*)malloc(
+        max(scanSet->mBucketStarts[65536], 1) * sizeof(TracerScanSetEntry));
+
+    if (!scanSet->mEntries) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        free(anchorOffsets);
+        tracerDestroyScanSet((TracerHandle)scanSet);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < numPatterns; ++i) {
+        tracerScanSetForEachKey(&patterns[i], anchorOffsets[i], tracerScanSetInsertKey, scanSet, (uint32_t)i);
+    }
+
+    // Every cursor ended up at the start of the next bucket
+    memmove(&scanSet->mBucketStarts[1], &scanSet->mBucketStarts[0], 65536 * sizeof(uint32_t));
+    scanSet->mBucketStarts[0] = 0;
+
+    free(anchorOffsets);
+    return (TracerHandle)scanSet;
+}
+
+void tracerDestroyScanSet(TracerHandle handle) {
+    TracerScanSet* scanSet = (TracerScanSet*)handle;
+
+    if (!scanSet) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    free(scanSet->mEntries);
+    free(scanSet->mBucketStarts);
+    free(scanSet->mPatterns);
+    free(scanSet);
+}
+
+size_t tracerScanSetGetMaxPatternSize(TracerHandle handle) {
+    TracerScanSet* scanSet = (TracerScanSet*)handle;
+
+    if (!scanSet) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    return scanSet->mMaxPatternSize;
+}
+
+size_t tracerScanSetSearch(TracerHandle handle, const uint8_t* data, size_t size, TracerScanCallback callback, void* userData) {
+    TracerScanSet* scanSet = (TracerScanSet*)handle;
+
+    if (!scanSet || !data || !callback) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    TracerBool(*verify)(const TracerScanPattern*, const uint8_t*) =
+        (tracerScanGetLevel() >= eTracerScanLevelSse2) ? tracerScanVerifySse2 : tracerScanVerifyScalar;
+
+    size_t numMatches = 0;
+
+    // One pass over the data, the filter bitmap is small enough to stay in the L1 cache and
+    // rejects most positions before any pattern is looked at
+    const uint32_t* filter = scanSet->mFilter;
+
+    for (size_t position = 0; position + 1 < size; ++position) {
+        uint16_t key = *(const uint16_t*)(data + position);
+
+        if (!(filter[key >> 5] & (1u << (key & 31)))) {
+            continue;
+        }
+
+        for (uint32_t i = scanSet->mBucketStarts[key]; i < scanSet->mBucketStarts[key + 1]; ++i) {
+            const TracerScanSetEntry* entry = &scanSet->mEntries[i];
+            const TracerScanPattern* pattern = &scanSet->mPatterns[entry->mPatternId];
+
+            if (position < entry->mAnchorOffset) {
+                continue;
+            }
+
+            size_t start = position - entry->mAnchorOffset;
+
+            if (pattern->mSize > size - start || !verify(pattern, data + start)) {
+                continue;
+            }
+
+            ++numMatches;
+
+            if (!callback(data + start, entry->mPatternId, userData)) {
+                return numMatches;
+            }
+        }
+    }
+
+    return numMatches;
+}
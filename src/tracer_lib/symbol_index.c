@@ -0,0 +1,456 @@
+
+#include <tracer_lib/symbol_index.h>
+
+#include <string.h>
+
+#define TLIB_SYMBOL_INDEX_MIN_TABLE_SIZE    1024
+
+static uint32_t tracerSymbolIndexHashName(const char* name, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static void tracerSymbolIndexFreeModule(TracerSymbolModule* module) {
+    free(module->mSymbols);
+    free(module->mStringPool);
+    free(module);
+}
+
+void tracerSymbolIndexInit(TracerSymbolIndex* index) {
+    memset(index, 0, sizeof(TracerSymbolIndex));
+}
+
+void tracerSymbolIndexClear(TracerSymbolIndex* index) {
+    for (size_t i = 0; i < index->mNumModules; ++i) {
+        tracerSymbolIndexFreeModule(index->mModules[i]);
+    }
+
+    free(index->mModules);
+    free(index->mNameTable);
+
+    tracerSymbolIndexInit(index);
+}
+
+TracerSymbolModule* tracerSymbolIndexAddModule(TracerSymbolIndex* index, uintptr_t baseAddress, size_t size,
+    uint32_t timeDateStamp, uint32_t checkSum, const char* name) {
+
+    // Find the insertion point, the modules are kept sorted by their base address
+    size_t position = 0;
+
+    while (position < index->mNumModules && index->mModules[position]->mBaseAddress < baseAddress) {
+        ++position;
+    }
+
+    if (position < index->mNumModules && index->mModules[position]->mBaseAddress == baseAddress) {
+        TracerSymbolModule* known = index->mModules[position];
+
+        if (known->mSize == size && known->mTimeDateStamp == timeDateStamp && known->mCheckSum == checkSum) {
+            // We already know this module
+            return known;
+        }
+
+        // The module was unloaded and another one took its place
+        tracerSymbolIndexRemoveModule(index, known);
+    }
+
+    if (index->mNumModules == index->mMaxModules) {
+        size_t maxModules = index->mMaxModules ? index->mMaxModules * 2 : 64;
+
+        TracerSymbolModule** modules = (TracerSymbolModule**)realloc(
+            index->mModules, maxModules * sizeof(TracerSymbolModule*));
+
+        if (!modules) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            return NULL;
+        }
+
+        index->mModules = modules;
+        index->mMaxModules = maxModules;
+    }
+
+    TracerSymbolModule* module = (TracerSymbolModule*)calloc(1, sizeof(TracerSymbolModule));
+
+    if (!module) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    module->mBaseAddress = baseAddress;
+    module->mSize = size;
+    module->mTimeDateStamp = timeDateStamp;
+    module->mCheckSum = checkSum;
+
+    if (name) {
+        strncpy(module->mName, name, sizeof(module->mName) - 1);
+    }
+
+    memmove(&index->mModules[position + 1], &index->mModules[position],
+        (index->mNumModules - position) * sizeof(TracerSymbolModule*));
+
+    index->mModules[position] = module;
+    index->mNumModules++;
+
+    return module;
+}
+
+static void tracerSymbolIndexRebuildNames(TracerSymbolIndex* index);
+
+void tracerSymbolIndexRemoveModule(TracerSymbolIndex* index, TracerSymbolModule* module) {
+    size_t position = 0;
+
+    while (position < index->mNumModules && index->mModules[position] != module) {
+        ++position;
+    }
+
+    if (position == index->mNumModules) {
+        return;
+    }
+
+    memmove(&index->mModules[position], &index->mModules[position + 1],
+        (index->mNumModules - position - 1) * sizeof(TracerSymbolModule*));
+
+    index->mNumModules--;
+
+    if (module->mIsIndexed) {
+        // Open addressing doesn't allow to simply clear the slots, the other names are inserted again
+        module->mIsIndexed = eTracerFalse;
+        tracerSymbolIndexRebuildNames(index);
+    }
+
+    tracerSymbolIndexFreeModule(module);
+}
+
+TracerSymbolModule* tracerSymbolIndexFindModule(const TracerSymbolIndex* index, uintptr_t address) {
+    size_t low = 0;
+    size_t high = index->mNumModules;
+
+    // Find the last module that starts at or before the address
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (index->mModules[middle]->mBaseAddress <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == 0) {
+        return NULL;
+    }
+
+    TracerSymbolModule* module = index->mModules[low - 1];
+
+    if (address - module->mBaseAddress >= module->mSize) {
+        return NULL;
+    }
+
+    return module;
+}
+
+TracerBool tracerSymbolIndexAddSymbol(TracerSymbolModule* module, uintptr_t address, size_t size, const char* name) {
+    if (module->mIsIndexed) {
+        // Symbols can't be added after the module was finalized
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    size_t nameLength = strlen(name) + 1;
+
+    if (module->mNumSymbols == module->mMaxSymbols) {
+        size_t maxSymbols = module->mMaxSymbols ? module->mMaxSymbols * 2 : 256;
+
+        TracerSymbolEntry* symbols = (TracerSymbolEntry*)realloc(
+            module->mSymbols, maxSymbols * sizeof(TracerSymbolEntry));
+
+        if (!symbols) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            return eTracerFalse;
+        }
+
+        module->mSymbols = symbols;
+        module->mMaxSymbols = maxSymbols;
+    }
+
+    if (module->mStringPoolSize + nameLength > module->mMaxStringPoolSize) {
+        size_t maxStringPoolSize = module->mMaxStringPoolSize ? module->mMaxStringPoolSize * 2 : 8192;
+
+        while (module->mStringPoolSize + nameLength > maxStringPoolSize) {
+            maxStringPoolSize *= 2;
+        }
+
+        char* stringPool = (char*)realloc(module->mStringPool, maxStringPoolSize);
+
+        if (!stringPool) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            return eTracerFalse;
+        }
+
+        module->mStringPool = stringPool;
+        module->mMaxStringPoolSize = maxStringPoolSize;
+    }
+
+    TracerSymbolEntry* entry = &module->mSymbols[module->mNumSymbols++];
+    entry->mAddress = address;
+    entry->mSize = (uint32_t)size;
+    entry->mNameOffset = (uint32_t)module->mStringPoolSize;
+
+    memcpy(module->mStringPool + module->mStringPoolSize, name, nameLength);
+    module->mStringPoolSize += nameLength;
+
+    return eTracerTrue;
+}
+
+static int tracerSymbolIndexCompareSymbols(const void* left, const void* right) {
+    const TracerSymbolEntry* a = (const TracerSymbolEntry*)left;
+    const TracerSymbolEntry* b = (const TracerSymbolEntry*)right;
+
+    if (a->mAddress != b->mAddress) {
+        return (a->mAddress < b->mAddress) ? -1 : 1;
+    }
+
+    // Symbols at the same address keep the order in which they were added
+    if (a->mNameOffset != b->mNameOffset) {
+        return (a->mNameOffset < b->mNameOffset) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static void tracerSymbolIndexInsertName(TracerSymbolNameSlot* table, size_t tableSize,
+    uint32_t hash, TracerSymbolModule* module, uint32_t symbolIndex) {
+
+    size_t mask = tableSize - 1;
+    size_t slot = hash & mask;
+
+    while (table[slot].mModule) {
+        slot = (slot + 1) & mask;
+    }
+
+    table[slot].mHash = hash;
+    table[slot].mModule = module;
+    table[slot].mSymbolIndex = symbolIndex;
+}
+
+static TracerBool tracerSymbolIndexReserveNames(TracerSymbolIndex* index, size_t numNames) {
+    size_t tableSize = index->mNameTableSize ? index->mNameTableSize : TLIB_SYMBOL_INDEX_MIN_TABLE_SIZE;
+
+    // Keep the load factor of the table below 50%
+    while ((index->mNumNames + numNames) * 2 > tableSize) {
+        tableSize *= 2;
+    }
+
+    if (tableSize == index->mNameTableSize) {
+        return eTracerTrue;
+    }
+
+    TracerSymbolNameSlot* table = (TracerSymbolNameSlot*)calloc(tableSize, sizeof(TracerSymbolNameSlot));
+
+    if (!table) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    for (size_t i = 0; i < index->mNameTableSize; ++i) {
+        TracerSymbolNameSlot* oldSlot = &index->mNameTable[i];
+
+        if (oldSlot->mModule) {
+            tracerSymbolIndexInsertName(table, tableSize, oldSlot->mHash, oldSlot->mModule, oldSlot->mSymbolIndex);
+        }
+    }
+
+    free(index->mNameTable);
+
+    index->mNameTable = table;
+    index->mNameTableSize = tableSize;
+    return eTracerTrue;
+}
+
+static void tracerSymbolIndexInsertModuleNames(TracerSymbolIndex* index, TracerSymbolModule* module) {
+    for (size_t i = 0; i < module->mNumSymbols; ++i) {
+        const char* name = module->mStringPool + module->mSymbols[i].mNameOffset;
+        uint32_t hash = tracerSymbolIndexHashName(name, strlen(name));
+
+        tracerSymbolIndexInsertName(index->mNameTable, index->mNameTableSize, hash, module, (uint32_t)i);
+    }
+
+    index->mNumNames += module->mNumSymbols;
+}
+
+TracerBool tracerSymbolIndexFinalizeModule(TracerSymbolIndex* index, TracerSymbolModule* module) {
+    if (module->mIsIndexed) {
+        return eTracerTrue;
+    }
+
+    if (!tracerSymbolIndexReserveNames(index, module->mNumSymbols)) {
+        return eTracerFalse;
+    }
+
+    qsort(module->mSymbols, module->mNumSymbols, sizeof(TracerSymbolEntry), tracerSymbolIndexCompareSymbols);
+
+    tracerSymbolIndexInsertModuleNames(index, module);
+    module->mIsIndexed = eTracerTrue;
+
+    return eTracerTrue;
+}
+
+static void tracerSymbolIndexRebuildNames(TracerSymbolIndex* index) {
+    if (!index->mNameTableSize) {
+        return;
+    }
+
+    // The table keeps its size, so this can't fail
+    memset(index->mNameTable, 0, index->mNameTableSize * sizeof(TracerSymbolNameSlot));
+    index->mNumNames = 0;
+
+    for (size_t i = 0; i < index->mNumModules; ++i) {
+        if (index->mModules[i]->mIsIndexed) {
+            tracerSymbolIndexInsertModuleNames(index, index->mModules[i]);
+        }
+    }
+}
+
+static TracerBool tracerSymbolIndexLookupBefore(const TracerSymbolModule* module,
+    size_t upperBound, uintptr_t address, TracerSymbolLookup* lookup) {
+
+    // The upper bound is the index of the first symbol that starts behind the address
+    if (upperBound == 0) {
+        return eTracerFalse;
+    }
+
+    size_t symbolIndex = upperBound - 1;
+
+    // Prefer the first name if there are multiple symbols at the same address
+    while (symbolIndex > 0 && module->mSymbols[symbolIndex - 1].mAddress == module->mSymbols[symbolIndex].mAddress) {
+        --symbolIndex;
+    }
+
+    const TracerSymbolEntry* entry = &module->mSymbols[symbolIndex];
+
+    // Public symbols don't have a size, we treat them as extending up to the next symbol
+    if (entry->mSize && address - entry->mAddress >= entry->mSize) {
+        return eTracerFalse;
+    }
+
+    lookup->mModule = module;
+    lookup->mSymbolName = module->mStringPool + entry->mNameOffset;
+    lookup->mSymbolAddress = entry->mAddress;
+    lookup->mDisplacement = address - entry->mAddress;
+
+    return eTracerTrue;
+}
+
+TracerBool tracerSymbolIndexLookupAddress(const TracerSymbolModule* module, uintptr_t address, TracerSymbolLookup* lookup) {
+    if (!module->mIsIndexed || !module->mNumSymbols) {
+        return eTracerFalse;
+    }
+
+    size_t low = 0;
+    size_t high = module->mNumSymbols;
+
+    // Find the last symbol that starts at or before the address
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (module->mSymbols[middle].mAddress <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return tracerSymbolIndexLookupBefore(module, low, address, lookup);
+}
+
+TracerBool tracerSymbolIndexLookupAddressSorted(const TracerSymbolModule* module,
+    uintptr_t address, size_t* cursor, TracerSymbolLookup* lookup) {
+
+    if (!module->mIsIndexed || !module->mNumSymbols) {
+        return eTracerFalse;
+    }
+
+    // The addresses are visited in ascending order, so the cursor only ever moves forward.
+    // Gallop ahead first, addresses that are far apart shouldn't cost a linear scan.
+    size_t low = *cursor;
+    size_t step = 1;
+
+    while (low + step <= module->mNumSymbols && module->mSymbols[low + step - 1].mAddress <= address) {
+        low += step;
+        step *= 2;
+    }
+
+    size_t high = min(low + step - 1, module->mNumSymbols);
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (module->mSymbols[middle].mAddress <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    size_t upperBound = low;
+    *cursor = upperBound;
+    return tracerSymbolIndexLookupBefore(module, upperBound, address, lookup);
+}
+
+TracerBool tracerSymbolIndexLookupName(const TracerSymbolIndex* index, const char* name, TracerSymbolLookup* lookup) {
+    if (!index->mNameTableSize) {
+        return eTracerFalse;
+    }
+
+    // Names can be qualified with the module name (e.g. kernel32!CreateFileW)
+    const char* moduleName = NULL;
+    size_t moduleNameLength = 0;
+
+    const char* separator = strchr(name, '!');
+
+    if (separator) {
+        moduleName = name;
+        moduleNameLength = (size_t)(separator - name);
+        name = separator + 1;
+    }
+
+    size_t nameLength = strlen(name);
+    uint32_t hash = tracerSymbolIndexHashName(name, nameLength);
+
+    size_t mask = index->mNameTableSize - 1;
+    size_t slot = hash & mask;
+
+    for (; index->mNameTable[slot].mModule; slot = (slot + 1) & mask) {
+        const TracerSymbolNameSlot* nameSlot = &index->mNameTable[slot];
+
+        if (nameSlot->mHash != hash) {
+            continue;
+        }
+
+        const TracerSymbolModule* module = nameSlot->mModule;
+        const TracerSymbolEntry* entry = &module->mSymbols[nameSlot->mSymbolIndex];
+
+        if (strcmp(module->mStringPool + entry->mNameOffset, name) != 0) {
+            continue;
+        }
+
+        if (moduleName && (strlen(module->mName) != moduleNameLength ||
+                _strnicmp(module->mName, moduleName, moduleNameLength) != 0)) {
+            continue;
+        }
+
+        lookup->mModule = module;
+        lookup->mSymbolName = module->mStringPool + entry->mNameOffset;
+        lookup->mSymbolAddress = entry->mAddress;
+        lookup->mDisplacement = 0;
+
+        return eTracerTrue;
+    }
+
+    return eTracerFalse;
+}
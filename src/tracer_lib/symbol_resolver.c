@@ -1,12 +1,17 @@
 
 #include <tracer_lib/symbol_resolver.h>
+#include <tracer_lib/pe_image.h>
 
 #include <Zydis/Zydis.h>
 
 #include <DbgHelp.h>
+#include <Psapi.h>
 #include <stdio.h>
 
 #pragma comment(lib, "dbghelp.lib")
+#pragma comment(lib, "psapi")
+
+#define TLIB_SYMBOL_RESOLVER_MAX_MODULES    1024
 
 /**
  * @brief   Appends formatted text to the given `string`.
@@ -38,6 +43,19 @@ static ZYDIS_INLINE ZydisStatus ZydisStringAppendFormatC(ZydisString* string, co
     return ZYDIS_STATUS_SUCCESS;
 }
 
+typedef struct TracerSymbolResolver {
+    HANDLE                          mProcess;
+    TracerSymbolIndex               mIndex;
+    DWORD                           mLastModuleRefresh;
+    uint32_t                        mGeneration;            // Counts the module refreshes
+    SYMBOL_INFO_PACKAGE             mFallbackSymbol;        // Holds the result of the last DbgHelp lookup
+} TracerSymbolResolver;
+
+typedef struct TracerSortedAddress {
+    uintptr_t                       mAddress;
+    size_t                          mIndex;                 // Position within the caller's array
+} TracerSortedAddress;
+
 static ZydisFormatterAddressFunc formatAddressOriginal;
 
 static ZydisStatus ZydisFormatterPrintAddressWithSymbols(const ZydisFormatter* formatter,
@@ -45,32 +63,226 @@ static ZydisStatus ZydisFormatterPrintAddressWithSymbols(const ZydisFormatter* f
     const ZydisDecodedOperand* operand, ZydisU64 address, void* userData)
 {
     ZYDIS_UNUSED_PARAMETER(operand);
-    ZYDIS_UNUSED_PARAMETER(userData);
 
     if (!formatter || !instruction) {
         return ZYDIS_STATUS_INVALID_PARAMETER;
     }
 
-    SYMBOL_INFO_PACKAGE symbolInfoPackage;
-    symbolInfoPackage.si.SizeOfStruct = sizeof(SYMBOL_INFO);
-    symbolInfoPackage.si.MaxNameLen = sizeof(symbolInfoPackage.name);
+    // The user data holds the symbol resolver of the process that the instruction belongs to
+    TracerSymbolLookup lookup;
 
-    DWORD64 displacement = 0;
-    if (!SymFromAddr(GetCurrentProcess(), address, &displacement, &symbolInfoPackage.si)) {
+    if (!userData || !tracerResolveAddress((TracerHandle)userData, (uintptr_t)address, &lookup)) {
         return formatAddressOriginal(formatter, string, instruction, operand, address, userData);
     }
 
-    if (!displacement) {
-        return ZydisStringAppendFormatC(string, "%s", symbolInfoPackage.si.Name);
+    if (!lookup.mDisplacement) {
+        return ZydisStringAppendFormatC(string, "%s", lookup.mSymbolName);
     } else {
-        return ZydisStringAppendFormatC(string, "%s+%X", symbolInfoPackage.si.Name, displacement);
+        return ZydisStringAppendFormatC(string, "%s+%X", lookup.mSymbolName, (unsigned int)lookup.mDisplacement);
     }
 }
 
-TracerBool tracerRegisterCustomSymbolResolver(void* instructionFormatter) {
-    SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS);
-    SymInitialize(GetCurrentProcess(), NULL, TRUE);
+static void tracerSymbolResolverRemoveModule(TracerSymbolResolver* resolver, TracerSymbolModule* module) {
+    if (module->mIsIndexed) {
+        // DbgHelp knows modules by their base address, the next image there has to be loaded anew
+        tracerCoreAcquireDbgHelpLock();
+        SymUnloadModule64(resolver->mProcess, (DWORD64)module->mBaseAddress);
+        tracerCoreReleaseDbgHelpLock();
+    }
+
+    tracerSymbolIndexRemoveModule(&resolver->mIndex, module);
+}
+
+static void tracerSymbolResolverRefreshModules(TracerSymbolResolver* resolver) {
+    resolver->mLastModuleRefresh = GetTickCount();
+
+    HMODULE modules[TLIB_SYMBOL_RESOLVER_MAX_MODULES];
+    DWORD bytesNeeded = 0;
+
+    // Only the module list is read here, nothing gets loaded before a module is actually looked at
+    if (!EnumProcessModules(resolver->mProcess, modules, sizeof(modules), &bytesNeeded)) {
+        return;
+    }
+
+    DWORD numModules = min(bytesNeeded, sizeof(modules)) / sizeof(HMODULE);
+    uint32_t generation = ++resolver->mGeneration;
+
+    for (DWORD i = 0; i < numModules; ++i) {
+        MODULEINFO moduleInfo;
+        char moduleName[TLIB_SYMBOL_INDEX_MAX_MODULE_NAME];
+
+        if (!GetModuleInformation(resolver->mProcess, modules[i], &moduleInfo, sizeof(moduleInfo)) ||
+            !GetModuleBaseNameA(resolver->mProcess, modules[i], moduleName, sizeof(moduleName))) {
+            continue;
+        }
+
+        // Strip the extension, names are qualified the same way as in DbgHelp (e.g. kernel32!CreateFileW)
+        char* extension = strrchr(moduleName, '.');
+
+        if (extension) {
+            *extension = 0;
+        }
+
+        uintptr_t baseAddress = (uintptr_t)moduleInfo.lpBaseOfDll;
+        uint32_t timeDateStamp = 0;
+        uint32_t checkSum = 0;
+
+        tracerPeReadImageStamp(resolver->mProcess, baseAddress, &timeDateStamp, &checkSum);
+
+        TracerSymbolModule* module = tracerSymbolIndexFindModule(&resolver->mIndex, baseAddress);
+
+        if (module && module->mBaseAddress == baseAddress && (module->mSize != (size_t)moduleInfo.SizeOfImage ||
+                module->mTimeDateStamp != timeDateStamp || module->mCheckSum != checkSum)) {
+
+            // Another image was loaded at the same base
+            tracerSymbolResolverRemoveModule(resolver, module);
+        }
+
+        module = tracerSymbolIndexAddModule(&resolver->mIndex, baseAddress,
+            (size_t)moduleInfo.SizeOfImage, timeDateStamp, checkSum, moduleName);
+
+        if (module) {
+            module->mGeneration = generation;
+        }
+    }
+
+    // A truncated list doesn't tell which modules are gone
+    if (bytesNeeded > sizeof(modules)) {
+        return;
+    }
+
+    for (size_t i = resolver->mIndex.mNumModules; i-- > 0;) {
+        TracerSymbolModule* module = resolver->mIndex.mModules[i];
+
+        if (module->mGeneration != generation) {
+            tracerSymbolResolverRemoveModule(resolver, module);
+        }
+    }
+}
+
+static BOOL CALLBACK tracerSymbolResolverEnumSymbol(PSYMBOL_INFO symbolInfo, ULONG symbolSize, PVOID userContext) {
+    TracerSymbolModule* module = (TracerSymbolModule*)userContext;
+
+    if (symbolInfo->Address && symbolInfo->NameLen) {
+        tracerSymbolIndexAddSymbol(module, (uintptr_t)symbolInfo->Address, (size_t)symbolSize, symbolInfo->Name);
+    }
+
+    return TRUE;
+}
+
+static void tracerSymbolResolverEnumExport(uintptr_t address, const char* name, void* userData) {
+    tracerSymbolIndexAddSymbol((TracerSymbolModule*)userData, address, 0, name);
+}
+
+static void tracerSymbolResolverIndexModule(TracerSymbolResolver* resolver, TracerSymbolModule* module) {
+    TracerPeImageInfo imageInfo;
+
+    if (tracerPeReadImageInfo(resolver->mProcess, module->mBaseAddress, &imageInfo)) {
+        if (imageInfo.mHasDebugInfo) {
+            // The image references a PDB, only now hand the module to DbgHelp so it can load it
+            char imagePath[MAX_PATH];
 
+            if (GetModuleFileNameExA(resolver->mProcess, (HMODULE)module->mBaseAddress, imagePath, sizeof(imagePath))) {
+                tracerCoreAcquireDbgHelpLock();
+
+                if (SymLoadModuleEx(resolver->mProcess, NULL, imagePath, NULL,
+                        (DWORD64)module->mBaseAddress, (DWORD)module->mSize, NULL, 0)) {
+
+                    SymEnumSymbols(resolver->mProcess, (ULONG64)module->mBaseAddress, "*",
+                        tracerSymbolResolverEnumSymbol, module);
+                }
+
+                tracerCoreReleaseDbgHelpLock();
+            }
+        }
+
+        if (!module->mNumSymbols) {
+            // No debug information, the export table is all we've got
+            tracerPeEnumExports(resolver->mProcess, &imageInfo, tracerSymbolResolverEnumExport, module);
+        }
+    }
+
+    tracerSymbolIndexFinalizeModule(&resolver->mIndex, module);
+}
+
+static TracerBool tracerSymbolResolverIndexModulesForName(TracerSymbolResolver* resolver,
+    const char* symbolName, TracerSymbolLookup* lookup)
+{
+    const char* separator = strchr(symbolName, '!');
+    size_t moduleNameLength = separator ? (size_t)(separator - symbolName) : 0;
+
+    for (size_t i = 0; i < resolver->mIndex.mNumModules; ++i) {
+        TracerSymbolModule* module = resolver->mIndex.mModules[i];
+
+        if (module->mIsIndexed) {
+            continue;
+        }
+
+        // A qualified name only needs its own module
+        if (separator && (strlen(module->mName) != moduleNameLength ||
+                _strnicmp(module->mName, symbolName, moduleNameLength) != 0)) {
+            continue;
+        }
+
+        tracerSymbolResolverIndexModule(resolver, module);
+
+        if (tracerSymbolIndexLookupName(&resolver->mIndex, symbolName, lookup)) {
+            return eTracerTrue;
+        }
+    }
+
+    return eTracerFalse;
+}
+
+TracerHandle tracerCreateSymbolResolver(TracerHandle process) {
+    TracerSymbolResolver* resolver = (TracerSymbolResolver*)malloc(sizeof(TracerSymbolResolver));
+
+    if (!resolver) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    resolver->mProcess = process ? (HANDLE)process : GetCurrentProcess();
+    resolver->mGeneration = 0;
+    tracerSymbolIndexInit(&resolver->mIndex);
+
+    tracerCoreAcquireDbgHelpLock();
+
+    SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS | SYMOPT_FAIL_CRITICAL_ERRORS | SYMOPT_NO_PROMPTS);
+
+    // Don't let DbgHelp invade the process, modules are handed to it one by one when they are needed
+    BOOL initialized = SymInitialize(resolver->mProcess, NULL, FALSE);
+
+    tracerCoreReleaseDbgHelpLock();
+
+    if (!initialized) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        free(resolver);
+        return NULL;
+    }
+
+    tracerSymbolResolverRefreshModules(resolver);
+    return (TracerHandle)resolver;
+}
+
+void tracerDestroySymbolResolver(TracerHandle handle) {
+    TracerSymbolResolver* resolver = (TracerSymbolResolver*)handle;
+
+    if (!resolver) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    tracerCoreAcquireDbgHelpLock();
+    SymCleanup(resolver->mProcess);
+    tracerCoreReleaseDbgHelpLock();
+
+    tracerSymbolIndexClear(&resolver->mIndex);
+
+    free(resolver);
+}
+
+TracerBool tracerRegisterCustomSymbolResolver(void* instructionFormatter) {
     formatAddressOriginal = (ZydisFormatterAddressFunc)&ZydisFormatterPrintAddressWithSymbols;
 
     if (ZydisFormatterSetHook((ZydisFormatter*)instructionFormatter,
@@ -83,20 +295,211 @@ TracerBool tracerRegisterCustomSymbolResolver(void* instructionFormatter) {
     return eTracerTrue;
 }
 
-TracerBool tracerUnregisterCustomSymbolResolver() {
-    SymCleanup(GetCurrentProcess());
+static TracerSymbolModule* tracerSymbolResolverFindModule(TracerSymbolResolver* resolver, uintptr_t address) {
+    TracerSymbolModule* module = tracerSymbolIndexFindModule(&resolver->mIndex, address);
+
+    if (!module && GetTickCount() - resolver->mLastModuleRefresh >= TLIB_SYMBOL_RESOLVER_REFRESH_INTERVAL) {
+        // The address might belong to a module that was loaded recently
+        tracerSymbolResolverRefreshModules(resolver);
+        module = tracerSymbolIndexFindModule(&resolver->mIndex, address);
+    }
+
+    if (module && !module->mIsIndexed) {
+        tracerSymbolResolverIndexModule(resolver, module);
+    }
+
+    return module;
+}
+
+TracerBool tracerResolveAddress(TracerHandle handle, uintptr_t address, TracerSymbolLookup* lookup) {
+    TracerSymbolResolver* resolver = (TracerSymbolResolver*)handle;
+
+    if (!resolver || !lookup) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    TracerSymbolModule* module = tracerSymbolResolverFindModule(resolver, address);
+
+    if (module && tracerSymbolIndexLookupAddress(module, address, lookup)) {
+        return eTracerTrue;
+    }
+
+    // Not in our index, ask DbgHelp
+    SYMBOL_INFO* symbolInfo = &resolver->mFallbackSymbol.si;
+    symbolInfo->SizeOfStruct = sizeof(SYMBOL_INFO);
+    symbolInfo->MaxNameLen = sizeof(resolver->mFallbackSymbol.name);
+
+    DWORD64 displacement = 0;
+
+    tracerCoreAcquireDbgHelpLock();
+    BOOL found = SymFromAddr(resolver->mProcess, (DWORD64)address, &displacement, symbolInfo);
+    tracerCoreReleaseDbgHelpLock();
+
+    if (!found) {
+        return eTracerFalse;
+    }
+
+    lookup->mModule = module;
+    lookup->mSymbolName = symbolInfo->Name;
+    lookup->mSymbolAddress = (uintptr_t)symbolInfo->Address;
+    lookup->mDisplacement = (uintptr_t)displacement;
+
     return eTracerTrue;
 }
 
-uintptr_t tracerResolveSymbol(const char* symbolName) {
-    SYMBOL_INFO_PACKAGE symbolInfoPackage;
-    symbolInfoPackage.si.SizeOfStruct = sizeof(SYMBOL_INFO);
-    symbolInfoPackage.si.MaxNameLen = sizeof(symbolInfoPackage.name);
+uintptr_t tracerResolveSymbol(TracerHandle handle, const char* symbolName) {
+    TracerSymbolResolver* resolver = (TracerSymbolResolver*)handle;
 
-    if (!SymFromName(GetCurrentProcess(), symbolName, &symbolInfoPackage.si)) {
-        tracerCoreSetLastError(eTracerErrorSystemCall);
+    if (!resolver || !symbolName) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
         return 0;
     }
 
-    return (uintptr_t)symbolInfoPackage.si.Address;
+    TracerSymbolLookup lookup;
+
+    if (tracerSymbolIndexLookupName(&resolver->mIndex, symbolName, &lookup)) {
+        return lookup.mSymbolAddress;
+    }
+
+    // Index the remaining modules one at a time, until one of them knows the name
+    if (tracerSymbolResolverIndexModulesForName(resolver, symbolName, &lookup)) {
+        return lookup.mSymbolAddress;
+    }
+
+    if (GetTickCount() - resolver->mLastModuleRefresh >= TLIB_SYMBOL_RESOLVER_REFRESH_INTERVAL) {
+        tracerSymbolResolverRefreshModules(resolver);
+
+        if (tracerSymbolResolverIndexModulesForName(resolver, symbolName, &lookup)) {
+            return lookup.mSymbolAddress;
+        }
+    }
+
+    tracerCoreSetLastError(eTracerErrorSystemCall);
+    return 0;
+}
+
+const TracerSymbolModule* tracerResolveModule(TracerHandle handle, uintptr_t address) {
+    TracerSymbolResolver* resolver = (TracerSymbolResolver*)handle;
+
+    if (!resolver) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    return tracerSymbolResolverFindModule(resolver, address);
+}
+
+static int tracerSymbolResolverCompareAddresses(const void* lhs, const void* rhs) {
+    uintptr_t lhsAddress = ((const TracerSortedAddress*)lhs)->mAddress;
+    uintptr_t rhsAddress = ((const TracerSortedAddress*)rhs)->mAddress;
+
+    return (lhsAddress > rhsAddress) - (lhsAddress < rhsAddress);
+}
+
+static void tracerSymbolResolverFillInfo(TracerSymbolInfo* symbol, uintptr_t address,
+    const TracerSymbolModule* module, const TracerSymbolLookup* lookup)
+{
+    memset(symbol, 0, sizeof(TracerSymbolInfo));
+    symbol->mAddress = address;
+
+    if (lookup && lookup->mModule) {
+        module = lookup->mModule;
+    }
+
+    if (module) {
+        symbol->mModuleBase = module->mBaseAddress;
+        strncpy(symbol->mModuleName, module->mName, sizeof(symbol->mModuleName) - 1);
+    }
+
+    if (lookup) {
+        symbol->mSymbolAddress = lookup->mSymbolAddress;
+        symbol->mDisplacement = lookup->mDisplacement;
+        strncpy(symbol->mSymbolName, lookup->mSymbolName, sizeof(symbol->mSymbolName) - 1);
+    }
+}
+
+size_t tracerResolveAddresses(TracerHandle handle, const uintptr_t* addresses, size_t numAddresses, TracerSymbolInfo* outSymbols) {
+    TracerSymbolResolver* resolver = (TracerSymbolResolver*)handle;
+
+    if (!resolver || (numAddresses && (!addresses || !outSymbols))) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    if (!numAddresses) {
+        return 0;
+    }
+
+    TracerSortedAddress* sorted = (TracerSortedAddress*)malloc(numAddresses * sizeof(TracerSortedAddress));
+
+    if (!sorted) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return 0;
+    }
+
+    for (size_t i = 0; i < numAddresses; ++i) {
+        sorted[i].mAddress = addresses[i];
+        sorted[i].mIndex = i;
+    }
+
+    // Sorting groups the addresses by module and lets us walk each symbol table once, front to back
+    qsort(sorted, numAddresses, sizeof(TracerSortedAddress), tracerSymbolResolverCompareAddresses);
+
+    TracerSymbolModule* module = NULL;
+    TracerSymbolInfo* previous = NULL;
+    TracerBool refreshedModules = eTracerFalse;
+
+    size_t cursor = 0;
+    size_t numResolved = 0;
+
+    for (size_t i = 0; i < numAddresses; ++i) {
+        uintptr_t address = sorted[i].mAddress;
+        TracerSymbolInfo* symbol = &outSymbols[sorted[i].mIndex];
+
+        if (previous && previous->mAddress == address) {
+            // Call stacks and traces repeat the same addresses a lot, resolve every address only once
+            *symbol = *previous;
+
+            if (symbol->mSymbolAddress) {
+                ++numResolved;
+            }
+
+            continue;
+        }
+
+        previous = symbol;
+
+        if (!module || address - module->mBaseAddress >= module->mSize) {
+            module = tracerSymbolIndexFindModule(&resolver->mIndex, address);
+
+            if (!module && !refreshedModules) {
+                // Refresh at most once per batch, unknown addresses won't appear out of thin air
+                tracerSymbolResolverRefreshModules(resolver);
+                refreshedModules = eTracerTrue;
+
+                module = tracerSymbolIndexFindModule(&resolver->mIndex, address);
+            }
+
+            if (module && !module->mIsIndexed) {
+                tracerSymbolResolverIndexModule(resolver, module);
+            }
+
+            cursor = 0;
+        }
+
+        TracerSymbolLookup lookup;
+
+        if ((module && tracerSymbolIndexLookupAddressSorted(module, address, &cursor, &lookup)) ||
+            tracerResolveAddress(handle, address, &lookup)) {
+
+            tracerSymbolResolverFillInfo(symbol, address, module, &lookup);
+            ++numResolved;
+        } else {
+            tracerSymbolResolverFillInfo(symbol, address, module, NULL);
+        }
+    }
+
+    free(sorted);
+    return numResolved;
 }
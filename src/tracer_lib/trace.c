@@ -47,3 +47,30 @@ TracerBool tracerTraceStop(TracerContext* ctx, void* address, int threadId) {
     TLIB_METHOD_CHECK_SUPPORT(trace->mStopTrace, eTracerFalse);
     return trace->mStopTrace(ctx, address, threadId);
 }
+
+TracerBool tracerTraceGetStatistics(TracerContext* ctx, TracerStatistics* statistics) {
+    if (!tracerCoreValidateContext(ctx, eTracerTraceContext)) {
+        return eTracerFalse;
+    }
+    TracerTraceContext* trace = (TracerTraceContext*)ctx;
+    TLIB_METHOD_CHECK_SUPPORT(trace->mGetStatistics, eTracerFalse);
+    return trace->mGetStatistics(ctx, statistics);
+}
+
+TracerBool tracerTraceStartWatch(TracerContext* ctx, void* address, int size, TracerWatchCondition condition, int threadId) {
+    if (!tracerCoreValidateContext(ctx, eTracerTraceContext)) {
+        return eTracerFalse;
+    }
+    TracerTraceContext* trace = (TracerTraceContext*)ctx;
+    TLIB_METHOD_CHECK_SUPPORT(trace->mStartWatch, eTracerFalse);
+    return trace->mStartWatch(ctx, address, size, condition, threadId);
+}
+
+TracerBool tracerTraceStopWatch(TracerContext* ctx, void* address, int threadId) {
+    if (!tracerCoreValidateContext(ctx, eTracerTraceContext)) {
+        return eTracerFalse;
+    }
+    TracerTraceContext* trace = (TracerTraceContext*)ctx;
+    TLIB_METHOD_CHECK_SUPPORT(trace->mStopWatch, eTracerFalse);
+    return trace->mStopWatch(ctx, address, threadId);
+}
@@ -0,0 +1,523 @@
+
+#include <tracer_lib/trace_chunk.h>
+
+#define TLIB_TRACE_CHUNK_ALIGNMENT      8
+#define TLIB_TRACE_CHUNK_DICTIONARY_SLOTS (TLIB_TRACE_CHUNK_MAX_DICTIONARY * 2)
+
+typedef struct TracerTraceColumnInfo {
+    size_t                      mOffset;            // Of the field in TracerTracedInstruction
+    size_t                      mWidth;
+} TracerTraceColumnInfo;
+
+static const TracerTraceColumnInfo gTracerTraceColumns[eTracerTraceColumnCount] = {
+    { FIELD_OFFSET(TracerTracedInstruction, mType),                 sizeof(uint8_t)   },
+    { FIELD_OFFSET(TracerTracedInstruction, mTraceId),              sizeof(int)       },
+    { FIELD_OFFSET(TracerTracedInstruction, mThreadId),             sizeof(int)       },
+    { FIELD_OFFSET(TracerTracedInstruction, mCallDepth),            sizeof(int)       },
+    { FIELD_OFFSET(TracerTracedInstruction, mBranchSource),         sizeof(uintptr_t) },
+    { FIELD_OFFSET(TracerTracedInstruction, mBranchTarget),         sizeof(uintptr_t) },
+    { FIELD_OFFSET(TracerTracedInstruction, mTimestamp),            sizeof(uint64_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mOldValue),             sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mNewValue),             sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mEAX),     sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mEBX),     sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mECX),     sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mEDX),     sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mESI),     sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mEDI),     sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mEBP),     sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mESP),     sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mSegGS),   sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mSegFS),   sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mSegES),   sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mSegDS),   sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mSegCS),   sizeof(uint32_t)  },
+    { FIELD_OFFSET(TracerTracedInstruction, mRegisterSet.mSegSS),   sizeof(uint32_t)  },
+};
+
+typedef struct TracerTraceDictionary {
+    uint64_t                    mValues[TLIB_TRACE_CHUNK_MAX_DICTIONARY];
+    size_t                      mNumValues;
+    uint16_t                    mSlots[TLIB_TRACE_CHUNK_DICTIONARY_SLOTS];  // Index + 1, 0 for a free slot
+} TracerTraceDictionary;
+
+size_t tracerTraceColumnWidth(TracerTraceColumn column) {
+    return gTracerTraceColumns[column].mWidth;
+}
+
+size_t tracerTraceChunkMaxEncodedSize(size_t numRecords) {
+    // Raw is always a candidate, so no column ever exceeds it
+    size_t size = sizeof(TracerTraceChunkHeader) + numRecords * sizeof(TracerTraceRef);
+
+    for (int i = 0; i < eTracerTraceColumnCount; i++) {
+        size += numRecords * gTracerTraceColumns[i].mWidth + TLIB_TRACE_CHUNK_ALIGNMENT;
+    }
+
+    return size;
+}
+
+static uint64_t tracerTraceChunkLoad(const void* data, size_t width) {
+    uint8_t value8;
+    uint32_t value32;
+    uint64_t value64;
+
+    switch (width) {
+    case 1:
+        memcpy(&value8, data, 1);
+        return value8;
+    case 4:
+        memcpy(&value32, data, 4);
+        return value32;
+    default:
+        memcpy(&value64, data, 8);
+        return value64;
+    }
+}
+
+static void tracerTraceChunkStore(void* data, size_t width, uint64_t value) {
+    uint8_t value8 = (uint8_t)value;
+    uint32_t value32 = (uint32_t)value;
+
+    switch (width) {
+    case 1:
+        memcpy(data, &value8, 1);
+        break;
+    case 4:
+        memcpy(data, &value32, 4);
+        break;
+    default:
+        memcpy(data, &value, 8);
+        break;
+    }
+}
+
+static uint64_t tracerTraceChunkRefValue(const TracerTraceRef* ref, size_t refIndex, TracerTraceColumn column) {
+    switch (column) {
+    case eTracerTraceColumnType:
+        return TLIB_TRACE_CHUNK_TYPE_REF;
+    case eTracerTraceColumnTraceId:
+        return (uint32_t)ref->mTraceId;
+    case eTracerTraceColumnThreadId:
+        return (uint32_t)ref->mThreadId;
+    case eTracerTraceColumnCallDepth:
+        return (uint32_t)ref->mCallDepth;
+    case eTracerTraceColumnTarget:
+        return refIndex;
+    case eTracerTraceColumnTimestamp:
+        return ref->mTimestamp;
+    default:
+        return 0;
+    }
+}
+
+static void tracerTraceChunkGather(const TracerTracedInstruction* records, size_t numRecords,
+    TracerTraceColumn column, uint64_t* values) {
+
+    size_t offset = gTracerTraceColumns[column].mOffset;
+    size_t width = gTracerTraceColumns[column].mWidth;
+    size_t numRefs = 0;
+
+    for (size_t i = 0; i < numRecords; i++) {
+        const TracerTracedInstruction* record = &records[i];
+
+        if ((uint32_t)record->mType == TLIB_TRACE_REF_TYPE) {
+            values[i] = tracerTraceChunkRefValue((const TracerTraceRef*)record, numRefs++, column);
+        } else if (column == eTracerTraceColumnType) {
+            values[i] = (uint8_t)record->mType;
+        } else {
+            values[i] = tracerTraceChunkLoad((const uint8_t*)record + offset, width);
+        }
+    }
+}
+
+static int tracerTraceDictionaryInsert(TracerTraceDictionary* dictionary, uint64_t value) {
+    size_t slot = (size_t)((value * 0x9E3779B97F4A7C15ULL) >> 55);
+
+    for (;;) {
+        uint16_t index = dictionary->mSlots[slot];
+
+        if (!index) {
+            break;
+        }
+
+        if (dictionary->mValues[index - 1] == value) {
+            return index - 1;
+        }
+
+        slot = (slot + 1) & (TLIB_TRACE_CHUNK_DICTIONARY_SLOTS - 1);
+    }
+
+    if (dictionary->mNumValues == TLIB_TRACE_CHUNK_MAX_DICTIONARY) {
+        return -1;
+    }
+
+    dictionary->mValues[dictionary->mNumValues] = value;
+    dictionary->mSlots[slot] = (uint16_t)++dictionary->mNumValues;
+    return (int)dictionary->mNumValues - 1;
+}
+
+static size_t tracerTraceVarintSize(uint64_t value) {
+    size_t size = 1;
+
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+static uint64_t tracerTraceZigzag(uint64_t delta) {
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static size_t tracerTraceChunkEncodeColumn(const uint64_t* values, size_t numRecords, size_t width,
+    TracerTraceColumnHeader* column, uint8_t* out) {
+
+    TracerTraceDictionary dictionary;
+
+    dictionary.mNumValues = 0;
+    memset(dictionary.mSlots, 0, sizeof(dictionary.mSlots));
+
+    TracerBool useDictionary = eTracerTrue;
+    size_t deltaSize = 0;
+    uint64_t previous = 0;
+
+    for (size_t i = 0; i < numRecords; i++) {
+        if (useDictionary && tracerTraceDictionaryInsert(&dictionary, values[i]) < 0) {
+            useDictionary = eTracerFalse;
+        }
+
+        deltaSize += tracerTraceVarintSize(tracerTraceZigzag(values[i] - previous));
+        previous = values[i];
+    }
+
+    size_t rawSize = numRecords * width;
+    size_t dictionarySize = useDictionary ? dictionary.mNumValues * width + numRecords : SIZE_MAX;
+
+    column->mWidth = (uint8_t)width;
+    column->mNumEntries = 0;
+
+    if (numRecords && dictionary.mNumValues == 1) {
+        column->mEncoding = eTracerTraceEncodingConstant;
+        column->mSize = (uint32_t)width;
+
+        tracerTraceChunkStore(out, width, values[0]);
+    } else if (dictionarySize < rawSize && dictionarySize <= deltaSize) {
+        column->mEncoding = eTracerTraceEncodingDictionary;
+        column->mNumEntries = (uint16_t)(dictionary.mNumValues - 1);
+        column->mSize = (uint32_t)dictionarySize;
+
+        for (size_t i = 0; i < dictionary.mNumValues; i++) {
+            tracerTraceChunkStore(out + i * width, width, dictionary.mValues[i]);
+        }
+
+        uint8_t* indices = out + dictionary.mNumValues * width;
+
+        for (size_t i = 0; i < numRecords; i++) {
+            indices[i] = (uint8_t)tracerTraceDictionaryInsert(&dictionary, values[i]);
+        }
+    } else if (deltaSize < rawSize) {
+        column->mEncoding = eTracerTraceEncodingDelta;
+        column->mSize = (uint32_t)deltaSize;
+
+        previous = 0;
+
+        for (size_t i = 0; i < numRecords; i++) {
+            uint64_t delta = tracerTraceZigzag(values[i] - previous);
+
+            while (delta >= 0x80) {
+                *out++ = (uint8_t)(delta | 0x80);
+                delta >>= 7;
+            }
+
+            *out++ = (uint8_t)delta;
+            previous = values[i];
+        }
+    } else {
+        column->mEncoding = eTracerTraceEncodingRaw;
+        column->mSize = (uint32_t)rawSize;
+
+        for (size_t i = 0; i < numRecords; i++) {
+            tracerTraceChunkStore(out + i * width, width, values[i]);
+        }
+    }
+
+    return column->mSize;
+}
+
+size_t tracerTraceChunkEncode(const TracerTracedInstruction* records, size_t numRecords,
+    uint64_t* scratch, uint8_t* outBuffer, size_t bufferSize) {
+
+    if (bufferSize < tracerTraceChunkMaxEncodedSize(numRecords)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    TracerTraceChunkHeader* header = (TracerTraceChunkHeader*)outBuffer;
+    memset(header, 0, sizeof(TracerTraceChunkHeader));
+
+    size_t offset = sizeof(TracerTraceChunkHeader);
+
+    for (int i = 0; i < eTracerTraceColumnCount; i++) {
+        TracerTraceColumnHeader* column = &header->mColumns[i];
+
+        offset = (offset + TLIB_TRACE_CHUNK_ALIGNMENT - 1) & ~(size_t)(TLIB_TRACE_CHUNK_ALIGNMENT - 1);
+        column->mOffset = (uint32_t)offset;
+
+        tracerTraceChunkGather(records, numRecords, (TracerTraceColumn)i, scratch);
+        offset += tracerTraceChunkEncodeColumn(scratch, numRecords, gTracerTraceColumns[i].mWidth, column, outBuffer + offset);
+    }
+
+    offset = (offset + TLIB_TRACE_CHUNK_ALIGNMENT - 1) & ~(size_t)(TLIB_TRACE_CHUNK_ALIGNMENT - 1);
+    header->mRefsOffset = (uint32_t)offset;
+
+    for (size_t i = 0; i < numRecords; i++) {
+        if ((uint32_t)records[i].mType == TLIB_TRACE_REF_TYPE) {
+            memcpy(outBuffer + offset, &records[i], sizeof(TracerTraceRef));
+
+            offset += sizeof(TracerTraceRef);
+            header->mNumRefs++;
+        }
+    }
+
+    header->mNumRecords = (uint32_t)numRecords;
+    header->mSize = (uint32_t)offset;
+    return offset;
+}
+
+TracerTraceChunk* tracerCreateTraceChunk(size_t maxRecords) {
+    TracerTraceChunk* chunk = (TracerTraceChunk*)malloc(sizeof(TracerTraceChunk));
+
+    if (!chunk) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    memset(chunk, 0, sizeof(TracerTraceChunk));
+
+    chunk->mMaxRecords = maxRecords;
+    chunk->mRefs = (TracerTraceRef*)malloc(max(maxRecords, 1) * sizeof(TracerTraceRef));
+
+    TracerBool allocated = chunk->mRefs != NULL;
+
+    for (int i = 0; i < eTracerTraceColumnCount; i++) {
+        chunk->mColumns[i] = malloc(max(maxRecords, 1) * gTracerTraceColumns[i].mWidth);
+        allocated = allocated && chunk->mColumns[i];
+    }
+
+    if (!allocated) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        tracerDestroyTraceChunk(chunk);
+        return NULL;
+    }
+
+    return chunk;
+}
+
+void tracerDestroyTraceChunk(TracerTraceChunk* chunk) {
+    if (!chunk) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    for (int i = 0; i < eTracerTraceColumnCount; i++) {
+        free(chunk->mColumns[i]);
+    }
+
+    free(chunk->mRefs);
+    free(chunk);
+}
+
+static TracerBool tracerTraceChunkDecodeColumn(const uint8_t* data, const TracerTraceColumnHeader* column,
+    size_t width, size_t numRecords, uint8_t* out) {
+
+    size_t numEntries = (size_t)column->mNumEntries + 1;
+
+    switch (column->mEncoding) {
+    case eTracerTraceEncodingRaw:
+        if (column->mSize != numRecords * width) {
+            return eTracerFalse;
+        }
+
+        memcpy(out, data, numRecords * width);
+        return eTracerTrue;
+
+    case eTracerTraceEncodingConstant:
+        if (column->mSize != width) {
+            return eTracerFalse;
+        }
+
+        for (size_t i = 0; i < numRecords; i++) {
+            memcpy(out + i * width, data, width);
+        }
+        return eTracerTrue;
+
+    case eTracerTraceEncodingDictionary: {
+        if (column->mSize != numEntries * width + numRecords) {
+            return eTracerFalse;
+        }
+
+        const uint8_t* indices = data + numEntries * width;
+
+        for (size_t i = 0; i < numRecords; i++) {
+            if (indices[i] >= numEntries) {
+                return eTracerFalse;
+            }
+
+            memcpy(out + i * width, data + indices[i] * width, width);
+        }
+        return eTracerTrue;
+    }
+
+    case eTracerTraceEncodingDelta: {
+        const uint8_t* end = data + column->mSize;
+        uint64_t value = 0;
+
+        for (size_t i = 0; i < numRecords; i++) {
+            uint64_t delta = 0;
+            int shift = 0;
+
+            do {
+                if (data == end || shift > 63) {
+                    return eTracerFalse;
+                }
+
+                delta |= (uint64_t)(*data & 0x7F) << shift;
+                shift += 7;
+            } while (*data++ & 0x80);
+
+            value += (delta >> 1) ^ (0 - (delta & 1));
+            tracerTraceChunkStore(out + i * width, width, value);
+        }
+        return data == end;
+    }
+
+    default:
+        return eTracerFalse;
+    }
+}
+
+TracerBool tracerTraceChunkDecode(const uint8_t* data, size_t size, uint32_t columnMask, TracerTraceChunk* chunk) {
+    const TracerTraceChunkHeader* header = (const TracerTraceChunkHeader*)data;
+
+    if (!data || !chunk || size < sizeof(TracerTraceChunkHeader)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    if (header->mSize > size || header->mNumRecords > chunk->mMaxRecords || header->mNumRefs > header->mNumRecords ||
+        header->mRefsOffset > header->mSize ||
+        (header->mSize - header->mRefsOffset) / sizeof(TracerTraceRef) < header->mNumRefs) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    size_t numRecords = header->mNumRecords;
+
+    for (int i = 0; i < eTracerTraceColumnCount; i++) {
+        const TracerTraceColumnHeader* column = &header->mColumns[i];
+
+        if (!(columnMask & TLIB_TRACE_COLUMN_BIT(i))) {
+            continue;
+        }
+
+        if (column->mOffset > header->mSize || column->mSize > header->mSize - column->mOffset ||
+            column->mWidth != gTracerTraceColumns[i].mWidth ||
+            !tracerTraceChunkDecodeColumn(data + column->mOffset, column, column->mWidth, numRecords, (uint8_t*)chunk->mColumns[i])) {
+
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return eTracerFalse;
+        }
+    }
+
+    memcpy(chunk->mRefs, data + header->mRefsOffset, header->mNumRefs * sizeof(TracerTraceRef));
+
+    chunk->mNumRecords = numRecords;
+    chunk->mNumRefs = header->mNumRefs;
+
+    // References must point into the reference table
+    if ((columnMask & TLIB_TRACE_COLUMN_BIT(eTracerTraceColumnType)) &&
+        (columnMask & TLIB_TRACE_COLUMN_BIT(eTracerTraceColumnTarget))) {
+
+        const uint8_t* types = TLIB_TRACE_CHUNK_COLUMN(chunk, eTracerTraceColumnType, uint8_t);
+        const uintptr_t* targets = TLIB_TRACE_CHUNK_COLUMN(chunk, eTracerTraceColumnTarget, uintptr_t);
+
+        for (size_t i = 0; i < numRecords; i++) {
+            if (types[i] == TLIB_TRACE_CHUNK_TYPE_REF && targets[i] >= chunk->mNumRefs) {
+                tracerCoreSetLastError(eTracerErrorInvalidArgument);
+                return eTracerFalse;
+            }
+        }
+    }
+
+    return eTracerTrue;
+}
+
+void tracerTraceChunkGetRecord(const TracerTraceChunk* chunk, size_t index, TracerTracedInstruction* outTrace) {
+    uint8_t type = TLIB_TRACE_CHUNK_COLUMN(chunk, eTracerTraceColumnType, uint8_t)[index];
+
+    memset(outTrace, 0, sizeof(TracerTracedInstruction));
+
+    if (type == TLIB_TRACE_CHUNK_TYPE_REF) {
+        uintptr_t ref = TLIB_TRACE_CHUNK_COLUMN(chunk, eTracerTraceColumnTarget, uintptr_t)[index];
+        memcpy(outTrace, &chunk->mRefs[ref], sizeof(TracerTraceRef));
+        return;
+    }
+
+    outTrace->mType = (TracerTracedInstructionType)type;
+
+    for (int i = eTracerTraceColumnType + 1; i < eTracerTraceColumnCount; i++) {
+        size_t width = gTracerTraceColumns[i].mWidth;
+        memcpy((uint8_t*)outTrace + gTracerTraceColumns[i].mOffset, (const uint8_t*)chunk->mColumns[i] + index * width, width);
+    }
+}
+
+uint64_t tracerTraceColumnGetValue(const TracerTracedInstruction* record, TracerTraceColumn column) {
+    if (column == eTracerTraceColumnType) {
+        return (uint8_t)record->mType;
+    }
+
+    return tracerTraceChunkLoad((const uint8_t*)record + gTracerTraceColumns[column].mOffset, gTracerTraceColumns[column].mWidth);
+}
+
+TracerBool tracerTraceChunkGetColumnRange(const uint8_t* data, size_t size, TracerTraceColumn column,
+    uint64_t* outMin, uint64_t* outMax) {
+
+    const TracerTraceChunkHeader* header = (const TracerTraceChunkHeader*)data;
+
+    if (!data || size < sizeof(TracerTraceChunkHeader) || header->mSize > size || !header->mNumRecords) {
+        return eTracerFalse;
+    }
+
+    const TracerTraceColumnHeader* columnHeader = &header->mColumns[column];
+    size_t width = gTracerTraceColumns[column].mWidth;
+    size_t numValues = 0;
+
+    if (columnHeader->mEncoding == eTracerTraceEncodingConstant) {
+        numValues = 1;
+    } else if (columnHeader->mEncoding == eTracerTraceEncodingDictionary) {
+        numValues = (size_t)columnHeader->mNumEntries + 1;
+    }
+
+    if (!numValues || columnHeader->mWidth != width || columnHeader->mOffset > header->mSize ||
+        numValues * width > header->mSize - columnHeader->mOffset) {
+
+        return eTracerFalse;
+    }
+
+    const uint8_t* values = data + columnHeader->mOffset;
+
+    *outMin = UINT64_MAX;
+    *outMax = 0;
+
+    for (size_t i = 0; i < numValues; i++) {
+        uint64_t value = tracerTraceChunkLoad(values + i * width, width);
+
+        *outMin = min(*outMin, value);
+        *outMax = max(*outMax, value);
+    }
+
+    return eTracerTrue;
+}
@@ -0,0 +1,350 @@
+
+#include <tracer_lib/trace_diff.h>
+#include <tracer_lib/trace_file.h>
+
+#define TLIB_TRACE_DIFF_SEED            0x84222325CBF29CE4ULL
+
+typedef struct TracerDiffRecord {
+    TracerTracedInstructionType mType;
+    uintptr_t                   mSource;            // Relative to the base address of the file
+    uintptr_t                   mTarget;
+    size_t                      mEnd;               // One past the subtree that starts with this record
+    uint64_t                    mHash;              // Hash of that subtree
+    uint64_t                    mFileIndex;
+} TracerDiffRecord;
+
+typedef struct TracerDiffInvocation {
+    size_t                      mBegin;
+    size_t                      mEnd;
+    uint64_t                    mHash;
+} TracerDiffInvocation;
+
+typedef struct TracerDiffFrame {
+    size_t                      mBegin;             // The call that opened the frame
+    uint64_t                    mHash;
+} TracerDiffFrame;
+
+typedef struct TracerDiffSide {
+    TracerHandle                mFile;
+    uintptr_t                   mBaseAddress;
+    uint64_t                    mNumFileRecords;
+    TracerDiffRecord*           mRecords;           // Without watch hits
+    size_t                      mNumRecords;
+    TracerDiffInvocation*       mInvocations;
+    size_t                      mNumInvocations;
+    size_t                      mMaxInvocations;
+    TracerDiffFrame*            mFrames;
+    size_t                      mNumFrames;
+    size_t                      mMaxFrames;
+    size_t                      mInvocationBegin;   // State of the invocation that is being summarized
+    uint64_t                    mInvocationHash;
+    int                         mThreadId;
+    int                         mTraceId;
+} TracerDiffSide;
+
+static uint64_t tracerDiffMix(uint64_t hash, uint64_t value) {
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 32);
+}
+
+static TracerBool tracerDiffGrow(void** array, size_t* capacity, size_t count, size_t elemSize) {
+    if (count < *capacity) {
+        return eTracerTrue;
+    }
+
+    size_t newCapacity = *capacity ? *capacity * 2 : 64;
+    void* newArray = realloc(*array, newCapacity * elemSize);
+
+    if (!newArray) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    *array = newArray;
+    *capacity = newCapacity;
+    return eTracerTrue;
+}
+
+static void tracerDiffAddHash(TracerDiffSide* side, uint64_t hash) {
+    if (side->mNumFrames) {
+        TracerDiffFrame* frame = &side->mFrames[side->mNumFrames - 1];
+        frame->mHash = tracerDiffMix(frame->mHash, hash);
+    } else {
+        side->mInvocationHash = tracerDiffMix(side->mInvocationHash, hash);
+    }
+}
+
+static void tracerDiffCloseFrame(TracerDiffSide* side, size_t end) {
+    TracerDiffFrame* frame = &side->mFrames[--side->mNumFrames];
+    TracerDiffRecord* call = &side->mRecords[frame->mBegin];
+
+    call->mEnd = end;
+    call->mHash = frame->mHash;
+
+    tracerDiffAddHash(side, frame->mHash);
+}
+
+static TracerBool tracerDiffCloseInvocation(TracerDiffSide* side) {
+    if (side->mInvocationBegin == side->mNumRecords) {
+        return eTracerTrue;
+    }
+
+    // Calls that didn't return before the trace ended extend to the end of the invocation
+    while (side->mNumFrames) {
+        tracerDiffCloseFrame(side, side->mNumRecords);
+    }
+
+    if (!tracerDiffGrow((void**)&side->mInvocations, &side->mMaxInvocations,
+        side->mNumInvocations, sizeof(TracerDiffInvocation))) {
+
+        return eTracerFalse;
+    }
+
+    TracerDiffInvocation* invocation = &side->mInvocations[side->mNumInvocations++];
+
+    invocation->mBegin = side->mInvocationBegin;
+    invocation->mEnd = side->mNumRecords;
+    invocation->mHash = side->mInvocationHash;
+
+    side->mInvocationBegin = side->mNumRecords;
+    side->mInvocationHash = TLIB_TRACE_DIFF_SEED;
+    return eTracerTrue;
+}
+
+static TracerBool tracerDiffAddRecord(TracerDiffSide* side, const TracerTracedInstruction* trace, uint64_t fileIndex) {
+    if (side->mNumRecords > side->mInvocationBegin &&
+        (trace->mThreadId != side->mThreadId || trace->mTraceId != side->mTraceId)) {
+
+        if (!tracerDiffCloseInvocation(side)) {
+            return eTracerFalse;
+        }
+    }
+
+    side->mThreadId = trace->mThreadId;
+    side->mTraceId = trace->mTraceId;
+
+    size_t index = side->mNumRecords++;
+    TracerDiffRecord* record = &side->mRecords[index];
+
+    record->mType = trace->mType;
+    record->mSource = trace->mBranchSource - side->mBaseAddress;
+    record->mTarget = trace->mBranchTarget - side->mBaseAddress;
+    record->mEnd = index + 1;
+    record->mFileIndex = fileIndex;
+
+    record->mHash = tracerDiffMix(TLIB_TRACE_DIFF_SEED, record->mType);
+    record->mHash = tracerDiffMix(record->mHash, record->mSource);
+    record->mHash = tracerDiffMix(record->mHash, record->mTarget);
+
+    if (record->mType == eTracerInstructionTypeCall) {
+        if (!tracerDiffGrow((void**)&side->mFrames, &side->mMaxFrames, side->mNumFrames, sizeof(TracerDiffFrame))) {
+            return eTracerFalse;
+        }
+
+        TracerDiffFrame* frame = &side->mFrames[side->mNumFrames++];
+
+        frame->mBegin = index;
+        frame->mHash = record->mHash;
+    } else if (record->mType == eTracerInstructionTypeReturn && side->mNumFrames) {
+        tracerDiffAddHash(side, record->mHash);
+        tracerDiffCloseFrame(side, index + 1);
+    } else {
+        // Includes returns out of the function the trace started in
+        tracerDiffAddHash(side, record->mHash);
+    }
+
+    return eTracerTrue;
+}
+
+static TracerBool tracerDiffSummarize(TracerDiffSide* side, TracerTracedInstruction* batch) {
+    side->mNumFileRecords = tracerTraceReaderGetNumRecords(side->mFile);
+    side->mInvocationHash = TLIB_TRACE_DIFF_SEED;
+
+    if (side->mNumFileRecords >= SIZE_MAX / sizeof(TracerDiffRecord)) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    side->mRecords = (TracerDiffRecord*)malloc(((size_t)side->mNumFileRecords + 1) * sizeof(TracerDiffRecord));
+
+    if (!side->mRecords) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    uint64_t first = 0;
+
+    while (first < side->mNumFileRecords) {
+        size_t count = tracerTraceReaderRead(side->mFile, first, batch, TLIB_TRACE_DIFF_READ_BATCH);
+
+        // A chunk that can't be decoded or cached
+        if (!count) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return eTracerFalse;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (batch[i].mType != eTracerInstructionTypeWatch && !tracerDiffAddRecord(side, &batch[i], first + i)) {
+                return eTracerFalse;
+            }
+        }
+
+        first += count;
+    }
+
+    return tracerDiffCloseInvocation(side);
+}
+
+static void tracerDiffFreeSide(TracerDiffSide* side) {
+    free(side->mRecords);
+    free(side->mInvocations);
+    free(side->mFrames);
+}
+
+// Walks both invocations in lock step. Subtrees with the same hash are stepped over as a whole,
+// a call whose content differs is entered. The calls that were entered on the left side are kept
+// in its frame stack, which can't grow beyond the depth it had while summarizing.
+static TracerBool tracerDiffCompare(TracerDiffSide* left, TracerDiffSide* right,
+    const TracerDiffInvocation* leftInvocation, const TracerDiffInvocation* rightInvocation,
+    size_t* outLeftIndex, size_t* outRightIndex) {
+
+    size_t i = leftInvocation->mBegin;
+    size_t j = rightInvocation->mBegin;
+
+    left->mNumFrames = 0;
+
+    for (;;) {
+        while (left->mNumFrames && left->mRecords[left->mFrames[left->mNumFrames - 1].mBegin].mEnd <= i) {
+            left->mNumFrames--;
+        }
+
+        if (i == leftInvocation->mEnd || j == rightInvocation->mEnd) {
+            break;
+        }
+
+        const TracerDiffRecord* a = &left->mRecords[i];
+        const TracerDiffRecord* b = &right->mRecords[j];
+
+        if (a->mType != b->mType || a->mSource != b->mSource || a->mTarget != b->mTarget) {
+            break;
+        }
+
+        if (a->mHash == b->mHash && a->mEnd - i == b->mEnd - j) {
+            i = a->mEnd;
+            j = b->mEnd;
+            continue;
+        }
+
+        left->mFrames[left->mNumFrames++].mBegin = i;
+
+        i++;
+        j++;
+    }
+
+    *outLeftIndex = i;
+    *outRightIndex = j;
+
+    return i != leftInvocation->mEnd || j != rightInvocation->mEnd;
+}
+
+static void tracerDiffReportSide(TracerDiffSide* side, size_t index, size_t end,
+    uint64_t* outRecord, TracerTracedInstruction* outTrace) {
+
+    *outRecord = index < side->mNumRecords ? side->mRecords[index].mFileIndex : side->mNumFileRecords;
+
+    if (index >= end || !tracerTraceReaderRead(side->mFile, *outRecord, outTrace, 1)) {
+        memset(outTrace, 0, sizeof(TracerTracedInstruction));
+    }
+}
+
+static void tracerDiffReport(TracerDiffTraces* diff, TracerDiffSide* left, TracerDiffSide* right,
+    size_t invocation, size_t leftIndex, size_t leftEnd, size_t rightIndex, size_t rightEnd) {
+
+    diff->mDiverged = eTracerTrue;
+    diff->mInvocation = invocation;
+
+    tracerDiffReportSide(left, leftIndex, leftEnd, &diff->mLeftRecord, &diff->mLeftTrace);
+    tracerDiffReportSide(right, rightIndex, rightEnd, &diff->mRightRecord, &diff->mRightTrace);
+
+    size_t first = left->mNumFrames > TLIB_DIFF_MAX_CONTEXT ? left->mNumFrames - TLIB_DIFF_MAX_CONTEXT : 0;
+
+    diff->mContextDepth = (int)left->mNumFrames;
+
+    for (size_t i = first; i < left->mNumFrames; i++) {
+        const TracerDiffRecord* call = &left->mRecords[left->mFrames[i].mBegin];
+
+        if (!tracerTraceReaderRead(left->mFile, call->mFileIndex, &diff->mContext[i - first], 1)) {
+            memset(&diff->mContext[i - first], 0, sizeof(TracerTracedInstruction));
+        }
+    }
+}
+
+TracerBool tracerTraceDiff(TracerDiffTraces* diff) {
+    TracerDiffSide left, right;
+
+    memset(&left, 0, sizeof(left));
+    memset(&right, 0, sizeof(right));
+
+    left.mFile = diff->mLeftFile;
+    left.mBaseAddress = diff->mLeftBaseAddress;
+    right.mFile = diff->mRightFile;
+    right.mBaseAddress = diff->mRightBaseAddress;
+
+    diff->mDiverged = eTracerFalse;
+    diff->mInvocation = 0;
+    diff->mLeftRecord = 0;
+    diff->mRightRecord = 0;
+    diff->mContextDepth = 0;
+
+    memset(&diff->mLeftTrace, 0, sizeof(diff->mLeftTrace));
+    memset(&diff->mRightTrace, 0, sizeof(diff->mRightTrace));
+    memset(diff->mContext, 0, sizeof(diff->mContext));
+
+    TracerBool result = eTracerFalse;
+    TracerTracedInstruction* batch = (TracerTracedInstruction*)malloc(TLIB_TRACE_DIFF_READ_BATCH * sizeof(TracerTracedInstruction));
+
+    if (!batch) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        goto cleanup;
+    }
+
+    if (!tracerDiffSummarize(&left, batch) || !tracerDiffSummarize(&right, batch)) {
+        goto cleanup;
+    }
+
+    result = eTracerTrue;
+
+    size_t numPairs = min(left.mNumInvocations, right.mNumInvocations);
+
+    for (size_t k = 0; k < numPairs; k++) {
+        const TracerDiffInvocation* a = &left.mInvocations[k];
+        const TracerDiffInvocation* b = &right.mInvocations[k];
+
+        size_t i, j;
+
+        if (a->mHash == b->mHash && a->mEnd - a->mBegin == b->mEnd - b->mBegin) {
+            continue;
+        }
+
+        if (tracerDiffCompare(&left, &right, a, b, &i, &j)) {
+            tracerDiffReport(diff, &left, &right, k, i, a->mEnd, j, b->mEnd);
+            goto cleanup;
+        }
+    }
+
+    if (left.mNumInvocations != right.mNumInvocations) {
+        // One capture has more invocations than the other
+        size_t i = numPairs < left.mNumInvocations ? left.mInvocations[numPairs].mBegin : left.mNumRecords;
+        size_t j = numPairs < right.mNumInvocations ? right.mInvocations[numPairs].mBegin : right.mNumRecords;
+
+        left.mNumFrames = 0;
+        tracerDiffReport(diff, &left, &right, numPairs, i, left.mNumRecords, j, right.mNumRecords);
+    }
+
+cleanup:
+    free(batch);
+
+    tracerDiffFreeSide(&left);
+    tracerDiffFreeSide(&right);
+    return result;
+}
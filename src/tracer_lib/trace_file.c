@@ -0,0 +1,1321 @@
+
+#include <tracer_lib/trace_file.h>
+
+typedef struct TracerTraceWriterFrame {
+    uint64_t                    mBegin;             // Stored index of the call
+    uint64_t                    mNumExpanded;       // Records appended before the call
+    uint64_t                    mHash;
+    size_t                      mLogMark;           // Entries added since the call are logged after this
+} TracerTraceWriterFrame;
+
+typedef struct TracerTraceWriterEntry {
+    uint64_t                    mHash;
+    uint64_t                    mFirstRecord;
+    uint64_t                    mNumRecords;
+    uint64_t                    mNumExpanded;       // 0 for a free entry
+} TracerTraceWriterEntry;
+
+typedef struct TracerTraceWriterRange {
+    size_t                      mBegin;             // Buffer indices
+    size_t                      mEnd;
+    size_t                      mNext;
+    uint32_t                    mCount;             // Repeats left, including the current one
+} TracerTraceWriterRange;
+
+// Walks the expanded records of a range of the buffer
+typedef struct TracerTraceWriterCursor {
+    TracerBool                  mFailed;            // Set for a reference that doesn't point into the buffer
+    size_t                      mDepth;
+    TracerTraceWriterRange      mRanges[TLIB_TRACE_FILE_COMPARE_DEPTH];
+} TracerTraceWriterCursor;
+
+typedef struct TracerTraceWriterTarget {
+    uint64_t                    mTarget;
+    uint32_t                    mLastChunk;
+    uint32_t                    mNumChunks;         // 0 for a free slot
+    uint8_t*                    mPostings;
+    uint32_t                    mSize;
+    uint32_t                    mMaxSize;
+} TracerTraceWriterTarget;
+
+typedef struct TracerTraceWriter {
+    HANDLE                      mFile;
+    uint64_t                    mNumRecords;        // Stored records, including the buffered ones
+    uint64_t                    mNumExpanded;       // Appended records
+    size_t                      mNumBuffered;
+    TracerBool                  mDeduplicate;
+    TracerBool                  mIndexTargets;
+    int                         mThreadId;
+    int                         mTraceId;
+    TracerTraceWriterFrame*     mFrames;            // The calls that didn't return yet
+    size_t                      mNumFrames;
+    size_t                      mMaxFrames;
+    TracerTraceWriterEntry*     mEntries;           // Direct mapped by the subtree hash
+    size_t                      mNumLog;            // Entries that point into the buffer, in insertion order
+    uint64_t                    mFileOffset;        // Where the next chunk goes
+    TracerTraceFileChunkEntry*  mChunks;
+    size_t                      mNumChunks;
+    size_t                      mMaxChunks;
+    TracerTraceWriterTarget*    mTargets;           // Open addressing by the branch target
+    size_t                      mNumTargets;
+    size_t                      mMaxTargets;
+    uint64_t                    mIndexOffset;
+    uint8_t*                    mEncoded;           // The chunk that is being written
+    TracerTraceFileStatistics   mStatistics;
+    uint64_t                    mScratch[TLIB_TRACE_FILE_CHUNK_RECORDS];
+    uint32_t                    mLog[TLIB_TRACE_FILE_CHUNK_RECORDS];
+    TracerTracedInstruction     mBuffer[TLIB_TRACE_FILE_CHUNK_RECORDS];
+} TracerTraceWriter;
+
+typedef struct TracerTraceReader {
+    HANDLE                      mFile;
+    HANDLE                      mMapping;
+    const uint8_t*              mView;
+    size_t                      mViewSize;
+    const TracerTraceFileHeader* mHeader;
+    const TracerTraceFileChunkEntry* mChunks;
+    size_t                      mNumChunks;
+    size_t                      mChunkRecords;
+    const TracerTraceFileIndexEntry* mIndex;        // NULL without a target index
+    size_t                      mNumIndexEntries;
+    const uint8_t*              mPostings;
+    size_t                      mPostingsSize;
+    size_t                      mNumStored;
+    uint64_t*                   mExpandedBegin;     // Per stored record plus one, NULL without references
+    uint64_t                    mNumRecords;        // Expanded
+    TracerTraceChunk*           mCache[TLIB_TRACE_FILE_CHUNK_CACHE];
+    size_t                      mCachedChunk[TLIB_TRACE_FILE_CHUNK_CACHE];  // Index + 1, 0 for a free slot
+    size_t                      mNextVictim;
+} TracerTraceReader;
+
+static uint64_t tracerTraceFileMix(uint64_t hash, uint64_t value) {
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 32);
+}
+
+static TracerBool tracerTraceWriterWrite(TracerTraceWriter* writer, const void* data, size_t size) {
+    DWORD bytesWritten = 0;
+
+    if (!WriteFile(writer->mFile, data, (DWORD)size, &bytesWritten, NULL) || bytesWritten != size) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return eTracerFalse;
+    }
+
+    return eTracerTrue;
+}
+
+static void tracerTraceWriterComputeZones(const TracerTracedInstruction* records, size_t numRecords, TracerTraceFileZone* zones) {
+    for (size_t i = 0; i < TLIB_TRACE_FILE_ZONE_COLUMNS; i++) {
+        zones[i].mMin = UINT64_MAX;
+        zones[i].mMax = 0;
+    }
+
+    for (size_t i = 0; i < numRecords; i++) {
+        if ((uint32_t)records[i].mType == TLIB_TRACE_REF_TYPE) {
+            continue;
+        }
+
+        for (size_t j = 0; j < TLIB_TRACE_FILE_ZONE_COLUMNS; j++) {
+            uint64_t value = tracerTraceColumnGetValue(&records[i], (TracerTraceColumn)j);
+
+            zones[j].mMin = min(zones[j].mMin, value);
+            zones[j].mMax = max(zones[j].mMax, value);
+        }
+    }
+}
+
+// Returns the slot of target, which is free if the target wasn't seen yet
+static TracerTraceWriterTarget* tracerTraceWriterGetTarget(TracerTraceWriter* writer, uint64_t target) {
+    if ((writer->mNumTargets + 1) * 2 > writer->mMaxTargets) {
+        size_t maxTargets = writer->mMaxTargets ? writer->mMaxTargets * 2 : 1024;
+        TracerTraceWriterTarget* targets = (TracerTraceWriterTarget*)calloc(maxTargets, sizeof(TracerTraceWriterTarget));
+
+        if (!targets) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            return NULL;
+        }
+
+        for (size_t i = 0; i < writer->mMaxTargets; i++) {
+            if (writer->mTargets[i].mNumChunks) {
+                size_t slot = (size_t)tracerTraceFileMix(0, writer->mTargets[i].mTarget) & (maxTargets - 1);
+
+                while (targets[slot].mNumChunks) {
+                    slot = (slot + 1) & (maxTargets - 1);
+                }
+
+                targets[slot] = writer->mTargets[i];
+            }
+        }
+
+        free(writer->mTargets);
+
+        writer->mTargets = targets;
+        writer->mMaxTargets = maxTargets;
+    }
+
+    size_t slot = (size_t)tracerTraceFileMix(0, target) & (writer->mMaxTargets - 1);
+
+    while (writer->mTargets[slot].mNumChunks && writer->mTargets[slot].mTarget != target) {
+        slot = (slot + 1) & (writer->mMaxTargets - 1);
+    }
+
+    return &writer->mTargets[slot];
+}
+
+// Adds the chunk that is being flushed to the postings of the targets it stores
+static TracerBool tracerTraceWriterIndexChunk(TracerTraceWriter* writer) {
+    uint32_t chunkIndex = (uint32_t)writer->mNumChunks;
+
+    for (size_t i = 0; i < writer->mNumBuffered; i++) {
+        const TracerTracedInstruction* record = &writer->mBuffer[i];
+
+        // Loops branch to the same target over and over
+        if ((uint32_t)record->mType == TLIB_TRACE_REF_TYPE ||
+            (i && record->mBranchTarget == writer->mBuffer[i - 1].mBranchTarget && (uint32_t)writer->mBuffer[i - 1].mType != TLIB_TRACE_REF_TYPE)) {
+            continue;
+        }
+
+        TracerTraceWriterTarget* target = tracerTraceWriterGetTarget(writer, record->mBranchTarget);
+
+        if (!target) {
+            return eTracerFalse;
+        }
+
+        if (target->mNumChunks && target->mLastChunk == chunkIndex) {
+            continue;
+        }
+
+        if (target->mSize + 5 > target->mMaxSize) {
+            uint32_t maxSize = target->mMaxSize ? target->mMaxSize * 2 : 8;
+            uint8_t* postings = (uint8_t*)realloc(target->mPostings, maxSize);
+
+            if (!postings) {
+                tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+                return eTracerFalse;
+            }
+
+            target->mPostings = postings;
+            target->mMaxSize = maxSize;
+        }
+
+        uint32_t delta = target->mNumChunks ? chunkIndex - target->mLastChunk : chunkIndex;
+
+        while (delta >= 0x80) {
+            target->mPostings[target->mSize++] = (uint8_t)(delta | 0x80);
+            delta >>= 7;
+        }
+
+        target->mPostings[target->mSize++] = (uint8_t)delta;
+
+        if (!target->mNumChunks) {
+            target->mTarget = record->mBranchTarget;
+            writer->mNumTargets++;
+        }
+
+        target->mNumChunks++;
+        target->mLastChunk = chunkIndex;
+    }
+
+    return eTracerTrue;
+}
+
+static TracerBool tracerTraceWriterFlush(TracerTraceWriter* writer) {
+    if (!writer->mNumBuffered) {
+        return eTracerTrue;
+    }
+
+    if (writer->mNumChunks == writer->mMaxChunks) {
+        size_t maxChunks = writer->mMaxChunks ? writer->mMaxChunks * 2 : 64;
+        TracerTraceFileChunkEntry* chunks = (TracerTraceFileChunkEntry*)realloc(writer->mChunks, maxChunks * sizeof(TracerTraceFileChunkEntry));
+
+        if (!chunks) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            return eTracerFalse;
+        }
+
+        writer->mChunks = chunks;
+        writer->mMaxChunks = maxChunks;
+    }
+
+    size_t size = tracerTraceChunkEncode(writer->mBuffer, writer->mNumBuffered, writer->mScratch,
+        writer->mEncoded, tracerTraceChunkMaxEncodedSize(TLIB_TRACE_FILE_CHUNK_RECORDS));
+
+    if (!size || !tracerTraceWriterWrite(writer, writer->mEncoded, size)) {
+        return eTracerFalse;
+    }
+
+    if (writer->mIndexTargets && !tracerTraceWriterIndexChunk(writer)) {
+        return eTracerFalse;
+    }
+
+    TracerTraceFileChunkEntry* entry = &writer->mChunks[writer->mNumChunks++];
+
+    entry->mOffset = writer->mFileOffset;
+    entry->mSize = (uint32_t)size;
+    entry->mNumRefs = ((const TracerTraceChunkHeader*)writer->mEncoded)->mNumRefs;
+
+    tracerTraceWriterComputeZones(writer->mBuffer, writer->mNumBuffered, entry->mZones);
+
+    writer->mFileOffset += size;
+    writer->mNumBuffered = 0;
+
+    // Nothing before this point can be replaced by a reference anymore
+    writer->mNumLog = 0;
+    return eTracerTrue;
+}
+
+static TracerBool tracerTraceWriterWriteHeader(TracerTraceWriter* writer) {
+    TracerTraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.mMagic = TLIB_TRACE_FILE_MAGIC;
+    header.mVersion = TLIB_TRACE_FILE_VERSION;
+    header.mChunkRecords = TLIB_TRACE_FILE_CHUNK_RECORDS;
+    header.mNumChunks = (uint32_t)writer->mNumChunks;
+    header.mNumRecords = writer->mNumRecords;
+    header.mDirectoryOffset = writer->mFileOffset;
+    header.mIndexOffset = writer->mIndexOffset;
+    header.mNumIndexEntries = writer->mNumTargets;
+    header.mStatistics = writer->mStatistics;
+
+    if (SetFilePointer(writer->mFile, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        return eTracerFalse;
+    }
+
+    return tracerTraceWriterWrite(writer, &header, sizeof(header));
+}
+
+static int tracerTraceWriterCompareTargets(const void* lhs, const void* rhs) {
+    const TracerTraceWriterTarget* a = (const TracerTraceWriterTarget*)lhs;
+    const TracerTraceWriterTarget* b = (const TracerTraceWriterTarget*)rhs;
+
+    return (a->mTarget > b->mTarget) - (a->mTarget < b->mTarget);
+}
+
+// Writes the target index after the directory, the hash table is sorted in place
+static TracerBool tracerTraceWriterWriteIndex(TracerTraceWriter* writer) {
+    if (!writer->mNumTargets) {
+        return eTracerTrue;
+    }
+
+    size_t numTargets = 0;
+    size_t postingsSize = 0;
+
+    for (size_t i = 0; i < writer->mMaxTargets; i++) {
+        if (!writer->mTargets[i].mNumChunks) {
+            continue;
+        }
+
+        if (i != numTargets) {
+            writer->mTargets[numTargets] = writer->mTargets[i];
+            writer->mTargets[i].mNumChunks = 0;
+            writer->mTargets[i].mPostings = NULL;
+        }
+
+        postingsSize += writer->mTargets[numTargets++].mSize;
+    }
+
+    qsort(writer->mTargets, numTargets, sizeof(TracerTraceWriterTarget), tracerTraceWriterCompareTargets);
+
+    size_t indexSize = numTargets * sizeof(TracerTraceFileIndexEntry);
+    uint8_t* buffer = (uint8_t*)malloc(indexSize + postingsSize);
+
+    if (!buffer) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    TracerTraceFileIndexEntry* entries = (TracerTraceFileIndexEntry*)buffer;
+    uint8_t* postings = buffer + indexSize;
+    size_t offset = 0;
+
+    for (size_t i = 0; i < numTargets; i++) {
+        const TracerTraceWriterTarget* target = &writer->mTargets[i];
+
+        entries[i].mTarget = target->mTarget;
+        entries[i].mOffset = offset;
+        entries[i].mNumChunks = target->mNumChunks;
+        entries[i].mSize = target->mSize;
+
+        memcpy(postings + offset, target->mPostings, target->mSize);
+        offset += target->mSize;
+    }
+
+    writer->mIndexOffset = writer->mFileOffset + writer->mNumChunks * sizeof(TracerTraceFileChunkEntry);
+
+    TracerBool result = tracerTraceWriterWrite(writer, buffer, indexSize + postingsSize);
+
+    free(buffer);
+    return result;
+}
+
+TracerHandle tracerCreateTraceWriter(const char* path, TracerBool deduplicate, TracerBool indexTargets) {
+    if (!path) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    TracerTraceWriter* writer = (TracerTraceWriter*)malloc(sizeof(TracerTraceWriter));
+
+    if (!writer) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    writer->mNumRecords = 0;
+    writer->mNumExpanded = 0;
+    writer->mNumBuffered = 0;
+    writer->mDeduplicate = deduplicate;
+    writer->mIndexTargets = indexTargets;
+    writer->mThreadId = 0;
+    writer->mTraceId = 0;
+    writer->mFrames = NULL;
+    writer->mNumFrames = 0;
+    writer->mMaxFrames = 0;
+    writer->mEntries = NULL;
+    writer->mNumLog = 0;
+    writer->mFileOffset = sizeof(TracerTraceFileHeader);
+    writer->mChunks = NULL;
+    writer->mNumChunks = 0;
+    writer->mMaxChunks = 0;
+    writer->mTargets = NULL;
+    writer->mNumTargets = 0;
+    writer->mMaxTargets = 0;
+    writer->mIndexOffset = 0;
+    writer->mFile = INVALID_HANDLE_VALUE;
+    writer->mEncoded = (uint8_t*)malloc(tracerTraceChunkMaxEncodedSize(TLIB_TRACE_FILE_CHUNK_RECORDS));
+
+    if (!writer->mEncoded) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        goto cleanup;
+    }
+
+    if (deduplicate) {
+        writer->mEntries = (TracerTraceWriterEntry*)calloc(TLIB_TRACE_FILE_DEDUP_ENTRIES, sizeof(TracerTraceWriterEntry));
+
+        if (!writer->mEntries) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            goto cleanup;
+        }
+    }
+
+    writer->mFile = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (writer->mFile == INVALID_HANDLE_VALUE) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        goto cleanup;
+    }
+
+    // Reserve the space for the header, the record count is only known once the writer is closed
+    if (!tracerTraceWriterWriteHeader(writer)) {
+        goto cleanup;
+    }
+
+    return (TracerHandle)writer;
+
+cleanup:
+    if (writer->mFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(writer->mFile);
+    }
+
+    free(writer->mEncoded);
+    free(writer->mEntries);
+    free(writer);
+    return NULL;
+}
+
+static TracerBool tracerTraceWriterPush(TracerTraceWriter* writer, const TracerTracedInstruction* trace) {
+    if (writer->mNumBuffered == TLIB_TRACE_FILE_CHUNK_RECORDS && !tracerTraceWriterFlush(writer)) {
+        return eTracerFalse;
+    }
+
+    writer->mBuffer[writer->mNumBuffered++] = *trace;
+    writer->mNumRecords++;
+    return eTracerTrue;
+}
+
+static void tracerTraceWriterReplaceSubtree(TracerTraceWriter* writer, const TracerTraceWriterFrame* frame,
+    const TracerTraceWriterEntry* entry) {
+
+    uint64_t numFlushed = writer->mNumRecords - writer->mNumBuffered;
+
+    // Forget the subtrees inside the replaced one, their records are about to be dropped
+    for (size_t i = frame->mLogMark; i < writer->mNumLog; i++) {
+        TracerTraceWriterEntry* inner = &writer->mEntries[writer->mLog[i]];
+
+        if (inner->mFirstRecord >= frame->mBegin) {
+            memset(inner, 0, sizeof(TracerTraceWriterEntry));
+        }
+    }
+
+    writer->mNumLog = frame->mLogMark;
+
+    size_t begin = (size_t)(frame->mBegin - numFlushed);
+    const TracerTracedInstruction* call = &writer->mBuffer[begin];
+
+    if (begin) {
+        TracerTraceRef* previous = (TracerTraceRef*)&writer->mBuffer[begin - 1];
+
+        if (previous->mType == TLIB_TRACE_REF_TYPE && previous->mFirstRecord == entry->mFirstRecord &&
+            previous->mThreadId == call->mThreadId && previous->mTraceId == call->mTraceId &&
+            previous->mCallDepth == call->mCallDepth && previous->mCount != UINT32_MAX) {
+
+            previous->mCount++;
+
+            writer->mNumRecords -= writer->mNumBuffered - begin;
+            writer->mNumBuffered = begin;
+            return;
+        }
+    }
+
+    TracerTraceRef ref;
+    memset(&ref, 0, sizeof(ref));
+
+    ref.mType = TLIB_TRACE_REF_TYPE;
+    ref.mTraceId = call->mTraceId;
+    ref.mThreadId = call->mThreadId;
+    ref.mCallDepth = call->mCallDepth;
+    ref.mFirstRecord = entry->mFirstRecord;
+    ref.mNumRecords = entry->mNumRecords;
+    ref.mTimestamp = call->mTimestamp;
+    ref.mCount = 1;
+
+    memset(&writer->mBuffer[begin], 0, sizeof(TracerTracedInstruction));
+    memcpy(&writer->mBuffer[begin], &ref, sizeof(ref));
+
+    writer->mNumRecords -= writer->mNumBuffered - (begin + 1);
+    writer->mNumBuffered = begin + 1;
+}
+
+static uint64_t tracerTraceWriterHashRecord(const TracerTracedInstruction* trace) {
+    // Every field goes through its own multiply, so the fields can't cancel each other out
+    uint64_t hash = tracerTraceFileMix(0xCBF29CE484222325ULL, trace->mType);
+    hash = tracerTraceFileMix(hash, trace->mBranchSource);
+    hash = tracerTraceFileMix(hash, trace->mBranchTarget);
+
+    if (trace->mType == eTracerInstructionTypeWatch) {
+        hash = tracerTraceFileMix(hash, trace->mOldValue);
+        hash = tracerTraceFileMix(hash, trace->mNewValue);
+    }
+
+    return hash;
+}
+
+static void tracerTraceWriterInitCursor(TracerTraceWriterCursor* cursor, size_t begin, size_t end) {
+    cursor->mFailed = eTracerFalse;
+    cursor->mDepth = 1;
+    cursor->mRanges[0].mBegin = begin;
+    cursor->mRanges[0].mEnd = end;
+    cursor->mRanges[0].mNext = begin;
+    cursor->mRanges[0].mCount = 1;
+}
+
+static const TracerTracedInstruction* tracerTraceWriterNextExpanded(const TracerTraceWriter* writer, TracerTraceWriterCursor* cursor) {
+    uint64_t numFlushed = writer->mNumRecords - writer->mNumBuffered;
+
+    while (cursor->mDepth) {
+        TracerTraceWriterRange* range = &cursor->mRanges[cursor->mDepth - 1];
+
+        if (range->mNext == range->mEnd) {
+            if (--range->mCount) {
+                range->mNext = range->mBegin;
+            } else {
+                cursor->mDepth--;
+            }
+            continue;
+        }
+
+        const TracerTracedInstruction* record = &writer->mBuffer[range->mNext++];
+
+        if ((uint32_t)record->mType != TLIB_TRACE_REF_TYPE) {
+            return record;
+        }
+
+        const TracerTraceRef* ref = (const TracerTraceRef*)record;
+
+        if (cursor->mDepth == TLIB_TRACE_FILE_COMPARE_DEPTH || ref->mFirstRecord < numFlushed ||
+            ref->mFirstRecord + ref->mNumRecords > writer->mNumRecords || !ref->mNumRecords || !ref->mCount) {
+
+            cursor->mFailed = eTracerTrue;
+            return NULL;
+        }
+
+        range = &cursor->mRanges[cursor->mDepth++];
+        range->mBegin = (size_t)(ref->mFirstRecord - numFlushed);
+        range->mEnd = range->mBegin + (size_t)ref->mNumRecords;
+        range->mNext = range->mBegin;
+        range->mCount = ref->mCount;
+    }
+
+    return NULL;
+}
+
+// A hash match is only a candidate, the expanded records of both subtrees have to be the same.
+// Only copies that are still buffered can be compared.
+static TracerBool tracerTraceWriterSameSubtree(const TracerTraceWriter* writer, const TracerTraceWriterFrame* frame,
+    const TracerTraceWriterEntry* entry) {
+
+    uint64_t numFlushed = writer->mNumRecords - writer->mNumBuffered;
+
+    if (entry->mFirstRecord < numFlushed || frame->mBegin < numFlushed) {
+        return eTracerFalse;
+    }
+
+    TracerTraceWriterCursor stored;
+    TracerTraceWriterCursor repeat;
+
+    tracerTraceWriterInitCursor(&stored, (size_t)(entry->mFirstRecord - numFlushed),
+        (size_t)(entry->mFirstRecord + entry->mNumRecords - numFlushed));
+    tracerTraceWriterInitCursor(&repeat, (size_t)(frame->mBegin - numFlushed), writer->mNumBuffered);
+
+    for (;;) {
+        const TracerTracedInstruction* lhs = tracerTraceWriterNextExpanded(writer, &stored);
+        const TracerTracedInstruction* rhs = tracerTraceWriterNextExpanded(writer, &repeat);
+
+        if (!lhs || !rhs) {
+            return !lhs && !rhs && !stored.mFailed && !repeat.mFailed;
+        }
+
+        if (lhs->mType != rhs->mType || lhs->mBranchSource != rhs->mBranchSource || lhs->mBranchTarget != rhs->mBranchTarget) {
+            return eTracerFalse;
+        }
+
+        if (lhs->mType == eTracerInstructionTypeWatch && (lhs->mOldValue != rhs->mOldValue || lhs->mNewValue != rhs->mNewValue)) {
+            return eTracerFalse;
+        }
+    }
+}
+
+static void tracerTraceWriterCompleteSubtree(TracerTraceWriter* writer, const TracerTraceWriterFrame* frame) {
+    uint64_t numFlushed = writer->mNumRecords - writer->mNumBuffered;
+    uint64_t numExpanded = writer->mNumExpanded - frame->mNumExpanded;
+
+    uint32_t slot = (uint32_t)(frame->mHash & (TLIB_TRACE_FILE_DEDUP_ENTRIES - 1));
+    TracerTraceWriterEntry* entry = &writer->mEntries[slot];
+
+    if (writer->mNumFrames) {
+        TracerTraceWriterFrame* parent = &writer->mFrames[writer->mNumFrames - 1];
+        parent->mHash = tracerTraceFileMix(parent->mHash, frame->mHash);
+    }
+
+    if (entry->mHash == frame->mHash && entry->mNumExpanded == numExpanded && tracerTraceWriterSameSubtree(writer, frame, entry)) {
+        tracerTraceWriterReplaceSubtree(writer, frame, entry);
+        return;
+    }
+
+    if (frame->mBegin >= numFlushed) {
+        if (writer->mNumLog == TLIB_TRACE_FILE_CHUNK_RECORDS) {
+            return;
+        }
+        writer->mLog[writer->mNumLog++] = slot;
+    }
+
+    entry->mHash = frame->mHash;
+    entry->mFirstRecord = frame->mBegin;
+    entry->mNumRecords = writer->mNumRecords - frame->mBegin;
+    entry->mNumExpanded = numExpanded;
+}
+
+static TracerBool tracerTraceWriterAppendDeduplicated(TracerTraceWriter* writer, const TracerTracedInstruction* trace) {
+    // Subtrees are only tracked within a run of records of the same trace
+    if (trace->mThreadId != writer->mThreadId || trace->mTraceId != writer->mTraceId) {
+        writer->mNumFrames = 0;
+        writer->mThreadId = trace->mThreadId;
+        writer->mTraceId = trace->mTraceId;
+    }
+
+    uint64_t hash = tracerTraceWriterHashRecord(trace);
+    uint64_t index = writer->mNumRecords;
+
+    if (!tracerTraceWriterPush(writer, trace)) {
+        return eTracerFalse;
+    }
+
+    writer->mNumExpanded++;
+
+    if (trace->mType == eTracerInstructionTypeCall) {
+        if (writer->mNumFrames == writer->mMaxFrames) {
+            size_t maxFrames = writer->mMaxFrames ? writer->mMaxFrames * 2 : 64;
+            TracerTraceWriterFrame* frames = (TracerTraceWriterFrame*)realloc(writer->mFrames, maxFrames * sizeof(TracerTraceWriterFrame));
+
+            if (!frames) {
+                tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+                return eTracerFalse;
+            }
+
+            writer->mFrames = frames;
+            writer->mMaxFrames = maxFrames;
+        }
+
+        TracerTraceWriterFrame* frame = &writer->mFrames[writer->mNumFrames++];
+
+        frame->mBegin = index;
+        frame->mNumExpanded = writer->mNumExpanded - 1;
+        frame->mHash = hash;
+        frame->mLogMark = writer->mNumLog;
+        return eTracerTrue;
+    }
+
+    if (!writer->mNumFrames) {
+        return eTracerTrue;
+    }
+
+    TracerTraceWriterFrame* top = &writer->mFrames[writer->mNumFrames - 1];
+    top->mHash = tracerTraceFileMix(top->mHash, hash);
+
+    if (trace->mType == eTracerInstructionTypeReturn) {
+        TracerTraceWriterFrame frame = *top;
+
+        writer->mNumFrames--;
+        tracerTraceWriterCompleteSubtree(writer, &frame);
+    }
+
+    return eTracerTrue;
+}
+
+TracerBool tracerTraceWriterAppend(TracerHandle handle, const TracerTracedInstruction* traces, size_t numTraces) {
+    TracerTraceWriter* writer = (TracerTraceWriter*)handle;
+
+    if (!writer || (!traces && numTraces)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    if (writer->mDeduplicate) {
+        for (size_t i = 0; i < numTraces; i++) {
+            if (!tracerTraceWriterAppendDeduplicated(writer, &traces[i])) {
+                return eTracerFalse;
+            }
+        }
+        return eTracerTrue;
+    }
+
+    while (numTraces) {
+        size_t count = min(numTraces, TLIB_TRACE_FILE_CHUNK_RECORDS - writer->mNumBuffered);
+
+        memcpy(&writer->mBuffer[writer->mNumBuffered], traces, count * sizeof(TracerTracedInstruction));
+
+        writer->mNumBuffered += count;
+        writer->mNumRecords += count;
+        writer->mNumExpanded += count;
+
+        traces += count;
+        numTraces -= count;
+
+        if (writer->mNumBuffered == TLIB_TRACE_FILE_CHUNK_RECORDS && !tracerTraceWriterFlush(writer)) {
+            return eTracerFalse;
+        }
+    }
+
+    return eTracerTrue;
+}
+
+TracerBool tracerTraceWriterSetStatistics(TracerHandle handle, const TracerStatistics* statistics) {
+    TracerTraceWriter* writer = (TracerTraceWriter*)handle;
+
+    if (!writer || !statistics) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    writer->mStatistics.mSingleStepExceptions = statistics->mSingleStepExceptions;
+    writer->mStatistics.mIgnoredTraceEntries = statistics->mIgnoredTraceEntries;
+    writer->mStatistics.mQueueFullStalls = statistics->mQueueFullStalls;
+    writer->mStatistics.mQueueStallCycles = statistics->mQueueStallCycles;
+    writer->mStatistics.mDecodeFailures = statistics->mDecodeFailures;
+    writer->mStatistics.mBreakpointSuspensions = statistics->mBreakpointSuspensions;
+    writer->mStatistics.mHandlerCycles = statistics->mHandlerCycles;
+    writer->mStatistics.mReturnMismatches = statistics->mReturnMismatches;
+    writer->mStatistics.mUnarmedThreads = statistics->mUnarmedThreads;
+    return eTracerTrue;
+}
+
+TracerBool tracerDestroyTraceWriter(TracerHandle handle) {
+    TracerTraceWriter* writer = (TracerTraceWriter*)handle;
+
+    if (!writer) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    // The header is written last, a file that wasn't closed properly has no directory
+    TracerBool result = tracerTraceWriterFlush(writer) &&
+        tracerTraceWriterWrite(writer, writer->mChunks, writer->mNumChunks * sizeof(TracerTraceFileChunkEntry)) &&
+        tracerTraceWriterWriteIndex(writer) &&
+        tracerTraceWriterWriteHeader(writer);
+
+    CloseHandle(writer->mFile);
+
+    for (size_t i = 0; i < writer->mMaxTargets; i++) {
+        free(writer->mTargets[i].mPostings);
+    }
+
+    free(writer->mTargets);
+    free(writer->mChunks);
+    free(writer->mEncoded);
+    free(writer->mFrames);
+    free(writer->mEntries);
+    free(writer);
+    return result;
+}
+
+static const uint8_t* tracerTraceReaderGetChunkData(const TracerTraceReader* reader, size_t index, size_t* outSize) {
+    const TracerTraceFileChunkEntry* entry = &reader->mChunks[index];
+
+    *outSize = entry->mSize;
+    return reader->mView + (size_t)entry->mOffset;
+}
+
+// Returns the decoded chunk with all columns, the pointer stays valid until the next call
+static const TracerTraceChunk* tracerTraceReaderLoadChunk(TracerTraceReader* reader, size_t index) {
+    for (size_t i = 0; i < TLIB_TRACE_FILE_CHUNK_CACHE; i++) {
+        if (reader->mCachedChunk[i] == index + 1) {
+            return reader->mCache[i];
+        }
+    }
+
+    size_t slot = reader->mNextVictim;
+    reader->mNextVictim = (slot + 1) % TLIB_TRACE_FILE_CHUNK_CACHE;
+
+    if (!reader->mCache[slot]) {
+        reader->mCache[slot] = tracerCreateTraceChunk(reader->mChunkRecords);
+
+        if (!reader->mCache[slot]) {
+            return NULL;
+        }
+    }
+
+    size_t size = 0;
+    const uint8_t* data = tracerTraceReaderGetChunkData(reader, index, &size);
+
+    reader->mCachedChunk[slot] = 0;
+
+    if (!tracerTraceChunkDecode(data, size, TLIB_TRACE_COLUMN_ALL, reader->mCache[slot])) {
+        return NULL;
+    }
+
+    reader->mCachedChunk[slot] = index + 1;
+    return reader->mCache[slot];
+}
+
+static TracerBool tracerTraceReaderGetStored(TracerTraceReader* reader, size_t row, TracerTracedInstruction* outTrace) {
+    const TracerTraceChunk* chunk = tracerTraceReaderLoadChunk(reader, row / reader->mChunkRecords);
+
+    if (!chunk || row % reader->mChunkRecords >= chunk->mNumRecords) {
+        return eTracerFalse;
+    }
+
+    tracerTraceChunkGetRecord(chunk, row % reader->mChunkRecords, outTrace);
+    return eTracerTrue;
+}
+
+// Computes where the expansion of each stored record begins. References may only point back to
+// earlier subtrees, so a single pass over the type and target columns is enough.
+static TracerBool tracerTraceReaderIndexReferences(TracerTraceReader* reader) {
+    size_t i = 0;
+
+    while (i < reader->mNumChunks && !reader->mChunks[i].mNumRefs) {
+        i++;
+    }
+
+    if (i == reader->mNumChunks) {
+        return eTracerTrue;
+    }
+
+    TracerTraceChunk* chunk = tracerCreateTraceChunk(reader->mChunkRecords);
+    reader->mExpandedBegin = (uint64_t*)malloc((reader->mNumStored + 1) * sizeof(uint64_t));
+
+    if (!chunk || !reader->mExpandedBegin) {
+        if (chunk) {
+            tracerDestroyTraceChunk(chunk);
+        }
+
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    uint64_t* begin = reader->mExpandedBegin;
+    TracerBool result = eTracerTrue;
+    size_t row = 0;
+
+    begin[0] = 0;
+
+    for (i = 0; i < reader->mNumChunks && result; i++) {
+        size_t size = 0;
+        const uint8_t* data = tracerTraceReaderGetChunkData(reader, i, &size);
+
+        result = tracerTraceChunkDecode(data, size, TLIB_TRACE_COLUMN_BIT(eTracerTraceColumnType) |
+            TLIB_TRACE_COLUMN_BIT(eTracerTraceColumnTarget), chunk);
+
+        const uint8_t* types = TLIB_TRACE_CHUNK_COLUMN(chunk, eTracerTraceColumnType, uint8_t);
+        const uintptr_t* targets = TLIB_TRACE_CHUNK_COLUMN(chunk, eTracerTraceColumnTarget, uintptr_t);
+
+        for (size_t j = 0; j < chunk->mNumRecords && result; j++, row++) {
+            if (types[j] != TLIB_TRACE_CHUNK_TYPE_REF) {
+                begin[row + 1] = begin[row] + 1;
+                continue;
+            }
+
+            const TracerTraceRef* ref = &chunk->mRefs[targets[j]];
+
+            if (!ref->mCount || !ref->mNumRecords || ref->mFirstRecord >= row || ref->mNumRecords > row - ref->mFirstRecord) {
+                tracerCoreSetLastError(eTracerErrorInvalidArgument);
+                result = eTracerFalse;
+                break;
+            }
+
+            uint64_t length = begin[ref->mFirstRecord + ref->mNumRecords] - begin[ref->mFirstRecord];
+            begin[row + 1] = begin[row] + length * ref->mCount;
+        }
+    }
+
+    tracerDestroyTraceChunk(chunk);
+
+    if (result) {
+        reader->mNumRecords = begin[reader->mNumStored];
+    }
+
+    return result;
+}
+
+// Copies the expanded records starting at firstRecord, references are resolved recursively
+static size_t tracerTraceReaderExpand(TracerTraceReader* reader, uint64_t firstRecord,
+    TracerTracedInstruction* outTraces, size_t maxElements) {
+
+    const uint64_t* begin = reader->mExpandedBegin;
+
+    // The last stored record whose expansion begins at or before firstRecord
+    size_t low = 0, high = reader->mNumStored;
+
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+
+        if (begin[mid] <= firstRecord) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    size_t row = low;
+    size_t count = 0;
+
+    while (count < maxElements && row < reader->mNumStored) {
+        uint64_t position = firstRecord + count;
+
+        if (position >= begin[row + 1]) {
+            row++;
+            continue;
+        }
+
+        TracerTracedInstruction* out = &outTraces[count];
+
+        if (!tracerTraceReaderGetStored(reader, row, out)) {
+            break;
+        }
+
+        if ((uint32_t)out->mType != TLIB_TRACE_REF_TYPE) {
+            count++;
+            continue;
+        }
+
+        // The output slot is overwritten by the expansion, and so may be the cached chunk
+        TracerTraceRef ref;
+        TracerTracedInstruction call;
+
+        memcpy(&ref, out, sizeof(ref));
+
+        if (!tracerTraceReaderGetStored(reader, (size_t)ref.mFirstRecord, &call)) {
+            break;
+        }
+
+        uint64_t subtreeBegin = begin[ref.mFirstRecord];
+        uint64_t subtreeLength = begin[ref.mFirstRecord + ref.mNumRecords] - subtreeBegin;
+        uint64_t offset = (position - begin[row]) % subtreeLength;
+
+        size_t numCopied = tracerTraceReaderExpand(reader, subtreeBegin + offset, out,
+            (size_t)min((uint64_t)(maxElements - count), subtreeLength - offset));
+
+        for (size_t i = 0; i < numCopied; i++) {
+            out[i].mTraceId = ref.mTraceId;
+            out[i].mThreadId = ref.mThreadId;
+            out[i].mCallDepth += ref.mCallDepth - call.mCallDepth;
+            out[i].mTimestamp += ref.mTimestamp - call.mTimestamp;
+        }
+
+        if (!numCopied) {
+            break;
+        }
+
+        count += numCopied;
+    }
+
+    return count;
+}
+
+TracerHandle tracerCreateTraceReader(const char* path) {
+    if (!path) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    TracerTraceReader* reader = (TracerTraceReader*)malloc(sizeof(TracerTraceReader));
+
+    if (!reader) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return NULL;
+    }
+
+    memset(reader, 0, sizeof(TracerTraceReader));
+
+    LARGE_INTEGER fileSize;
+
+    reader->mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+
+    if (reader->mFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(reader->mFile, &fileSize)) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        goto cleanup;
+    }
+
+    if ((uint64_t)fileSize.QuadPart < sizeof(TracerTraceFileHeader) || (uint64_t)fileSize.QuadPart > SIZE_MAX) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        goto cleanup;
+    }
+
+    reader->mMapping = CreateFileMapping(reader->mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (reader->mMapping) {
+        reader->mView = (const uint8_t*)MapViewOfFile(reader->mMapping, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (!reader->mView) {
+        tracerCoreSetLastError(eTracerErrorSystemCall);
+        goto cleanup;
+    }
+
+    reader->mViewSize = (size_t)fileSize.QuadPart;
+
+    const TracerTraceFileHeader* header = (const TracerTraceFileHeader*)reader->mView;
+
+    // A writer that was never closed leaves an empty directory behind
+    if (header->mMagic != TLIB_TRACE_FILE_MAGIC || header->mVersion != TLIB_TRACE_FILE_VERSION || !header->mChunkRecords ||
+        header->mDirectoryOffset < sizeof(TracerTraceFileHeader) || header->mDirectoryOffset > reader->mViewSize ||
+        (reader->mViewSize - header->mDirectoryOffset) / sizeof(TracerTraceFileChunkEntry) < header->mNumChunks ||
+        header->mNumRecords > (uint64_t)header->mNumChunks * header->mChunkRecords) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        goto cleanup;
+    }
+
+    if (header->mIndexOffset) {
+        uint64_t directoryEnd = header->mDirectoryOffset + (uint64_t)header->mNumChunks * sizeof(TracerTraceFileChunkEntry);
+
+        if (header->mIndexOffset < directoryEnd || header->mIndexOffset > reader->mViewSize ||
+            (reader->mViewSize - header->mIndexOffset) / sizeof(TracerTraceFileIndexEntry) < header->mNumIndexEntries) {
+
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            goto cleanup;
+        }
+
+        reader->mIndex = (const TracerTraceFileIndexEntry*)(reader->mView + (size_t)header->mIndexOffset);
+        reader->mNumIndexEntries = (size_t)header->mNumIndexEntries;
+        reader->mPostings = (const uint8_t*)(reader->mIndex + reader->mNumIndexEntries);
+        reader->mPostingsSize = reader->mViewSize - (size_t)(reader->mPostings - reader->mView);
+    }
+
+    reader->mHeader = header;
+    reader->mChunks = (const TracerTraceFileChunkEntry*)(reader->mView + (size_t)header->mDirectoryOffset);
+    reader->mNumChunks = header->mNumChunks;
+    reader->mChunkRecords = header->mChunkRecords;
+    reader->mNumStored = (size_t)header->mNumRecords;
+    reader->mNumRecords = header->mNumRecords;
+
+    // Every chunk but the last one is full, which makes locating a stored record a division
+    for (size_t i = 0; i < reader->mNumChunks; i++) {
+        const TracerTraceFileChunkEntry* entry = &reader->mChunks[i];
+        size_t numRecords = i + 1 < reader->mNumChunks ? reader->mChunkRecords : reader->mNumStored - i * reader->mChunkRecords;
+
+        if (entry->mOffset < sizeof(TracerTraceFileHeader) || entry->mOffset > header->mDirectoryOffset ||
+            entry->mSize > header->mDirectoryOffset - entry->mOffset || entry->mSize < sizeof(TracerTraceChunkHeader) ||
+            ((const TracerTraceChunkHeader*)(reader->mView + (size_t)entry->mOffset))->mNumRecords != numRecords) {
+
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            goto cleanup;
+        }
+    }
+
+    if (!tracerTraceReaderIndexReferences(reader)) {
+        goto cleanup;
+    }
+
+    return (TracerHandle)reader;
+
+cleanup:
+    tracerDestroyTraceReader((TracerHandle)reader);
+    return NULL;
+}
+
+void tracerDestroyTraceReader(TracerHandle handle) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return;
+    }
+
+    for (size_t i = 0; i < TLIB_TRACE_FILE_CHUNK_CACHE; i++) {
+        if (reader->mCache[i]) {
+            tracerDestroyTraceChunk(reader->mCache[i]);
+        }
+    }
+
+    if (reader->mView) {
+        UnmapViewOfFile(reader->mView);
+    }
+
+    if (reader->mMapping) {
+        CloseHandle(reader->mMapping);
+    }
+
+    if (reader->mFile && reader->mFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(reader->mFile);
+    }
+
+    free(reader->mExpandedBegin);
+    free(reader);
+}
+
+uint64_t tracerTraceReaderGetNumRecords(TracerHandle handle) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    return reader->mNumRecords;
+}
+
+TracerBool tracerTraceReaderGetStatistics(TracerHandle handle, TracerStatistics* outStatistics) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader || !outStatistics) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    const TracerTraceFileStatistics* statistics = &reader->mHeader->mStatistics;
+
+    outStatistics->mSingleStepExceptions = statistics->mSingleStepExceptions;
+    outStatistics->mIgnoredTraceEntries = statistics->mIgnoredTraceEntries;
+    outStatistics->mQueueFullStalls = statistics->mQueueFullStalls;
+    outStatistics->mQueueStallCycles = statistics->mQueueStallCycles;
+    outStatistics->mDecodeFailures = statistics->mDecodeFailures;
+    outStatistics->mBreakpointSuspensions = statistics->mBreakpointSuspensions;
+    outStatistics->mHandlerCycles = statistics->mHandlerCycles;
+    outStatistics->mReturnMismatches = statistics->mReturnMismatches;
+    outStatistics->mUnarmedThreads = statistics->mUnarmedThreads;
+    return eTracerTrue;
+}
+
+size_t tracerTraceReaderRead(TracerHandle handle, uint64_t firstRecord, TracerTracedInstruction* outTraces, size_t maxElements) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader || !outTraces) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    if (firstRecord >= reader->mNumRecords) {
+        return 0;
+    }
+
+    if (reader->mExpandedBegin) {
+        return tracerTraceReaderExpand(reader, firstRecord, outTraces, maxElements);
+    }
+
+    size_t row = (size_t)firstRecord;
+    size_t count = 0;
+
+    while (count < maxElements && row < reader->mNumStored) {
+        const TracerTraceChunk* chunk = tracerTraceReaderLoadChunk(reader, row / reader->mChunkRecords);
+
+        if (!chunk) {
+            break;
+        }
+
+        size_t first = row % reader->mChunkRecords;
+        size_t numRecords = min(chunk->mNumRecords - first, maxElements - count);
+
+        for (size_t i = 0; i < numRecords; i++) {
+            tracerTraceChunkGetRecord(chunk, first + i, &outTraces[count + i]);
+        }
+
+        count += numRecords;
+        row += numRecords;
+    }
+
+    return count;
+}
+
+size_t tracerTraceReaderGetNumChunks(TracerHandle handle) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    return reader->mNumChunks;
+}
+
+TracerTraceChunk* tracerTraceReaderCreateChunk(TracerHandle handle) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    return tracerCreateTraceChunk(reader->mChunkRecords);
+}
+
+TracerBool tracerTraceReaderDecodeChunk(TracerHandle handle, size_t index, uint32_t columnMask, TracerTraceChunk* chunk) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader || !chunk || index >= reader->mNumChunks) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    size_t size = 0;
+    const uint8_t* data = tracerTraceReaderGetChunkData(reader, index, &size);
+
+    return tracerTraceChunkDecode(data, size, columnMask, chunk);
+}
+
+TracerBool tracerTraceReaderHasReferences(TracerHandle handle) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    return reader->mExpandedBegin != NULL;
+}
+
+uint64_t tracerTraceReaderGetExpandedIndex(TracerHandle handle, uint64_t storedRecord) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader || storedRecord > reader->mNumStored) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    return reader->mExpandedBegin ? reader->mExpandedBegin[storedRecord] : storedRecord;
+}
+
+TracerBool tracerTraceReaderGetColumnRange(TracerHandle handle, size_t index, TracerTraceColumn column,
+    uint64_t* outMin, uint64_t* outMax) {
+
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader || index >= reader->mNumChunks || !outMin || !outMax) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    if (column < TLIB_TRACE_FILE_ZONE_COLUMNS) {
+        *outMin = reader->mChunks[index].mZones[column].mMin;
+        *outMax = reader->mChunks[index].mZones[column].mMax;
+        return eTracerTrue;
+    }
+
+    size_t size = 0;
+    const uint8_t* data = tracerTraceReaderGetChunkData(reader, index, &size);
+
+    return tracerTraceChunkGetColumnRange(data, size, column, outMin, outMax);
+}
+
+size_t tracerTraceReaderFindTarget(TracerHandle handle, uint64_t target, uint32_t* outChunks, size_t maxChunks) {
+    TracerTraceReader* reader = (TracerTraceReader*)handle;
+
+    if (!reader || (!outChunks && maxChunks)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    if (!reader->mIndex) {
+        size_t count = 0;
+
+        for (size_t i = 0; i < reader->mNumChunks; i++) {
+            const TracerTraceFileZone* zone = &reader->mChunks[i].mZones[eTracerTraceColumnTarget];
+
+            if (zone->mMin <= target && target <= zone->mMax) {
+                if (count < maxChunks) {
+                    outChunks[count] = (uint32_t)i;
+                }
+                count++;
+            }
+        }
+
+        return count;
+    }
+
+    size_t low = 0;
+    size_t high = reader->mNumIndexEntries;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (reader->mIndex[middle].mTarget < target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == reader->mNumIndexEntries || reader->mIndex[low].mTarget != target) {
+        return 0;
+    }
+
+    const TracerTraceFileIndexEntry* entry = &reader->mIndex[low];
+
+    if (entry->mOffset > reader->mPostingsSize || entry->mSize > reader->mPostingsSize - entry->mOffset) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return 0;
+    }
+
+    const uint8_t* data = reader->mPostings + (size_t)entry->mOffset;
+    const uint8_t* end = data + entry->mSize;
+    size_t count = min(entry->mNumChunks, maxChunks);
+    uint32_t chunkIndex = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t delta = 0;
+        int shift = 0;
+
+        do {
+            if (data == end || shift > 28) {
+                tracerCoreSetLastError(eTracerErrorInvalidArgument);
+                return 0;
+            }
+
+            delta |= (uint32_t)(*data & 0x7F) << shift;
+            shift += 7;
+        } while (*data++ & 0x80);
+
+        chunkIndex += delta;
+
+        if (chunkIndex >= reader->mNumChunks) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return 0;
+        }
+
+        outChunks[i] = chunkIndex;
+    }
+
+    return entry->mNumChunks;
+}
@@ -0,0 +1,816 @@
+
+#include <tracer_lib/trace_query.h>
+#include <tracer_lib/trace_file.h>
+
+#include <intrin.h>
+
+typedef enum TracerQueryLevel {
+    eTracerQueryLevelUnknown        = 0,
+    eTracerQueryLevelScalar         = 1,
+    eTracerQueryLevelSse2           = 2,
+} TracerQueryLevel;
+
+typedef struct TracerQueryFilter {
+    TracerTraceColumn               mColumn;
+    size_t                          mWidth;
+    uint64_t                        mLow;
+    uint64_t                        mRange;                 // Matches are within [mLow, mLow + mRange]
+} TracerQueryFilter;
+
+typedef struct TracerQueryGroupMap {
+    TracerQueryGroup*               mGroups;                // Open addressing, a count of 0 marks a free slot
+    size_t                          mNumGroups;
+    size_t                          mCapacity;
+} TracerQueryGroupMap;
+
+typedef struct TracerQueryJob {
+    TracerQueryTraceFile*           mQuery;
+    const TracerQueryFilter*        mFilters;
+    size_t                          mNumFilters;
+    uint32_t                        mColumnMask;
+    TracerBool                      mUseSse2;
+
+    size_t                          mNumChunks;
+    size_t                          mChunkRecords;
+    uint8_t*                        mSkip;                  // Set for chunks whose value ranges can't match
+    uint64_t*                       mChunkMatches;          // Counted by the first pass
+    uint64_t*                       mChunkOffsets;          // Where the matches of a chunk go in mOutRecords
+    TracerBool                      mCollect;               // Whether this is the second pass
+    volatile LONG                   mNextChunk;
+} TracerQueryJob;
+
+typedef struct TracerQueryWorker {
+    TracerQueryJob*                 mJob;
+    HANDLE                          mThread;
+    TracerTraceChunk*               mChunk;
+    uint8_t*                        mMask;                  // 0xFF for every record that still matches
+    TracerQueryGroupMap             mGroups;
+    TracerError                     mError;                 // eTracerErrorSuccess unless the worker failed
+} TracerQueryWorker;
+
+static volatile LONG gTracerQueryLevel = eTracerQueryLevelUnknown;
+
+static TracerQueryLevel tracerQueryGetLevel() {
+    TracerQueryLevel level = (TracerQueryLevel)gTracerQueryLevel;
+
+    if (level == eTracerQueryLevelUnknown) {
+        int info[4];
+        __cpuid(info, 1);
+
+        level = (info[3] & (1 << 26)) ? eTracerQueryLevelSse2 : eTracerQueryLevelScalar;
+        InterlockedExchange(&gTracerQueryLevel, (LONG)level);
+    }
+
+    return level;
+}
+
+static void tracerQueryFilter8(const uint8_t* values, size_t numValues, uint8_t low, uint8_t range,
+    uint8_t* mask, TracerBool useSse2) {
+
+    size_t i = 0;
+
+    if (useSse2) {
+        __m128i lowVector = _mm_set1_epi8((char)low);
+        __m128i rangeVector = _mm_set1_epi8((char)range);
+
+        for (; i + 16 <= numValues; i += 16) {
+            __m128i offset = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(values + i)), lowVector);
+            __m128i inside = _mm_cmpeq_epi8(_mm_min_epu8(offset, rangeVector), offset);
+
+            _mm_storeu_si128((__m128i*)(mask + i), _mm_and_si128(_mm_loadu_si128((const __m128i*)(mask + i)), inside));
+        }
+    }
+
+    for (; i < numValues; i++) {
+        if ((uint8_t)(values[i] - low) > range) {
+            mask[i] = 0;
+        }
+    }
+}
+
+static void tracerQueryFilter32(const uint32_t* values, size_t numValues, uint32_t low, uint32_t range,
+    uint8_t* mask, TracerBool useSse2) {
+
+    size_t i = 0;
+
+    if (useSse2) {
+        // SSE2 only compares signed integers, flipping the sign bit of both sides makes it unsigned
+        __m128i sign = _mm_set1_epi32((int)0x80000000);
+        __m128i lowVector = _mm_set1_epi32((int)low);
+        __m128i rangeVector = _mm_xor_si128(_mm_set1_epi32((int)range), sign);
+
+        for (; i + 16 <= numValues; i += 16) {
+            __m128i outside[4];
+
+            for (int j = 0; j < 4; j++) {
+                __m128i offset = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(values + i + j * 4)), lowVector);
+                outside[j] = _mm_cmpgt_epi32(_mm_xor_si128(offset, sign), rangeVector);
+            }
+
+            __m128i packed = _mm_packs_epi16(_mm_packs_epi32(outside[0], outside[1]), _mm_packs_epi32(outside[2], outside[3]));
+
+            _mm_storeu_si128((__m128i*)(mask + i), _mm_andnot_si128(packed, _mm_loadu_si128((const __m128i*)(mask + i))));
+        }
+    }
+
+    for (; i < numValues; i++) {
+        if (values[i] - low > range) {
+            mask[i] = 0;
+        }
+    }
+}
+
+static void tracerQueryFilter64(const uint64_t* values, size_t numValues, uint64_t low, uint64_t range, uint8_t* mask) {
+    for (size_t i = 0; i < numValues; i++) {
+        if (values[i] - low > range) {
+            mask[i] = 0;
+        }
+    }
+}
+
+static void tracerQueryApplyFilter(const TracerQueryFilter* filter, const TracerTraceChunk* chunk,
+    uint8_t* mask, TracerBool useSse2) {
+
+    const void* values = chunk->mColumns[filter->mColumn];
+
+    switch (filter->mWidth) {
+    case 1:
+        tracerQueryFilter8((const uint8_t*)values, chunk->mNumRecords, (uint8_t)filter->mLow, (uint8_t)filter->mRange, mask, useSse2);
+        break;
+    case 4:
+        tracerQueryFilter32((const uint32_t*)values, chunk->mNumRecords, (uint32_t)filter->mLow, (uint32_t)filter->mRange, mask, useSse2);
+        break;
+    default:
+        tracerQueryFilter64((const uint64_t*)values, chunk->mNumRecords, filter->mLow, filter->mRange, mask);
+        break;
+    }
+}
+
+static size_t tracerQueryCountMask(const uint8_t* mask, size_t numValues, TracerBool useSse2) {
+    size_t count = 0;
+    size_t i = 0;
+
+    if (useSse2) {
+        __m128i one = _mm_set1_epi8(1);
+        __m128i total = _mm_setzero_si128();
+
+        for (; i + 16 <= numValues; i += 16) {
+            __m128i bits = _mm_and_si128(_mm_loadu_si128((const __m128i*)(mask + i)), one);
+            total = _mm_add_epi64(total, _mm_sad_epu8(bits, _mm_setzero_si128()));
+        }
+
+        count = (size_t)_mm_cvtsi128_si32(total) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(total, 8));
+    }
+
+    for (; i < numValues; i++) {
+        count += mask[i] & 1;
+    }
+
+    return count;
+}
+
+static uint64_t tracerQueryGetValue(const TracerTraceChunk* chunk, TracerTraceColumn column, size_t index) {
+    switch (tracerTraceColumnWidth(column)) {
+    case 1:
+        return TLIB_TRACE_CHUNK_COLUMN(chunk, column, uint8_t)[index];
+    case 4:
+        return TLIB_TRACE_CHUNK_COLUMN(chunk, column, uint32_t)[index];
+    default:
+        return TLIB_TRACE_CHUNK_COLUMN(chunk, column, uint64_t)[index];
+    }
+}
+
+static TracerBool tracerQueryGroupAdd(TracerQueryGroupMap* map, uint64_t value, uint64_t count) {
+    if ((map->mNumGroups + 1) * 2 > map->mCapacity) {
+        size_t capacity = map->mCapacity ? map->mCapacity * 2 : 256;
+        TracerQueryGroup* groups = (TracerQueryGroup*)calloc(capacity, sizeof(TracerQueryGroup));
+
+        if (!groups) {
+            return eTracerFalse;
+        }
+
+        TracerQueryGroupMap grown = { groups, 0, capacity };
+
+        for (size_t i = 0; i < map->mCapacity; i++) {
+            if (map->mGroups[i].mCount) {
+                tracerQueryGroupAdd(&grown, map->mGroups[i].mValue, map->mGroups[i].mCount);
+            }
+        }
+
+        free(map->mGroups);
+        *map = grown;
+    }
+
+    size_t slot = (size_t)((value * 0x9E3779B97F4A7C15ULL) >> 32) & (map->mCapacity - 1);
+
+    while (map->mGroups[slot].mCount && map->mGroups[slot].mValue != value) {
+        slot = (slot + 1) & (map->mCapacity - 1);
+    }
+
+    if (!map->mGroups[slot].mCount) {
+        map->mGroups[slot].mValue = value;
+        map->mNumGroups++;
+    }
+
+    map->mGroups[slot].mCount += count;
+    return eTracerTrue;
+}
+
+static int tracerQueryCompareGroups(const void* lhs, const void* rhs) {
+    const TracerQueryGroup* a = (const TracerQueryGroup*)lhs;
+    const TracerQueryGroup* b = (const TracerQueryGroup*)rhs;
+
+    if (a->mCount != b->mCount) {
+        return (a->mCount > b->mCount) ? -1 : 1;
+    }
+    return (a->mValue > b->mValue) - (a->mValue < b->mValue);
+}
+
+// Sorts the groups by size and hands out the largest, the map is unusable afterwards
+static void tracerQueryFinishGroups(TracerQueryTraceFile* query, TracerQueryGroupMap* map) {
+    size_t numGroups = 0;
+
+    for (size_t i = 0; i < map->mCapacity; i++) {
+        if (map->mGroups[i].mCount) {
+            map->mGroups[numGroups++] = map->mGroups[i];
+        }
+    }
+
+    qsort(map->mGroups, numGroups, sizeof(TracerQueryGroup), tracerQueryCompareGroups);
+
+    query->mNumGroups = numGroups;
+
+    if (query->mOutGroups) {
+        memcpy(query->mOutGroups, map->mGroups, min(numGroups, query->mMaxGroups) * sizeof(TracerQueryGroup));
+    }
+}
+
+static TracerBool tracerQueryProcessChunk(TracerQueryWorker* worker, size_t index) {
+    TracerQueryJob* job = worker->mJob;
+    TracerQueryTraceFile* query = job->mQuery;
+    TracerTraceChunk* chunk = worker->mChunk;
+
+    if (!tracerTraceReaderDecodeChunk(query->mFile, index, job->mColumnMask, chunk)) {
+        worker->mError = eTracerErrorInvalidArgument;
+        return eTracerFalse;
+    }
+
+    memset(worker->mMask, 0xFF, chunk->mNumRecords);
+
+    for (size_t i = 0; i < job->mNumFilters; i++) {
+        tracerQueryApplyFilter(&job->mFilters[i], chunk, worker->mMask, job->mUseSse2);
+    }
+
+    if (job->mCollect) {
+        uint64_t position = job->mChunkOffsets[index];
+        uint64_t firstRecord = (uint64_t)index * job->mChunkRecords;
+
+        for (size_t i = 0; i < chunk->mNumRecords && position < query->mMaxRecords; i++) {
+            if (worker->mMask[i]) {
+                query->mOutRecords[position++] = firstRecord + i;
+            }
+        }
+        return eTracerTrue;
+    }
+
+    job->mChunkMatches[index] = tracerQueryCountMask(worker->mMask, chunk->mNumRecords, job->mUseSse2);
+
+    if (query->mGroupByField == eTracerTraceFieldNone || !job->mChunkMatches[index]) {
+        return eTracerTrue;
+    }
+
+    // Runs of the same value are common, e.g. the thread or a loop target, so they are added at once
+    TracerTraceColumn column = (TracerTraceColumn)query->mGroupByField;
+    uint64_t runValue = 0;
+    uint64_t runLength = 0;
+
+    for (size_t i = 0; i < chunk->mNumRecords; i++) {
+        if (!worker->mMask[i]) {
+            continue;
+        }
+
+        uint64_t value = tracerQueryGetValue(chunk, column, i);
+
+        if (runLength && value != runValue) {
+            if (!tracerQueryGroupAdd(&worker->mGroups, runValue, runLength)) {
+                worker->mError = eTracerErrorNotEnoughMemory;
+                return eTracerFalse;
+            }
+            runLength = 0;
+        }
+
+        runValue = value;
+        runLength++;
+    }
+
+    if (!tracerQueryGroupAdd(&worker->mGroups, runValue, runLength)) {
+        worker->mError = eTracerErrorNotEnoughMemory;
+        return eTracerFalse;
+    }
+
+    return eTracerTrue;
+}
+
+static DWORD WINAPI tracerQueryWorkerThread(LPVOID parameter) {
+    TracerQueryWorker* worker = (TracerQueryWorker*)parameter;
+    TracerQueryJob* job = worker->mJob;
+
+    while (worker->mError == eTracerErrorSuccess) {
+        LONG chunkIndex = InterlockedIncrement(&job->mNextChunk) - 1;
+
+        if ((size_t)chunkIndex >= job->mNumChunks) {
+            break;
+        }
+
+        if (job->mSkip[chunkIndex]) {
+            continue;
+        }
+
+        if (job->mCollect && (!job->mChunkMatches[chunkIndex] || job->mChunkOffsets[chunkIndex] >= job->mQuery->mMaxRecords)) {
+            continue;
+        }
+
+        tracerQueryProcessChunk(worker, (size_t)chunkIndex);
+    }
+    return 0;
+}
+
+static TracerBool tracerQuerySkipByTarget(TracerQueryJob* job, uint64_t target) {
+    uint32_t* chunks = (uint32_t*)malloc(max(job->mNumChunks, 1) * sizeof(uint32_t));
+
+    if (!chunks) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    size_t numChunks = tracerTraceReaderFindTarget(job->mQuery->mFile, target, chunks, job->mNumChunks);
+
+    if (tracerCoreGetLastError() != eTracerErrorSuccess) {
+        free(chunks);
+        return eTracerFalse;
+    }
+
+    memset(job->mSkip, eTracerTrue, job->mNumChunks);
+
+    for (size_t i = 0; i < min(numChunks, job->mNumChunks); i++) {
+        job->mSkip[chunks[i]] = eTracerFalse;
+    }
+
+    free(chunks);
+    return eTracerTrue;
+}
+
+static TracerError tracerQueryRunPass(TracerQueryJob* job, TracerQueryWorker* workers, size_t numThreads) {
+    job->mNextChunk = 0;
+
+    // The calling thread is the first worker, the others get a thread of their own
+    for (size_t i = 1; i < numThreads; ++i) {
+        workers[i].mThread = CreateThread(NULL, 0, tracerQueryWorkerThread, &workers[i], 0, NULL);
+    }
+
+    tracerQueryWorkerThread(&workers[0]);
+
+    TracerError error = workers[0].mError;
+
+    for (size_t i = 1; i < numThreads; ++i) {
+        if (workers[i].mThread) {
+            WaitForSingleObject(workers[i].mThread, INFINITE);
+            CloseHandle(workers[i].mThread);
+
+            workers[i].mThread = NULL;
+        }
+
+        if (workers[i].mError != eTracerErrorSuccess) {
+            error = workers[i].mError;
+        }
+    }
+
+    return error;
+}
+
+static TracerBool tracerQueryZonesMatch(const TracerTraceFileZone* zones, const TracerQueryFilter* filters, size_t numFilters) {
+    for (size_t i = 0; i < numFilters; i++) {
+        if (zones[i].mMax < filters[i].mLow || zones[i].mMin > filters[i].mLow + filters[i].mRange) {
+            return eTracerFalse;
+        }
+    }
+    return eTracerTrue;
+}
+
+// The value ranges of the filtered columns over the expansion of a reference. Its copies take the
+// trace and thread id of the reference, and their call depths and time stamps are shifted.
+static void tracerQueryRefZones(const TracerTraceRef* ref, const TracerQueryFilter* filters, size_t numFilters,
+    const TracerTraceFileZone* chunkZones, size_t chunkRecords, TracerTraceFileZone* outZones) {
+
+    size_t firstChunk = (size_t)(ref->mFirstRecord / chunkRecords);
+    size_t lastChunk = (size_t)((ref->mFirstRecord + ref->mNumRecords - 1) / chunkRecords);
+
+    for (size_t i = 0; i < numFilters; i++) {
+        TracerTraceFileZone* zone = &outZones[i];
+
+        switch (filters[i].mColumn) {
+        case eTracerTraceColumnTraceId:
+            zone->mMin = zone->mMax = (uint32_t)ref->mTraceId;
+            break;
+        case eTracerTraceColumnThreadId:
+            zone->mMin = zone->mMax = (uint32_t)ref->mThreadId;
+            break;
+        case eTracerTraceColumnCallDepth:
+        case eTracerTraceColumnTimestamp:
+            zone->mMin = 0;
+            zone->mMax = UINT64_MAX;
+            break;
+        default:
+            zone->mMin = UINT64_MAX;
+            zone->mMax = 0;
+
+            for (size_t j = firstChunk; j <= lastChunk; j++) {
+                zone->mMin = min(zone->mMin, chunkZones[j * numFilters + i].mMin);
+                zone->mMax = max(zone->mMax, chunkZones[j * numFilters + i].mMax);
+            }
+            break;
+        }
+    }
+}
+
+// Computes the value ranges of the filtered columns over the expansion of every chunk, the own
+// records joined with everything its references expand to. References only point back, so a
+// single pass in order is enough. A reference into its own chunk sees the records before it.
+static TracerBool tracerQueryExpandZones(TracerQueryTraceFile* query, const TracerQueryFilter* filters, size_t numFilters,
+    TracerTraceChunk* chunk, size_t numChunks, TracerTraceFileZone* refZones, TracerTraceFileZone* outZones) {
+
+    for (size_t i = 0; i < numChunks; i++) {
+        TracerTraceFileZone* zones = &outZones[i * numFilters];
+
+        for (size_t j = 0; j < numFilters; j++) {
+            if (!tracerTraceReaderGetColumnRange(query->mFile, i, filters[j].mColumn, &zones[j].mMin, &zones[j].mMax)) {
+                zones[j].mMin = 0;
+                zones[j].mMax = UINT64_MAX;
+            }
+        }
+
+        // The references are decoded regardless of the columns
+        if (!tracerTraceReaderDecodeChunk(query->mFile, i, 0, chunk)) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return eTracerFalse;
+        }
+
+        for (size_t j = 0; j < chunk->mNumRefs; j++) {
+            tracerQueryRefZones(&chunk->mRefs[j], filters, numFilters, outZones, chunk->mMaxRecords, refZones);
+
+            for (size_t k = 0; k < numFilters; k++) {
+                zones[k].mMin = min(zones[k].mMin, refZones[k].mMin);
+                zones[k].mMax = max(zones[k].mMax, refZones[k].mMax);
+            }
+        }
+    }
+
+    return eTracerTrue;
+}
+
+static TracerBool tracerQueryAddExpandedMatch(TracerQueryTraceFile* query, TracerQueryGroupMap* groups, uint64_t record, uint64_t groupValue) {
+    if (query->mNumMatches < query->mMaxRecords) {
+        query->mOutRecords[query->mNumMatches] = record;
+    }
+
+    query->mNumMatches++;
+
+    if (query->mGroupByField != eTracerTraceFieldNone && !tracerQueryGroupAdd(groups, groupValue, 1)) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+    return eTracerTrue;
+}
+
+// Tests the expanded records [first, end) one by one
+static TracerBool tracerQueryExpandRange(TracerQueryTraceFile* query, const TracerQueryFilter* filters, size_t numFilters,
+    TracerQueryGroupMap* groups, TracerTracedInstruction* batch, uint64_t first, uint64_t end) {
+
+    while (first < end) {
+        size_t count = tracerTraceReaderRead(query->mFile, first, batch, (size_t)min(end - first, TLIB_TRACE_QUERY_READ_BATCH));
+
+        if (!count) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return eTracerFalse;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            size_t j = 0;
+
+            while (j < numFilters && tracerTraceColumnGetValue(&batch[i], filters[j].mColumn) - filters[j].mLow <= filters[j].mRange) {
+                j++;
+            }
+
+            if (j == numFilters && !tracerQueryAddExpandedMatch(query, groups, first + i,
+                query->mGroupByField != eTracerTraceFieldNone ? tracerTraceColumnGetValue(&batch[i], (TracerTraceColumn)query->mGroupByField) : 0)) {
+
+                return eTracerFalse;
+            }
+        }
+
+        first += count;
+    }
+
+    return eTracerTrue;
+}
+
+// References replace whole subtrees, so the matches of a stored record depend on where it is
+// expanded. The value ranges of the chunks are joined with those of the subtrees they reference
+// to skip chunks, the stored records of the others are filtered by column and only the references
+// that can match are expanded. Runs on the calling thread, the reader isn't thread safe.
+static TracerBool tracerQueryExpanded(TracerQueryTraceFile* query, const TracerQueryFilter* filters, size_t numFilters,
+    uint32_t columnMask, TracerBool useSse2) {
+
+    size_t numChunks = tracerTraceReaderGetNumChunks(query->mFile);
+    TracerTraceChunk* chunk = tracerTraceReaderCreateChunk(query->mFile);
+    TracerTracedInstruction* batch = (TracerTracedInstruction*)malloc(TLIB_TRACE_QUERY_READ_BATCH * sizeof(TracerTracedInstruction));
+    TracerTraceFileZone* zones = (TracerTraceFileZone*)malloc(max(numChunks * numFilters, 1) * sizeof(TracerTraceFileZone));
+    TracerTraceFileZone* refZones = (TracerTraceFileZone*)malloc(max(numFilters, 1) * sizeof(TracerTraceFileZone));
+    uint8_t* mask = chunk ? (uint8_t*)malloc(max(chunk->mMaxRecords, 1)) : NULL;
+    TracerQueryGroupMap groups = { NULL, 0, 0 };
+    TracerBool result = eTracerFalse;
+
+    if (!chunk || !batch || !zones || !refZones || !mask) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        goto cleanup;
+    }
+
+    if (!tracerQueryExpandZones(query, filters, numFilters, chunk, numChunks, refZones, zones)) {
+        goto cleanup;
+    }
+
+    columnMask |= TLIB_TRACE_COLUMN_BIT(eTracerTraceColumnType) | TLIB_TRACE_COLUMN_BIT(eTracerTraceColumnTarget);
+
+    for (size_t i = 0; i < numChunks; i++) {
+        if (!tracerQueryZonesMatch(&zones[i * numFilters], filters, numFilters)) {
+            query->mNumSkippedChunks++;
+            continue;
+        }
+
+        if (!tracerTraceReaderDecodeChunk(query->mFile, i, columnMask, chunk)) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            goto cleanup;
+        }
+
+        memset(mask, 0xFF, chunk->mNumRecords);
+
+        for (size_t j = 0; j < numFilters; j++) {
+            tracerQueryApplyFilter(&filters[j], chunk, mask, useSse2);
+        }
+
+        const uint8_t* types = TLIB_TRACE_CHUNK_COLUMN(chunk, eTracerTraceColumnType, uint8_t);
+        const uintptr_t* targets = TLIB_TRACE_CHUNK_COLUMN(chunk, eTracerTraceColumnTarget, uintptr_t);
+        uint64_t row = (uint64_t)i * chunk->mMaxRecords;
+
+        for (size_t j = 0; j < chunk->mNumRecords; j++, row++) {
+            if (types[j] == TLIB_TRACE_CHUNK_TYPE_REF) {
+                tracerQueryRefZones(&chunk->mRefs[targets[j]], filters, numFilters, zones, chunk->mMaxRecords, refZones);
+
+                if (tracerQueryZonesMatch(refZones, filters, numFilters) &&
+                    !tracerQueryExpandRange(query, filters, numFilters, &groups, batch,
+                        tracerTraceReaderGetExpandedIndex(query->mFile, row), tracerTraceReaderGetExpandedIndex(query->mFile, row + 1))) {
+
+                    goto cleanup;
+                }
+                continue;
+            }
+
+            if (mask[j] && !tracerQueryAddExpandedMatch(query, &groups, tracerTraceReaderGetExpandedIndex(query->mFile, row),
+                query->mGroupByField != eTracerTraceFieldNone ? tracerQueryGetValue(chunk, (TracerTraceColumn)query->mGroupByField, j) : 0)) {
+
+                goto cleanup;
+            }
+        }
+    }
+
+    tracerQueryFinishGroups(query, &groups);
+    result = eTracerTrue;
+
+cleanup:
+    if (chunk) {
+        tracerDestroyTraceChunk(chunk);
+    }
+
+    free(groups.mGroups);
+    free(mask);
+    free(refZones);
+    free(zones);
+    free(batch);
+    return result;
+}
+
+TracerBool tracerTraceQuery(TracerQueryTraceFile* query) {
+    query->mNumMatches = 0;
+    query->mNumGroups = 0;
+    query->mNumSkippedChunks = 0;
+
+    if (query->mGroupByField != eTracerTraceFieldNone &&
+        (query->mGroupByField < 0 || query->mGroupByField >= (TracerTraceField)eTracerTraceColumnCount)) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    TracerQueryFilter* filters = (TracerQueryFilter*)malloc(max(query->mNumPredicates, 1) * sizeof(TracerQueryFilter));
+
+    if (!filters) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    TracerQueryJob job;
+    memset(&job, 0, sizeof(job));
+
+    job.mQuery = query;
+    job.mFilters = filters;
+    job.mNumFilters = query->mNumPredicates;
+    job.mUseSse2 = tracerQueryGetLevel() == eTracerQueryLevelSse2;
+
+    TracerBool result = eTracerFalse;
+    TracerBool matchesNothing = eTracerFalse;
+
+    TracerQueryWorker* workers = NULL;
+    size_t numWorkers = 0;
+
+    for (size_t i = 0; i < query->mNumPredicates; i++) {
+        const TracerQueryPredicate* predicate = &query->mPredicates[i];
+
+        if (predicate->mField < 0 || predicate->mField >= (TracerTraceField)eTracerTraceColumnCount) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            goto cleanup;
+        }
+
+        TracerQueryFilter* filter = &filters[i];
+
+        filter->mColumn = (TracerTraceColumn)predicate->mField;
+        filter->mWidth = tracerTraceColumnWidth(filter->mColumn);
+
+        // Clamp the range to the values that the column can hold
+        uint64_t maxValue = filter->mWidth < 8 ? (1ULL << (filter->mWidth * 8)) - 1 : UINT64_MAX;
+        uint64_t high = min(predicate->mMax, maxValue);
+
+        if (predicate->mMin > high) {
+            matchesNothing = eTracerTrue;
+        }
+
+        filter->mLow = predicate->mMin;
+        filter->mRange = high - predicate->mMin;
+
+        job.mColumnMask |= TLIB_TRACE_COLUMN_BIT(filter->mColumn);
+    }
+
+    if (query->mGroupByField != eTracerTraceFieldNone) {
+        job.mColumnMask |= TLIB_TRACE_COLUMN_BIT(query->mGroupByField);
+    }
+
+    TracerBool hasReferences = tracerTraceReaderHasReferences(query->mFile);
+
+    // Repeats are expanded with the registers of their stored copy, which would match the wrong records
+    if (hasReferences) {
+        TracerBool testsRegisters = query->mGroupByField >= (TracerTraceField)eTracerTraceColumnEAX;
+
+        for (size_t i = 0; i < job.mNumFilters; i++) {
+            testsRegisters |= filters[i].mColumn >= eTracerTraceColumnEAX;
+        }
+
+        if (testsRegisters) {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            goto cleanup;
+        }
+    }
+
+    if (matchesNothing) {
+        result = eTracerTrue;
+        goto cleanup;
+    }
+
+    if (hasReferences) {
+        result = tracerQueryExpanded(query, filters, job.mNumFilters, job.mColumnMask, job.mUseSse2);
+        goto cleanup;
+    }
+
+    job.mNumChunks = tracerTraceReaderGetNumChunks(query->mFile);
+    job.mSkip = (uint8_t*)calloc(max(job.mNumChunks, 1), sizeof(uint8_t));
+    job.mChunkMatches = (uint64_t*)calloc(max(job.mNumChunks, 1), sizeof(uint64_t));
+    job.mChunkOffsets = (uint64_t*)calloc(max(job.mNumChunks, 1), sizeof(uint64_t));
+
+    if (!job.mSkip || !job.mChunkMatches || !job.mChunkOffsets) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        goto cleanup;
+    }
+
+    // A single branch target only has to look at the chunks that are listed for it
+    for (size_t i = 0; i < job.mNumFilters; i++) {
+        if (filters[i].mColumn == eTracerTraceColumnTarget && !filters[i].mRange) {
+            if (!tracerQuerySkipByTarget(&job, filters[i].mLow)) {
+                goto cleanup;
+            }
+            break;
+        }
+    }
+
+    // Chunks whose value range for any predicate lies outside of it can't match
+    for (size_t i = 0; i < job.mNumChunks; i++) {
+        for (size_t j = 0; j < job.mNumFilters && !job.mSkip[i]; j++) {
+            const TracerQueryFilter* filter = &filters[j];
+            uint64_t low = 0, high = 0;
+
+            if (tracerTraceReaderGetColumnRange(query->mFile, i, filter->mColumn, &low, &high) &&
+                (high < filter->mLow || low > filter->mLow + filter->mRange)) {
+
+                job.mSkip[i] = eTracerTrue;
+            }
+        }
+
+        query->mNumSkippedChunks += job.mSkip[i];
+    }
+
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+
+    numWorkers = query->mNumThreads > 0 ? (size_t)query->mNumThreads : max(systemInfo.dwNumberOfProcessors, 1);
+    numWorkers = min(min(numWorkers, TLIB_TRACE_QUERY_MAX_WORKERS), max(job.mNumChunks, 1));
+
+    workers = (TracerQueryWorker*)calloc(numWorkers, sizeof(TracerQueryWorker));
+
+    if (!workers) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < numWorkers; ++i) {
+        workers[i].mJob = &job;
+        workers[i].mChunk = tracerTraceReaderCreateChunk(query->mFile);
+
+        if (!workers[i].mChunk) {
+            goto cleanup;
+        }
+
+        workers[i].mMask = (uint8_t*)malloc(max(workers[i].mChunk->mMaxRecords, 1));
+
+        if (!workers[i].mMask) {
+            tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+            goto cleanup;
+        }
+    }
+
+    job.mChunkRecords = workers[0].mChunk->mMaxRecords;
+
+    TracerError error = tracerQueryRunPass(&job, workers, numWorkers);
+
+    if (error != eTracerErrorSuccess) {
+        tracerCoreSetLastError(error);
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < job.mNumChunks; i++) {
+        job.mChunkOffsets[i] = query->mNumMatches;
+        query->mNumMatches += job.mChunkMatches[i];
+    }
+
+    if (query->mGroupByField != eTracerTraceFieldNone) {
+        for (size_t i = 1; i < numWorkers; ++i) {
+            const TracerQueryGroupMap* groups = &workers[i].mGroups;
+
+            for (size_t j = 0; j < groups->mCapacity; j++) {
+                if (groups->mGroups[j].mCount &&
+                    !tracerQueryGroupAdd(&workers[0].mGroups, groups->mGroups[j].mValue, groups->mGroups[j].mCount)) {
+
+                    tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+                    goto cleanup;
+                }
+            }
+        }
+
+        tracerQueryFinishGroups(query, &workers[0].mGroups);
+    }
+
+    if (query->mMaxRecords && query->mNumMatches) {
+        job.mCollect = eTracerTrue;
+        error = tracerQueryRunPass(&job, workers, numWorkers);
+
+        if (error != eTracerErrorSuccess) {
+            tracerCoreSetLastError(error);
+            goto cleanup;
+        }
+    }
+
+    result = eTracerTrue;
+
+cleanup:
+    for (size_t i = 0; i < numWorkers && workers; ++i) {
+        if (workers[i].mChunk) {
+            tracerDestroyTraceChunk(workers[i].mChunk);
+        }
+
+        free(workers[i].mMask);
+        free(workers[i].mGroups.mGroups);
+    }
+
+    free(workers);
+    free(job.mChunkOffsets);
+    free(job.mChunkMatches);
+    free(job.mSkip);
+    free(filters);
+    return result;
+}
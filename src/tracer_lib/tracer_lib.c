@@ -2,30 +2,287 @@
 #include <tracer_lib/core.h>
 #include <tracer_lib/process_local.h>
 #include <tracer_lib/process_remote.h>
+#include <tracer_lib/trace_diff.h>
+#include <tracer_lib/trace_file.h>
+#include <tracer_lib/trace_query.h>
 
 #include <stdio.h>
 
-static TracerBool tracerDetachProcessCallback(TracerContext* ctx, void* param) {
-    int processId = tracerProcessGetPid(ctx);
-    if (!processId) {
-        return eTracerFalse;
+static TracerBool tracerCollectContextCallback(TracerContext* ctx, void* param) {
+    TracerContext*** next = (TracerContext***)param;
+
+    tracerProcessAddRef(ctx);
+    *(*next)++ = ctx;
+    return eTracerTrue;
+}
+
+// Returns a reference to the context that the calling thread works on, the lock of the table is
+// only held for the lookup. The context stays valid until it is released, even if it gets detached.
+static TracerContext* tracerAcquireCurrentContext(TracerBool fallbackToLocal) {
+    tracerCoreAcquireProcessContextLock();
+
+    // NULL if another thread detached it
+    TracerContext* ctx = tracerCoreGetProcessContext();
+
+    if (!ctx && fallbackToLocal) {
+        // The own process is always attached with the local context
+        ctx = tracerCoreGetContextForPID((int)GetCurrentProcessId());
+    }
+
+    if (ctx) {
+        tracerProcessAddRef(ctx);
+    }
+
+    tracerCoreReleaseProcessContextLock();
+    return ctx;
+}
+
+// Takes a reference to every attached process, so they can be worked on without holding the table lock
+static TracerContext** tracerAcquireAllContexts(size_t* numContexts) {
+    tracerCoreAcquireProcessContextLock();
+
+    *numContexts = tracerCoreGetNumProcessContexts();
+
+    TracerContext** contexts = (TracerContext**)malloc(max(*numContexts, 1) * sizeof(TracerContext*));
+
+    if (contexts) {
+        TracerContext** next = contexts;
+        tracerCoreEnumProcessContexts(tracerCollectContextCallback, &next, eTracerFalse);
+    } else {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        *numContexts = 0;
     }
 
+    tracerCoreReleaseProcessContextLock();
+    return contexts;
+}
+
+static void tracerReleaseContexts(TracerContext** contexts, size_t numContexts) {
+    for (size_t i = 0; i < numContexts; ++i) {
+        tracerProcessRelease(contexts[i]);
+    }
+    free(contexts);
+}
+
+// The caller holds a reference, the last one tears the process down outside of the table lock
+static TracerBool tracerDetachContext(TracerContext* ctx) {
+    tracerCoreAcquireProcessContextLock();
+
     if (ctx == tracerCoreGetProcessContext()) {
-        tracerCoreSetProcessContext(NULL);
+        tracerCoreSetProcessContext(0, 0);
     }
 
-    tracerCoreSetContextForPID(processId, NULL);
-    tracerCoreDestroyContext(ctx);
-    return eTracerTrue;
+    TracerBool result = tracerCoreSetContextForPID(tracerProcessGetPid(ctx), NULL);
+
+    tracerCoreReleaseProcessContextLock();
+
+    // Drop the reference of the table, threads that still use the process keep it alive
+    if (result) {
+        tracerProcessRelease(ctx);
+    }
+    return result;
 }
 
 static TracerBool tracerStartTraceCallback(TracerContext* ctx, void* param) {
-    return tracerProcessStartTrace(ctx, (TracerStartTrace*)param);
+    tracerProcessLock(ctx);
+    TracerBool result = tracerProcessStartTrace(ctx, (TracerStartTrace*)param);
+    tracerProcessUnlock(ctx);
+    return result;
 }
 
 static TracerBool tracerStopTraceCallback(TracerContext* ctx, void* param) {
-    return tracerProcessStopTrace(ctx, (TracerStopTrace*)param);
+    tracerProcessLock(ctx);
+    TracerBool result = tracerProcessStopTrace(ctx, (TracerStopTrace*)param);
+    tracerProcessUnlock(ctx);
+    return result;
+}
+
+static TracerBool tracerStartWatchCallback(TracerContext* ctx, void* param) {
+    tracerProcessLock(ctx);
+    TracerBool result = tracerProcessStartWatch(ctx, (TracerStartWatch*)param);
+    tracerProcessUnlock(ctx);
+    return result;
+}
+
+static TracerBool tracerStopWatchCallback(TracerContext* ctx, void* param) {
+    tracerProcessLock(ctx);
+    TracerBool result = tracerProcessStopWatch(ctx, (TracerStopWatch*)param);
+    tracerProcessUnlock(ctx);
+    return result;
+}
+
+typedef struct TracerTraceRun {
+    size_t                      mBegin;
+    size_t                      mEnd;
+} TracerTraceRun;
+
+static TracerBool tracerIsRunHeadEarlier(const TracerProcessTracedInstruction* traces,
+    const TracerTraceRun* a, const TracerTraceRun* b) {
+
+    return (traces[a->mBegin].mTrace.mTimestamp < traces[b->mBegin].mTrace.mTimestamp) ? eTracerTrue : eTracerFalse;
+}
+
+static void tracerSiftDownRun(const TracerProcessTracedInstruction* traces,
+    TracerTraceRun* heap, size_t numRuns, size_t index) {
+
+    for (;;) {
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+
+        if (left < numRuns && tracerIsRunHeadEarlier(traces, &heap[left], &heap[smallest])) {
+            smallest = left;
+        }
+        if (right < numRuns && tracerIsRunHeadEarlier(traces, &heap[right], &heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            return;
+        }
+
+        TracerTraceRun temp = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = temp;
+        index = smallest;
+    }
+}
+
+// Every process pushes its traces in the order they were recorded, so each run is sorted already
+// and a k-way merge puts the whole batch in timestamp order
+static TracerBool tracerMergeTraceRuns(TracerProcessTracedInstruction* traces, size_t numTraces,
+    TracerTraceRun* runs, size_t numRuns) {
+
+    if (numRuns < 2) {
+        return eTracerTrue;
+    }
+
+    TracerProcessTracedInstruction* merged = (TracerProcessTracedInstruction*)malloc(
+        numTraces * sizeof(TracerProcessTracedInstruction));
+
+    if (!merged) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        return eTracerFalse;
+    }
+
+    for (size_t i = numRuns / 2; i > 0; --i) {
+        tracerSiftDownRun(traces, runs, numRuns, i - 1);
+    }
+
+    for (size_t i = 0; i < numTraces; ++i) {
+        merged[i] = traces[runs[0].mBegin++];
+
+        if (runs[0].mBegin == runs[0].mEnd) {
+            runs[0] = runs[--numRuns];
+        }
+
+        tracerSiftDownRun(traces, runs, numRuns, 0);
+    }
+
+    memcpy(traces, merged, numTraces * sizeof(TracerProcessTracedInstruction));
+    free(merged);
+    return eTracerTrue;
+}
+
+static size_t tracerDrainContexts(TracerContext** contexts, size_t numContexts,
+    TracerProcessTracedInstruction* outTraces, size_t maxElements, TracerTraceRun* runs, size_t* numRuns) {
+
+    static volatile LONG gNextContext = 0;
+
+    // Start with a different process every time, and only hand each one its share of the space
+    // that is left, so a busy process can't starve the others
+    size_t first = (size_t)InterlockedIncrement(&gNextContext);
+    size_t numTraces = 0;
+
+    *numRuns = 0;
+
+    for (size_t i = 0; i < numContexts && numTraces < maxElements; ++i) {
+        TracerContext* ctx = contexts[(first + i) % numContexts];
+        size_t share = max((maxElements - numTraces) / (numContexts - i), 1);
+
+        tracerProcessLock(ctx);
+        size_t numFetched = tracerProcessFetchTracesTagged(ctx, outTraces + numTraces, share);
+        tracerProcessUnlock(ctx);
+
+        if (numFetched) {
+            runs[*numRuns].mBegin = numTraces;
+            runs[*numRuns].mEnd = numTraces + numFetched;
+            ++*numRuns;
+
+            numTraces += numFetched;
+        }
+    }
+
+    return numTraces;
+}
+
+// Sleeps until one of the processes signals new traces or the timeout elapses
+static void tracerWaitForContexts(TracerContext** contexts, size_t numContexts, HANDLE* events, DWORD timeout) {
+    size_t numEvents = 0;
+    TracerBool mustPoll = eTracerFalse;
+    size_t numPrepared = 0;
+
+    for (; numPrepared < numContexts; ++numPrepared) {
+        HANDLE event = (HANDLE)tracerProcessGetDataEvent(contexts[numPrepared]);
+
+        if (!event) {
+            mustPoll = eTracerTrue;
+            continue;
+        }
+
+        if (!tracerProcessPrepareWaitForTraces(contexts[numPrepared])) {
+            // Traces arrived in the meantime
+            timeout = 0;
+            ++numPrepared;
+            break;
+        }
+
+        events[numEvents++] = event;
+    }
+
+    if (mustPoll || numEvents > MAXIMUM_WAIT_OBJECTS) {
+        timeout = min(timeout, TLIB_PROCESS_POLL_INTERVAL);
+    }
+
+    if (timeout) {
+        if (numEvents) {
+            WaitForMultipleObjects((DWORD)min(numEvents, MAXIMUM_WAIT_OBJECTS), events, FALSE, timeout);
+        } else {
+            Sleep(timeout);
+        }
+    }
+
+    for (size_t i = 0; i < numPrepared; ++i) {
+        tracerProcessCancelWaitForTraces(contexts[i]);
+    }
+}
+
+static TracerBool tracerBroadcast(TracerContextCallback cb, void* param) {
+    TracerContext* ctx = tracerAcquireCurrentContext(eTracerFalse);
+
+    if (ctx) {
+        // The thread picked a process with tracerSetProcessContext
+        TracerBool result = cb(ctx, param);
+        tracerProcessRelease(ctx);
+        return result;
+    }
+
+    size_t numContexts = 0;
+    TracerContext** contexts = tracerAcquireAllContexts(&numContexts);
+
+    if (!contexts) {
+        return eTracerFalse;
+    }
+
+    TracerBool result = eTracerTrue;
+
+    for (size_t i = 0; i < numContexts; ++i) {
+        if (!cb(contexts[i], param)) {
+            result = eTracerFalse;
+        }
+    }
+
+    tracerReleaseContexts(contexts, numContexts);
+    return result;
 }
 
 /*
@@ -155,20 +412,38 @@ TLIB_API TracerContext* TLIB_CALL tracerAttachProcessEx(TracerAttachProcess* att
         pid = currentPid;
     }
 
-    tracerCoreAcquireProcessContextLock();
+    tracerCoreAcquireProcessAttachLock();
 
+    tracerCoreAcquireProcessContextLock();
     TracerContext* ctx = tracerCoreGetContextForPID(pid);
+    tracerCoreReleaseProcessContextLock();
+
+    // Creating the context may take a while, only other attaches and detaches wait for it
     if (!ctx) {
         if (pid == currentPid) {
-            ctx = tracerCreateLocalProcessContext(eTracerProcessContextLocal, sizeof(TracerLocalProcessContext), attach->mSharedMemoryHandle);
+            if (tracerGetLocalProcessContext()) {
+                // Detached, but another thread still holds a reference
+                tracerCoreSetLastError(eTracerErrorInvalidProcess);
+            } else {
+                ctx = tracerCreateLocalProcessContext(eTracerProcessContextLocal, sizeof(TracerLocalProcessContext), attach->mSharedMemoryHandle);
+            }
         } else {
             ctx = tracerCreateRemoteProcessContext(eTracerProcessContextRemote, sizeof(TracerRemoteProcessContext), pid);
         }
 
-        tracerCoreSetContextForPID(pid, ctx);
+        if (ctx) {
+            tracerCoreAcquireProcessContextLock();
+            TracerBool registered = tracerCoreSetContextForPID(pid, ctx);
+            tracerCoreReleaseProcessContextLock();
+
+            if (!registered) {
+                tracerProcessRelease(ctx);
+                ctx = NULL;
+            }
+        }
     }
 
-    tracerCoreReleaseProcessContextLock();
+    tracerCoreReleaseProcessAttachLock();
     return ctx;
 }
 
@@ -176,26 +451,72 @@ TLIB_API TracerBool TLIB_CALL tracerDetachProcess(TracerContext* ctx) {
     tracerCoreSetLastError(eTracerErrorSuccess);
 
     TracerBool result = eTracerFalse;
-    tracerCoreAcquireProcessContextLock();
+    tracerCoreAcquireProcessAttachLock();
 
     if (ctx) {
-        result = tracerDetachProcessCallback(ctx, NULL);
+        tracerCoreAcquireProcessContextLock();
+
+        TracerBool registered = tracerCoreIsContextRegistered(ctx);
+        if (registered) {
+            tracerProcessAddRef(ctx);
+        } else {
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        }
+
+        tracerCoreReleaseProcessContextLock();
+
+        if (registered) {
+            result = tracerDetachContext(ctx);
+            tracerProcessRelease(ctx);
+        }
     } else {
-        result = tracerCoreEnumProcessContexts(tracerDetachProcessCallback, NULL, eTracerFalse);
+        size_t numContexts = 0;
+        TracerContext** contexts = tracerAcquireAllContexts(&numContexts);
+
+        if (contexts) {
+            result = eTracerTrue;
+
+            for (size_t i = 0; i < numContexts; ++i) {
+                if (!tracerDetachContext(contexts[i])) {
+                    result = eTracerFalse;
+                }
+            }
+
+            tracerReleaseContexts(contexts, numContexts);
+        }
     }
 
-    tracerCoreReleaseProcessContextLock();
+    tracerCoreReleaseProcessAttachLock();
     return result;
 }
 
 TLIB_API void TLIB_CALL tracerSetProcessContext(TracerContext* ctx) {
     tracerCoreSetLastError(eTracerErrorSuccess);
-    tracerCoreSetProcessContext(ctx);
+
+    if (ctx && !tracerCoreValidateContext(ctx, eTracerProcessContext)) {
+        return;
+    }
+
+    tracerCoreAcquireProcessContextLock();
+
+    if (ctx) {
+        int pid = tracerProcessGetPid(ctx);
+        tracerCoreSetProcessContext(pid, tracerCoreGetContextGeneration(pid, ctx));
+    } else {
+        tracerCoreSetProcessContext(0, 0);
+    }
+
+    tracerCoreReleaseProcessContextLock();
 }
 
 TLIB_API TracerContext* TLIB_CALL tracerGetProcessContext() {
     tracerCoreSetLastError(eTracerErrorSuccess);
-    return tracerCoreGetProcessContext();
+
+    tracerCoreAcquireProcessContextLock();
+    TracerContext* ctx = tracerCoreGetProcessContext();
+    tracerCoreReleaseProcessContextLock();
+
+    return ctx;
 }
 
 TLIB_API TracerContext* TLIB_CALL tracerGetContextForPid(int pid) {
@@ -234,19 +555,7 @@ TLIB_API TracerBool TLIB_CALL tracerStartTraceEx(TracerStartTrace* startTrace) {
         return eTracerFalse;
     }
 
-    TracerBool result = eTracerFalse;
-    tracerCoreAcquireProcessContextLock();
-
-    TracerContext* ctx = tracerCoreGetProcessContext();
-    if (ctx) {
-        result = tracerStartTraceCallback(ctx, startTrace);
-    } else {
-        result = tracerCoreEnumContexts(tracerStartTraceCallback,
-            startTrace, eTracerProcessContext, eTracerFalse);
-    }
-
-    tracerCoreReleaseProcessContextLock();
-    return result;
+    return tracerBroadcast(tracerStartTraceCallback, startTrace);
 }
 
 TLIB_API TracerBool TLIB_CALL tracerStopTrace(void* functionAddress, int threadId) {
@@ -266,19 +575,49 @@ TLIB_API TracerBool TLIB_CALL tracerStopTraceEx(TracerStopTrace* stopTrace) {
         return eTracerFalse;
     }
 
-    TracerBool result = eTracerFalse;
-    tracerCoreAcquireProcessContextLock();
+    return tracerBroadcast(tracerStopTraceCallback, stopTrace);
+}
 
-    TracerContext* ctx = tracerCoreGetProcessContext();
-    if (ctx) {
-        result = tracerStopTraceCallback(ctx, stopTrace);
-    } else {
-        result = tracerCoreEnumContexts(tracerStopTraceCallback,
-            stopTrace, eTracerProcessContext, eTracerFalse);
+TLIB_API TracerBool TLIB_CALL tracerStartWatch(void* address, int size, TracerWatchCondition condition, int threadId) {
+    TracerStartWatch startWatch = {
+        /* mSizeOfStruct        = */ sizeof(TracerStartWatch),
+        /* mAddress             = */ address,
+        /* mSize                = */ size,
+        /* mCondition           = */ condition,
+        /* mThreadId            = */ threadId,
+    };
+    return tracerStartWatchEx(&startWatch);
+}
+
+TLIB_API TracerBool TLIB_CALL tracerStartWatchEx(TracerStartWatch* startWatch) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!startWatch || startWatch->mSizeOfStruct < sizeof(TracerStartWatch)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
     }
 
-    tracerCoreReleaseProcessContextLock();
-    return result;
+    return tracerBroadcast(tracerStartWatchCallback, startWatch);
+}
+
+TLIB_API TracerBool TLIB_CALL tracerStopWatch(void* address, int threadId) {
+    TracerStopWatch stopWatch = {
+        /* mSizeOfStruct        = */ sizeof(TracerStopWatch),
+        /* mAddress             = */ address,
+        /* mThreadId            = */ threadId,
+    };
+    return tracerStopWatchEx(&stopWatch);
+}
+
+TLIB_API TracerBool TLIB_CALL tracerStopWatchEx(TracerStopWatch* stopWatch) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!stopWatch || stopWatch->mSizeOfStruct < sizeof(TracerStopWatch)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    return tracerBroadcast(tracerStopWatchCallback, stopWatch);
 }
 
 TLIB_API size_t TLIB_CALL tracerFetchTraces(TracerTracedInstruction* outTraces, size_t maxElements) {
@@ -290,20 +629,109 @@ TLIB_API size_t TLIB_CALL tracerFetchTraces(TracerTracedInstruction* outTraces,
     }
 
     size_t result = 0;
-    tracerCoreAcquireProcessContextLock();
-
-    TracerContext* ctx = tracerCoreGetProcessContext();
-    if (!ctx) {
-        ctx = tracerGetLocalProcessContext();
-    }
+    TracerContext* ctx = tracerAcquireCurrentContext(eTracerTrue);
 
     if (ctx) {
+        tracerProcessLock(ctx);
         result = tracerProcessFetchTraces(ctx, outTraces, maxElements);
+        tracerProcessUnlock(ctx);
+
+        tracerProcessRelease(ctx);
     } else {
         tracerCoreSetLastError(eTracerErrorNotImplemented);
     }
 
-    tracerCoreReleaseProcessContextLock();
+    return result;
+}
+
+TLIB_API size_t TLIB_CALL tracerFetchTracesAll(TracerProcessTracedInstruction* outTraces, size_t maxElements, int timeout) {
+    TracerFetchTracesAll fetchAll = {
+        /* mSizeOfStruct        = */ sizeof(TracerFetchTracesAll),
+        /* mOutTraces           = */ outTraces,
+        /* mMaxElements         = */ maxElements,
+        /* mTimeout             = */ timeout,
+        /* mMergeByTimestamp    = */ eTracerFalse,
+        /* mNumTraces           = */ 0,
+    };
+
+    if (tracerFetchTracesAllEx(&fetchAll)) {
+        return fetchAll.mNumTraces;
+    }
+    return 0;
+}
+
+TLIB_API TracerBool TLIB_CALL tracerFetchTracesAllEx(TracerFetchTracesAll* fetchAll) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!fetchAll || fetchAll->mSizeOfStruct < sizeof(TracerFetchTracesAll) ||
+        !fetchAll->mOutTraces || !fetchAll->mMaxElements) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    fetchAll->mNumTraces = 0;
+
+    size_t numContexts = 0;
+    TracerContext** contexts = tracerAcquireAllContexts(&numContexts);
+
+    if (!contexts) {
+        return eTracerFalse;
+    }
+
+    if (!numContexts) {
+        tracerCoreSetLastError(eTracerErrorNotImplemented);
+        free(contexts);
+        return eTracerFalse;
+    }
+
+    TracerBool result = eTracerFalse;
+
+    TracerTraceRun* runs = (TracerTraceRun*)malloc(numContexts * sizeof(TracerTraceRun));
+    HANDLE* events = (HANDLE*)malloc(numContexts * sizeof(HANDLE));
+
+    if (!runs || !events) {
+        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        goto cleanup;
+    }
+
+    DWORD startTime = GetTickCount();
+    size_t numRuns = 0;
+
+    for (;;) {
+        fetchAll->mNumTraces = tracerDrainContexts(contexts, numContexts,
+            fetchAll->mOutTraces, fetchAll->mMaxElements, runs, &numRuns);
+
+        if (fetchAll->mNumTraces || !fetchAll->mTimeout) {
+            break;
+        }
+
+        DWORD timeout = INFINITE;
+
+        if (fetchAll->mTimeout > 0) {
+            DWORD elapsed = GetTickCount() - startTime;
+
+            if (elapsed >= (DWORD)fetchAll->mTimeout) {
+                tracerCoreSetLastError(eTracerErrorWaitTimeout);
+                goto cleanup;
+            }
+            timeout = (DWORD)fetchAll->mTimeout - elapsed;
+        }
+
+        tracerWaitForContexts(contexts, numContexts, events, timeout);
+    }
+
+    result = eTracerTrue;
+
+    if (fetchAll->mMergeByTimestamp) {
+        result = tracerMergeTraceRuns(fetchAll->mOutTraces, fetchAll->mNumTraces, runs, numRuns);
+    }
+
+cleanup:
+    free(events);
+    free(runs);
+
+    tracerReleaseContexts(contexts, numContexts);
     return result;
 }
 
@@ -337,20 +765,18 @@ TLIB_API const char* TLIB_CALL tracerDecodeAndFormatInstructionEx(TracerDecodeAn
     }
 
     const char* result = NULL;
-    tracerCoreAcquireProcessContextLock();
-
-    TracerContext* ctx = tracerCoreGetProcessContext();
-    if (!ctx) {
-        ctx = tracerGetLocalProcessContext();
-    }
+    TracerContext* ctx = tracerAcquireCurrentContext(eTracerTrue);
 
     if (ctx) {
+        tracerProcessLock(ctx);
         result = tracerProcessDecodeAndFormatInstruction(ctx, decodeAndFmt);
+        tracerProcessUnlock(ctx);
+
+        tracerProcessRelease(ctx);
     } else {
         tracerCoreSetLastError(eTracerErrorNotImplemented);
     }
 
-    tracerCoreReleaseProcessContextLock();
     return result;
 }
 
@@ -384,19 +810,205 @@ TLIB_API TracerBool TLIB_CALL tracerGetSymbolAddressFromSymbolNameEx(TracerGetSy
     }
 
     TracerBool result = eTracerFalse;
-    tracerCoreAcquireProcessContextLock();
+    TracerContext* ctx = tracerAcquireCurrentContext(eTracerTrue);
 
-    TracerContext* ctx = tracerCoreGetProcessContext();
-    if (!ctx) {
-        ctx = tracerGetLocalProcessContext();
+    if (ctx) {
+        tracerProcessLock(ctx);
+        result = tracerProcessGetSymbolAddressFromSymbolName(ctx, addrFromName);
+        tracerProcessUnlock(ctx);
+
+        tracerProcessRelease(ctx);
+    } else {
+        tracerCoreSetLastError(eTracerErrorNotImplemented);
+    }
+
+    return result;
+}
+
+TLIB_API size_t TLIB_CALL tracerSymbolizeAddresses(const uintptr_t* addresses, size_t numAddresses, TracerSymbolInfo* outSymbols) {
+    TracerSymbolizeAddresses symbolize = {
+        /* mSizeOfStruct        = */ sizeof(TracerSymbolizeAddresses),
+        /* mAddresses           = */ addresses,
+        /* mNumAddresses        = */ numAddresses,
+        /* mOutSymbols          = */ outSymbols,
+        /* mNumResolved         = */ 0,
+    };
+
+    if (tracerSymbolizeAddressesEx(&symbolize)) {
+        return symbolize.mNumResolved;
+    }
+    return 0;
+}
+
+TLIB_API TracerBool TLIB_CALL tracerSymbolizeAddressesEx(TracerSymbolizeAddresses* symbolize) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!symbolize || symbolize->mSizeOfStruct < sizeof(TracerSymbolizeAddresses) ||
+        (symbolize->mNumAddresses && (!symbolize->mAddresses || !symbolize->mOutSymbols))) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
     }
 
+    TracerBool result = eTracerFalse;
+    TracerContext* ctx = tracerAcquireCurrentContext(eTracerTrue);
+
     if (ctx) {
-        result = tracerProcessGetSymbolAddressFromSymbolName(ctx, addrFromName);
+        tracerProcessLock(ctx);
+        result = tracerProcessSymbolizeAddresses(ctx, symbolize);
+        tracerProcessUnlock(ctx);
+
+        tracerProcessRelease(ctx);
     } else {
         tracerCoreSetLastError(eTracerErrorNotImplemented);
     }
 
-    tracerCoreReleaseProcessContextLock();
     return result;
 }
+
+TLIB_API TracerBool TLIB_CALL tracerGetStatistics(TracerStatistics* statistics) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!statistics || statistics->mSizeOfStruct < sizeof(TracerStatistics)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    TracerBool result = eTracerFalse;
+    TracerContext* ctx = tracerAcquireCurrentContext(eTracerTrue);
+
+    if (ctx) {
+        tracerProcessLock(ctx);
+        result = tracerProcessGetStatistics(ctx, statistics);
+        tracerProcessUnlock(ctx);
+
+        tracerProcessRelease(ctx);
+    } else {
+        tracerCoreSetLastError(eTracerErrorNotImplemented);
+    }
+
+    return result;
+}
+
+TLIB_API TracerHandle TLIB_CALL tracerOpenTraceWriter(const char* path, TracerBool deduplicate, TracerBool indexTargets) {
+    TracerOpenTraceWriter open = {
+        /* mSizeOfStruct        = */ sizeof(TracerOpenTraceWriter),
+        /* mPath                = */ path,
+        /* mDeduplicate         = */ deduplicate,
+        /* mIndexTargets        = */ indexTargets,
+    };
+
+    return tracerOpenTraceWriterEx(&open);
+}
+
+TLIB_API TracerHandle TLIB_CALL tracerOpenTraceWriterEx(TracerOpenTraceWriter* open) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!open || open->mSizeOfStruct < sizeof(TracerOpenTraceWriter)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return NULL;
+    }
+
+    return tracerCreateTraceWriter(open->mPath, open->mDeduplicate, open->mIndexTargets);
+}
+
+TLIB_API TracerBool TLIB_CALL tracerWriteTraces(TracerHandle writer, const TracerTracedInstruction* traces, size_t numTraces) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+    return tracerTraceWriterAppend(writer, traces, numTraces);
+}
+
+TLIB_API TracerBool TLIB_CALL tracerSetTraceWriterStatistics(TracerHandle writer, const TracerStatistics* statistics) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!statistics || statistics->mSizeOfStruct < sizeof(TracerStatistics)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    return tracerTraceWriterSetStatistics(writer, statistics);
+}
+
+TLIB_API TracerBool TLIB_CALL tracerCloseTraceWriter(TracerHandle writer) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+    return tracerDestroyTraceWriter(writer);
+}
+
+TLIB_API TracerHandle TLIB_CALL tracerOpenTraceFile(const char* path) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+    return tracerCreateTraceReader(path);
+}
+
+TLIB_API void TLIB_CALL tracerCloseTraceFile(TracerHandle file) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+    tracerDestroyTraceReader(file);
+}
+
+TLIB_API uint64_t TLIB_CALL tracerGetTraceFileRecordCount(TracerHandle file) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+    return tracerTraceReaderGetNumRecords(file);
+}
+
+TLIB_API TracerBool TLIB_CALL tracerGetTraceFileStatistics(TracerHandle file, TracerStatistics* statistics) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!statistics || statistics->mSizeOfStruct < sizeof(TracerStatistics)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    statistics->mThreadId = -1;
+    return tracerTraceReaderGetStatistics(file, statistics);
+}
+
+TLIB_API size_t TLIB_CALL tracerReadTraceFile(TracerHandle file, uint64_t firstRecord, TracerTracedInstruction* outTraces, size_t maxElements) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+    return tracerTraceReaderRead(file, firstRecord, outTraces, maxElements);
+}
+
+TLIB_API TracerBool TLIB_CALL tracerDiffTraceFiles(TracerDiffTraces* diff) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!diff || diff->mSizeOfStruct < sizeof(TracerDiffTraces) || !diff->mLeftFile || !diff->mRightFile) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    return tracerTraceDiff(diff);
+}
+
+TLIB_API uint64_t TLIB_CALL tracerQueryTraceFile(TracerHandle file, const TracerQueryPredicate* predicates, size_t numPredicates) {
+    TracerQueryTraceFile query = {
+        /* mSizeOfStruct        = */ sizeof(TracerQueryTraceFile),
+        /* mFile                = */ file,
+        /* mPredicates          = */ predicates,
+        /* mNumPredicates       = */ numPredicates,
+        /* mGroupByField        = */ eTracerTraceFieldNone,
+        /* mOutGroups           = */ NULL,
+        /* mMaxGroups           = */ 0,
+        /* mOutRecords          = */ NULL,
+        /* mMaxRecords          = */ 0,
+        /* mNumThreads          = */ 0,
+        /* mNumMatches          = */ 0,
+        /* mNumGroups           = */ 0,
+        /* mNumSkippedChunks    = */ 0,
+    };
+
+    if (tracerQueryTraceFileEx(&query)) {
+        return query.mNumMatches;
+    }
+    return 0;
+}
+
+TLIB_API TracerBool TLIB_CALL tracerQueryTraceFileEx(TracerQueryTraceFile* query) {
+    tracerCoreSetLastError(eTracerErrorSuccess);
+
+    if (!query || query->mSizeOfStruct < sizeof(TracerQueryTraceFile) || !query->mFile ||
+        (query->mNumPredicates && !query->mPredicates) || (query->mMaxGroups && !query->mOutGroups) ||
+        (query->mMaxRecords && !query->mOutRecords)) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    return tracerTraceQuery(query);
+}
@@ -2,10 +2,13 @@
 #include <tracer_lib/vetrace.h>
 #include <tracer_lib/hwbp.h>
 #include <tracer_lib/process_local.h>
+#include <tracer_lib/lde.h>
 #include <tracer_lib/rwqueue.h>
+#include <tracer_lib/pool.h>
 
 #include <stdio.h>
 #include <assert.h>
+#include <intrin.h>
 
 #include <TlHelp32.h>
 
@@ -18,6 +21,11 @@
 
 #define TLIB_VETRACE_EFLAGS_SINGLE_STEP      0x100       // Single Step Flag (Trap on next instruction)
 
+#define TLIB_VETRACE_DR6_HIT_MASK            0xF         // Breakpoint condition detected (Bits 0 to 3 in DR6)
+#define TLIB_VETRACE_DR6_SINGLE_STEP         0x4000      // Single step (Bit 14 in DR6)
+
+#define TLIB_VETRACE_MAX_STACK_FRAMES        1024        // Watch hits stop counting frames after this many
+
 static TracerBool tracerVeTraceInit(TracerContext* ctx);
 
 static TracerBool tracerVeTraceShutdown(TracerContext* ctx);
@@ -26,8 +34,17 @@ static TracerBool tracerVeTraceStart(TracerContext* ctx, void* address, int thre
 
 static TracerBool tracerVeTraceStop(TracerContext* ctx, void* address, int threadId);
 
+static TracerBool tracerVeTraceGetStatistics(TracerContext* ctx, TracerStatistics* statistics);
+
+static TracerBool tracerVeTraceStartWatch(TracerContext* ctx, void* address, int size, TracerWatchCondition condition, int threadId);
+
+static TracerBool tracerVeTraceStopWatch(TracerContext* ctx, void* address, int threadId);
+
 static void tracerVeTraceSetFlags(PCONTEXT context, TracerBool enable);
 
+static LONG tracerVeTraceHandleSingleStep(TracerLocalProcessContext* process,
+    TracerVeTraceContext* trace, PEXCEPTION_POINTERS ex, TracerStatistics* statistics);
+
 static LONG CALLBACK tracerVeTraceHandler(PEXCEPTION_POINTERS ex);
 
 TracerContext* tracerCreateVeTraceContext(int type, int size, TracerHandle traceQueue) {
@@ -44,6 +61,9 @@ TracerContext* tracerCreateVeTraceContext(int type, int size, TracerHandle trace
     TracerTraceContext* trace = (TracerTraceContext*)ctx;
     trace->mStartTrace = tracerVeTraceStart;
     trace->mStopTrace = tracerVeTraceStop;
+    trace->mGetStatistics = tracerVeTraceGetStatistics;
+    trace->mStartWatch = tracerVeTraceStartWatch;
+    trace->mStopWatch = tracerVeTraceStopWatch;
 
     TracerVeTraceContext* veTrace = (TracerVeTraceContext*)ctx;
     veTrace->mSharedRWQueue = traceQueue;
@@ -67,6 +87,19 @@ void tracerCleanupVeTraceContext(TracerContext* ctx) {
 static TracerBool tracerVeTraceInit(TracerContext* ctx) {
     TracerVeTraceContext* trace = (TracerVeTraceContext*)ctx;
     InitializeCriticalSection(&trace->mTraceCritSect);
+    InitializeCriticalSection(&trace->mPushCritSect);
+
+    trace->mActiveTracePool = tracerCreatePool(sizeof(TracerActiveTrace), 0, TLIB_VETRACE_MAX_ACTIVE_TRACES);
+
+    if (!trace->mActiveTracePool) {
+        return eTracerFalse;
+    }
+
+    trace->mActiveWatchPool = tracerCreatePool(sizeof(TracerActiveWatch), 0, TLIB_VETRACE_MAX_ACTIVE_WATCHES);
+
+    if (!trace->mActiveWatchPool) {
+        return eTracerFalse;
+    }
 
     // Register the VEH. To avoid unwanted calls, make sure it is the last handler in the chain.
     trace->mAddVehHandle = AddVectoredExceptionHandler(TRUE, tracerVeTraceHandler);
@@ -86,6 +119,20 @@ static TracerBool tracerVeTraceShutdown(TracerContext* ctx) {
         trace->mAddVehHandle = NULL;
     }
 
+    if (trace->mActiveTracePool) {
+        // Whatever is still in the list goes away together with the pool
+        tracerDestroyPool(trace->mActiveTracePool);
+        trace->mActiveTracePool = NULL;
+        trace->mActiveTraces = NULL;
+    }
+
+    if (trace->mActiveWatchPool) {
+        tracerDestroyPool(trace->mActiveWatchPool);
+        trace->mActiveWatchPool = NULL;
+        trace->mActiveWatches = NULL;
+    }
+
+    DeleteCriticalSection(&trace->mPushCritSect);
     DeleteCriticalSection(&trace->mTraceCritSect);
     return eTracerTrue;
 }
@@ -176,13 +223,13 @@ static TracerBool tracerVeTraceStart(TracerContext* ctx, void* address, int thre
         return eTracerFalse;
     }
 
-    TracerActiveTrace* activeTrace = (TracerActiveTrace*)malloc(sizeof(TracerActiveTrace));
+    TracerActiveTrace* activeTrace = (TracerActiveTrace*)tracerPoolAlloc(trace->mActiveTracePool);
     if (!activeTrace) {
         tracerRemoveHwBreakpoint(breakpoint);
 
         LeaveCriticalSection(&trace->mTraceCritSect);
 
-        tracerCoreSetLastError(eTracerErrorNotEnoughMemory);
+        tracerCoreSetLastError(eTracerErrorOutOfResources);
         return eTracerFalse;
     }
 
@@ -233,7 +280,7 @@ static TracerBool tracerVeTraceStop(TracerContext* ctx, void* address, int threa
                 trace->mCurrentTrace = NULL;
             }
 
-            free(activeTrace);
+            tracerPoolFree(trace->mActiveTracePool, activeTrace);
             activeTrace = NULL;
 
             result = eTracerTrue;
@@ -249,6 +296,236 @@ static TracerBool tracerVeTraceStop(TracerContext* ctx, void* address, int threa
     return result;
 }
 
+static TracerBool tracerVeTraceStartWatch(TracerContext* ctx, void* address, int size, TracerWatchCondition condition, int threadId) {
+    if (!tracerCoreValidateContext(ctx, eTracerTraceContextVEH)) {
+        return eTracerFalse;
+    }
+
+    // The debug registers only match naturally aligned data of up to four bytes
+    if (!address || (size != 1 && size != 2 && size != 4) || ((uintptr_t)address & (size - 1)) ||
+        (condition != eTracerWatchWrite && condition != eTracerWatchReadWrite)) {
+
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    uint32_t value = 0;
+
+    if (!ReadProcessMemory(GetCurrentProcess(), address, &value, size, NULL)) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+        return eTracerFalse;
+    }
+
+    TracerVeTraceContext* trace = (TracerVeTraceContext*)ctx;
+    EnterCriticalSection(&trace->mTraceCritSect);
+
+    for (TracerActiveWatch* watch = trace->mActiveWatches; watch; watch = watch->mNextLink) {
+        if (watch->mAddress == address && watch->mThreadId == threadId) {
+            LeaveCriticalSection(&trace->mTraceCritSect);
+
+            tracerCoreSetLastError(eTracerErrorInvalidArgument);
+            return eTracerFalse;
+        }
+    }
+
+    TracerHandle breakpoint = NULL;
+
+    if (threadId >= 0) {
+        breakpoint = tracerSetHwBreakpointOnThread(address, size, threadId, (TracerHwBpCond)condition);
+    } else {
+        breakpoint = tracerSetHwBreakpointGlobal(address, size, (TracerHwBpCond)condition);
+    }
+
+    if (!breakpoint) {
+        LeaveCriticalSection(&trace->mTraceCritSect);
+
+        tracerCoreSetLastError(eTracerErrorOutOfResources);
+        return eTracerFalse;
+    }
+
+    TracerActiveWatch* watch = (TracerActiveWatch*)tracerPoolAlloc(trace->mActiveWatchPool);
+    if (!watch) {
+        tracerRemoveHwBreakpoint(breakpoint);
+
+        LeaveCriticalSection(&trace->mTraceCritSect);
+
+        tracerCoreSetLastError(eTracerErrorOutOfResources);
+        return eTracerFalse;
+    }
+
+    watch->mAddress = address;
+    watch->mSize = size;
+    watch->mThreadId = threadId;
+    watch->mLastValue = value;
+    watch->mBreakpoint = breakpoint;
+    watch->mNextLink = trace->mActiveWatches;
+
+    trace->mActiveWatches = watch;
+
+    LeaveCriticalSection(&trace->mTraceCritSect);
+
+    return eTracerTrue;
+}
+
+static TracerBool tracerVeTraceStopWatch(TracerContext* ctx, void* address, int threadId) {
+    if (!tracerCoreValidateContext(ctx, eTracerTraceContextVEH)) {
+        return eTracerFalse;
+    }
+
+    TracerBool result = eTracerFalse;
+
+    TracerVeTraceContext* trace = (TracerVeTraceContext*)ctx;
+    EnterCriticalSection(&trace->mTraceCritSect);
+
+    TracerActiveWatch** link = &trace->mActiveWatches;
+
+    while (*link) {
+        TracerActiveWatch* watch = *link;
+
+        if (watch->mAddress == address && watch->mThreadId == threadId) {
+            tracerRemoveHwBreakpoint(watch->mBreakpoint);
+
+            *link = watch->mNextLink;
+            tracerPoolFree(trace->mActiveWatchPool, watch);
+
+            result = eTracerTrue;
+            break;
+        }
+
+        link = &watch->mNextLink;
+    }
+
+    LeaveCriticalSection(&trace->mTraceCritSect);
+
+    if (!result) {
+        tracerCoreSetLastError(eTracerErrorInvalidArgument);
+    }
+    return result;
+}
+
+static TracerStatistics* tracerVeFindThreadStatistics(TracerVeTraceContext* trace, int threadId, TracerBool claim) {
+    // Thread ids are multiples of 4, so drop the lower bits before hashing
+    int startSlot = (threadId >> 2) % TLIB_VETRACE_MAX_THREAD_STATISTICS;
+
+    for (int i = 0; i < TLIB_VETRACE_MAX_THREAD_STATISTICS; ++i) {
+        TracerStatistics* slot = &trace->mThreadStatistics[(startSlot + i) % TLIB_VETRACE_MAX_THREAD_STATISTICS];
+
+        if (slot->mThreadId == threadId) {
+            return slot;
+        }
+
+        if (claim && !slot->mThreadId && InterlockedCompareExchange(
+                (volatile LONG*)&slot->mThreadId, (LONG)threadId, 0) == 0) {
+
+            // We claimed a free slot for this thread
+            slot->mSizeOfStruct = sizeof(TracerStatistics);
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+static void tracerVeAccumulateStatistics(TracerStatistics* total, const TracerStatistics* statistics) {
+    total->mSingleStepExceptions += statistics->mSingleStepExceptions;
+    total->mIgnoredTraceEntries += statistics->mIgnoredTraceEntries;
+    total->mQueueFullStalls += statistics->mQueueFullStalls;
+    total->mQueueStallCycles += statistics->mQueueStallCycles;
+    total->mDecodeFailures += statistics->mDecodeFailures;
+    total->mBreakpointSuspensions += statistics->mBreakpointSuspensions;
+    total->mHandlerCycles += statistics->mHandlerCycles;
+    total->mReturnMismatches += statistics->mReturnMismatches;
+}
+
+static void tracerVeAtomicAdd64(volatile uint64_t* value, uint64_t addend) {
+    // The intrinsic compiles to cmpxchg8b, kernel32 only exports InterlockedCompareExchange64 since Vista
+    LONGLONG previous;
+
+    do {
+        previous = *(volatile LONGLONG*)value;
+    } while (_InterlockedCompareExchange64((volatile LONGLONG*)value, previous + (LONGLONG)addend, previous) != previous);
+}
+
+// The overflow slot is shared between threads, so its counters are only updated atomically
+static void tracerVeAccumulateSharedStatistics(TracerStatistics* total, const TracerStatistics* statistics) {
+    tracerVeAtomicAdd64(&total->mSingleStepExceptions, statistics->mSingleStepExceptions);
+    tracerVeAtomicAdd64(&total->mIgnoredTraceEntries, statistics->mIgnoredTraceEntries);
+    tracerVeAtomicAdd64(&total->mQueueFullStalls, statistics->mQueueFullStalls);
+    tracerVeAtomicAdd64(&total->mQueueStallCycles, statistics->mQueueStallCycles);
+    tracerVeAtomicAdd64(&total->mDecodeFailures, statistics->mDecodeFailures);
+    tracerVeAtomicAdd64(&total->mBreakpointSuspensions, statistics->mBreakpointSuspensions);
+    tracerVeAtomicAdd64(&total->mHandlerCycles, statistics->mHandlerCycles);
+    tracerVeAtomicAdd64(&total->mReturnMismatches, statistics->mReturnMismatches);
+}
+
+// Only called once the exception turned out to be ours, single steps of a debugger don't take a slot
+static void tracerVeCommitThreadStatistics(TracerVeTraceContext* trace, const TracerStatistics* statistics) {
+    TracerStatistics* slot = tracerVeFindThreadStatistics(trace, (int)GetCurrentThreadId(), eTracerTrue);
+
+    if (slot) {
+        tracerVeAccumulateStatistics(slot, statistics);
+    } else {
+        // All slots are in use, share the overflow slot with other threads
+        tracerVeAccumulateSharedStatistics(&trace->mOverflowStatistics, statistics);
+    }
+}
+
+void tracerVeTraceOnThreadDetach() {
+    TracerLocalProcessContext* process = (TracerLocalProcessContext*)tracerGetLocalProcessContext();
+
+    if (!process || !process->mTraceContext) {
+        return;
+    }
+
+    TracerVeTraceContext* trace = (TracerVeTraceContext*)process->mTraceContext;
+    TracerStatistics* slot = tracerVeFindThreadStatistics(trace, (int)GetCurrentThreadId(), eTracerFalse);
+
+    if (!slot) {
+        return;
+    }
+
+    // Keep the counts in the totals and free the slot, a later thread may get the same id
+    tracerVeAccumulateSharedStatistics(&trace->mOverflowStatistics, slot);
+
+    TracerStatistics released;
+    memset(&released, 0, sizeof(released));
+    released.mThreadId = slot->mThreadId;
+
+    *slot = released;
+    InterlockedExchange((volatile LONG*)&slot->mThreadId, 0);
+}
+
+static TracerBool tracerVeTraceGetStatistics(TracerContext* ctx, TracerStatistics* statistics) {
+    if (!tracerCoreValidateContext(ctx, eTracerTraceContextVEH)) {
+        return eTracerFalse;
+    }
+
+    TracerVeTraceContext* trace = (TracerVeTraceContext*)ctx;
+
+    TracerStatistics total;
+    memset(&total, 0, sizeof(total));
+
+    for (int i = 0; i < TLIB_VETRACE_MAX_THREAD_STATISTICS; ++i) {
+        const TracerStatistics* slot = &trace->mThreadStatistics[i];
+
+        if (slot->mThreadId && (statistics->mThreadId == -1 || slot->mThreadId == statistics->mThreadId)) {
+            tracerVeAccumulateStatistics(&total, slot);
+        }
+    }
+
+    if (statistics->mThreadId == -1) {
+        tracerVeAccumulateStatistics(&total, &trace->mOverflowStatistics);
+        total.mUnarmedThreads = tracerHwBreakpointGetNumUnarmedThreads();
+    }
+
+    // Keep the header fields that were passed by the caller
+    total.mSizeOfStruct = statistics->mSizeOfStruct;
+    total.mThreadId = statistics->mThreadId;
+
+    *statistics = total;
+    return eTracerTrue;
+}
+
 static void tracerVeRemoveCurrentTrace(TracerContext* ctx, PCONTEXT registers) {
     if (!tracerCoreValidateContext(ctx, eTracerTraceContextVEH)) {
         return;
@@ -272,7 +549,7 @@ static void tracerVeRemoveCurrentTrace(TracerContext* ctx, PCONTEXT registers) {
                 trace->mActiveTraces = next;
             }
 
-            free(activeTrace);
+            tracerPoolFree(trace->mActiveTracePool, activeTrace);
             break;
         }
 
@@ -339,7 +616,151 @@ static TracerActiveTrace* tracerVeGetTraceForAddress(TracerContext* ctx, uintptr
     return NULL;
 }
 
-static TracerBool tracerVeTraceInstruction(TracerContext* ctx, PEXCEPTION_POINTERS ex, TracerBool triggeredByBreakpoint, void** resumeAddress) {
+static void tracerVeCaptureRegisters(const CONTEXT* context, TracerRegisterSet* registers) {
+    registers->mEAX = context->Eax;
+    registers->mEBX = context->Ebx;
+    registers->mECX = context->Ecx;
+    registers->mEDX = context->Edx;
+    registers->mESI = context->Esi;
+    registers->mEDI = context->Edi;
+    registers->mEBP = context->Ebp;
+    registers->mESP = context->Esp;
+
+    registers->mSegGS = context->SegGs;
+    registers->mSegFS = context->SegFs;
+    registers->mSegES = context->SegEs;
+    registers->mSegDS = context->SegDs;
+    registers->mSegCS = context->SegCs;
+    registers->mSegSS = context->SegSs;
+}
+
+// The queue has a single writer, the traced thread and the threads that hit a watch take turns
+static TracerBool tracerVeTryPushTrace(TracerVeTraceContext* trace, const TracerTracedInstruction* inst) {
+    EnterCriticalSection(&trace->mPushCritSect);
+    TracerBool pushed = tracerRWQueuePushItem(trace->mSharedRWQueue, inst);
+    LeaveCriticalSection(&trace->mPushCritSect);
+    return pushed;
+}
+
+static void tracerVePushTrace(TracerVeTraceContext* trace, const TracerTracedInstruction* inst, TracerStatistics* statistics) {
+    if (!tracerVeTryPushTrace(trace, inst)) {
+        // The reader can't keep up with us, wait until there is free space in the queue
+        uint64_t stallStart = __rdtsc();
+
+        do {
+            Sleep(1);
+        } while (!tracerVeTryPushTrace(trace, inst));
+
+        statistics->mQueueFullStalls++;
+        statistics->mQueueStallCycles += __rdtsc() - stallStart;
+    }
+}
+
+static int tracerVeCountStackFrames(const CONTEXT* context) {
+    NT_TIB* tib = (NT_TIB*)NtCurrentTeb();
+
+    uintptr_t stackLimit = (uintptr_t)tib->StackLimit;
+    uintptr_t stackBase = (uintptr_t)tib->StackBase;
+
+    uintptr_t frame = (uintptr_t)context->Ebp;
+    int depth = 0;
+
+    // Follows the saved frame pointers, functions built without frame pointers end the walk early
+    while (depth < TLIB_VETRACE_MAX_STACK_FRAMES && !(frame & (sizeof(uintptr_t) - 1)) &&
+           frame >= stackLimit && frame + 2 * sizeof(uintptr_t) <= stackBase) {
+
+        uintptr_t next = *(const uintptr_t*)frame;
+        depth++;
+
+        if (next <= frame) {
+            break;
+        }
+        frame = next;
+    }
+
+    return depth;
+}
+
+static uint32_t tracerVeReadWatchedValue(const void* address, int size) {
+    switch (size) {
+    case 1: return *(const volatile uint8_t*)address;
+    case 2: return *(const volatile uint16_t*)address;
+    default: return *(const volatile uint32_t*)address;
+    }
+}
+
+static TracerBool tracerVeHandleWatchHits(TracerVeTraceContext* trace, PEXCEPTION_POINTERS ex, TracerStatistics* statistics) {
+    PCONTEXT context = ex->ContextRecord;
+
+    if (!(context->Dr6 & TLIB_VETRACE_DR6_HIT_MASK) || !trace->mActiveWatches) {
+        return eTracerFalse;
+    }
+
+    int threadId = (int)GetCurrentThreadId();
+    TracerBool handled = eTracerFalse;
+
+    for (int index = 0; index < 4; ++index) {
+
+        // Execute breakpoints have a condition of zero, they belong to the trace logic
+        if (!(context->Dr6 & (1 << index)) || !tracerHwBreakpointGetBits(context->Dr7, 16 | (index << 2), 2)) {
+            continue;
+        }
+
+        void* address = NULL;
+
+        switch (index) {
+        case 0: address = (void*)context->Dr0; break;
+        case 1: address = (void*)context->Dr1; break;
+        case 2: address = (void*)context->Dr2; break;
+        case 3: address = (void*)context->Dr3; break;
+        }
+
+        TracerBool found = eTracerFalse;
+
+        TracerTracedInstruction inst;
+
+        EnterCriticalSection(&trace->mTraceCritSect);
+
+        for (TracerActiveWatch* watch = trace->mActiveWatches; watch; watch = watch->mNextLink) {
+            if (watch->mAddress == address && (watch->mThreadId == -1 || watch->mThreadId == threadId)) {
+
+                // Data breakpoints trap after the access, the new value is already in place
+                inst.mOldValue = watch->mLastValue;
+                inst.mNewValue = tracerVeReadWatchedValue(address, watch->mSize);
+
+                watch->mLastValue = inst.mNewValue;
+                found = eTracerTrue;
+                break;
+            }
+        }
+
+        LeaveCriticalSection(&trace->mTraceCritSect);
+
+        if (!found) {
+            continue;
+        }
+
+        inst.mType = eTracerInstructionTypeWatch;
+        inst.mTraceId = tracerCoreGetCurrentTraceId();
+        inst.mThreadId = threadId;
+        inst.mCallDepth = tracerVeCountStackFrames(context);
+        inst.mBranchSource = (uintptr_t)address;
+        inst.mBranchTarget = (uintptr_t)ex->ExceptionRecord->ExceptionAddress;
+        inst.mTimestamp = __rdtsc();
+
+        tracerVeCaptureRegisters(context, &inst.mRegisterSet);
+        tracerVePushTrace(trace, &inst, statistics);
+
+        context->Dr6 &= ~(1 << index);
+        handled = eTracerTrue;
+    }
+
+    return handled;
+}
+
+static TracerBool tracerVeTraceInstruction(TracerContext* ctx, PEXCEPTION_POINTERS ex,
+    TracerBool triggeredByBreakpoint, void** resumeAddress, TracerStatistics* statistics) {
+
     TracerVeTraceContext* trace = (TracerVeTraceContext*)ctx;
 
     if (!trace->mCurrentTrace) {
@@ -353,21 +774,19 @@ static TracerBool tracerVeTraceInstruction(TracerContext* ctx, PEXCEPTION_POINTE
         return eTracerTrue;
     }
 
-    TracerLocalProcessContext* process = (TracerLocalProcessContext*)tracerGetLocalProcessContext();
+    // Only the length and the kind of the branch are needed here, no need for a full decode
+    TracerLdeInstruction decodedInst;
 
-    ZydisDecodedInstruction decodedInst;
-
-    if (ZydisDecoderDecodeBuffer(
-            &process->mDecoder,
-            (void*)lastBranchAddress,
-            ZYDIS_MAX_INSTRUCTION_LENGTH,
-            lastBranchAddress,
-            &decodedInst) != ZYDIS_STATUS_SUCCESS) {
+    if (!tracerLdeDecode((const uint8_t*)lastBranchAddress, TLIB_LDE_MAX_INSTRUCTION_SIZE,
+            TLIB_LDE_MODE_NATIVE, &decodedInst)) {
 
+        statistics->mDecodeFailures++;
         return eTracerFalse;
     }
 
-    TracerBool continueTrace = eTracerFalse;
+    uintptr_t stackPointer = (uintptr_t)ex->ContextRecord->Esp;
+
+    TracerBool returnMatched = eTracerFalse;
 
     TracerTracedInstruction inst;
     inst.mTraceId = tracerCoreGetCurrentTraceId();
@@ -375,206 +794,243 @@ static TracerBool tracerVeTraceInstruction(TracerContext* ctx, PEXCEPTION_POINTE
 
     inst.mBranchSource = (uintptr_t)ex->ExceptionRecord->ExceptionInformation[0];
     inst.mBranchTarget = (uintptr_t)ex->ExceptionRecord->ExceptionAddress;
+    inst.mTimestamp = __rdtsc();
+
+    inst.mOldValue = 0;
+    inst.mNewValue = 0;
 
-    inst.mRegisterSet.mEAX = ex->ContextRecord->Eax;
-    inst.mRegisterSet.mEBX = ex->ContextRecord->Ebx;
-    inst.mRegisterSet.mECX = ex->ContextRecord->Ecx;
-    inst.mRegisterSet.mEDX = ex->ContextRecord->Edx;
-    inst.mRegisterSet.mESI = ex->ContextRecord->Esi;
-    inst.mRegisterSet.mEDI = ex->ContextRecord->Edi;
-    inst.mRegisterSet.mEBP = ex->ContextRecord->Ebp;
-    inst.mRegisterSet.mESP = ex->ContextRecord->Esp;
-
-    inst.mRegisterSet.mSegGS = ex->ContextRecord->SegGs;
-    inst.mRegisterSet.mSegFS = ex->ContextRecord->SegFs;
-    inst.mRegisterSet.mSegES = ex->ContextRecord->SegEs;
-    inst.mRegisterSet.mSegDS = ex->ContextRecord->SegDs;
-    inst.mRegisterSet.mSegCS = ex->ContextRecord->SegCs;
-    inst.mRegisterSet.mSegSS = ex->ContextRecord->SegSs;
-
-    switch (decodedInst.meta.category) {
-    case ZYDIS_CATEGORY_CALL:
+    tracerVeCaptureRegisters(ex->ContextRecord, &inst.mRegisterSet);
+
+    switch (decodedInst.mFlow) {
+    case eTracerLdeFlowCall:
         inst.mType = eTracerInstructionTypeCall;
-        inst.mCallDepth = tracerCoreOnBranchEntered();
-        continueTrace = (inst.mCallDepth >= 0);
 
-        *resumeAddress = *(void**)ex->ContextRecord->Esp;
+        // The return address is known from the decoded call, there is no need to read it from the stack
+        *resumeAddress = (void*)(lastBranchAddress + decodedInst.mLength);
+
+        inst.mCallDepth = tracerCoreOnBranchEntered((uintptr_t)*resumeAddress, stackPointer);
         break;
-    case ZYDIS_CATEGORY_RET:
+    case eTracerLdeFlowReturn:
         inst.mType = eTracerInstructionTypeReturn;
-        inst.mCallDepth = tracerCoreOnBranchReturned();
-        continueTrace = (inst.mCallDepth > 0);
+        inst.mCallDepth = tracerCoreOnBranchReturned(inst.mBranchTarget, stackPointer, &returnMatched);
+
+        if (!returnMatched && inst.mCallDepth > 0) {
+            statistics->mReturnMismatches++;
+        }
 
         *resumeAddress = (void*)ex->ContextRecord->Eip;
         break;
     default:
+        // Resynchronize the shadow stack in case the branch left one or more frames (longjmp, unwinding)
+        tracerCoreSyncShadowStack(stackPointer);
+
         inst.mType = eTracerInstructionTypeBranch;
         inst.mCallDepth = tracerCoreGetBranchCallDepth();
-        continueTrace = (inst.mCallDepth >= 0);
 
         *resumeAddress = (void*)ex->ContextRecord->Eip;
     }
 
-    while (!tracerRWQueuePushItem(trace->mSharedRWQueue, &inst)) {
-        Sleep(1);
-    }
+    // The trace ends as soon as the stack was unwound past the frame of the traced function
+    TracerBool continueTrace = (stackPointer <= tracerCoreGetTraceEntryStackPointer());
+
+    tracerVePushTrace(trace, &inst, statistics);
 
     return continueTrace;
 }
 
-static LONG CALLBACK tracerVeTraceHandler(PEXCEPTION_POINTERS ex) {
-    TracerLocalProcessContext* process = (TracerLocalProcessContext*)tracerGetLocalProcessContext();
+static LONG tracerVeTraceHandleSingleStep(TracerLocalProcessContext* process,
+    TracerVeTraceContext* trace, PEXCEPTION_POINTERS ex, TracerStatistics* statistics) {
 
-    TracerVeTraceContext* trace = (TracerVeTraceContext*)process->mTraceContext;
+    // A watch hit can be reported together with the single step of a running trace, only the latter
+    // needs the trace logic below
+    if (tracerVeHandleWatchHits(trace, ex, statistics) &&
+        !(ex->ContextRecord->Dr6 & TLIB_VETRACE_DR6_SINGLE_STEP)) {
+
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
 
     uintptr_t exceptionAddr = (uintptr_t)ex->ExceptionRecord->ExceptionAddress;
 
-    switch (ex->ExceptionRecord->ExceptionCode) {
-    case EXCEPTION_SINGLE_STEP:
-    {
-        TracerBool triggeredByBreakpoint = eTracerFalse;
-
-        // Check if there is already an ongoing trace
-        int index = tracerCoreGetActiveHwBreakpointIndex();
-
-        if (index == -1) {
-            // There was no active trace, check if the interrupt came from a hardware breakpoint
-
-            // If it was triggered by a HW breakpoint we need to unset the control bit for this
-            // index and restore it on the next call to the interrupt handler, otherwise
-            // the interrupt handler will get called in an endless loop.
-            if (exceptionAddr == ex->ContextRecord->Dr0) {
-                index = 0;
-            } else if (exceptionAddr == ex->ContextRecord->Dr1) {
-                index = 1;
-            } else if (exceptionAddr == ex->ContextRecord->Dr2) {
-                index = 2;
-            } else if (exceptionAddr == ex->ContextRecord->Dr3) {
-                index = 3;
-            }
+    TracerBool triggeredByBreakpoint = eTracerFalse;
+
+    // Check if there is already an ongoing trace
+    int index = tracerCoreGetActiveHwBreakpointIndex();
+
+    if (index == -1) {
+        // There was no active trace, check if the interrupt came from a hardware breakpoint
+
+        // If it was triggered by a HW breakpoint we need to unset the control bit for this
+        // index and restore it on the next call to the interrupt handler, otherwise
+        // the interrupt handler will get called in an endless loop.
+        if (exceptionAddr == ex->ContextRecord->Dr0) {
+            index = 0;
+        } else if (exceptionAddr == ex->ContextRecord->Dr1) {
+            index = 1;
+        } else if (exceptionAddr == ex->ContextRecord->Dr2) {
+            index = 2;
+        } else if (exceptionAddr == ex->ContextRecord->Dr3) {
+            index = 3;
+        }
 
-            // Check if this index was actually enabled in the debug control register
-            if (index == -1 || !tracerHwBreakpointGetBits(ex->ContextRecord->Dr7, index << 1, 1)) {
+        // Check if this index was actually enabled in the debug control register
+        if (index == -1 || !tracerHwBreakpointGetBits(ex->ContextRecord->Dr7, index << 1, 1)) {
 
-                // The interrupt was not triggered by our tracer
-                return EXCEPTION_CONTINUE_SEARCH;
-            }
+            // The interrupt was not triggered by our tracer
+            return EXCEPTION_CONTINUE_SEARCH;
+        }
 
-            EnterCriticalSection(&trace->mTraceCritSect);
+        EnterCriticalSection(&trace->mTraceCritSect);
 
-            // Get the trace for this address
-            TracerActiveTrace* activeTrace = tracerVeGetTraceForAddress(
-                process->mTraceContext, exceptionAddr);
+        // Get the trace for this address
+        TracerActiveTrace* activeTrace = tracerVeGetTraceForAddress(
+            process->mTraceContext, exceptionAddr);
 
-            if (!activeTrace) {
-                LeaveCriticalSection(&trace->mTraceCritSect);
+        if (!activeTrace) {
+            LeaveCriticalSection(&trace->mTraceCritSect);
 
-                // The interrupt was not triggered by our tracer
-                return EXCEPTION_CONTINUE_SEARCH;
-            }
+            // The interrupt was not triggered by our tracer
+            return EXCEPTION_CONTINUE_SEARCH;
+        }
 
-            if (trace->mCurrentTrace) {
-                LeaveCriticalSection(&trace->mTraceCritSect);
+        if (trace->mCurrentTrace) {
+            LeaveCriticalSection(&trace->mTraceCritSect);
 
-                // Some other thread is currently running a trace, ignore this
-                return EXCEPTION_CONTINUE_EXECUTION;
-            }
+            // Some other thread is currently running a trace, ignore this
+            statistics->mIgnoredTraceEntries++;
+            return EXCEPTION_CONTINUE_EXECUTION;
+        }
 
-            trace->mCurrentTrace = activeTrace;
+        // This will back up the breakpoint index into the thread local storage and reset the shadow stack
+        if (!tracerCoreOnBeginNewTrace(index, (uintptr_t)ex->ContextRecord->Esp)) {
             LeaveCriticalSection(&trace->mTraceCritSect);
 
-            // Temporarily remove the enabled bit for this breakpoint
-            // We will set this bit again on the next call to this handler (else part of this branch)
-            tracerHwBreakpointSetBits(&ex->ContextRecord->Dr7, index << 1, 1, 0);
+            // Without a shadow stack we are unable to follow this invocation, skip it
+            statistics->mIgnoredTraceEntries++;
+            return EXCEPTION_CONTINUE_EXECUTION;
+        }
+
+        trace->mCurrentTrace = activeTrace;
+        LeaveCriticalSection(&trace->mTraceCritSect);
+
+        // Temporarily remove the enabled bit for this breakpoint
+        // We will set this bit again on the next call to this handler (else part of this branch)
+        tracerHwBreakpointSetBits(&ex->ContextRecord->Dr7, index << 1, 1, 0);
 
-            // This will back up the breakpoint index into the thread local storage and reset the call depth
-            tracerCoreOnBeginNewTrace(index);
+        triggeredByBreakpoint = eTracerTrue;
+    }
+
+    int resumeIndex = tracerCoreGetSuspendedHwBreakpointIndex();
+
+    if (resumeIndex != -1) {
+        // Disable the breakpoint that we used to resume the trace
+        tracerHwBreakpointSetBits(&ex->ContextRecord->Dr7, resumeIndex << 1, 1, 0);
 
-            triggeredByBreakpoint = eTracerTrue;
+        switch (resumeIndex) {
+        case 0: ex->ContextRecord->Dr0 = 0; break;
+        case 1: ex->ContextRecord->Dr1 = 0; break;
+        case 2: ex->ContextRecord->Dr2 = 0; break;
+        case 3: ex->ContextRecord->Dr3 = 0; break;
+        default: assert(FALSE);
         }
 
-        int resumeIndex = tracerCoreGetSuspendedHwBreakpointIndex();
+        // Unset suspended index
+        tracerCoreSetSuspendedHwBreakpointIndex(-1);
 
-        if (resumeIndex != -1) {
-            // Disable the breakpoint that we used to resume the trace
-            tracerHwBreakpointSetBits(&ex->ContextRecord->Dr7, resumeIndex << 1, 1, 0);
+        // We just resumed from a suspended call, pop every frame that has been left in the meantime
+        tracerCoreSyncShadowStack((uintptr_t)ex->ContextRecord->Esp);
 
-            switch (resumeIndex) {
-            case 0: ex->ContextRecord->Dr0 = 0; break;
-            case 1: ex->ContextRecord->Dr1 = 0; break;
-            case 2: ex->ContextRecord->Dr2 = 0; break;
-            case 3: ex->ContextRecord->Dr3 = 0; break;
-            default: assert(FALSE);
-            }
+        triggeredByBreakpoint = eTracerTrue;
+    }
+
+    void* resumeAddr = NULL;
+
+    // If this function returns false it means that the tracing for the current
+    // thread should be disabled. In this case we remove the branch trace flags.
+    if (tracerVeTraceInstruction(process->mTraceContext, ex, triggeredByBreakpoint, &resumeAddr, statistics)) {
+
+        if (tracerVeShouldSuspendCurrentTrace(process->mTraceContext, exceptionAddr)) {
+            // We are not interested in tracing calls inside windows libraries.
+
+            // We suspend tracing by temporarily adding a hardware breakpoint on the place  that the call
+            // will return to. During this time we disable branch tracing completely.
 
-            // Unset suspended index
-            tracerCoreSetSuspendedHwBreakpointIndex(-1);
+            // Once the resume hardware breakpoint is triggered, the breakpoint is removed and the tracing
+            // will continue.
+            resumeIndex = tracerSetHwBreakpointOnContext(resumeAddr, 1, ex->ContextRecord, eTracerBpCondExecute);
 
-            // We just resumed from a suspended call, the call depth is therefore 1 call too high
-            tracerCoreOnBranchReturned();
+            // We remember the breakpoint index for this suspended trace by storing it in the threads TLS
+            // data.
+            tracerCoreSetSuspendedHwBreakpointIndex(resumeIndex);
 
-            triggeredByBreakpoint = eTracerTrue;
+            statistics->mBreakpointSuspensions++;
+
+            // Disable branch tracing for now (until the resume breakpoint triggers)
+            tracerVeTraceSetFlags(ex->ContextRecord, eTracerFalse);
+
+        } else {
+            // Keep branch tracing on this thread
+            tracerVeTraceSetFlags(ex->ContextRecord, eTracerTrue);
         }
 
-        void* resumeAddr = NULL;
+    } else {
 
-        // If this function returns false it means that the tracing for the current
-        // thread should be disabled. In this case we remove the branch trace flags.
-        if (tracerVeTraceInstruction(process->mTraceContext, ex, triggeredByBreakpoint, &resumeAddr)) {
+        // Each trace has a lifetime field. If the lifetime field is set and reaches 0, the trace
+        // for this function should be removed.
 
-            if (tracerVeShouldSuspendCurrentTrace(process->mTraceContext, exceptionAddr)) {
-                // We are not interested in tracing calls inside windows libraries.
+        EnterCriticalSection(&trace->mTraceCritSect);
 
-                // We suspend tracing by temporarily adding a hardware breakpoint on the place  that the call
-                // will return to. During this time we disable branch tracing completely.
+        TracerActiveTrace* currentTrace = trace->mCurrentTrace;
 
-                // Once the resume hardware breakpoint is triggered, the breakpoint is removed and the tracing
-                // will continue.
-                resumeIndex = tracerSetHwBreakpointOnContext(resumeAddr, 1, ex->ContextRecord, eTracerBpCondExecute);
+        if (currentTrace && currentTrace->mLifetime > 0 && --currentTrace->mLifetime == 0) {
+            // Lifetime value reached zero, remove this trace (and delete hardware breakpoint)
+            tracerVeRemoveCurrentTrace(process->mTraceContext, ex->ContextRecord);
+        }
+        else {
+            // Restore the bit that we removed during the first call to the handler
+            tracerHwBreakpointSetBits(&ex->ContextRecord->Dr7, index << 1, 1, 1);
+        }
 
-                // We remember the breakpoint index for this suspended trace by storing it in the threads TLS
-                // data.
-                tracerCoreSetSuspendedHwBreakpointIndex(resumeIndex);
+        // The current trace has ended
+        trace->mCurrentTrace = NULL;
 
-                // Disable branch tracing for now (until the resume breakpoint triggers)
-                tracerVeTraceSetFlags(ex->ContextRecord, eTracerFalse);
+        LeaveCriticalSection(&trace->mTraceCritSect);
 
-            } else {
-                // Keep branch tracing on this thread
-                tracerVeTraceSetFlags(ex->ContextRecord, eTracerTrue);
-            }
+        // Disable branch tracing on this thread
+        tracerVeTraceSetFlags(ex->ContextRecord, eTracerFalse);
 
-        } else {
+        // And remove the stored tls index for the breakpoint
+        tracerCoreOnTraceEnded();
+    }
 
-            // Each trace has a lifetime field. If the lifetime field is set and reaches 0, the trace
-            // for this function should be removed.
+    return EXCEPTION_CONTINUE_EXECUTION;
+}
 
-            EnterCriticalSection(&trace->mTraceCritSect);
+static LONG CALLBACK tracerVeTraceHandler(PEXCEPTION_POINTERS ex) {
+    TracerLocalProcessContext* process = (TracerLocalProcessContext*)tracerGetLocalProcessContext();
 
-            TracerActiveTrace* currentTrace = trace->mCurrentTrace;
+    TracerVeTraceContext* trace = (TracerVeTraceContext*)process->mTraceContext;
 
-            if (currentTrace && currentTrace->mLifetime > 0 && --currentTrace->mLifetime == 0) {
-                // Lifetime value reached zero, remove this trace (and delete hardware breakpoint)
-                tracerVeRemoveCurrentTrace(process->mTraceContext, ex->ContextRecord);
-            }
-            else {
-                // Restore the bit that we removed during the first call to the handler
-                tracerHwBreakpointSetBits(&ex->ContextRecord->Dr7, index << 1, 1, 1);
-            }
+    switch (ex->ExceptionRecord->ExceptionCode) {
+    case EXCEPTION_SINGLE_STEP:
+    {
+        uint64_t startCycles = __rdtsc();
 
-            // The current trace has ended
-            trace->mCurrentTrace = NULL;
+        // Counted on the stack and only added to the thread's slot if the exception was ours
+        TracerStatistics statistics;
+        memset(&statistics, 0, sizeof(statistics));
 
-            LeaveCriticalSection(&trace->mTraceCritSect);
+        TLIB_CORE_ENTER_HOT_PATH();
+        LONG result = tracerVeTraceHandleSingleStep(process, trace, ex, &statistics);
 
-            // Disable branch tracing on this thread
-            tracerVeTraceSetFlags(ex->ContextRecord, eTracerFalse);
+        if (result == EXCEPTION_CONTINUE_EXECUTION) {
+            statistics.mSingleStepExceptions++;
+            statistics.mHandlerCycles += __rdtsc() - startCycles;
 
-            // And remove the stored tls index for the breakpoint
-            tracerCoreOnTraceEnded();
+            tracerVeCommitThreadStatistics(trace, &statistics);
         }
+        TLIB_CORE_LEAVE_HOT_PATH();
 
-        return EXCEPTION_CONTINUE_EXECUTION;
+        return result;
     }
 
     default: